@@ -7,21 +7,79 @@
 #include <unordered_map>
 #include <memory>
 #include <variant>
+#include <optional>
 #include <algorithm>
 #include <chrono>
 #include <cassert>
+#include <cstring>
 #include <fstream>
 #include <queue>
 #include <list>
 #include <functional>
 #include <filesystem>
+#include <limits>
+#include <bitset>
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <string_view>
+#include <cmath>
+#include <numeric>
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <set>
+#include <map>
+#include <sstream>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define DATABASEAPP_HAS_IO_URING 1
+#else
+#define DATABASEAPP_HAS_IO_URING 0
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 // 資料導向設計的列存儲資料庫實作
 
 // 常數定義
-constexpr size_t PAGE_SIZE = 4096;  // 4KB 頁面大小
+constexpr size_t PAGE_SIZE = 4096;  // 4KB 預設頁面大小：B+ 樹節點、欄位邏輯頁、字串堆積
+constexpr size_t MAX_PAGE_SIZE = 1024 * 1024;     // 檔案可選的頁面大小上限
+constexpr size_t COLUMN_EXTENT_SIZE = 64 * 1024;  // 欄位資料檔的預設實體頁（extent）大小
+constexpr size_t EXTENT_POOL_SIZE = 64;           // 緩衝池中 COLUMN_EXTENT_SIZE 頁框數
 constexpr size_t BUFFER_POOL_SIZE = 1000;  // 緩衝池大小
-constexpr size_t BTREE_ORDER = 128;  // B+樹階數
+constexpr size_t BUFFER_POOL_SHARDS = 16;  // 緩衝池分片數（上限）
+constexpr size_t READ_AHEAD_PAGES = 32;    // 循序掃描時非同步預讀的頁數
+constexpr size_t MORSEL_PAGES = 16;        // 平行掃描時每個 morsel 的欄位頁數
+constexpr uint64_t CHECKPOINT_LOG_BYTES = 64 * 1024 * 1024;  // 預寫日誌超過此大小時觸發檢查點
+constexpr std::chrono::seconds CHECKPOINT_INTERVAL(30);        // 背景檢查點的最長間隔
 
 // 支持的資料型別
 enum class DataType {
@@ -37,1135 +95,9148 @@ enum class DataType {
 using Value = std::variant<int32_t, int64_t, float, double, std::string, bool>;
 using PageId = uint64_t;
 using RecordId = uint64_t;
+using FileId = uint32_t;   // 由 DiskManager 分配的檔案編號
+using FrameId = uint32_t;  // 緩衝池中的頁框編號
 
-// 頁面結構
-struct Page {
-    PageId page_id;
-    bool is_dirty;
-    std::vector<char> data;
+constexpr FrameId INVALID_FRAME_ID = std::numeric_limits<FrameId>::max();
 
-    Page(PageId id) : page_id(id), is_dirty(false) {
-        data.resize(PAGE_SIZE);
-    }
+// 頁面結構 - 緩衝池中的一個頁框，data 指向預先配置、按頁對齊的記憶體。
+// latch 保護頁面內容：讀取時持有共享鎖，修改時持有獨占鎖。
+struct Page {
+    FileId file_id = 0;
+    PageId page_id = 0;
+    uint32_t pin_count = 0;  // 由所屬分片的互斥鎖保護
+    std::atomic<bool> is_dirty{ false };
+    std::atomic<bool> io_pending{ false };  // 預讀中：頁框已在頁表中，但資料尚未從磁碟讀入
+    char* data = nullptr;
+    size_t size = PAGE_SIZE;  // 頁框大小，等於所屬檔案的頁面大小
+    std::shared_mutex latch;
 };
 
-// 磁碟管理器
-class DiskManager {
-private:
-    std::string db_path_;
-    std::unordered_map<std::string, std::fstream> file_streams_;
+// 日誌等級。ERR 不取名為 ERROR：Windows 的 wingdi.h 把 ERROR 定義成巨集
+enum class LogLevel {
+    OFF,
+    ERR,
+    WARN,
+    INFO,
+    DEBUG,
+    TRACE  // 逐頁、逐筆的訊息
+};
 
+// 編譯期上限：高於此等級的 DATABASEAPP_LOG 在編譯時即被移除，不留下任何判斷。
+// 預設 Release 保留到 INFO、Debug 保留到 DEBUG；TRACE 需要明確定義為 5
+#ifndef DATABASEAPP_MAX_LOG_LEVEL
+#if defined(NDEBUG)
+#define DATABASEAPP_MAX_LOG_LEVEL 3
+#else
+#define DATABASEAPP_MAX_LOG_LEVEL 4
+#endif
+#endif
+
+// 執行期的日誌門檻，預設只輸出 WARN 以上；訊息寫到 std::cerr，整行在鎖內輸出不會交錯
+class Log {
 public:
-    DiskManager(const std::string& db_path) : db_path_(db_path) {
-        std::filesystem::create_directories(db_path_);
+    static bool enabled(LogLevel level) {
+        return static_cast<int>(level) <= threshold().load(std::memory_order_relaxed);
     }
 
-    ~DiskManager() {
-        std::cout << "DEBUG: DiskManager destructor - closing files\n";
-        for (auto& [filename, stream] : file_streams_) {
-            if (stream.is_open()) {
-                stream.flush();  // 確保所有資料都寫入
-                stream.close();
-                std::cout << "DEBUG: Closed file: " << filename << std::endl;
-            }
-        }
-    }
+    static void setLevel(LogLevel level) { threshold().store(static_cast<int>(level), std::memory_order_relaxed); }
+    static LogLevel level() { return static_cast<LogLevel>(threshold().load(std::memory_order_relaxed)); }
 
-    std::fstream& getFileStream(const std::string& filename) {
-        auto it = file_streams_.find(filename);
-        if (it == file_streams_.end()) {
-            std::string filepath = db_path_ + "/" + filename;
-            
-            // 如果目錄結構不存在則創建
-            size_t last_slash = filepath.find_last_of("/\\");
-            if (last_slash != std::string::npos) {
-                std::string dir_path = filepath.substr(0, last_slash);
-                std::filesystem::create_directories(dir_path);
-            }
-            
-            // 直接創建文件，確保可讀寫
-            file_streams_[filename] = std::fstream(filepath,
-                std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
-                
-            if (!file_streams_[filename].is_open()) {
-                std::cerr << "Failed to create file: " << filepath << std::endl;
-            } else {
-                std::cout << "DEBUG: Successfully created file: " << filepath << std::endl;
-                
-                // 確保文件可寫入 - 寫入一些初始資料然後 seek 回開頭
-                file_streams_[filename].write("\0", 1);
-                file_streams_[filename].flush();
-                file_streams_[filename].seekp(0);
-                file_streams_[filename].seekg(0);
-                
-                if (file_streams_[filename].good()) {
-                    std::cout << "DEBUG: File stream is ready for I/O: " << filepath << std::endl;
-                } else {
-                    std::cerr << "ERROR: File stream not ready for I/O: " << filepath << std::endl;
-                }
-            }
-        }
-        return file_streams_[filename];
+    static void write(LogLevel level, const std::string& message) {
+        static std::mutex mutex;
+        std::lock_guard<std::mutex> lock(mutex);
+        std::cerr << name(level) << ": " << message << std::endl;
     }
 
-    void writePage(const std::string& filename, PageId page_id, const Page& page) {
-        auto& stream = getFileStream(filename);
-        if (stream.is_open()) {
-            stream.seekp(page_id * PAGE_SIZE);
-            stream.write(page.data.data(), PAGE_SIZE);
-            stream.flush();
-            
-            // 檢查寫入是否成功
-            if (stream.good()) {
-                std::cout << "DEBUG: Successfully wrote page " << page_id << " to file " << filename 
-                          << " (size: " << PAGE_SIZE << " bytes)" << std::endl;
-            } else {
-                std::cerr << "ERROR: Failed to write page " << page_id << " to file " << filename 
-                          << " - Stream state: " << stream.rdstate() << std::endl;
-                // 嘗試重置流狀態
-                stream.clear();
-                stream.seekp(page_id * PAGE_SIZE);
-                stream.write(page.data.data(), PAGE_SIZE);
-                stream.flush();
-                
-                if (stream.good()) {
-                    std::cout << "DEBUG: Retry write succeeded for page " << page_id << std::endl;
-                } else {
-                    std::cerr << "ERROR: Retry write also failed for page " << page_id << std::endl;
-                }
-            }
-        } else {
-            std::cerr << "ERROR: Cannot write to file " << filename << std::endl;
+    static const char* name(LogLevel level) {
+        switch (level) {
+        case LogLevel::OFF: return "OFF";
+        case LogLevel::ERR: return "ERROR";
+        case LogLevel::WARN: return "WARN";
+        case LogLevel::INFO: return "INFO";
+        case LogLevel::DEBUG: return "DEBUG";
+        case LogLevel::TRACE: return "TRACE";
         }
+        return "UNKNOWN";
     }
 
-    void readPage(const std::string& filename, PageId page_id, Page& page) {
-        auto& stream = getFileStream(filename);
-        if (stream.is_open()) {
-            stream.seekg(page_id * PAGE_SIZE);
-            
-            if (stream.good()) {
-                stream.read(page.data.data(), PAGE_SIZE);
-                
-                // 檢查實際讀取的字節數
-                std::streamsize bytes_read = stream.gcount();
-                if (bytes_read < PAGE_SIZE) {
-                    // 如果檔案較小，將剩餘字節初始化為零
-                    std::fill(page.data.begin() + bytes_read, page.data.end(), 0);
-                    std::cout << "DEBUG: Read " << bytes_read << " bytes from page " << page_id 
-                              << " in file " << filename << " (padded with zeros)" << std::endl;
-                } else {
-                    std::cout << "DEBUG: Successfully read full page " << page_id 
-                              << " from file " << filename << std::endl;
-                }
-                
-                // 清除 EOF 錯誤狀態（如果有的話）
-                if (stream.eof()) {
-                    stream.clear();
-                }
-            } else {
-                // 如果 seek 失敗，將頁面初始化為零
-                std::fill(page.data.begin(), page.data.end(), 0);
-                std::cout << "DEBUG: Initialized empty page " << page_id 
-                          << " for file " << filename << std::endl;
-            }
-        } else {
-            std::cerr << "ERROR: Cannot read from file " << filename << std::endl;
-            std::fill(page.data.begin(), page.data.end(), 0);
-        }
+private:
+    static std::atomic<int>& threshold() {
+        static std::atomic<int> value{ static_cast<int>(LogLevel::WARN) };
+        return value;
     }
 };
 
-// 緩衝池管理器 - LRU替換策略
-class BufferPoolManager {
-private:
-    size_t pool_size_;
-    std::unordered_map<std::string, std::unordered_map<PageId, std::shared_ptr<Page>>> pages_;
-    std::list<std::pair<std::string, PageId>> lru_list_;
-    std::unordered_map<std::string, std::unordered_map<PageId,
-        std::list<std::pair<std::string, PageId>>::iterator>> lru_map_;
-    DiskManager& disk_manager_;
+// message 是 operator<< 串接的運算式，只有在等級啟用時才求值
+#define DATABASEAPP_LOG(level, message)                                                      \
+    do {                                                                                     \
+        if (static_cast<int>(level) <= DATABASEAPP_MAX_LOG_LEVEL && Log::enabled(level)) {   \
+            std::ostringstream databaseapp_log_stream;                                       \
+            databaseapp_log_stream << message;                                               \
+            Log::write(level, databaseapp_log_stream.str());                                 \
+        }                                                                                    \
+    } while (false)
+
+// 只由所屬執行緒寫入的計數器：不需要原子的讀取-修改-寫入，讀取者以 relaxed 載入彙總
+inline void bumpCounter(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
 
-public:
-    BufferPoolManager(DiskManager& disk_manager)
-        : pool_size_(BUFFER_POOL_SIZE), disk_manager_(disk_manager) {
+inline uint64_t elapsedNanos(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+// 延遲直方圖：桶 b 計入 [2^(b-1), 2^b) 奈秒的樣本，桶 0 為 0 奈秒。只由所屬執行緒寫入
+struct LatencyHistogram {
+    static constexpr size_t BUCKETS = 48;  // 最後一個桶收納 2^46 奈秒（約 19 小時）以上
+
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+    std::atomic<uint64_t> count{ 0 };
+    std::atomic<uint64_t> total_ns{ 0 };
+    std::atomic<uint64_t> max_ns{ 0 };
+
+    void record(uint64_t ns) {
+        size_t bucket = 0;
+        for (uint64_t v = ns; v != 0 && bucket + 1 < BUCKETS; v >>= 1) ++bucket;
+        bumpCounter(buckets[bucket]);
+        bumpCounter(count);
+        bumpCounter(total_ns, ns);
+        if (ns > max_ns.load(std::memory_order_relaxed)) max_ns.store(ns, std::memory_order_relaxed);
+    }
+};
+
+// 多個執行緒的直方圖合併後的結果
+struct HistogramSnapshot {
+    uint64_t count = 0;
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    std::array<uint64_t, LatencyHistogram::BUCKETS> buckets{};
+
+    void add(const LatencyHistogram& histogram) {
+        for (size_t b = 0; b < buckets.size(); ++b) buckets[b] += histogram.buckets[b].load(std::memory_order_relaxed);
+        count += histogram.count.load(std::memory_order_relaxed);
+        total_ns += histogram.total_ns.load(std::memory_order_relaxed);
+        max_ns = std::max(max_ns, histogram.max_ns.load(std::memory_order_relaxed));
     }
 
-    std::shared_ptr<Page> fetchPage(const std::string& filename, PageId page_id) {
-        auto file_it = pages_.find(filename);
-        if (file_it != pages_.end()) {
-            auto page_it = file_it->second.find(page_id);
-            if (page_it != file_it->second.end()) {
-                // 更新LRU
-                updateLRU(filename, page_id);
-                return page_it->second;
+    double meanMicros() const { return count == 0 ? 0.0 : total_ns / 1000.0 / count; }
+    double maxMicros() const { return max_ns / 1000.0; }
+
+    // 取樣本所在桶的上界（不超過最大值），與實際值相差不到兩倍
+    double percentileMicros(double p) const {
+        if (count == 0) return 0.0;
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * count)));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < buckets.size(); ++b) {
+            seen += buckets[b];
+            if (seen >= rank) {
+                const uint64_t upper = b == 0 ? 0 : (uint64_t(1) << b) - 1;
+                return std::min(upper, max_ns) / 1000.0;
             }
         }
+        return maxMicros();
+    }
+};
 
-        // 頁面不在緩衝池中，需要從磁碟載入
-        auto page = std::make_shared<Page>(page_id);
-        
-        // 嘗試從磁碟讀取頁面
-        disk_manager_.readPage(filename, page_id, *page);
-        
-        // 新頁面開始時不標記為髒頁，只有真正修改時才標記
-        page->is_dirty = false;
+// 分別統計耗時的查詢種類
+enum class QueryKind {
+    INDEX_LOOKUP,  // openIndexedSelect / indexedSelect
+    RANGE,         // openRangeSelect / rangeSelect
+    SCAN,          // openScanSelect / scanSelect 與析取版本
+    COUNT,         // countWhere / countWhereAny
+    AGGREGATE,     // aggregateWhere
+    GROUP_BY,
+    JOIN
+};
 
-        // 檢查是否需要淘汰頁面
-        if (getTotalPages() >= pool_size_) {
-            evictPage();
-        }
+constexpr size_t QUERY_KIND_COUNT = 7;
+
+inline const char* queryKindName(QueryKind kind) {
+    switch (kind) {
+    case QueryKind::INDEX_LOOKUP: return "index_lookup";
+    case QueryKind::RANGE: return "range";
+    case QueryKind::SCAN: return "scan";
+    case QueryKind::COUNT: return "count";
+    case QueryKind::AGGREGATE: return "aggregate";
+    case QueryKind::GROUP_BY: return "group_by";
+    case QueryKind::JOIN: return "join";
+    }
+    return "unknown";
+}
+
+// 一個檔案的緩衝池與 I/O 計數
+struct FileMetrics {
+    FileId file_id = 0;
+    std::string name;
+    uint64_t hits = 0;          // fetch 命中緩衝池（含命中預讀中的頁框）
+    uint64_t misses = 0;        // fetch 未命中，同步讀取
+    uint64_t evictions = 0;     // 頁框被淘汰或由背景寫回移到空閒清單
+    uint64_t dirty_writes = 0;  // 緩衝池寫回的髒頁（前景淘汰、背景寫回與檢查點）
+    uint64_t reads = 0;         // 實際的頁面讀取（含預讀）
+    uint64_t writes = 0;        // 實際的頁面寫入
+
+    double hitRatio() const { return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses); }
+};
 
-        pages_[filename][page_id] = page;
-        lru_list_.push_front({ filename, page_id });
-        lru_map_[filename][page_id] = lru_list_.begin();
+// 索引的形狀；B+ 樹的 fill_factor 為葉子的平均填滿比例，點陣圖索引沒有頁面與樹高
+struct IndexMetrics {
+    std::string table;
+    std::string column;
+    std::string type;  // "btree" 或 "bitmap"
+    size_t height = 0;
+    size_t pages = 0;
+    size_t leaves = 0;
+    size_t entries = 0;
+    double fill_factor = 0.0;
+};
 
-        return page;
+// LargeScaleDatabase::metricsSnapshot 的結果，toJson 輸出機器可讀的格式
+struct MetricsSnapshot {
+    std::vector<FileMetrics> files;  // 只列出有任何計數的檔案，依 FileId 排序
+    HistogramSnapshot read_latency;
+    HistogramSnapshot write_latency;
+    uint64_t leaf_splits = 0;
+    uint64_t internal_splits = 0;
+    std::vector<IndexMetrics> indexes;
+    std::array<HistogramSnapshot, QUERY_KIND_COUNT> queries{};
+
+    static void writeHistogram(std::ostream& out, const HistogramSnapshot& h) {
+        out << "{\"count\": " << h.count << ", \"mean_us\": " << h.meanMicros()
+            << ", \"p50_us\": " << h.percentileMicros(0.50) << ", \"p99_us\": " << h.percentileMicros(0.99)
+            << ", \"p999_us\": " << h.percentileMicros(0.999) << ", \"max_us\": " << h.maxMicros() << "}";
     }
 
-    void flushPage(const std::string& filename, PageId page_id) {
-        auto file_it = pages_.find(filename);
-        if (file_it != pages_.end()) {
-            auto page_it = file_it->second.find(page_id);
-            if (page_it != file_it->second.end() && page_it->second->is_dirty) {
-                disk_manager_.writePage(filename, page_id, *page_it->second);
-                page_it->second->is_dirty = false;
-            }
+    static std::string quoted(const std::string& text) {
+        std::string out = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') out += '\\';
+            out += c;
         }
+        return out + "\"";
     }
 
-    void flushAllPages() {
-        for (const auto& [filename, page_map] : pages_) {
-            for (const auto& [page_id, page] : page_map) {
-                if (page->is_dirty) {
-                    disk_manager_.writePage(filename, page_id, *page);
-                    page->is_dirty = false;
-                }
-            }
+    std::string toJson() const {
+        std::ostringstream out;
+        out << "{\"files\": [";
+        for (size_t i = 0; i < files.size(); ++i) {
+            const FileMetrics& f = files[i];
+            out << (i ? ", " : "") << "{\"name\": " << quoted(f.name) << ", \"hits\": " << f.hits
+                << ", \"misses\": " << f.misses << ", \"evictions\": " << f.evictions
+                << ", \"dirty_writes\": " << f.dirty_writes << ", \"reads\": " << f.reads
+                << ", \"writes\": " << f.writes << "}";
+        }
+        out << "], \"io\": {\"read\": ";
+        writeHistogram(out, read_latency);
+        out << ", \"write\": ";
+        writeHistogram(out, write_latency);
+        out << "}, \"btree\": {\"leaf_splits\": " << leaf_splits << ", \"internal_splits\": " << internal_splits
+            << "}, \"indexes\": [";
+        for (size_t i = 0; i < indexes.size(); ++i) {
+            const IndexMetrics& index = indexes[i];
+            out << (i ? ", " : "") << "{\"table\": " << quoted(index.table) << ", \"column\": " << quoted(index.column)
+                << ", \"type\": " << quoted(index.type) << ", \"height\": " << index.height
+                << ", \"pages\": " << index.pages << ", \"leaves\": " << index.leaves
+                << ", \"entries\": " << index.entries << ", \"fill_factor\": " << index.fill_factor << "}";
+        }
+        out << "], \"queries\": {";
+        for (size_t k = 0; k < QUERY_KIND_COUNT; ++k) {
+            out << (k ? ", " : "") << "\"" << queryKindName(static_cast<QueryKind>(k)) << "\": ";
+            writeHistogram(out, queries[k]);
         }
+        out << "}}";
+        return out.str();
     }
+};
 
-private:
-    size_t getTotalPages() const {
-        size_t total = 0;
-        for (const auto& [filename, page_map] : pages_) {
-            total += page_map.size();
+// 引擎的執行期計量。每個執行緒寫入自己的區塊，熱路徑上沒有共享的寫入位置也沒有鎖；
+// 快照時才走訪所有區塊彙總。區塊在第一次使用時建立，保留到本物件解構，
+// 執行緒結束後的計數仍會計入；之後重用相同執行緒 ID 的執行緒接著使用同一個區塊
+class EngineMetrics {
+public:
+    static constexpr size_t MAX_FILES = size_t(1) << 16;  // 與 DiskManager::MAX_FILES 相同
+    static constexpr size_t FILE_CHUNK = 64;
+
+    struct FileCounters {
+        std::atomic<uint64_t> hits{ 0 };
+        std::atomic<uint64_t> misses{ 0 };
+        std::atomic<uint64_t> evictions{ 0 };
+        std::atomic<uint64_t> dirty_writes{ 0 };
+        std::atomic<uint64_t> reads{ 0 };
+        std::atomic<uint64_t> writes{ 0 };
+    };
+
+    struct ThreadMetrics {
+        // 每 FILE_CHUNK 個檔案一段，第一次用到時才配置；只有所屬執行緒會配置
+        std::array<std::atomic<std::array<FileCounters, FILE_CHUNK>*>, MAX_FILES / FILE_CHUNK> files{};
+        LatencyHistogram read_latency;
+        LatencyHistogram write_latency;
+        std::array<LatencyHistogram, QUERY_KIND_COUNT> queries;
+        std::atomic<uint64_t> leaf_splits{ 0 };
+        std::atomic<uint64_t> internal_splits{ 0 };
+
+        ~ThreadMetrics() {
+            for (auto& chunk : files) delete chunk.load(std::memory_order_relaxed);
         }
-        return total;
-    }
 
-    void updateLRU(const std::string& filename, PageId page_id) {
-        auto file_it = lru_map_.find(filename);
-        if (file_it != lru_map_.end()) {
-            auto page_it = file_it->second.find(page_id);
-            if (page_it != file_it->second.end()) {
-                lru_list_.erase(page_it->second);
-                lru_list_.push_front({ filename, page_id });
-                page_it->second = lru_list_.begin();
+        FileCounters& file(FileId file_id) {
+            auto& slot = files[(file_id % MAX_FILES) / FILE_CHUNK];
+            auto* chunk = slot.load(std::memory_order_relaxed);
+            if (!chunk) {
+                chunk = new std::array<FileCounters, FILE_CHUNK>();
+                slot.store(chunk, std::memory_order_release);
             }
+            return (*chunk)[file_id % FILE_CHUNK];
         }
-    }
-
-    void evictPage() {
-        if (lru_list_.empty()) return;
+    };
 
-        auto [filename, page_id] = lru_list_.back();
-        lru_list_.pop_back();
+private:
+    const uint64_t id_;  // 不重複使用，執行緒區域快取以它辨識所屬的實例
+    std::mutex mutex_;
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadMetrics>> threads_;
+    std::atomic<uint64_t> slow_query_ns_{ 0 };
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> next{ 1 };
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
 
-        // 如果頁面被修改，寫回磁碟
-        flushPage(filename, page_id);
+public:
+    EngineMetrics() : id_(nextId()) {}
+    EngineMetrics(const EngineMetrics&) = delete;
+    EngineMetrics& operator=(const EngineMetrics&) = delete;
+
+    // 呼叫端執行緒的區塊；最近使用的幾個實例快取在執行緒區域變數中，命中時不取鎖
+    ThreadMetrics& local() {
+        struct CacheEntry {
+            uint64_t owner = 0;
+            ThreadMetrics* block = nullptr;
+        };
+        thread_local std::array<CacheEntry, 4> cache{};
+        thread_local size_t next_slot = 0;
+        for (const CacheEntry& entry : cache) {
+            if (entry.owner == id_) return *entry.block;
+        }
 
-        pages_[filename].erase(page_id);
-        lru_map_[filename].erase(page_id);
+        ThreadMetrics* block;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& slot = threads_[std::this_thread::get_id()];
+            if (!slot) slot = std::make_unique<ThreadMetrics>();
+            block = slot.get();
+        }
+        cache[next_slot++ % cache.size()] = { id_, block };
+        return *block;
     }
-};
-
-// B+樹節點
-struct BPlusTreeNode {
-    bool is_leaf;
-    std::vector<Value> keys;
-    std::vector<PageId> children;  // 對於內部節點，指向子節點
-    std::vector<RecordId> records; // 對於葉子節點，指向記錄
-    PageId next_leaf;  // 葉子節點的下一個節點（用於範圍查詢）
 
-    BPlusTreeNode(bool leaf = true) : is_leaf(leaf), next_leaf(0) {}
-};
+    FileCounters& file(FileId file_id) { return local().file(file_id); }
 
-// B+樹索引
-class BPlusTreeIndex {
-private:
-    std::string index_name_;
-    PageId root_page_id_;
-    BufferPoolManager& buffer_manager_;
-    DataType key_type_;
-    size_t max_keys_;
+    // 超過門檻的查詢以 WARN 記錄；0 表示不記錄
+    void setSlowQueryThreshold(std::chrono::nanoseconds threshold) {
+        slow_query_ns_.store(static_cast<uint64_t>(threshold.count()), std::memory_order_relaxed);
+    }
 
-public:
-    BPlusTreeIndex(const std::string& name, DataType key_type, BufferPoolManager& buffer_manager)
-        : index_name_(name), root_page_id_(0), buffer_manager_(buffer_manager),
-        key_type_(key_type), max_keys_(BTREE_ORDER - 1) {
+    void recordQuery(QueryKind kind, uint64_t ns, const std::string& subject) {
+        local().queries[static_cast<size_t>(kind)].record(ns);
+        const uint64_t slow = slow_query_ns_.load(std::memory_order_relaxed);
+        if (slow != 0 && ns >= slow) {
+            DATABASEAPP_LOG(LogLevel::WARN, "Slow " << queryKindName(kind) << " query on " << subject << ": "
+                << ns / 1e6 << " ms");
+        }
     }
 
-    void insert(const Value& key, RecordId record_id) {
-        if (root_page_id_ == 0) {
-            // 創建根節點
-            root_page_id_ = createNewNode(true);
+    // 彙總所有執行緒的計數；檔名與索引由呼叫端補上
+    MetricsSnapshot collect() {
+        std::vector<ThreadMetrics*> blocks;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& entry : threads_) blocks.push_back(entry.second.get());
         }
 
-        auto result = insertInternal(root_page_id_, key, record_id);
-        if (result.second != 0) {
-            // 根節點分裂，創建新根
-            PageId new_root = createNewNode(false);
-            auto root_node = getNode(new_root);
-            root_node->keys.push_back(result.first);
-            root_node->children.push_back(root_page_id_);
-            root_node->children.push_back(result.second);
-            root_page_id_ = new_root;
-            saveNode(new_root, *root_node);
+        MetricsSnapshot snapshot;
+        std::map<FileId, FileMetrics> files;
+        for (ThreadMetrics* block : blocks) {
+            snapshot.read_latency.add(block->read_latency);
+            snapshot.write_latency.add(block->write_latency);
+            for (size_t k = 0; k < QUERY_KIND_COUNT; ++k) snapshot.queries[k].add(block->queries[k]);
+            snapshot.leaf_splits += block->leaf_splits.load(std::memory_order_relaxed);
+            snapshot.internal_splits += block->internal_splits.load(std::memory_order_relaxed);
+
+            for (size_t c = 0; c < block->files.size(); ++c) {
+                const auto* chunk = block->files[c].load(std::memory_order_acquire);
+                if (!chunk) continue;
+                for (size_t i = 0; i < FILE_CHUNK; ++i) {
+                    const FileCounters& counters = (*chunk)[i];
+                    const uint64_t hits = counters.hits.load(std::memory_order_relaxed);
+                    const uint64_t misses = counters.misses.load(std::memory_order_relaxed);
+                    const uint64_t evictions = counters.evictions.load(std::memory_order_relaxed);
+                    const uint64_t dirty_writes = counters.dirty_writes.load(std::memory_order_relaxed);
+                    const uint64_t reads = counters.reads.load(std::memory_order_relaxed);
+                    const uint64_t writes = counters.writes.load(std::memory_order_relaxed);
+                    if ((hits | misses | evictions | dirty_writes | reads | writes) == 0) continue;
+
+                    const FileId file_id = static_cast<FileId>(c * FILE_CHUNK + i);
+                    FileMetrics& f = files[file_id];
+                    f.file_id = file_id;
+                    f.hits += hits;
+                    f.misses += misses;
+                    f.evictions += evictions;
+                    f.dirty_writes += dirty_writes;
+                    f.reads += reads;
+                    f.writes += writes;
+                }
+            }
         }
+        for (auto& entry : files) snapshot.files.push_back(std::move(entry.second));
+        return snapshot;
     }
+};
+
+// 量測一次查詢到解構為止的耗時。游標形式的查詢只量測開啟（求出 RecordId）的部分
+class QueryTimer {
+private:
+    EngineMetrics& metrics_;
+    QueryKind kind_;
+    const std::string& subject_;
+    std::chrono::steady_clock::time_point start_;
 
-    std::vector<RecordId> search(const Value& key) {
-        if (root_page_id_ == 0) return {};
+public:
+    QueryTimer(EngineMetrics& metrics, QueryKind kind, const std::string& subject)
+        : metrics_(metrics), kind_(kind), subject_(subject), start_(std::chrono::steady_clock::now()) {}
 
-        PageId leaf_page = findLeaf(root_page_id_, key);
-        auto leaf_node = getNode(leaf_page);
+    QueryTimer(const QueryTimer&) = delete;
+    QueryTimer& operator=(const QueryTimer&) = delete;
 
-        std::vector<RecordId> results;
-        for (size_t i = 0; i < leaf_node->keys.size(); ++i) {
-            if (leaf_node->keys[i] == key) {
-                results.push_back(leaf_node->records[i]);
-            }
-        }
+    ~QueryTimer() { metrics_.recordQuery(kind_, elapsedNanos(start_), subject_); }
+};
 
-        return results;
+#if defined(_WIN32)
+using NativeFile = HANDLE;
+#else
+using NativeFile = int;
+#endif
+
+// 位置式 I/O - 不共用 seek 位置，多個執行緒可同時讀寫同一個檔案。
+// Windows 上檔案以 FILE_FLAG_OVERLAPPED 開啟並關聯完成埠，同步呼叫使用執行緒區域事件等待，
+// 事件控制代碼的最低位元設為 1，讓完成通知不送往完成埠
+namespace PositionalIo {
+#if defined(_WIN32)
+    inline HANDLE syncEvent() {
+        struct Event {
+            HANDLE handle = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+            ~Event() { CloseHandle(handle); }
+        };
+        thread_local Event event;
+        return reinterpret_cast<HANDLE>(reinterpret_cast<uintptr_t>(event.handle) | 1);
     }
 
-    std::vector<RecordId> rangeSearch(const Value& start_key, const Value& end_key) {
-        if (root_page_id_ == 0) return {};
+    inline bool transfer(HANDLE file, uint64_t offset, char* data, DWORD size, bool write, DWORD& n) {
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset & 0xFFFFFFFFu);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        overlapped.hEvent = syncEvent();
+        n = 0;
+        BOOL ok = write ? WriteFile(file, data, size, nullptr, &overlapped)
+            : ReadFile(file, data, size, nullptr, &overlapped);
+        if (ok || GetLastError() == ERROR_IO_PENDING) ok = GetOverlappedResult(file, &overlapped, &n, TRUE);
+        return ok != FALSE;
+    }
+#endif
+
+    // 從指定位移讀取，回傳實際讀到的位元組數（檔案結尾之後為 0）
+    inline size_t readAt(NativeFile file, uint64_t offset, char* data, size_t size) {
+        size_t done = 0;
+        while (done < size) {
+#if defined(_WIN32)
+            DWORD n = 0;
+            if (!transfer(file, offset + done, data + done, static_cast<DWORD>(size - done), false, n) || n == 0) break;
+#else
+            ssize_t n = ::pread(file, data + done, size - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+#endif
+            done += static_cast<size_t>(n);
+        }
+        return done;
+    }
 
-        std::vector<RecordId> results;
-        PageId leaf_page = findLeaf(root_page_id_, start_key);
+    inline bool writeAt(NativeFile file, uint64_t offset, const char* data, size_t size) {
+        size_t done = 0;
+        while (done < size) {
+#if defined(_WIN32)
+            DWORD n = 0;
+            if (!transfer(file, offset + done, const_cast<char*>(data) + done, static_cast<DWORD>(size - done), true, n)) return false;
+#else
+            ssize_t n = ::pwrite(file, data + done, size - done, static_cast<off_t>(offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return false;
+#endif
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
 
-        while (leaf_page != 0) {
-            auto leaf_node = getNode(leaf_page);
+    // 讓已寫入的內容落盤
+    inline bool sync(NativeFile file) {
+#if defined(_WIN32)
+        return FlushFileBuffers(file) != FALSE;
+#elif defined(__linux__)
+        return ::fdatasync(file) == 0;
+#else
+        return ::fsync(file) == 0;
+#endif
+    }
 
-            for (size_t i = 0; i < leaf_node->keys.size(); ++i) {
-                if (compareValues(leaf_node->keys[i], start_key) >= 0 &&
-                    compareValues(leaf_node->keys[i], end_key) <= 0) {
-                    results.push_back(leaf_node->records[i]);
-                }
-                if (compareValues(leaf_node->keys[i], end_key) > 0) {
-                    return results;
-                }
-            }
+    inline bool truncate(NativeFile file, uint64_t size) {
+#if defined(_WIN32)
+        FILE_END_OF_FILE_INFO info{};
+        info.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+        return SetFileInformationByHandle(file, FileEndOfFileInfo, &info, sizeof(info)) != FALSE;
+#else
+        return ::ftruncate(file, static_cast<off_t>(size)) == 0;
+#endif
+    }
+}
 
-            leaf_page = leaf_node->next_leaf;
-        }
+// 非同步頁面 I/O 請求 - 由提交者配置，在 on_complete 被呼叫之前必須保持有效
+struct AsyncPageIo {
+    FileId file_id = 0;
+    PageId page_id = 0;
+    char* data = nullptr;  // 檔案的一頁（length 位元組）
+    bool write = false;
+    void (*on_complete)(AsyncPageIo& io, bool ok) = nullptr;
+    void* context = nullptr;
+
+    // 以下由 DiskManager 與 AsyncIoEngine 填寫
+    NativeFile file{};
+    std::chrono::steady_clock::time_point submitted{};  // 提交時間，完成時計入 I/O 延遲
+    uint64_t offset = 0;
+    uint32_t length = 0;
+#if defined(_WIN32)
+    OVERLAPPED overlapped{};
+#elif DATABASEAPP_HAS_IO_URING
+    iovec iov{};
+#endif
+};
 
-        return results;
-    }
+// 非同步 I/O 引擎 - Linux 直接以系統呼叫操作 io_uring 的提交/完成佇列，Windows 使用 IOCP，
+// 兩者都不可用時退回固定數量的 pread/pwrite 工作執行緒。
+// 完成事件在引擎的執行緒上以 (請求, 位元組數或負的錯誤碼) 回呼；同時在途的請求數上限為 QUEUE_DEPTH
+class AsyncIoEngine {
+public:
+    static constexpr unsigned QUEUE_DEPTH = 64;
+    static constexpr size_t FALLBACK_THREADS = 4;
+    using CompletionHandler = std::function<void(AsyncPageIo&, int64_t)>;
 
 private:
-    // 序列化值到緩衝區
-    void serializeValue(char* data, size_t& offset, const Value& value, DataType type) {
-        switch (type) {
-        case DataType::INT32: {
-            int32_t val = std::get<int32_t>(value);
-            std::memcpy(data + offset, &val, sizeof(int32_t));
-            offset += sizeof(int32_t);
-            break;
+    CompletionHandler on_complete_;
+    std::mutex submit_mutex_;
+    std::mutex inflight_mutex_;
+    std::condition_variable inflight_cv_;
+    size_t inflight_ = 0;
+    bool stopping_ = false;
+    const char* backend_ = "threads";
+    std::vector<std::thread> threads_;
+
+    // 工作執行緒後端的佇列，由 submit_mutex_ 保護
+    std::deque<AsyncPageIo*> queue_;
+    std::condition_variable queue_cv_;
+
+#if DATABASEAPP_HAS_IO_URING
+    int ring_fd_ = -1;
+    void* sq_ring_ = nullptr;
+    void* cq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_mask_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned pending_sqes_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned* cq_mask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+#elif defined(_WIN32)
+    HANDLE port_ = nullptr;
+    static constexpr ULONG_PTR STOP_KEY = 1;
+#endif
+
+public:
+    explicit AsyncIoEngine(CompletionHandler on_complete) : on_complete_(std::move(on_complete)) {
+#if DATABASEAPP_HAS_IO_URING
+        if (setupRing()) {
+            backend_ = "io_uring";
+            threads_.emplace_back([this] { reapRing(); });
+            return;
         }
-        case DataType::INT64: {
-            int64_t val = std::get<int64_t>(value);
-            std::memcpy(data + offset, &val, sizeof(int64_t));
-            offset += sizeof(int64_t);
-            break;
+#elif defined(_WIN32)
+        port_ = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0);
+        if (port_) {
+            backend_ = "iocp";
+            threads_.emplace_back([this] { reapPort(); });
+            return;
         }
-        case DataType::FLOAT: {
-            float val = std::get<float>(value);
-            std::memcpy(data + offset, &val, sizeof(float));
-            offset += sizeof(float);
-            break;
+#endif
+        for (size_t i = 0; i < FALLBACK_THREADS; ++i) {
+            threads_.emplace_back([this] { workerLoop(); });
         }
-        case DataType::DOUBLE: {
-            double val = std::get<double>(value);
-            std::memcpy(data + offset, &val, sizeof(double));
-            offset += sizeof(double);
-            break;
+    }
+
+    AsyncIoEngine(const AsyncIoEngine&) = delete;
+    AsyncIoEngine& operator=(const AsyncIoEngine&) = delete;
+
+    // 等待所有在途請求完成後才停止引擎的執行緒
+    ~AsyncIoEngine() {
+        {
+            std::unique_lock<std::mutex> lock(inflight_mutex_);
+            inflight_cv_.wait(lock, [this] { return inflight_ == 0; });
         }
-        case DataType::STRING: {
-            std::string val = std::get<std::string>(value);
-            // 限制字串長度並填充到固定大小
-            val.resize(255, '\0');
-            std::memcpy(data + offset, val.c_str(), 256);
-            offset += 256;
-            break;
+#if DATABASEAPP_HAS_IO_URING
+        if (ring_fd_ >= 0) {
+            {
+                std::lock_guard<std::mutex> lock(submit_mutex_);
+                io_uring_sqe* sqe = nextSqe();
+                sqe->opcode = IORING_OP_NOP;
+                sqe->user_data = 0;  // 停止信號
+                flushSqes(1);
+            }
+            threads_.front().join();
+            teardownRing();
+            return;
         }
-        case DataType::BOOL: {
-            bool val = std::get<bool>(value);
-            std::memcpy(data + offset, &val, sizeof(bool));
-            offset += sizeof(bool);
-            break;
+#elif defined(_WIN32)
+        if (port_) {
+            PostQueuedCompletionStatus(port_, 0, STOP_KEY, nullptr);
+            threads_.front().join();
+            CloseHandle(port_);
+            return;
         }
+#endif
+        {
+            std::lock_guard<std::mutex> lock(submit_mutex_);
+            stopping_ = true;
         }
+        queue_cv_.notify_all();
+        for (auto& thread : threads_) thread.join();
     }
-    
-    // 從緩衝區反序列化值
-    Value deserializeValue(const char* data, size_t& offset, DataType type) {
-        switch (type) {
-        case DataType::INT32: {
-            int32_t val;
-            std::memcpy(&val, data + offset, sizeof(int32_t));
-            offset += sizeof(int32_t);
-            return val;
-        }
-        case DataType::INT64: {
-            int64_t val;
-            std::memcpy(&val, data + offset, sizeof(int64_t));
-            offset += sizeof(int64_t);
-            return val;
+
+    const char* backendName() const { return backend_; }
+
+    // Windows 上檔案控制代碼必須先關聯到完成埠；其他後端不需要
+    void attach(NativeFile file) {
+#if defined(_WIN32) && !DATABASEAPP_HAS_IO_URING
+        if (port_) CreateIoCompletionPort(file, port_, 0, 0);
+#else
+        (void)file;
+#endif
+    }
+
+    // 提交一批請求，呼叫端已填好 file 與 offset；在途請求達到上限時等待完成
+    void submit(AsyncPageIo* const* requests, size_t count) {
+        size_t done = 0;
+        while (done < count) {
+            size_t n;
+            {
+                std::unique_lock<std::mutex> lock(inflight_mutex_);
+                inflight_cv_.wait(lock, [this] { return inflight_ < QUEUE_DEPTH; });
+                n = std::min<size_t>(count - done, QUEUE_DEPTH - inflight_);
+                inflight_ += n;
+            }
+            submitNative(requests + done, n);
+            done += n;
         }
-        case DataType::FLOAT: {
-            float val;
-            std::memcpy(&val, data + offset, sizeof(float));
-            offset += sizeof(float);
-            return val;
+    }
+
+private:
+    void submitNative(AsyncPageIo* const* requests, size_t count) {
+#if DATABASEAPP_HAS_IO_URING
+        if (ring_fd_ >= 0) {
+            std::lock_guard<std::mutex> lock(submit_mutex_);
+            for (size_t i = 0; i < count; ++i) {
+                AsyncPageIo& io = *requests[i];
+                io.iov.iov_base = io.data;
+                io.iov.iov_len = io.length;
+                io_uring_sqe* sqe = nextSqe();
+                sqe->opcode = io.write ? IORING_OP_WRITEV : IORING_OP_READV;
+                sqe->fd = io.file;
+                sqe->off = io.offset;
+                sqe->addr = reinterpret_cast<uint64_t>(&io.iov);
+                sqe->len = 1;
+                sqe->user_data = reinterpret_cast<uint64_t>(&io);
+            }
+            flushSqes(static_cast<unsigned>(count));
+            return;
         }
-        case DataType::DOUBLE: {
-            double val;
-            std::memcpy(&val, data + offset, sizeof(double));
-            offset += sizeof(double);
-            return val;
+#elif defined(_WIN32)
+        if (port_) {
+            for (size_t i = 0; i < count; ++i) submitOverlapped(*requests[i]);
+            return;
         }
-        case DataType::STRING: {
-            std::string val(data + offset, 256);
-            val = val.c_str(); // 移除尾部的 null 字符
-            offset += 256;
-            return val;
+#endif
+        {
+            std::lock_guard<std::mutex> lock(submit_mutex_);
+            queue_.insert(queue_.end(), requests, requests + count);
         }
-        case DataType::BOOL: {
-            bool val;
-            std::memcpy(&val, data + offset, sizeof(bool));
-            offset += sizeof(bool);
-            return val;
+        queue_cv_.notify_all();
+    }
+
+    void complete(AsyncPageIo& io, int64_t result) {
+        on_complete_(io, result);
+        {
+            std::lock_guard<std::mutex> lock(inflight_mutex_);
+            inflight_--;
         }
+        inflight_cv_.notify_all();
+    }
+
+    void workerLoop() {
+        while (true) {
+            AsyncPageIo* io;
+            {
+                std::unique_lock<std::mutex> lock(submit_mutex_);
+                queue_cv_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+                if (queue_.empty()) return;
+                io = queue_.front();
+                queue_.pop_front();
+            }
+            int64_t result = io->write
+                ? (PositionalIo::writeAt(io->file, io->offset, io->data, io->length) ? int64_t(io->length) : -1)
+                : static_cast<int64_t>(PositionalIo::readAt(io->file, io->offset, io->data, io->length));
+            complete(*io, result);
         }
-        return int32_t(0); // 預設值
     }
 
-    PageId createNewNode(bool is_leaf) {
-        static PageId next_page_id = 1;
-        PageId page_id = next_page_id++;
+#if DATABASEAPP_HAS_IO_URING
+    bool setupRing() {
+        io_uring_params params{};
+        int fd = static_cast<int>(::syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params));
+        if (fd < 0) return false;
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+
+        void* sq = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        void* cq = single_mmap || sq == MAP_FAILED ? sq
+            : ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        void* sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+        if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+            if (sqes != MAP_FAILED) ::munmap(sqes, sqes_size_);
+            if (cq != MAP_FAILED && cq != sq) ::munmap(cq, cq_ring_size_);
+            if (sq != MAP_FAILED) ::munmap(sq, sq_ring_size_);
+            ::close(fd);
+            return false;
+        }
 
-        BPlusTreeNode node(is_leaf);
-        saveNode(page_id, node);
+        char* sq_base = static_cast<char*>(sq);
+        char* cq_base = static_cast<char*>(cq);
+        sq_ring_ = sq;
+        cq_ring_ = cq;
+        sq_tail_ = reinterpret_cast<unsigned*>(sq_base + params.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned*>(sq_base + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq_base + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned*>(cq_base + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq_base + params.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned*>(cq_base + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq_base + params.cq_off.cqes);
+        sqes_ = static_cast<io_uring_sqe*>(sqes);
+        ring_fd_ = fd;
+        return true;
+    }
 
-        return page_id;
+    void teardownRing() {
+        ::munmap(sqes_, sqes_size_);
+        if (cq_ring_ != sq_ring_) ::munmap(cq_ring_, cq_ring_size_);
+        ::munmap(sq_ring_, sq_ring_size_);
+        ::close(ring_fd_);
+        ring_fd_ = -1;
     }
 
-    std::shared_ptr<BPlusTreeNode> getNode(PageId page_id) {
-        auto page = buffer_manager_.fetchPage(index_name_, page_id);
-        auto node = std::make_shared<BPlusTreeNode>();
-        
-        char* data = page->data.data();
-        size_t offset = 0;
-        
-        // 檢查是否為空頁面（全零）
-        bool is_empty = true;
-        for (size_t i = 0; i < PAGE_SIZE && is_empty; ++i) {
-            if (data[i] != 0) is_empty = false;
-        }
-        
-        if (is_empty) {
-            std::cout << "DEBUG: Loading empty B+ tree node " << page_id << " (initializing new node)" << std::endl;
-            return node;
-        }
-        
-        std::cout << "DEBUG: Deserializing B+ tree node " << page_id << " from disk" << std::endl;
-        
-        // 讀取節點類型
-        std::memcpy(&node->is_leaf, data + offset, sizeof(bool));
-        offset += sizeof(bool);
-        
-        // 讀取資料型別
-        DataType node_data_type;
-        std::memcpy(&node_data_type, data + offset, sizeof(DataType));
-        offset += sizeof(DataType);
-        
-        // 讀取鍵的數量
-        size_t key_count;
-        std::memcpy(&key_count, data + offset, sizeof(size_t));
-        offset += sizeof(size_t);
-        
-        // 驗證鍵數量是否合理
-        if (key_count > max_keys_) {
-            std::cerr << "ERROR: Invalid key count " << key_count << " in B+ tree node " << page_id << std::endl;
-            return node; // 返回空節點
-        }
-        
-        // 讀取鍵值
-        node->keys.reserve(key_count);
-        for (size_t i = 0; i < key_count; ++i) {
-            try {
-                Value key = deserializeValue(data, offset, node_data_type);
-                node->keys.push_back(key);
-            } catch (const std::exception& e) {
-                std::cerr << "ERROR: Failed to deserialize key " << i << " in node " << page_id 
-                          << ": " << e.what() << std::endl;
-                return node; // 返回部分反序列化的節點
+    // 呼叫端持有 submit_mutex_。在途上限等於 SQ 大小，且每批填完即交給核心，因此一定有空位
+    io_uring_sqe* nextSqe() {
+        unsigned index = (*sq_tail_ + pending_sqes_) & *sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[index] = index;
+        pending_sqes_++;
+        return sqe;
+    }
+
+    void flushSqes(unsigned count) {
+        __atomic_store_n(sq_tail_, *sq_tail_ + pending_sqes_, __ATOMIC_RELEASE);
+        pending_sqes_ = 0;
+        while (count > 0) {
+            int submitted = static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, count, 0, 0, nullptr, 0));
+            if (submitted < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+                DATABASEAPP_LOG(LogLevel::ERR, "io_uring_enter failed: " << std::strerror(errno));
+                return;
             }
+            count -= static_cast<unsigned>(submitted);
         }
-        
-        // 讀取記錄或子節點
-        if (node->is_leaf) {
-            node->records.resize(key_count);
-            for (size_t i = 0; i < key_count; ++i) {
-                std::memcpy(&node->records[i], data + offset, sizeof(RecordId));
-                offset += sizeof(RecordId);
-            }
-            
-            // 讀取下一個葉節點指標
-            std::memcpy(&node->next_leaf, data + offset, sizeof(PageId));
-            offset += sizeof(PageId);
-            
-            // 數據一致性檢查：葉子節點的keys和records數量應該相等
-            if (node->keys.size() != node->records.size()) {
-                std::cerr << "ERROR: Leaf node " << page_id << " data inconsistency - keys: " 
-                          << node->keys.size() << ", records: " << node->records.size() << std::endl;
-                // 修正數據不一致問題
-                size_t min_size = std::min(node->keys.size(), node->records.size());
-                node->keys.resize(min_size);
-                node->records.resize(min_size);
-            }
-        } else {
-            size_t child_count = key_count + 1;
-            node->children.resize(child_count);
-            for (size_t i = 0; i < child_count; ++i) {
-                std::memcpy(&node->children[i], data + offset, sizeof(PageId));
-                offset += sizeof(PageId);
+    }
+
+    // 完成執行緒：只有它推進 CQ head
+    void reapRing() {
+        while (true) {
+            unsigned head = *cq_head_;
+            unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                ::syscall(__NR_io_uring_enter, ring_fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+                continue;
             }
-            
-            // 數據一致性檢查：內部節點的children數量應該是keys數量+1
-            if (node->children.size() != node->keys.size() + 1) {
-                std::cerr << "ERROR: Internal node " << page_id << " data inconsistency - keys: " 
-                          << node->keys.size() << ", children: " << node->children.size() << std::endl;
-                // 修正數據不一致問題
-                if (node->children.size() < node->keys.size() + 1) {
-                    // 如果children太少，添加虛擬子節點
-                    node->children.resize(node->keys.size() + 1, 0);
+
+            // 核心的佇列不在 C++ 記憶體模型內：取一次提交端的鎖，讓提交端對請求的存取先於完成回呼
+            { std::lock_guard<std::mutex> lock(submit_mutex_); }
+
+            bool stop = false;
+            for (; head != tail; ++head) {
+                const io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+                uint64_t user_data = cqe.user_data;
+                int64_t result = cqe.res;
+                __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+                if (user_data == 0) {
+                    stop = true;
                 } else {
-                    // 如果children太多，截斷到正確大小
-                    node->children.resize(node->keys.size() + 1);
+                    complete(*reinterpret_cast<AsyncPageIo*>(user_data), result);
                 }
             }
+            if (stop) return;
         }
-        
-        return node;
     }
-
-    void saveNode(PageId page_id, const BPlusTreeNode& node) {
-        // 在序列化前進行數據一致性檢查
-        if (node.is_leaf) {
-            if (node.keys.size() != node.records.size()) {
-                std::cerr << "ERROR: Cannot serialize leaf node " << page_id 
-                          << " - keys size: " << node.keys.size() 
-                          << ", records size: " << node.records.size() << std::endl;
-                return;
-            }
-        } else {
-            if (node.children.size() != node.keys.size() + 1) {
-                std::cerr << "ERROR: Cannot serialize internal node " << page_id 
-                          << " - keys size: " << node.keys.size() 
-                          << ", children size: " << node.children.size() << std::endl;
-                return;
-            }
-        }
-        
-        auto page = buffer_manager_.fetchPage(index_name_, page_id);
-        
-        std::cout << "DEBUG: Serializing B+ tree node " << page_id << " to disk" << std::endl;
-        
-        char* data = page->data.data();
-        size_t offset = 0;
-        
-        // 清空頁面
-        std::fill(page->data.begin(), page->data.end(), 0);
-        
-        // 寫入節點類型
-        std::memcpy(data + offset, &node.is_leaf, sizeof(bool));
-        offset += sizeof(bool);
-        
-        // 寫入資料型別
-        std::memcpy(data + offset, &key_type_, sizeof(DataType));
-        offset += sizeof(DataType);
-        
-        // 寫入鍵的數量
-        size_t key_count = node.keys.size();
-        std::memcpy(data + offset, &key_count, sizeof(size_t));
-        offset += sizeof(size_t);
-        
-        // 序列化鍵值
-        for (size_t i = 0; i < key_count; ++i) {
-            serializeValue(data, offset, node.keys[i], key_type_);
+#elif defined(_WIN32)
+    void submitOverlapped(AsyncPageIo& io) {
+        io.overlapped = OVERLAPPED{};
+        io.overlapped.Offset = static_cast<DWORD>(io.offset & 0xFFFFFFFFu);
+        io.overlapped.OffsetHigh = static_cast<DWORD>(io.offset >> 32);
+        BOOL ok = io.write
+            ? WriteFile(io.file, io.data, io.length, nullptr, &io.overlapped)
+            : ReadFile(io.file, io.data, io.length, nullptr, &io.overlapped);
+        if (!ok) {
+            DWORD error = GetLastError();
+            if (error == ERROR_IO_PENDING) return;
+            // 立即失敗的請求不會產生完成封包
+            complete(io, (!io.write && error == ERROR_HANDLE_EOF) ? 0 : -static_cast<int64_t>(error));
         }
-        
-        // 序列化記錄或子節點
-        if (node.is_leaf) {
-            for (size_t i = 0; i < key_count; ++i) {
-                std::memcpy(data + offset, &node.records[i], sizeof(RecordId));
-                offset += sizeof(RecordId);
+    }
+
+    void reapPort() {
+        while (true) {
+            DWORD bytes = 0;
+            ULONG_PTR key = 0;
+            OVERLAPPED* overlapped = nullptr;
+            BOOL ok = GetQueuedCompletionStatus(port_, &bytes, &key, &overlapped, INFINITE);
+            if (!overlapped) {
+                if (key == STOP_KEY) return;
+                continue;
             }
-            
-            // 寫入下一個葉節點指標
-            std::memcpy(data + offset, &node.next_leaf, sizeof(PageId));
-            offset += sizeof(PageId);
-        } else {
-            for (size_t i = 0; i < node.children.size(); ++i) {
-                std::memcpy(data + offset, &node.children[i], sizeof(PageId));
-                offset += sizeof(PageId);
+            AsyncPageIo& io = *CONTAINING_RECORD(overlapped, AsyncPageIo, overlapped);
+            int64_t result = bytes;
+            if (!ok) {
+                DWORD error = GetLastError();
+                result = (!io.write && error == ERROR_HANDLE_EOF) ? 0 : -static_cast<int64_t>(error);
             }
-        }
-        
-        page->is_dirty = true;
-        std::cout << "DEBUG: B+ tree node " << page_id << " serialized, " << offset << " bytes used" << std::endl;
-        
-        // 驗證序列化大小不超過頁面大小
-        if (offset > PAGE_SIZE) {
-            std::cerr << "ERROR: Serialized node too large: " << offset << " bytes (max: " << PAGE_SIZE << ")" << std::endl;
+            complete(io, result);
         }
     }
+#endif
+};
 
-    std::pair<Value, PageId> insertInternal(PageId page_id, const Value& key, RecordId record_id) {
-        auto node = getNode(page_id);
+// 磁碟管理器 - 以位置式 I/O（pread/pwrite、帶 OVERLAPPED 位移的 ReadFile/WriteFile）讀寫，
+// 多個執行緒可同時存取同一個檔案，不共用 seek 位置。
+// 批次與預讀請求交給 AsyncIoEngine 非同步提交，一次系統呼叫送出多頁。
+// 頁面大小是檔案的屬性，在 registerFile 時決定（PAGE_SIZE 到 MAX_PAGE_SIZE 之間的 2 的冪次）。
+// 啟用記憶體映射讀取時，另以唯讀 mmap/MapViewOfFile 映射檔案中已完整寫入的區段，
+// 讓不再修改的頁面直接從作業系統頁面快取讀取，不經過緩衝池複製
+class DiskManager {
+private:
+    static constexpr size_t MAX_FILES = size_t(1) << 16;  // FileId 在頁表鍵中佔 16 位元
+    static_assert(MAX_FILES == EngineMetrics::MAX_FILES, "per-file metrics must cover every FileId");
+    static constexpr size_t MAP_SEGMENT_BYTES = 256 * 1024;  // 映射區段至少 256KB，為 Windows 配置粒度的倍數
+    static constexpr size_t MAP_CHUNK_SEGMENTS = 1024;
+    static constexpr size_t MAP_CHUNKS = 1024;               // 每個檔案最多映射 1024*1024 個區段
+
+    // 區段一旦映射就保留到檔案關閉，讀取者拿到的指標不會失效
+    struct MapChunk {
+        std::atomic<const char*> segments[MAP_CHUNK_SEGMENTS];
+    };
+
+    struct FileHandle {
+        std::string name;
+#if defined(_WIN32)
+        HANDLE handle = INVALID_HANDLE_VALUE;
+        bool isOpen() const { return handle != INVALID_HANDLE_VALUE; }
+#else
+        int fd = -1;
+        bool isOpen() const { return fd >= 0; }
+#endif
+        size_t page_size = PAGE_SIZE;
+        size_t segment_bytes = MAP_SEGMENT_BYTES;  // 映射區段大小，為頁面大小的倍數
+        std::atomic<uint64_t> size{ 0 };  // 已寫入的檔案長度
+        std::mutex map_mutex;
+        std::array<std::atomic<MapChunk*>, MAP_CHUNKS> map_chunks{};
+        std::atomic<size_t> prefetched_segment{ std::numeric_limits<size_t>::max() };
+    };
 
-        if (node->is_leaf) {
-            // 葉子節點：插入鍵值對
-            insertIntoLeaf(*node, key, record_id);
+    std::string db_path_;
+    bool memory_mapped_reads_;
+    std::mutex registry_mutex_;
+    std::unordered_map<std::string, FileId> file_ids_;
+    std::unique_ptr<std::atomic<FileHandle*>[]> files_;
+    std::atomic<FileId> file_count_;
+    std::atomic<size_t> mapped_bytes_;
+    EngineMetrics metrics_;  // 在 I/O 引擎之前建構，引擎的完成執行緒結束前仍會寫入
+    std::unique_ptr<AsyncIoEngine> io_engine_;
+
+    // 同步批次的完成計數
+    struct BatchWait {
+        std::mutex mutex;
+        std::condition_variable done;
+        size_t remaining = 0;
+        bool ok = true;
+    };
 
-            if (node->keys.size() > max_keys_) {
-                // 分裂葉子節點
-                return splitLeaf(page_id, *node);
-            }
+public:
+    DiskManager(const std::string& db_path, bool memory_mapped_reads = false)
+        : db_path_(db_path), memory_mapped_reads_(memory_mapped_reads),
+        files_(new std::atomic<FileHandle*>[MAX_FILES]), file_count_(0), mapped_bytes_(0),
+        io_engine_(std::make_unique<AsyncIoEngine>([this](AsyncPageIo& io, int64_t result) {
+            completeAsync(io, result);
+        })) {
+        std::filesystem::create_directories(db_path_);
+        for (size_t i = 0; i < MAX_FILES; ++i) files_[i].store(nullptr, std::memory_order_relaxed);
+    }
 
-            saveNode(page_id, *node);
-            return { Value{}, 0 };
-        }
-        else {
-            // 內部節點：找到合適的子節點
-            size_t child_index = findChildIndex(*node, key);
-            
-            // 額外的邊界檢查
-            if (child_index >= node->children.size()) {
-                std::cerr << "ERROR: Child index " << child_index << " out of range in insertInternal" << std::endl;
-                child_index = node->children.size() > 0 ? node->children.size() - 1 : 0;
+    ~DiskManager() {
+        io_engine_.reset();  // 先等待在途的非同步請求完成
+        DATABASEAPP_LOG(LogLevel::DEBUG, "DiskManager closing " << file_count_.load() << " files");
+        for (FileId id = 0; id < file_count_.load(); ++id) {
+            FileHandle* file = files_[id].load();
+            if (file) unmapFile(*file);
+            if (file && file->isOpen()) {
+                closeFile(*file);
+                DATABASEAPP_LOG(LogLevel::TRACE, "Closed file: " << file->name);
             }
-            
-            auto result = insertInternal(node->children[child_index], key, record_id);
-
-            if (result.second != 0) {
-                // 子節點分裂，需要在當前節點插入新的鍵
-                insertIntoInternal(*node, result.first, result.second, child_index);
+            delete file;
+        }
+    }
 
-                if (node->keys.size() > max_keys_) {
-                    // 分裂內部節點
-                    return splitInternal(page_id, *node);
-                }
-            }
+    bool memoryMappedReads() const { return memory_mapped_reads_; }
+    const char* ioBackend() const { return io_engine_->backendName(); }
+    size_t getMappedBytes() const { return mapped_bytes_.load(std::memory_order_relaxed); }
+    EngineMetrics& metrics() { return metrics_; }
 
-            saveNode(page_id, *node);
-            return { Value{}, 0 };
+    static void checkPageSize(size_t page_size) {
+        if (page_size < PAGE_SIZE || page_size > MAX_PAGE_SIZE || (page_size & (page_size - 1)) != 0) {
+            throw std::runtime_error("Invalid page size " + std::to_string(page_size));
         }
     }
 
-    PageId findLeaf(PageId page_id, const Value& key) {
-        auto node = getNode(page_id);
-
-        if (node->is_leaf) {
-            return page_id;
+    // 回傳該頁在唯讀映射中的位址；未啟用映射、或頁面所在區段尚未完整寫入檔案時回傳 nullptr。
+    // 呼叫端必須保證該頁已寫回磁碟且之後不再修改。
+    // sequential 為 true 時（掃描），每跨入一個新區段就提示核心預讀下一個區段
+    const char* mapPage(FileId file_id, PageId page_id, bool sequential) {
+        if (!memory_mapped_reads_) return nullptr;
+
+        FileHandle& file = *files_[file_id].load(std::memory_order_acquire);
+        const uint64_t position = page_id * file.page_size;
+        size_t segment = static_cast<size_t>(position / file.segment_bytes);
+        const char* base = mapSegment(file, segment);
+        if (!base) return nullptr;
+
+        if (sequential && file.prefetched_segment.exchange(segment + 1, std::memory_order_relaxed) != segment + 1) {
+            if (const char* next = mapSegment(file, segment + 1)) {
+                prefetch(next, file.segment_bytes);
+            }
         }
-        else {
-            size_t child_index = findChildIndex(*node, key);
-            
-            // 額外的邊界檢查
-            if (child_index >= node->children.size()) {
-                std::cerr << "ERROR: Child index " << child_index << " out of range in findLeaf" << std::endl;
-                child_index = node->children.size() > 0 ? node->children.size() - 1 : 0;
+        return base + position % file.segment_bytes;
+    }
+
+    // 為檔案分配編號並開啟；之後的讀寫都以編號存取，不再對檔名做雜湊。
+    // 同一個檔案再次註冊時頁面大小必須相同
+    FileId registerFile(const std::string& filename, size_t page_size = PAGE_SIZE) {
+        checkPageSize(page_size);
+        std::lock_guard<std::mutex> lock(registry_mutex_);
+        auto it = file_ids_.find(filename);
+        if (it != file_ids_.end()) {
+            if (files_[it->second].load(std::memory_order_relaxed)->page_size != page_size) {
+                throw std::runtime_error("File " + filename + " is already registered with another page size");
             }
-            
-            return findLeaf(node->children[child_index], key);
+            return it->second;
+        }
+
+        FileId file_id = file_count_.load();
+        if (file_id >= MAX_FILES) {
+            throw std::runtime_error("Too many open files: " + filename);
         }
+
+        auto* file = new FileHandle();
+        file->name = filename;
+        file->page_size = page_size;
+        file->segment_bytes = std::max(MAP_SEGMENT_BYTES, page_size);
+        openFile(*file);
+        files_[file_id].store(file, std::memory_order_release);
+        file_ids_[filename] = file_id;
+        file_count_.store(file_id + 1, std::memory_order_release);
+        return file_id;
     }
 
-    void insertIntoLeaf(BPlusTreeNode& node, const Value& key, RecordId record_id) {
-        auto pos = std::lower_bound(node.keys.begin(), node.keys.end(), key,
-            [this](const Value& a, const Value& b) {
-                return compareValues(a, b) < 0;
-            });
+    const std::string& getFileName(FileId file_id) const {
+        return files_[file_id].load(std::memory_order_acquire)->name;
+    }
 
-        size_t index = pos - node.keys.begin();
-        
-        // 確保records向量大小正確
-        if (node.records.size() != node.keys.size()) {
-            std::cerr << "ERROR: Leaf node data inconsistency before insert - keys: " 
-                      << node.keys.size() << ", records: " << node.records.size() << std::endl;
-            node.records.resize(node.keys.size());
+    size_t getPageSize(FileId file_id) const {
+        return files_[file_id].load(std::memory_order_acquire)->page_size;
+    }
+
+    void writePage(FileId file_id, PageId page_id, const char* data) {
+        FileHandle& file = *files_[file_id].load(std::memory_order_acquire);
+        const std::string& filename = file.name;
+        if (file.isOpen()) {
+            // 檢查寫入是否成功
+            const size_t page_size = file.page_size;
+            const auto start = std::chrono::steady_clock::now();
+            if (writeAt(file, page_id * page_size, data, page_size)) {
+                noteWritten(file, (page_id + 1) * page_size);
+                DATABASEAPP_LOG(LogLevel::TRACE, "Wrote page " << page_id << " to file " << filename);
+            } else {
+                DATABASEAPP_LOG(LogLevel::ERR, "Failed to write page " << page_id << " to file " << filename);
+                // 再試一次
+                if (writeAt(file, page_id * page_size, data, page_size)) {
+                    noteWritten(file, (page_id + 1) * page_size);
+                    DATABASEAPP_LOG(LogLevel::WARN, "Retry write succeeded for page " << page_id);
+                } else {
+                    DATABASEAPP_LOG(LogLevel::ERR, "Retry write also failed for page " << page_id);
+                }
+            }
+            recordIo(file_id, true, elapsedNanos(start));
+        } else {
+            DATABASEAPP_LOG(LogLevel::ERR, "Cannot write to file " << filename);
         }
-        
-        node.keys.insert(pos, key);
-        node.records.insert(node.records.begin() + index, record_id);
-        
-        // 驗證插入後的一致性
-        if (node.keys.size() != node.records.size()) {
-            std::cerr << "ERROR: Leaf node data inconsistency after insert!" << std::endl;
+    }
+
+    // 非同步提交一批頁面讀寫，不等待完成；每個請求完成時在 I/O 執行緒上呼叫其 on_complete。
+    // 讀取不足一頁的部分補零，與 readPage 相同；寫入失敗時以同步寫入重試一次
+    void submitAsync(AsyncPageIo* const* requests, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            AsyncPageIo& io = *requests[i];
+            const FileHandle& file = *files_[io.file_id].load(std::memory_order_acquire);
+            io.file = nativeFile(file);
+            io.offset = io.page_id * file.page_size;
+            io.length = static_cast<uint32_t>(file.page_size);
+            io.submitted = std::chrono::steady_clock::now();
         }
+        io_engine_->submit(requests, count);
     }
 
-    void insertIntoInternal(BPlusTreeNode& node, const Value& key, PageId new_child, size_t child_index) {
-        // 檢查插入位置的有效性
-        if (child_index > node.keys.size()) {
-            std::cerr << "ERROR: Invalid child_index " << child_index 
-                      << " for internal node with " << node.keys.size() << " keys" << std::endl;
-            child_index = node.keys.size();
+    // 同步批次：一次提交整批請求並等待全部完成，回傳是否全部成功。會覆寫請求的 on_complete 與 context
+    bool transferPages(AsyncPageIo* requests, size_t count) {
+        if (count == 0) return true;
+        BatchWait wait;
+        wait.remaining = count;
+        std::vector<AsyncPageIo*> pointers(count);
+        for (size_t i = 0; i < count; ++i) {
+            requests[i].context = &wait;
+            requests[i].on_complete = [](AsyncPageIo& io, bool ok) {
+                BatchWait& batch = *static_cast<BatchWait*>(io.context);
+                std::lock_guard<std::mutex> lock(batch.mutex);
+                if (!ok) batch.ok = false;
+                if (--batch.remaining == 0) batch.done.notify_all();
+            };
+            pointers[i] = &requests[i];
         }
-        
-        // 確保children向量大小正確（應該是keys.size() + 1）
-        if (node.children.size() != node.keys.size() + 1) {
-            std::cerr << "ERROR: Internal node data inconsistency before insert - keys: " 
-                      << node.keys.size() << ", children: " << node.children.size() << std::endl;
-            node.children.resize(node.keys.size() + 1, 0);
+        submitAsync(pointers.data(), count);
+
+        std::unique_lock<std::mutex> lock(wait.mutex);
+        wait.done.wait(lock, [&wait] { return wait.remaining == 0; });
+        DATABASEAPP_LOG(LogLevel::TRACE, "Batched " << (requests[0].write ? "write" : "read") << " of " << count
+            << " pages via " << ioBackend() << (wait.ok ? "" : " (with errors)"));
+        return wait.ok;
+    }
+
+    // 讓所有檔案已寫入的頁面落盤；檢查點在截斷日誌之前呼叫
+    bool syncAll() {
+        bool ok = true;
+        for (FileId id = 0; id < file_count_.load(std::memory_order_acquire); ++id) {
+            FileHandle& file = *files_[id].load(std::memory_order_acquire);
+            if (file.isOpen() && !PositionalIo::sync(nativeFile(file))) {
+                DATABASEAPP_LOG(LogLevel::ERR, "Failed to sync file " << file.name);
+                ok = false;
+            }
         }
-        
-        node.keys.insert(node.keys.begin() + child_index, key);
-        node.children.insert(node.children.begin() + child_index + 1, new_child);
-        
-        // 驗證插入後的一致性
-        if (node.children.size() != node.keys.size() + 1) {
-            std::cerr << "ERROR: Internal node data inconsistency after insert!" << std::endl;
+        return ok;
+    }
+
+    void readPage(FileId file_id, PageId page_id, char* data) {
+        FileHandle& file = *files_[file_id].load(std::memory_order_acquire);
+        const std::string& filename = file.name;
+        if (file.isOpen()) {
+            const size_t page_size = file.page_size;
+            const auto start = std::chrono::steady_clock::now();
+            size_t bytes_read = readAt(file, page_id * page_size, data, page_size);
+            recordIo(file_id, false, elapsedNanos(start));
+
+            // 檢查實際讀取的字節數
+            if (bytes_read < page_size) {
+                // 如果檔案較小，將剩餘字節初始化為零
+                std::memset(data + bytes_read, 0, page_size - bytes_read);
+                DATABASEAPP_LOG(LogLevel::TRACE, "Read " << bytes_read << " bytes from page " << page_id
+                    << " in file " << filename << " (padded with zeros)");
+            } else {
+                DATABASEAPP_LOG(LogLevel::TRACE, "Read page " << page_id << " from file " << filename);
+            }
+        } else {
+            DATABASEAPP_LOG(LogLevel::ERR, "Cannot read from file " << filename);
+            std::memset(data, 0, file.page_size);
         }
     }
 
-    std::pair<Value, PageId> splitLeaf(PageId page_id, BPlusTreeNode& node) {
-        size_t mid = node.keys.size() / 2;
+private:
+    // 頁面讀寫的次數計入檔案，延遲計入全域的讀取或寫入直方圖
+    void recordIo(FileId file_id, bool write, uint64_t ns) {
+        EngineMetrics::ThreadMetrics& local = metrics_.local();
+        EngineMetrics::FileCounters& counters = local.file(file_id);
+        bumpCounter(write ? counters.writes : counters.reads);
+        (write ? local.write_latency : local.read_latency).record(ns);
+    }
+
+    void openFile(FileHandle& file) {
+        std::string filepath = db_path_ + "/" + file.name;
+
+        // 如果目錄結構不存在則創建
+        size_t last_slash = filepath.find_last_of("/\\");
+        if (last_slash != std::string::npos) {
+            std::string dir_path = filepath.substr(0, last_slash);
+            std::filesystem::create_directories(dir_path);
+        }
 
-        PageId new_page_id = createNewNode(true);
-        auto new_node = getNode(new_page_id);
+        // 開啟既有檔案（不存在時創建），確保可讀寫；已寫入的長度即為目前的檔案大小
+#if defined(_WIN32)
+        file.handle = CreateFileA(filepath.c_str(), GENERIC_READ | GENERIC_WRITE,
+            FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+#else
+        file.fd = ::open(filepath.c_str(), O_RDWR | O_CREAT, 0644);
+#endif
+
+        if (!file.isOpen()) {
+            DATABASEAPP_LOG(LogLevel::ERR, "Failed to create file: " << filepath);
+        } else {
+            file.size.store(fileSize(file), std::memory_order_relaxed);
+            io_engine_->attach(nativeFile(file));
+            DATABASEAPP_LOG(LogLevel::DEBUG, "Opened file: " << filepath << " (" << file.size.load() << " bytes)");
+        }
+    }
 
-        // 移動後半部分到新節點
-        new_node->keys.assign(node.keys.begin() + mid, node.keys.end());
-        new_node->records.assign(node.records.begin() + mid, node.records.end());
-        new_node->next_leaf = node.next_leaf;
+    static uint64_t fileSize(const FileHandle& file) {
+#if defined(_WIN32)
+        LARGE_INTEGER size;
+        return GetFileSizeEx(file.handle, &size) ? static_cast<uint64_t>(size.QuadPart) : 0;
+#else
+        struct stat info;
+        return ::fstat(file.fd, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+#endif
+    }
 
-        // 縮短原節點
-        node.keys.resize(mid);
-        node.records.resize(mid);
-        node.next_leaf = new_page_id;
+    static NativeFile nativeFile(const FileHandle& file) {
+#if defined(_WIN32)
+        return file.handle;
+#else
+        return file.fd;
+#endif
+    }
 
-        saveNode(page_id, node);
-        saveNode(new_page_id, *new_node);
+    // 在 I/O 執行緒上處理完成事件
+    void completeAsync(AsyncPageIo& io, int64_t result) {
+        FileHandle& file = *files_[io.file_id].load(std::memory_order_acquire);
+        bool ok = true;
+        recordIo(io.file_id, io.write, elapsedNanos(io.submitted));
+        if (io.write) {
+            if (result != static_cast<int64_t>(io.length)) {
+                DATABASEAPP_LOG(LogLevel::ERR, "Async write of page " << io.page_id << " to file " << file.name
+                    << " failed, retrying synchronously");
+                ok = writeAt(file, io.offset, io.data, io.length);
+                if (!ok) {
+                    DATABASEAPP_LOG(LogLevel::ERR, "Retry write also failed for page " << io.page_id);
+                }
+            }
+            if (ok) noteWritten(file, io.offset + io.length);
+        } else {
+            if (result < 0) {
+                DATABASEAPP_LOG(LogLevel::ERR, "Async read of page " << io.page_id << " from file " << file.name
+                    << " failed");
+                ok = false;
+            }
+            size_t bytes_read = result > 0 ? static_cast<size_t>(result) : 0;
+            if (bytes_read < io.length) std::memset(io.data + bytes_read, 0, io.length - bytes_read);
+        }
+        io.on_complete(io, ok);
+    }
 
-        return { new_node->keys[0], new_page_id };
+    static void noteWritten(FileHandle& file, uint64_t end) {
+        uint64_t size = file.size.load(std::memory_order_relaxed);
+        while (size < end && !file.size.compare_exchange_weak(size, end, std::memory_order_release)) {
+        }
     }
 
-    std::pair<Value, PageId> splitInternal(PageId page_id, BPlusTreeNode& node) {
-        size_t mid = node.keys.size() / 2;
+    // 取得區段的映射位址，必要時建立；區段必須完全位於已寫入的檔案範圍內
+    const char* mapSegment(FileHandle& file, size_t segment) {
+        size_t chunk_index = segment / MAP_CHUNK_SEGMENTS;
+        if (chunk_index >= MAP_CHUNKS) return nullptr;
 
-        PageId new_page_id = createNewNode(false);
-        auto new_node = getNode(new_page_id);
+        MapChunk* chunk = file.map_chunks[chunk_index].load(std::memory_order_acquire);
+        if (chunk) {
+            const char* base = chunk->segments[segment % MAP_CHUNK_SEGMENTS].load(std::memory_order_acquire);
+            if (base) return base;
+        }
+        const size_t segment_bytes = file.segment_bytes;
+        uint64_t offset = static_cast<uint64_t>(segment) * segment_bytes;
+        if (file.size.load(std::memory_order_acquire) < offset + segment_bytes) return nullptr;
+
+        std::lock_guard<std::mutex> lock(file.map_mutex);
+        chunk = file.map_chunks[chunk_index].load(std::memory_order_relaxed);
+        if (!chunk) {
+            chunk = new MapChunk();
+            file.map_chunks[chunk_index].store(chunk, std::memory_order_release);
+        }
+        auto& slot = chunk->segments[segment % MAP_CHUNK_SEGMENTS];
+        const char* base = slot.load(std::memory_order_relaxed);
+        if (base) return base;
+
+#if defined(_WIN32)
+        uint64_t end = offset + segment_bytes;
+        HANDLE mapping = CreateFileMappingA(file.handle, nullptr, PAGE_READONLY,
+            static_cast<DWORD>(end >> 32), static_cast<DWORD>(end & 0xFFFFFFFFu), nullptr);
+        if (!mapping) return nullptr;
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ,
+            static_cast<DWORD>(offset >> 32), static_cast<DWORD>(offset & 0xFFFFFFFFu), segment_bytes);
+        CloseHandle(mapping);  // 映射視圖會保留對映射物件的參考
+        if (!view) return nullptr;
+#else
+        void* view = ::mmap(nullptr, segment_bytes, PROT_READ, MAP_SHARED, file.fd, static_cast<off_t>(offset));
+        if (view == MAP_FAILED) return nullptr;
+#endif
+        base = static_cast<const char*>(view);
+        slot.store(base, std::memory_order_release);
+        mapped_bytes_.fetch_add(segment_bytes, std::memory_order_relaxed);
+        return base;
+    }
 
-        // 移動後半部分到新節點
-        Value promoted_key = node.keys[mid];
-        new_node->keys.assign(node.keys.begin() + mid + 1, node.keys.end());
-        new_node->children.assign(node.children.begin() + mid + 1, node.children.end());
+    static void prefetch(const char* address, size_t length) {
+#if defined(_WIN32)
+#if defined(_WIN32_WINNT) && _WIN32_WINNT >= 0x0602
+        WIN32_MEMORY_RANGE_ENTRY range{ const_cast<char*>(address), length };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+        (void)address;
+        (void)length;
+#endif
+#else
+        ::madvise(const_cast<char*>(address), length, MADV_WILLNEED);
+#endif
+    }
 
-        // 縮短原節點
-        node.keys.resize(mid);
-        node.children.resize(mid + 1);
+    void unmapFile(FileHandle& file) {
+        for (auto& chunk_ptr : file.map_chunks) {
+            MapChunk* chunk = chunk_ptr.load();
+            if (!chunk) continue;
+            for (auto& segment : chunk->segments) {
+                const char* base = segment.load();
+                if (!base) continue;
+#if defined(_WIN32)
+                UnmapViewOfFile(base);
+#else
+                ::munmap(const_cast<char*>(base), file.segment_bytes);
+#endif
+            }
+            delete chunk;
+        }
+    }
 
-        saveNode(page_id, node);
-        saveNode(new_page_id, *new_node);
+    static void closeFile(FileHandle& file) {
+#if defined(_WIN32)
+        CloseHandle(file.handle);
+        file.handle = INVALID_HANDLE_VALUE;
+#else
+        ::close(file.fd);
+        file.fd = -1;
+#endif
+    }
 
-        return { promoted_key, new_page_id };
+    static size_t readAt(const FileHandle& file, uint64_t offset, char* data, size_t size) {
+        return PositionalIo::readAt(nativeFile(file), offset, data, size);
     }
 
-    size_t findChildIndex(const BPlusTreeNode& node, const Value& key) {
-        auto pos = std::lower_bound(node.keys.begin(), node.keys.end(), key,
-            [this](const Value& a, const Value& b) {
-                return compareValues(a, b) < 0;
-            });
+    static bool writeAt(const FileHandle& file, uint64_t offset, const char* data, size_t size) {
+        return PositionalIo::writeAt(nativeFile(file), offset, data, size);
+    }
+};
 
-        size_t index = pos - node.keys.begin();
-        
-        // 確保索引不會超出children向量的範圍
-        // 對於內部節點，children的數量應該是keys數量+1
-        if (!node.is_leaf && index >= node.children.size()) {
-            std::cerr << "ERROR: Child index " << index << " out of range (children size: " 
-                      << node.children.size() << ", keys size: " << node.keys.size() << ")" << std::endl;
-            return node.children.size() > 0 ? node.children.size() - 1 : 0;
+// CRC-32（IEEE 多項式），用來辨識日誌與目錄中寫到一半或損壞的內容
+inline uint32_t crc32(const char* data, size_t size, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
         }
-        
-        return index;
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// 日誌記錄與目錄內容的序列化；整數以本機位元組序存放，與資料頁相同
+class ByteWriter {
+private:
+    std::string body_;
+
+public:
+    template<typename T>
+    void put(T value) {
+        static_assert(std::is_trivially_copyable_v<T>, "put() takes fixed-size values");
+        body_.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void putString(std::string_view value) {
+        value = value.substr(0, std::numeric_limits<uint16_t>::max());
+        put(static_cast<uint16_t>(value.size()));
+        body_.append(value.data(), value.size());
+    }
+
+    void putBytes(const char* data, size_t size) {
+        put(static_cast<uint32_t>(size));
+        body_.append(data, size);
     }
 
-    int compareValues(const Value& a, const Value& b) {
-        // 實作值比較邏輯
-        if (a == b) return 0;
-        return (a < b) ? -1 : 1;
+    // 值以 variant 索引開頭，重做時不需要查詢表格結構
+    void putValue(const Value& value) {
+        put(static_cast<uint8_t>(value.index()));
+        std::visit([this](const auto& v) {
+            using T = std::decay_t<decltype(v)>;
+            if constexpr (std::is_same_v<T, std::string>) {
+                putString(v);
+            }
+            else if constexpr (std::is_same_v<T, bool>) {
+                put(static_cast<uint8_t>(v ? 1 : 0));
+            }
+            else {
+                put(v);
+            }
+            }, value);
     }
+
+    const std::string& body() const { return body_; }
 };
 
-// 支援大資料集的列存儲結構
-class DiskBasedColumn {
+// 讀取 ByteWriter 寫出的內容；資料不足時拋出例外
+class ByteReader {
 private:
-    std::string name_;
-    DataType type_;
-    std::string data_file_;
-    std::unique_ptr<BPlusTreeIndex> index_;
-    BufferPoolManager& buffer_manager_;
-    size_t total_records_;
-    size_t records_per_page_;
+    const char* pos_;
+    const char* end_;
 
 public:
-    DiskBasedColumn(const std::string& name, DataType type, BufferPoolManager& buffer_manager)
-        : name_(name), type_(type), buffer_manager_(buffer_manager), total_records_(0) {
-        
-        // name 參數是從資料庫根目錄開始的相對路徑（例如："employees/id"）
-        // 我們需要創建相對於資料庫根目錄的資料檔案路徑
-        data_file_ = name + ".data";
+    ByteReader(const char* data, size_t size) : pos_(data), end_(data + size) {}
+
+    template<typename T>
+    T get() {
+        static_assert(std::is_trivially_copyable_v<T>, "get() takes fixed-size values");
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
 
-        // 計算每頁可存儲的記錄數
-        size_t record_size = getRecordSize(type);
-        records_per_page_ = PAGE_SIZE / record_size;
+    std::string getString() {
+        size_t size = get<uint16_t>();
+        return std::string(take(size), size);
+    }
 
-        // 為此列創建索引
-        index_ = std::make_unique<BPlusTreeIndex>(name + ".idx", type, buffer_manager);
+    // 回傳的指標指向原始緩衝區
+    std::string_view getBytes() {
+        size_t size = get<uint32_t>();
+        return std::string_view(take(size), size);
     }
 
-    RecordId append(const Value& value) {
-        RecordId record_id = total_records_;
-        PageId page_id = record_id / records_per_page_;
-        size_t offset = record_id % records_per_page_;
+    Value getValue() {
+        switch (get<uint8_t>()) {
+        case 0: return get<int32_t>();
+        case 1: return get<int64_t>();
+        case 2: return get<float>();
+        case 3: return get<double>();
+        case 4: return getString();
+        case 5: return get<uint8_t>() != 0;
+        }
+        throw std::runtime_error("Invalid value tag in record");
+    }
 
-        auto page = buffer_manager_.fetchPage(data_file_, page_id);
-        writeValueToPage(*page, offset, value);
-        page->is_dirty = true;
+    bool atEnd() const { return pos_ == end_; }
 
-        // 更新索引
-        index_->insert(value, record_id);
+private:
+    const char* take(size_t size) {
+        if (static_cast<size_t>(end_ - pos_) < size) {
+            throw std::runtime_error("Truncated record");
+        }
+        const char* data = pos_;
+        pos_ += size;
+        return data;
+    }
+};
 
-        // 前幾筆記錄的除錯輸出
-        if (total_records_ < 5 || total_records_ % 10000 == 0) {
-            std::cout << "DEBUG: Appended record " << record_id << " to page " << page_id 
-                      << " in file " << data_file_ << std::endl;
-            
-            // 每隔一段時間強制刷新頁面
-            if (total_records_ % 1000 == 0) {
-                buffer_manager_.flushPage(data_file_, page_id);
-                std::cout << "DEBUG: Forced flush of page " << page_id << std::endl;
+// 頁表 - (file_id, page_id) -> frame_id 的開放定址雜湊表。
+// 容量在建構時固定，插入與刪除都不配置記憶體；刪除採用 backward-shift，不留墓碑。
+class PageTable {
+private:
+    static constexpr uint64_t EMPTY_KEY = std::numeric_limits<uint64_t>::max();
+
+    std::vector<uint64_t> keys_;
+    std::vector<FrameId> frames_;
+    size_t mask_;
+
+public:
+    static uint64_t hash(uint64_t key) {
+        // splitmix64 finalizer
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+        return key;
+    }
+
+    explicit PageTable(size_t max_entries) {
+        size_t capacity = 16;
+        while (capacity < max_entries * 2) capacity <<= 1;
+        keys_.assign(capacity, EMPTY_KEY);
+        frames_.assign(capacity, INVALID_FRAME_ID);
+        mask_ = capacity - 1;
+    }
+
+    static uint64_t makeKey(FileId file_id, PageId page_id) {
+        // 高 16 位元為檔案編號，低 48 位元為頁面編號
+        return (static_cast<uint64_t>(file_id) << 48) | (page_id & ((uint64_t(1) << 48) - 1));
+    }
+
+    FrameId find(uint64_t key) const {
+        for (size_t slot = hash(key) & mask_;; slot = (slot + 1) & mask_) {
+            if (keys_[slot] == key) return frames_[slot];
+            if (keys_[slot] == EMPTY_KEY) return INVALID_FRAME_ID;
+        }
+    }
+
+    void insert(uint64_t key, FrameId frame_id) {
+        size_t slot = hash(key) & mask_;
+        while (keys_[slot] != EMPTY_KEY && keys_[slot] != key) {
+            slot = (slot + 1) & mask_;
+        }
+        keys_[slot] = key;
+        frames_[slot] = frame_id;
+    }
+
+    void erase(uint64_t key) {
+        size_t slot = hash(key) & mask_;
+        while (keys_[slot] != key) {
+            if (keys_[slot] == EMPTY_KEY) return;
+            slot = (slot + 1) & mask_;
+        }
+
+        // 把後面探測鏈上的項目往前搬，維持線性探測的不變式
+        size_t hole = slot;
+        for (size_t next = (hole + 1) & mask_; keys_[next] != EMPTY_KEY; next = (next + 1) & mask_) {
+            size_t home = hash(keys_[next]) & mask_;
+            bool movable = (hole <= next) ? (home <= hole || home > next) : (home <= hole && home > next);
+            if (movable) {
+                keys_[hole] = keys_[next];
+                frames_[hole] = frames_[next];
+                hole = next;
             }
         }
+        keys_[hole] = EMPTY_KEY;
+        frames_[hole] = INVALID_FRAME_ID;
+    }
+};
 
-        total_records_++;
-        return record_id;
+// 頁面存取類型 - 循序掃描的存取不應把熱頁面擠出緩衝池
+enum class AccessType {
+    NORMAL,
+    SCAN
+};
+
+// 頁面替換策略種類
+enum class ReplacementPolicyType {
+    LRU,
+    CLOCK,
+    TWO_QUEUE  // 2Q：新頁面先進 A1in FIFO，再次被引用才進入 Am LRU
+};
+
+// 以頁框編號組成的侵入式雙向鏈結串列，不配置記憶體
+class FrameList {
+private:
+    std::vector<FrameId> prev_;
+    std::vector<FrameId> next_;
+    std::vector<bool> linked_;
+    FrameId head_;
+    FrameId tail_;
+    size_t size_;
+
+public:
+    explicit FrameList(size_t capacity)
+        : prev_(capacity, INVALID_FRAME_ID), next_(capacity, INVALID_FRAME_ID),
+        linked_(capacity, false), head_(INVALID_FRAME_ID), tail_(INVALID_FRAME_ID), size_(0) {
     }
 
-    Value get(RecordId record_id) const {
-        PageId page_id = record_id / records_per_page_;
-        size_t offset = record_id % records_per_page_;
+    FrameId head() const { return head_; }
+    FrameId tail() const { return tail_; }
+    FrameId prev(FrameId frame_id) const { return prev_[frame_id]; }
+    size_t size() const { return size_; }
+    bool contains(FrameId frame_id) const { return linked_[frame_id]; }
+
+    void pushFront(FrameId frame_id) {
+        prev_[frame_id] = INVALID_FRAME_ID;
+        next_[frame_id] = head_;
+        if (head_ != INVALID_FRAME_ID) prev_[head_] = frame_id;
+        head_ = frame_id;
+        if (tail_ == INVALID_FRAME_ID) tail_ = frame_id;
+        linked_[frame_id] = true;
+        size_++;
+    }
 
-        auto page = buffer_manager_.fetchPage(data_file_, page_id);
-        return readValueFromPage(*page, offset);
+    void pushBack(FrameId frame_id) {
+        next_[frame_id] = INVALID_FRAME_ID;
+        prev_[frame_id] = tail_;
+        if (tail_ != INVALID_FRAME_ID) next_[tail_] = frame_id;
+        tail_ = frame_id;
+        if (head_ == INVALID_FRAME_ID) head_ = frame_id;
+        linked_[frame_id] = true;
+        size_++;
     }
 
-    std::vector<RecordId> findRecords(const Value& value) {
-        return index_->search(value);
+    void unlink(FrameId frame_id) {
+        if (!linked_[frame_id]) return;
+        FrameId prev = prev_[frame_id];
+        FrameId next = next_[frame_id];
+        if (prev != INVALID_FRAME_ID) next_[prev] = next; else head_ = next;
+        if (next != INVALID_FRAME_ID) prev_[next] = prev; else tail_ = prev;
+        prev_[frame_id] = INVALID_FRAME_ID;
+        next_[frame_id] = INVALID_FRAME_ID;
+        linked_[frame_id] = false;
+        size_--;
     }
 
-    std::vector<RecordId> findRecordsInRange(const Value& start, const Value& end) {
-        return index_->rangeSearch(start, end);
+    void moveToFront(FrameId frame_id) {
+        if (frame_id == head_) return;
+        unlink(frame_id);
+        pushFront(frame_id);
     }
+};
 
-    // 聚合函式 - 針對大資料集優化
-    double sum() const {
-        double result = 0.0;
+// 頁面替換策略介面 - 只在頁框未被釘住（pin_count == 0）時才可能被選為淘汰對象
+class ReplacementPolicy {
+public:
+    virtual ~ReplacementPolicy() = default;
+
+    // 每次 fetch 時呼叫；is_new 表示頁面剛從磁碟載入到這個頁框
+    virtual void recordAccess(FrameId frame_id, uint64_t page_key, AccessType access, bool is_new) = 0;
+    virtual void setEvictable(FrameId frame_id, bool evictable) = 0;
+    // 選出並移除一個可淘汰的頁框；沒有可淘汰的頁框時回傳 INVALID_FRAME_ID
+    virtual FrameId evict() = 0;
+    // 依預計的淘汰順序列出至多 limit 個可淘汰頁框，不改變狀態；背景寫回用來挑選即將被淘汰的髒頁
+    virtual void peekVictims(size_t limit, std::vector<FrameId>& out) const = 0;
+    // 淘汰指定的可淘汰頁框（通常是 peekVictims 列出的頁框），效果與 evict() 選中它相同
+    virtual void remove(FrameId frame_id) = 0;
+    virtual const char* name() const = 0;
+};
 
-        // 分頁處理，避免記憶體溢出
-        for (PageId page_id = 0; page_id * records_per_page_ < total_records_; ++page_id) {
-            auto page = buffer_manager_.fetchPage(data_file_, page_id);
+// LRU：掃描載入的新頁面放在最冷端，最先被淘汰
+class LRUReplacer : public ReplacementPolicy {
+private:
+    FrameList lru_;  // head 為最近使用
+    std::vector<bool> evictable_;
 
-            size_t start_record = page_id * records_per_page_;
-            size_t end_record = std::min(start_record + records_per_page_, total_records_);
+public:
+    explicit LRUReplacer(size_t pool_size) : lru_(pool_size), evictable_(pool_size, false) {}
 
-            for (size_t i = start_record; i < end_record; ++i) {
-                Value val = readValueFromPage(*page, i - start_record);
-                result += getNumericValue(val);
+    void recordAccess(FrameId frame_id, uint64_t, AccessType access, bool is_new) override {
+        if (is_new) {
+            if (access == AccessType::SCAN) lru_.pushBack(frame_id);
+            else lru_.pushFront(frame_id);
+        }
+        else if (access == AccessType::NORMAL) {
+            lru_.moveToFront(frame_id);
+        }
+    }
+
+    void setEvictable(FrameId frame_id, bool evictable) override {
+        evictable_[frame_id] = evictable;
+    }
+
+    FrameId evict() override {
+        for (FrameId frame_id = lru_.tail(); frame_id != INVALID_FRAME_ID; frame_id = lru_.prev(frame_id)) {
+            if (evictable_[frame_id]) {
+                lru_.unlink(frame_id);
+                evictable_[frame_id] = false;
+                return frame_id;
             }
         }
+        return INVALID_FRAME_ID;
+    }
 
-        return result;
+    void peekVictims(size_t limit, std::vector<FrameId>& out) const override {
+        for (FrameId frame_id = lru_.tail(); frame_id != INVALID_FRAME_ID && limit > 0; frame_id = lru_.prev(frame_id)) {
+            if (evictable_[frame_id]) {
+                out.push_back(frame_id);
+                limit--;
+            }
+        }
     }
 
-    double average() const {
-        if (total_records_ == 0) return 0.0;
-        return sum() / total_records_;
+    void remove(FrameId frame_id) override {
+        lru_.unlink(frame_id);
+        evictable_[frame_id] = false;
     }
 
-    size_t size() const { return total_records_; }
-    const std::string& getName() const { return name_; }
-    DataType getType() const { return type_; }
+    const char* name() const override { return "LRU"; }
+};
 
+// CLOCK：每個頁框一個參考位元；掃描存取不設定參考位元
+class ClockReplacer : public ReplacementPolicy {
 private:
-    size_t getRecordSize(DataType type) const {
-        switch (type) {
-        case DataType::INT32: return sizeof(int32_t);
-        case DataType::INT64: return sizeof(int64_t);
-        case DataType::FLOAT: return sizeof(float);
-        case DataType::DOUBLE: return sizeof(double);
-        case DataType::STRING: return 256;  // 固定長度字串
-        case DataType::BOOL: return sizeof(bool);
+    std::vector<bool> resident_;
+    std::vector<bool> referenced_;
+    std::vector<bool> evictable_;
+    size_t hand_;
+
+public:
+    explicit ClockReplacer(size_t pool_size)
+        : resident_(pool_size, false), referenced_(pool_size, false),
+        evictable_(pool_size, false), hand_(0) {
+    }
+
+    void recordAccess(FrameId frame_id, uint64_t, AccessType access, bool is_new) override {
+        resident_[frame_id] = true;
+        if (access == AccessType::NORMAL) referenced_[frame_id] = true;
+        else if (is_new) referenced_[frame_id] = false;
+    }
+
+    void setEvictable(FrameId frame_id, bool evictable) override {
+        evictable_[frame_id] = evictable;
+    }
+
+    FrameId evict() override {
+        const size_t n = resident_.size();
+        // 最多轉兩圈：第一圈清除參考位元，第二圈必定找到（若存在可淘汰頁框）
+        for (size_t step = 0; step < 2 * n; ++step) {
+            FrameId frame_id = static_cast<FrameId>(hand_);
+            hand_ = (hand_ + 1) % n;
+            if (!resident_[frame_id] || !evictable_[frame_id]) continue;
+            if (referenced_[frame_id]) {
+                referenced_[frame_id] = false;
+                continue;
+            }
+            resident_[frame_id] = false;
+            evictable_[frame_id] = false;
+            return frame_id;
+        }
+        return INVALID_FRAME_ID;
+    }
+
+    // 從指針位置起，先列未設定參考位元的頁框，再列會在第二圈被淘汰的頁框
+    void peekVictims(size_t limit, std::vector<FrameId>& out) const override {
+        const size_t n = resident_.size();
+        for (int round = 0; round < 2; ++round) {
+            for (size_t step = 0; step < n && limit > 0; ++step) {
+                FrameId frame_id = static_cast<FrameId>((hand_ + step) % n);
+                if (!resident_[frame_id] || !evictable_[frame_id]) continue;
+                if (referenced_[frame_id] != (round == 1)) continue;
+                out.push_back(frame_id);
+                limit--;
+            }
         }
-        return 8;  // 預設大小
     }
 
-    void writeValueToPage(Page& page, size_t offset, const Value& value) {
-        size_t record_size = getRecordSize(type_);
-        char* data_ptr = page.data.data() + offset * record_size;
+    void remove(FrameId frame_id) override {
+        resident_[frame_id] = false;
+        evictable_[frame_id] = false;
+    }
 
-        switch (type_) {
-        case DataType::INT32: {
-            int32_t val = std::get<int32_t>(value);
-            std::memcpy(data_ptr, &val, sizeof(int32_t));
-            break;
+    const char* name() const override { return "CLOCK"; }
+};
+
+// 2Q：新頁面進入 A1in（FIFO），從 A1in 淘汰的頁面記錄在 A1out 幽靈佇列；
+// 幽靈佇列中的頁面再次被正常存取時直接進入 Am（LRU）。掃描存取永遠不會進入 Am，
+// 且掃描載入的頁面排在 A1in 出口端。
+class TwoQueueReplacer : public ReplacementPolicy {
+private:
+    FrameList a1in_;
+    FrameList am_;
+    std::vector<bool> evictable_;
+    std::vector<uint64_t> frame_keys_;
+    size_t a1in_target_;
+
+    // A1out：只記錄頁面鍵的環狀佇列；ghost_index_ 的值為該鍵在環中的位置
+    std::vector<uint64_t> ghost_ring_;
+    size_t ghost_next_;
+    PageTable ghost_index_;
+
+public:
+    explicit TwoQueueReplacer(size_t pool_size)
+        : a1in_(pool_size), am_(pool_size), evictable_(pool_size, false),
+        frame_keys_(pool_size, 0), a1in_target_(std::max<size_t>(1, pool_size / 4)),
+        ghost_ring_(std::max<size_t>(1, pool_size / 2), std::numeric_limits<uint64_t>::max()),
+        ghost_next_(0), ghost_index_(std::max<size_t>(1, pool_size / 2)) {
+    }
+
+    void recordAccess(FrameId frame_id, uint64_t page_key, AccessType access, bool is_new) override {
+        if (is_new) {
+            frame_keys_[frame_id] = page_key;
+            FrameId ghost_slot = ghost_index_.find(page_key);
+            if (access == AccessType::NORMAL && ghost_slot != INVALID_FRAME_ID) {
+                ghost_index_.erase(page_key);
+                ghost_ring_[ghost_slot] = std::numeric_limits<uint64_t>::max();
+                am_.pushFront(frame_id);
+            }
+            else if (access == AccessType::SCAN) {
+                // 掃描頁面放在 A1in 的出口端，先於其他新頁面被淘汰
+                a1in_.pushBack(frame_id);
+            }
+            else {
+                a1in_.pushFront(frame_id);
+            }
         }
-        case DataType::INT64: {
-            int64_t val = std::get<int64_t>(value);
-            std::memcpy(data_ptr, &val, sizeof(int64_t));
-            break;
+        else if (access == AccessType::NORMAL && am_.contains(frame_id)) {
+            am_.moveToFront(frame_id);
         }
-        case DataType::FLOAT: {
-            float val = std::get<float>(value);
-            std::memcpy(data_ptr, &val, sizeof(float));
-            break;
+        // A1in 內的命中視為相關引用，不提升
+    }
+
+    void setEvictable(FrameId frame_id, bool evictable) override {
+        evictable_[frame_id] = evictable;
+    }
+
+    FrameId evict() override {
+        FrameId frame_id = INVALID_FRAME_ID;
+        if (a1in_.size() > a1in_target_ || am_.size() == 0) {
+            frame_id = evictFrom(a1in_, true);
         }
-        case DataType::DOUBLE: {
-            double val = std::get<double>(value);
-            std::memcpy(data_ptr, &val, sizeof(double));
-            break;
+        if (frame_id == INVALID_FRAME_ID) frame_id = evictFrom(am_, false);
+        if (frame_id == INVALID_FRAME_ID) frame_id = evictFrom(a1in_, true);
+        return frame_id;
+    }
+
+    void peekVictims(size_t limit, std::vector<FrameId>& out) const override {
+        if (a1in_.size() > a1in_target_ || am_.size() == 0) {
+            limit = peekFrom(a1in_, limit, out);
+            peekFrom(am_, limit, out);
         }
-        case DataType::STRING: {
-            std::string val = std::get<std::string>(value);
-            val.resize(255);  // 確保不超過固定長度
-            std::memcpy(data_ptr, val.c_str(), 256);
-            break;
+        else {
+            limit = peekFrom(am_, limit, out);
+            peekFrom(a1in_, limit, out);
         }
-        case DataType::BOOL: {
-            bool val = std::get<bool>(value);
-            std::memcpy(data_ptr, &val, sizeof(bool));
-            break;
+    }
+
+    void remove(FrameId frame_id) override {
+        if (a1in_.contains(frame_id)) {
+            a1in_.unlink(frame_id);
+            rememberGhost(frame_keys_[frame_id]);
+        }
+        else {
+            am_.unlink(frame_id);
+        }
+        evictable_[frame_id] = false;
+    }
+
+    const char* name() const override { return "2Q"; }
+
+private:
+    size_t peekFrom(const FrameList& list, size_t limit, std::vector<FrameId>& out) const {
+        for (FrameId frame_id = list.tail(); frame_id != INVALID_FRAME_ID && limit > 0; frame_id = list.prev(frame_id)) {
+            if (evictable_[frame_id]) {
+                out.push_back(frame_id);
+                limit--;
+            }
+        }
+        return limit;
+    }
+
+    FrameId evictFrom(FrameList& list, bool remember) {
+        for (FrameId frame_id = list.tail(); frame_id != INVALID_FRAME_ID; frame_id = list.prev(frame_id)) {
+            if (!evictable_[frame_id]) continue;
+            list.unlink(frame_id);
+            evictable_[frame_id] = false;
+            if (remember) rememberGhost(frame_keys_[frame_id]);
+            return frame_id;
+        }
+        return INVALID_FRAME_ID;
+    }
+
+    void rememberGhost(uint64_t page_key) {
+        uint64_t old_key = ghost_ring_[ghost_next_];
+        if (old_key != std::numeric_limits<uint64_t>::max() && ghost_index_.find(old_key) == ghost_next_) {
+            ghost_index_.erase(old_key);
+        }
+        if (ghost_index_.find(page_key) != INVALID_FRAME_ID) {
+            ghost_index_.erase(page_key);
+        }
+        ghost_ring_[ghost_next_] = page_key;
+        ghost_index_.insert(page_key, static_cast<FrameId>(ghost_next_));
+        ghost_next_ = (ghost_next_ + 1) % ghost_ring_.size();
+    }
+};
+
+inline std::unique_ptr<ReplacementPolicy> makeReplacementPolicy(ReplacementPolicyType type, size_t pool_size) {
+    switch (type) {
+    case ReplacementPolicyType::LRU: return std::make_unique<LRUReplacer>(pool_size);
+    case ReplacementPolicyType::CLOCK: return std::make_unique<ClockReplacer>(pool_size);
+    case ReplacementPolicyType::TWO_QUEUE: return std::make_unique<TwoQueueReplacer>(pool_size);
+    }
+    return std::make_unique<LRUReplacer>(pool_size);
+}
+
+class BufferPoolManager;
+
+// 頁面閂鎖模式
+enum class LatchMode {
+    NONE,
+    SHARED,
+    EXCLUSIVE
+};
+
+// 頁面守衛 - 持有期間頁框保持釘住狀態，可選擇性持有頁面閂鎖；解構時先釋放閂鎖再 unpin
+class PageGuard {
+private:
+    BufferPoolManager* buffer_manager_;
+    Page* page_;
+    LatchMode latch_;
+
+public:
+    PageGuard() : buffer_manager_(nullptr), page_(nullptr), latch_(LatchMode::NONE) {}
+    PageGuard(BufferPoolManager* buffer_manager, Page* page)
+        : buffer_manager_(buffer_manager), page_(page), latch_(LatchMode::NONE) {
+    }
+    PageGuard(const PageGuard&) = delete;
+    PageGuard& operator=(const PageGuard&) = delete;
+    PageGuard(PageGuard&& other) noexcept
+        : buffer_manager_(other.buffer_manager_), page_(other.page_), latch_(other.latch_) {
+        other.page_ = nullptr;
+        other.latch_ = LatchMode::NONE;
+    }
+    PageGuard& operator=(PageGuard&& other) noexcept {
+        if (this != &other) {
+            release();
+            buffer_manager_ = other.buffer_manager_;
+            page_ = other.page_;
+            latch_ = other.latch_;
+            other.page_ = nullptr;
+            other.latch_ = LatchMode::NONE;
+        }
+        return *this;
+    }
+    ~PageGuard() { release(); }
+
+    Page* operator->() const { return page_; }
+    Page& operator*() const { return *page_; }
+    explicit operator bool() const { return page_ != nullptr; }
+    LatchMode latchMode() const { return latch_; }
+
+    void lockShared() {
+        page_->latch.lock_shared();
+        latch_ = LatchMode::SHARED;
+    }
+
+    bool tryLockShared() {
+        if (!page_->latch.try_lock_shared()) return false;
+        latch_ = LatchMode::SHARED;
+        return true;
+    }
+
+    void lockExclusive() {
+        page_->latch.lock();
+        latch_ = LatchMode::EXCLUSIVE;
+    }
+
+    void unlock() {
+        if (latch_ == LatchMode::SHARED) page_->latch.unlock_shared();
+        else if (latch_ == LatchMode::EXCLUSIVE) page_->latch.unlock();
+        latch_ = LatchMode::NONE;
+    }
+
+    inline void release();
+};
+
+// 背景寫回的調整參數；比例都以分片的頁框數為基準
+struct BackgroundWriterConfig {
+    bool enabled = true;
+    double free_frame_ratio = 0.10;     // 每個分片預先淘汰乾淨頁面、保持空閒的頁框比例
+    double dirty_high_ratio = 0.30;     // 髒頁比例超過時開始寫回
+    double dirty_low_ratio = 0.10;      // 寫回到此比例為止
+    std::chrono::milliseconds interval{ 100 };  // 定期檢查間隔；前景淘汰寫回髒頁時會提早喚醒
+};
+
+// 緩衝池管理器 - 可替換的頁面替換策略（預設 LRU）與 pin/unpin 語意
+// 所有頁框在建構時一次配置（按 PAGE_SIZE 對齊），命中與未命中路徑上都沒有記憶體配置或字串雜湊。
+// 被釘住的頁框永遠不會被淘汰。
+// 頁面依 (file_id, page_id) 的雜湊分配到各分片，每個分片有自己的互斥鎖、頁表與替換策略，
+// 不同分片上的 fetch 互不阻塞；頁面內容另由每個頁框的閂鎖保護。
+// 分片鎖只保護頁表與頁框的配置，磁碟 I/O 都在鎖外進行：未命中時頁框先以 io_pending 狀態放入頁表並釘住，
+// 放開分片鎖後才讀取；預讀也是如此。命中 io_pending 頁框的 fetch 會等待讀取完成。
+// 淘汰時只剩髒頁可選，則釘住該頁、放開分片鎖寫回後再重新淘汰。
+// 背景寫回執行緒讓各分片淘汰端的頁框保持乾淨，前景的 fetch 未命中時幾乎不需要寫回髒頁。
+class BufferPoolManager {
+private:
+    struct AlignedDeleter {
+        void operator()(char* ptr) const {
+            ::operator delete[](ptr, std::align_val_t(PAGE_SIZE));
+        }
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        Page* frames;
+        size_t frame_count;
+        std::vector<bool> frame_in_use;
+        PageTable page_table;
+        std::vector<FrameId> free_frames;
+        std::unique_ptr<ReplacementPolicy> replacer;
+        size_t prefetching = 0;  // 預讀中（被釘住）的頁框數
+        size_t resident = 0;
+        size_t free_target = 0;  // 背景寫回保持的空閒頁框數
+        std::vector<FrameId> victims;  // peekVictims 的暫存，由 mutex 保護
+
+        Shard(Page* shard_frames, size_t count, ReplacementPolicyType policy)
+            : frames(shard_frames), frame_count(count), frame_in_use(count, false),
+            page_table(count), replacer(makeReplacementPolicy(policy, count)) {
+            free_frames.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                free_frames.push_back(static_cast<FrameId>(count - 1 - i));
+            }
+        }
+    };
+
+    // 頁框大小類別：同一類別的頁框大小相同，佔 frames_ 中連續的一段與 shards_ 中連續的分片
+    struct SizeClass {
+        size_t page_size;
+        size_t frame_count;
+        std::unique_ptr<char[], AlignedDeleter> memory;
+        size_t first_shard;
+        size_t shard_count;
+    };
+
+    size_t pool_size_;
+    std::vector<SizeClass> classes_;  // classes_[0] 的頁框大小為 PAGE_SIZE
+    std::unique_ptr<Page[]> frames_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<size_t> resident_pages_;
+    std::atomic<size_t> prefetched_pages_;
+
+    // 每個頁框一個非同步請求，預讀時不需配置記憶體
+    std::unique_ptr<AsyncPageIo[]> frame_io_;
+    std::mutex io_mutex_;
+    std::condition_variable io_cv_;
+    size_t prefetches_in_flight_ = 0;  // 由 io_mutex_ 保護
+
+    DiskManager& disk_manager_;
+
+    // 背景寫回
+    std::mutex writer_mutex_;
+    std::condition_variable writer_cv_;
+    BackgroundWriterConfig writer_config_;  // 由 writer_mutex_ 保護
+    bool writer_stopping_ = false;
+    std::atomic<bool> writer_wakeup_{ false };
+    std::atomic<size_t> background_writes_{ 0 };
+    std::atomic<size_t> foreground_writes_{ 0 };
+    std::thread writer_;
+
+public:
+    struct FrameClass {
+        size_t page_size;
+        size_t frame_count;
+    };
+
+    // pool_size 為 PAGE_SIZE 頁框數（索引、尾端頁、字串堆積）；extent_classes 另外配置較大的頁框，
+    // 供以 registerFile(name, page_size) 指定頁面大小的檔案使用（預設為欄位資料檔的 extent）
+    BufferPoolManager(DiskManager& disk_manager, size_t pool_size = BUFFER_POOL_SIZE,
+        ReplacementPolicyType policy = ReplacementPolicyType::LRU,
+        size_t shard_count = BUFFER_POOL_SHARDS,
+        const std::vector<FrameClass>& extent_classes = { { COLUMN_EXTENT_SIZE, EXTENT_POOL_SIZE } })
+        : pool_size_(0), resident_pages_(0), prefetched_pages_(0), disk_manager_(disk_manager) {
+        std::vector<FrameClass> layout{ { PAGE_SIZE, pool_size } };
+        for (const FrameClass& extra : extent_classes) {
+            if (extra.frame_count == 0) continue;
+            DiskManager::checkPageSize(extra.page_size);
+            for (const FrameClass& existing : layout) {
+                if (existing.page_size == extra.page_size) {
+                    throw std::runtime_error("Duplicate buffer pool frame class " + std::to_string(extra.page_size));
+                }
+            }
+            layout.push_back(extra);
+        }
+        for (const FrameClass& frame_class : layout) pool_size_ += frame_class.frame_count;
+        frames_.reset(new Page[pool_size_]);
+        frame_io_.reset(new AsyncPageIo[pool_size_]);
+
+        size_t first_frame = 0;
+        for (const FrameClass& frame_class : layout) {
+            SizeClass size_class{ frame_class.page_size, frame_class.frame_count,
+                std::unique_ptr<char[], AlignedDeleter>(static_cast<char*>(::operator new[](
+                    frame_class.frame_count * frame_class.page_size, std::align_val_t(PAGE_SIZE)))),
+                shards_.size(), 0 };
+            for (size_t i = 0; i < frame_class.frame_count; ++i) {
+                Page& page = frames_[first_frame + i];
+                page.data = size_class.memory.get() + i * frame_class.page_size;
+                page.size = frame_class.page_size;
+            }
+
+            // 每個分片至少 32 個頁框，避免分片太小時替換效果變差
+            size_class.shard_count = std::max<size_t>(1, std::min(shard_count, frame_class.frame_count / 32));
+            size_t first = first_frame;
+            for (size_t i = 0; i < size_class.shard_count; ++i) {
+                size_t count = frame_class.frame_count / size_class.shard_count +
+                    (i < frame_class.frame_count % size_class.shard_count ? 1 : 0);
+                shards_.push_back(std::make_unique<Shard>(frames_.get() + first, count, policy));
+                first += count;
+            }
+            first_frame += frame_class.frame_count;
+            classes_.push_back(std::move(size_class));
+        }
+        setWriterConfig(writer_config_);
+        writer_ = std::thread([this] { writerLoop(); });
+    }
+
+    // 在途的預讀完成時會存取頁框與分片，必須先等待
+    ~BufferPoolManager() {
+        {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            writer_stopping_ = true;
+        }
+        writer_cv_.notify_all();
+        writer_.join();
+
+        std::unique_lock<std::mutex> lock(io_mutex_);
+        io_cv_.wait(lock, [this] { return prefetches_in_flight_ == 0; });
+    }
+
+    void setWriterConfig(const BackgroundWriterConfig& config) {
+        if (config.free_frame_ratio < 0 || config.free_frame_ratio > 0.5 ||
+            config.dirty_low_ratio < 0 || config.dirty_low_ratio > config.dirty_high_ratio ||
+            config.dirty_high_ratio > 1 || config.interval.count() <= 0) {
+            throw std::runtime_error("Invalid background writer configuration");
+        }
+        {
+            std::lock_guard<std::mutex> lock(writer_mutex_);
+            writer_config_ = config;
+        }
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard->mutex);
+            shard->free_target = config.enabled ? static_cast<size_t>(shard->frame_count * config.free_frame_ratio) : 0;
+        }
+        writer_cv_.notify_all();
+    }
+
+    BackgroundWriterConfig getWriterConfig() {
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        return writer_config_;
+    }
+
+    // page_size 必須是已配置的頁框大小類別之一
+    FileId registerFile(const std::string& filename, size_t page_size = PAGE_SIZE) {
+        DiskManager::checkPageSize(page_size);
+        if (!findClass(page_size)) {
+            throw std::runtime_error("No buffer pool frames of " + std::to_string(page_size) +
+                " bytes for file " + filename);
+        }
+        return disk_manager_.registerFile(filename, page_size);
+    }
+
+    // 取得並釘住頁面；回傳的守衛解構時自動 unpin
+    PageGuard fetchPage(FileId file_id, PageId page_id, AccessType access = AccessType::NORMAL) {
+        uint64_t key = PageTable::makeKey(file_id, page_id);
+        Shard& shard = shardFor(file_id, key);
+        Page* hit;
+        while (true) {
+            PageGuard dirty_victim;  // 在 lock 之前宣告：必須在放開分片鎖之後才 unpin
+            std::unique_lock<std::mutex> lock(shard.mutex);
+
+            FrameId frame_id = shard.page_table.find(key);
+            if (frame_id != INVALID_FRAME_ID) {
+                hit = &shard.frames[frame_id];
+                if (hit->pin_count++ == 0) shard.replacer->setEvictable(frame_id, false);
+                shard.replacer->recordAccess(frame_id, key, access, false);
+                bumpCounter(metrics().file(file_id).hits);
+                break;
+            }
+
+            // 頁面不在緩衝池中，取得空閒頁框；沒有則淘汰頁面。
+            // 只剩髒頁可淘汰時在鎖外寫回，之後重新查詢：其他執行緒可能已在這段期間載入同一頁
+            if (shard.free_frames.empty() && !tryEvictPage(shard, &dirty_victim)) {
+                if (!dirty_victim) throw std::runtime_error("Buffer pool exhausted: all frames are pinned");
+                lock.unlock();
+                writeBackVictim(dirty_victim);
+                continue;
+            }
+            bumpCounter(metrics().file(file_id).misses);
+            frame_id = shard.free_frames.back();
+            shard.free_frames.pop_back();
+            if (shard.free_frames.size() < shard.free_target / 2) wakeWriter();
+
+            Page& page = shard.frames[frame_id];
+            page.file_id = file_id;
+            page.page_id = page_id;
+            page.pin_count = 1;
+            // 新頁面開始時不標記為髒頁，只有真正修改時才標記
+            page.is_dirty = false;
+            page.io_pending.store(true, std::memory_order_relaxed);
+
+            shard.page_table.insert(key, frame_id);
+            shard.frame_in_use[frame_id] = true;
+            shard.replacer->recordAccess(frame_id, key, access, true);
+            shard.resident++;
+            resident_pages_++;
+            lock.unlock();
+
+            // 讀取期間同一分片的其他 fetch 不受阻塞；同一頁的 fetch 命中 io_pending 頁框並等待
+            disk_manager_.readPage(file_id, page_id, page.data);
+            {
+                std::lock_guard<std::mutex> io_lock(io_mutex_);
+                page.io_pending.store(false, std::memory_order_release);
+            }
+            io_cv_.notify_all();
+            return PageGuard(this, &page);
+        }
+
+        // 命中仍在讀取中的頁框時，等待讀取完成（不持有分片鎖）
+        if (hit->io_pending.load(std::memory_order_acquire)) waitForIo(*hit);
+        return PageGuard(this, hit);
+    }
+
+    // 非同步預讀 [first, first + count) 中不在緩衝池的頁面，不等待完成，回傳提交的頁數。
+    // 頁框先以 io_pending 狀態放入頁表並釘住，讀取完成後才 unpin；
+    // 每個分片最多四分之一的頁框用於預讀，沒有空閒或可淘汰的頁框時提前停止，
+    // 預讀不會讓一般的 fetch 因頁框全被釘住而失敗
+    size_t prefetchPages(FileId file_id, PageId first, size_t count, AccessType access = AccessType::SCAN) {
+        AsyncPageIo* batch[AsyncIoEngine::QUEUE_DEPTH];
+        count = std::min<size_t>(count, AsyncIoEngine::QUEUE_DEPTH);
+        size_t issued = 0;
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t key = PageTable::makeKey(file_id, first + i);
+            Shard& shard = shardFor(file_id, key);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if (shard.page_table.find(key) != INVALID_FRAME_ID) continue;
+            if (shard.prefetching >= shard.frame_count / 4) continue;
+            if (shard.free_frames.empty() && !tryEvictPage(shard, nullptr)) break;
+
+            FrameId frame_id = shard.free_frames.back();
+            shard.free_frames.pop_back();
+            Page& page = shard.frames[frame_id];
+            page.file_id = file_id;
+            page.page_id = first + i;
+            page.pin_count = 1;
+            page.is_dirty = false;
+            page.io_pending.store(true, std::memory_order_relaxed);
+            shard.prefetching++;
+
+            shard.page_table.insert(key, frame_id);
+            shard.frame_in_use[frame_id] = true;
+            shard.replacer->recordAccess(frame_id, key, access, true);
+            shard.resident++;
+            resident_pages_++;
+
+            AsyncPageIo& io = frame_io_[&page - frames_.get()];
+            io.file_id = file_id;
+            io.page_id = page.page_id;
+            io.data = page.data;
+            io.write = false;
+            io.on_complete = &BufferPoolManager::prefetchCompleted;
+            io.context = this;
+            batch[issued++] = &io;
+        }
+        if (issued == 0) return 0;
+
+        {
+            std::lock_guard<std::mutex> lock(io_mutex_);
+            prefetches_in_flight_ += issued;
+        }
+        prefetched_pages_.fetch_add(issued, std::memory_order_relaxed);
+        // 提交時不持有分片鎖：完成回呼需要分片鎖才能 unpin
+        disk_manager_.submitAsync(batch, issued);
+        return issued;
+    }
+
+    // 不經過頁框，直接取得唯讀映射中的頁面；只適用於已寫回磁碟且不再修改的頁面。
+    // 未啟用映射或無法映射時回傳 nullptr，呼叫端應改用 fetchPageRead
+    const char* mapPage(FileId file_id, PageId page_id, AccessType access = AccessType::NORMAL) {
+        return disk_manager_.mapPage(file_id, page_id, access == AccessType::SCAN);
+    }
+
+    // 取得頁面並持有共享閂鎖（讀取用）
+    PageGuard fetchPageRead(FileId file_id, PageId page_id, AccessType access = AccessType::NORMAL) {
+        PageGuard guard = fetchPage(file_id, page_id, access);
+        guard.lockShared();
+        return guard;
+    }
+
+    // 取得頁面並持有獨占閂鎖（修改用）
+    PageGuard fetchPageWrite(FileId file_id, PageId page_id, AccessType access = AccessType::NORMAL) {
+        PageGuard guard = fetchPage(file_id, page_id, access);
+        guard.lockExclusive();
+        return guard;
+    }
+
+    void unpinPage(Page* page) {
+        Shard& shard = shardOf(*page);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (page->pin_count == 0) {
+            DATABASEAPP_LOG(LogLevel::ERR, "Unpinning page " << page->page_id << " which is not pinned");
+            return;
+        }
+        if (--page->pin_count == 0) {
+            shard.replacer->setEvictable(static_cast<FrameId>(page - shard.frames), true);
+        }
+    }
+
+    void flushPage(FileId file_id, PageId page_id) {
+        uint64_t key = PageTable::makeKey(file_id, page_id);
+        Shard& shard = shardFor(file_id, key);
+        PageGuard guard;
+        {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            FrameId frame_id = shard.page_table.find(key);
+            if (frame_id == INVALID_FRAME_ID) return;
+            guard = pinFrame(shard, frame_id);
+        }
+        flushPinned(guard);
+    }
+
+    // 寫回所有髒頁：每批最多 QUEUE_DEPTH 頁，依頁號排序後持有共享閂鎖一起提交並等待完成。
+    // 同時持有多個閂鎖時不能等待（可能與依父子順序加鎖的寫入者死結），
+    // 取不到閂鎖的頁面留到批次之後個別寫回
+    void flushAllPages() {
+        for (auto& shard_ptr : shards_) {
+            Shard& shard = *shard_ptr;
+            std::vector<PageGuard> dirty;
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                for (FrameId frame_id = 0; frame_id < shard.frame_count; ++frame_id) {
+                    if (shard.frame_in_use[frame_id] && shard.frames[frame_id].is_dirty) {
+                        dirty.push_back(pinFrame(shard, frame_id));
+                    }
+                }
+            }
+            sortByPage(dirty);
+            flushBatched(dirty);
+        }
+    }
+
+    // 背景寫回：每個分片空閒頁框不足 free_target 時，先寫回淘汰端接下來的髒頁，
+    // 再把淘汰端的乾淨頁面移到空閒清單，前景未命中直接取用空閒頁框，不需要淘汰與寫回。
+    // 髒頁比例超過 dirty_high_ratio 時另外依淘汰順序寫回到 dirty_low_ratio。
+    // 所有分片收集到的頁面依 (FileId, PageId) 排序後分批寫回，相鄰頁面在同一批中依序送出。
+    // 每輪每個分片最多釘住四分之一的頁框，還有剩餘時再做下一輪。
+    // 回傳寫回的頁數；背景執行緒定期呼叫，也可以直接呼叫
+    size_t writeBackDirtyPages(const BackgroundWriterConfig& config) {
+        constexpr int MAX_ROUNDS = 8;
+        size_t written = 0;
+        for (int round = 0; round < MAX_ROUNDS; ++round) {
+            bool more = false;
+            size_t round_written = writeBackRound(config, more);
+            written += round_written;
+            if (!more || round_written == 0) break;
+        }
+        refillFreeFrames();
+        background_writes_.fetch_add(written, std::memory_order_relaxed);
+        return written;
+    }
+
+    struct FrameClassStats {
+        size_t page_size;
+        size_t frames;
+        size_t resident;
+    };
+
+    std::vector<FrameClassStats> getFrameClassStats() {
+        std::vector<FrameClassStats> stats;
+        for (const SizeClass& size_class : classes_) {
+            FrameClassStats entry{ size_class.page_size, size_class.frame_count, 0 };
+            for (size_t i = 0; i < size_class.shard_count; ++i) {
+                Shard& shard = *shards_[size_class.first_shard + i];
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                entry.resident += shard.resident;
+            }
+            stats.push_back(entry);
+        }
+        return stats;
+    }
+
+    size_t getPoolSize() const { return pool_size_; }
+    size_t getResidentPages() const { return resident_pages_.load(); }
+    size_t getPrefetchedPages() const { return prefetched_pages_.load(std::memory_order_relaxed); }
+    size_t getBackgroundWrites() const { return background_writes_.load(std::memory_order_relaxed); }
+    size_t getForegroundWrites() const { return foreground_writes_.load(std::memory_order_relaxed); }
+    size_t getShardCount() const { return shards_.size(); }
+    const char* getPolicyName() const { return shards_.front()->replacer->name(); }
+
+    // 緩衝池、磁碟 I/O 與索引共用的計量，屬於 DiskManager
+    EngineMetrics& metrics() { return disk_manager_.metrics(); }
+
+private:
+    const SizeClass* findClass(size_t page_size) const {
+        for (const SizeClass& size_class : classes_) {
+            if (size_class.page_size == page_size) return &size_class;
+        }
+        return nullptr;
+    }
+
+    Shard& shardIn(const SizeClass& size_class, uint64_t key) {
+        // 頁表使用雜湊的低位元定位槽位，分片改用高位元，避免兩者相關
+        return *shards_[size_class.first_shard + (PageTable::hash(key) >> 40) % size_class.shard_count];
+    }
+
+    Shard& shardFor(FileId file_id, uint64_t key) {
+        return shardIn(*findClass(disk_manager_.getPageSize(file_id)), key);
+    }
+
+    Shard& shardOf(const Page& page) {
+        return shardIn(*findClass(page.size), PageTable::makeKey(page.file_id, page.page_id));
+    }
+
+    // 呼叫者須持有分片鎖
+    PageGuard pinFrame(Shard& shard, FrameId frame_id) {
+        Page& page = shard.frames[frame_id];
+        if (page.pin_count++ == 0) shard.replacer->setEvictable(frame_id, false);
+        return PageGuard(this, &page);
+    }
+
+    // 寫回已釘住的頁面；持有共享閂鎖，避免與修改中的寫入者交錯
+    bool flushPinned(PageGuard& guard) {
+        std::shared_lock<std::shared_mutex> latch(guard->latch);
+        if (!guard->is_dirty) return false;
+        disk_manager_.writePage(guard->file_id, guard->page_id, guard->data);
+        guard->is_dirty = false;
+        bumpCounter(metrics().file(guard->file_id).dirty_writes);
+        return true;
+    }
+
+    static void sortByPage(std::vector<PageGuard>& pages) {
+        std::sort(pages.begin(), pages.end(), [](const PageGuard& a, const PageGuard& b) {
+            return a->file_id != b->file_id ? a->file_id < b->file_id : a->page_id < b->page_id;
+        });
+    }
+
+    // 回傳寫回的頁數
+    size_t flushBatched(std::vector<PageGuard>& dirty) {
+        size_t written = 0;
+        std::vector<AsyncPageIo> batch;
+        std::vector<PageGuard*> batched;
+        std::vector<PageGuard*> contended;
+        batch.reserve(AsyncIoEngine::QUEUE_DEPTH);
+        for (size_t first = 0; first < dirty.size(); first += AsyncIoEngine::QUEUE_DEPTH) {
+            size_t last = std::min(dirty.size(), first + AsyncIoEngine::QUEUE_DEPTH);
+            batch.clear();
+            batched.clear();
+            for (size_t i = first; i < last; ++i) {
+                PageGuard& guard = dirty[i];
+                if (!guard.tryLockShared()) {
+                    contended.push_back(&guard);
+                    continue;
+                }
+                if (!guard->is_dirty) continue;
+                AsyncPageIo io;
+                io.file_id = guard->file_id;
+                io.page_id = guard->page_id;
+                io.data = guard->data;
+                io.write = true;
+                batch.push_back(io);
+                batched.push_back(&guard);
+            }
+            if (disk_manager_.transferPages(batch.data(), batch.size())) {
+                EngineMetrics::ThreadMetrics& local = metrics().local();
+                for (PageGuard* guard : batched) {
+                    (*guard)->is_dirty = false;
+                    bumpCounter(local.file((*guard)->file_id).dirty_writes);
+                }
+                written += batched.size();
+            }
+            for (size_t i = first; i < last; ++i) dirty[i].unlock();
+        }
+        for (PageGuard* guard : contended) {
+            if (flushPinned(*guard)) written++;
+        }
+        return written;
+    }
+
+    // writeBackDirtyPages 的一輪；有分片達到釘住上限時設定 more
+    size_t writeBackRound(const BackgroundWriterConfig& config, bool& more) {
+        std::vector<PageGuard> dirty;
+        for (auto& shard_ptr : shards_) {
+            Shard& shard = *shard_ptr;
+            const size_t high = static_cast<size_t>(shard.frame_count * config.dirty_high_ratio);
+            const size_t low = static_cast<size_t>(shard.frame_count * config.dirty_low_ratio);
+
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            size_t dirty_count = 0;
+            for (FrameId frame_id = 0; frame_id < shard.frame_count; ++frame_id) {
+                if (shard.frame_in_use[frame_id] && shard.frames[frame_id].is_dirty) dirty_count++;
+            }
+            if (dirty_count == 0) continue;
+
+            const size_t free_count = shard.free_frames.size();
+            const size_t reserve_victims = shard.free_target > free_count ? shard.free_target - free_count : 0;
+            size_t excess = dirty_count > high ? dirty_count - low : 0;
+            if (reserve_victims == 0 && excess == 0) continue;
+
+            std::vector<FrameId>& victims = shard.victims;
+            victims.clear();
+            shard.replacer->peekVictims(excess > 0 ? shard.frame_count : reserve_victims, victims);
+            const size_t cap = std::max<size_t>(1, shard.frame_count / 4);
+            size_t picked = 0;
+            for (size_t i = 0; i < victims.size(); ++i) {
+                if (i >= reserve_victims && excess == 0) break;
+                if (!shard.frames[victims[i]].is_dirty) continue;
+                if (picked == cap) {
+                    more = true;
+                    break;
+                }
+                dirty.push_back(pinFrame(shard, victims[i]));
+                picked++;
+                if (excess > 0) excess--;
+            }
+        }
+        if (dirty.empty()) return 0;
+
+        sortByPage(dirty);
+        return flushBatched(dirty);
+    }
+
+    // 把淘汰端的乾淨頁面移到空閒清單，直到達到 free_target 或下一個候選是髒頁（留給下一輪寫回）
+    void refillFreeFrames() {
+        for (auto& shard_ptr : shards_) {
+            Shard& shard = *shard_ptr;
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            while (shard.free_frames.size() < shard.free_target) {
+                shard.victims.clear();
+                shard.replacer->peekVictims(1, shard.victims);
+                if (shard.victims.empty() || shard.frames[shard.victims[0]].is_dirty) break;
+                releaseFrame(shard, shard.victims[0]);
+            }
+        }
+    }
+
+    void writerLoop() {
+        std::unique_lock<std::mutex> lock(writer_mutex_);
+        while (!writer_stopping_) {
+            writer_cv_.wait_for(lock, writer_config_.interval, [this] {
+                return writer_stopping_ || writer_wakeup_.load(std::memory_order_relaxed);
+            });
+            if (writer_stopping_) break;
+            writer_wakeup_.store(false, std::memory_order_relaxed);
+            BackgroundWriterConfig config = writer_config_;
+            lock.unlock();
+            if (config.enabled) {
+                try {
+                    writeBackDirtyPages(config);
+                }
+                catch (const std::exception& e) {
+                    DATABASEAPP_LOG(LogLevel::ERR, "Background writer failed: " << e.what());
+                }
+            }
+            lock.lock();
+        }
+    }
+
+    // 前景淘汰遇到髒頁時提早喚醒背景寫回；可能在持有分片鎖時呼叫
+    void wakeWriter() {
+        if (writer_wakeup_.exchange(true, std::memory_order_relaxed)) return;
+        std::lock_guard<std::mutex> lock(writer_mutex_);
+        writer_cv_.notify_one();
+    }
+
+    void waitForIo(Page& page) {
+        std::unique_lock<std::mutex> lock(io_mutex_);
+        io_cv_.wait(lock, [&page] { return !page.io_pending.load(std::memory_order_acquire); });
+    }
+
+    // 在 I/O 執行緒上呼叫。先清除 io_pending 再 unpin：unpin 之後頁框可能立刻被淘汰並重新預讀
+    static void prefetchCompleted(AsyncPageIo& io, bool ok) {
+        (void)ok;  // 讀取失敗時 DiskManager 已記錄錯誤並將頁面填零，與同步讀取相同
+        BufferPoolManager& self = *static_cast<BufferPoolManager*>(io.context);
+        Page& page = self.frames_[&io - self.frame_io_.get()];
+        {
+            std::lock_guard<std::mutex> lock(self.io_mutex_);
+            page.io_pending.store(false, std::memory_order_release);
+        }
+        self.io_cv_.notify_all();
+        {
+            Shard& shard = self.shardOf(page);
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.prefetching--;
+            if (--page.pin_count == 0) {
+                shard.replacer->setEvictable(static_cast<FrameId>(&page - shard.frames), true);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(self.io_mutex_);
+        if (--self.prefetches_in_flight_ == 0) self.io_cv_.notify_all();
+    }
+
+    // 呼叫者須持有分片鎖；被選中的頁框未被釘住，因此沒有人持有它的閂鎖。
+    // 在淘汰端前 CLEAN_VICTIM_SCAN 個候選中優先淘汰乾淨頁面，髒頁留給背景寫回，釋放了頁框時回傳 true。
+    // 候選全是髒頁時不在鎖內寫回：把替換策略接下來會選的髒頁釘住後交給 dirty_victim，
+    // 由呼叫端放開分片鎖寫回、unpin 後再重試；頁面寫回期間仍在頁表中，命中的 fetch 讀到的是最新內容。
+    // 回傳 false 且 dirty_victim 為空（或為 nullptr）表示沒有可淘汰的頁框
+    bool tryEvictPage(Shard& shard, PageGuard* dirty_victim) {
+        constexpr size_t CLEAN_VICTIM_SCAN = 8;
+        shard.victims.clear();
+        shard.replacer->peekVictims(CLEAN_VICTIM_SCAN, shard.victims);
+        for (FrameId candidate : shard.victims) {
+            if (!shard.frames[candidate].is_dirty) {
+                if (shard.victims.front() != candidate) wakeWriter();
+                releaseFrame(shard, candidate);
+                return true;
+            }
+        }
+        if (shard.victims.empty()) return false;
+
+        // 背景寫回未跟上，喚醒它補足乾淨頁框
+        wakeWriter();
+        if (dirty_victim) *dirty_victim = pinFrame(shard, shard.victims.front());
+        return false;
+    }
+
+    // 在分片鎖外寫回 tryEvictPage 交出的髒頁。呼叫端可能持有其他頁面的閂鎖，因此只嘗試取得共享閂鎖：
+    // 取不到時放棄這次寫回。持有閂鎖的執行緒也釘住了該頁，重試時它不在淘汰候選中
+    void writeBackVictim(PageGuard& victim) {
+        if (!victim.tryLockShared()) return;
+        if (victim->is_dirty) {
+            disk_manager_.writePage(victim->file_id, victim->page_id, victim->data);
+            victim->is_dirty = false;
+            foreground_writes_.fetch_add(1, std::memory_order_relaxed);
+            bumpCounter(metrics().file(victim->file_id).dirty_writes);
+        }
+        victim.unlock();
+    }
+
+    // 呼叫者須持有分片鎖；頁框必須可淘汰且是乾淨的
+    void releaseFrame(Shard& shard, FrameId frame_id) {
+        shard.replacer->remove(frame_id);
+        freeFrame(shard, frame_id);
+    }
+
+    // 呼叫者須持有分片鎖；頁框已移出替換策略
+    void freeFrame(Shard& shard, FrameId frame_id) {
+        Page& page = shard.frames[frame_id];
+        bumpCounter(metrics().file(page.file_id).evictions);
+        shard.page_table.erase(PageTable::makeKey(page.file_id, page.page_id));
+        shard.frame_in_use[frame_id] = false;
+        shard.free_frames.push_back(frame_id);
+        shard.resident--;
+        resident_pages_--;
+    }
+};
+
+inline void PageGuard::release() {
+    if (page_ != nullptr) {
+        unlock();
+        buffer_manager_->unpinPage(page_);
+        page_ = nullptr;
+    }
+}
+
+// 循序預讀器 - 每個掃描各自建立一個，依序回報即將讀取的頁號。
+// 偵測到連續存取相鄰頁面後，非同步預讀後面 window 頁，讀取前沿只剩半個視窗時再補下一批，
+// 讓磁碟上持續有請求在途；跳躍存取時重新偵測。limit 為允許預讀的頁號上限（不含）
+class SequentialPrefetcher {
+private:
+    static constexpr PageId NO_PAGE = std::numeric_limits<PageId>::max();
+
+    BufferPoolManager& buffer_manager_;
+    FileId file_id_;
+    PageId limit_;
+    size_t window_;
+    PageId last_ = NO_PAGE;
+    PageId frontier_ = 0;  // 已提交預讀的頁號上限（不含）
+
+public:
+    SequentialPrefetcher(BufferPoolManager& buffer_manager, FileId file_id, PageId limit = NO_PAGE,
+        size_t window = READ_AHEAD_PAGES)
+        : buffer_manager_(buffer_manager), file_id_(file_id), limit_(limit), window_(window) {
+    }
+
+    void access(PageId page_id) {
+        if (page_id == last_) return;
+        const bool sequential = last_ != NO_PAGE && page_id == last_ + 1;
+        last_ = page_id;
+        frontier_ = std::max(frontier_, page_id + 1);
+        if (!sequential) {
+            frontier_ = page_id + 1;
+            return;
+        }
+        if (frontier_ - page_id > window_ / 2 || frontier_ >= limit_) return;
+
+        PageId end = std::min<PageId>(page_id + 1 + window_, limit_);
+        buffer_manager_.prefetchPages(file_id_, frontier_, static_cast<size_t>(end - frontier_));
+        frontier_ = end;
+    }
+};
+
+// 固定寬度字串鍵：最多 255 字元，以 0 結尾並填充到 256 位元組
+struct FixedString {
+    static constexpr size_t SIZE = 256;
+    char data[SIZE];
+};
+
+// B+樹鍵型別特性 - 每種鍵型別在編譯期決定寬度、頁內存取方式與比較方式。
+//   Probe：查詢與比較使用的輕量型別（字串為指向頁框或呼叫端字串的 string_view）
+//   Owned：需要在釋放頁面閂鎖後繼續保存的鍵（例如分裂時上推的分隔鍵）
+template <typename Key>
+struct BPlusTreeKeyTraits {
+    static_assert(std::is_arithmetic_v<Key>, "B+ tree keys must be arithmetic types or FixedString");
+
+    using Probe = Key;
+    using Owned = Key;
+    static constexpr size_t SIZE = sizeof(Key);
+
+    static constexpr DataType dataType() {
+        if constexpr (std::is_same_v<Key, int32_t>) return DataType::INT32;
+        else if constexpr (std::is_same_v<Key, int64_t>) return DataType::INT64;
+        else if constexpr (std::is_same_v<Key, float>) return DataType::FLOAT;
+        else if constexpr (std::is_same_v<Key, double>) return DataType::DOUBLE;
+        else {
+            static_assert(std::is_same_v<Key, bool>, "unsupported B+ tree key type");
+            return DataType::BOOL;
+        }
+    }
+
+    static Probe load(const char* slot) {
+        Key key;
+        std::memcpy(&key, slot, sizeof(Key));
+        return key;
+    }
+
+    static void store(char* slot, Probe key) { std::memcpy(slot, &key, sizeof(Key)); }
+
+    static Probe fromValue(const Value& value) {
+        const Key* key = std::get_if<Key>(&value);
+        if (!key) {
+            throw std::runtime_error("Key type does not match B+ tree index key type");
+        }
+        return *key;
+    }
+};
+
+template <>
+struct BPlusTreeKeyTraits<FixedString> {
+    using Probe = std::string_view;
+    using Owned = std::string;
+    static constexpr size_t SIZE = FixedString::SIZE;
+
+    static constexpr DataType dataType() { return DataType::STRING; }
+
+    static Probe load(const char* slot) { return std::string_view(slot, strnlen(slot, SIZE)); }
+
+    static void store(char* slot, Probe key) {
+        key = key.substr(0, SIZE - 1);
+        std::memcpy(slot, key.data(), key.size());
+        std::memset(slot + key.size(), 0, SIZE - key.size());
+    }
+
+    static Probe fromValue(const Value& value) {
+        const std::string* key = std::get_if<std::string>(&value);
+        if (!key) {
+            throw std::runtime_error("Key type does not match B+ tree index key type");
+        }
+        return fromString(*key);
+    }
+
+    static Probe fromString(std::string_view key) { return key.substr(0, SIZE - 1); }
+};
+
+// 變長字串鍵：頁內只佔實際長度（最多 255 字元），節點以槽位陣列與鍵堆積存放並做前綴壓縮
+struct VarString {
+    static constexpr size_t MAX_LENGTH = 255;
+};
+
+template <>
+struct BPlusTreeKeyTraits<VarString> {
+    using Probe = std::string_view;
+    using Owned = std::string;
+
+    static constexpr DataType dataType() { return DataType::STRING; }
+
+    static Probe fromValue(const Value& value) {
+        const std::string* key = std::get_if<std::string>(&value);
+        if (!key) {
+            throw std::runtime_error("Key type does not match B+ tree index key type");
+        }
+        return fromString(*key);
+    }
+
+    static Probe fromString(std::string_view key) { return key.substr(0, VarString::MAX_LENGTH); }
+};
+
+// B+樹節點的頁內格式 - 直接在緩衝池頁框上搜尋與修改，不做序列化/反序列化
+//   [標頭][鍵陣列：capacity 個固定寬度鍵][值陣列：葉子為 RecordId，內部節點為 capacity + 1 個子頁面]
+struct BPlusTreeNodeHeader {
+    uint8_t is_leaf;
+    uint8_t key_type;
+    uint16_t reserved;
+    uint32_t key_count;
+    PageId next_leaf;  // 葉子節點的下一個節點（用於範圍查詢）
+};
+
+static_assert(sizeof(BPlusTreeNodeHeader) == 16, "B+ tree node header must stay 16 bytes");
+static_assert(sizeof(RecordId) == sizeof(PageId), "leaf records and child pointers share one value array");
+
+// 依鍵寬度與 PAGE_SIZE 在編譯期計算的節點容量（扇出）與值陣列位移
+template <typename Key>
+struct BPlusTreeLayout {
+    static constexpr size_t KEY_SIZE = BPlusTreeKeyTraits<Key>::SIZE;
+    // 值陣列對齊到 8 位元組，預留最多 7 位元組的填充
+    static constexpr size_t USABLE = PAGE_SIZE - sizeof(BPlusTreeNodeHeader) - 7;
+    static constexpr size_t LEAF_CAPACITY = USABLE / (KEY_SIZE + sizeof(RecordId));
+    static constexpr size_t INTERNAL_CAPACITY = (USABLE - sizeof(PageId)) / (KEY_SIZE + sizeof(PageId));
+
+    static constexpr size_t valuesOffset(size_t capacity) {
+        return (sizeof(BPlusTreeNodeHeader) + capacity * KEY_SIZE + 7) & ~size_t(7);
+    }
+
+    static constexpr size_t LEAF_VALUES_OFFSET = valuesOffset(LEAF_CAPACITY);
+    static constexpr size_t INTERNAL_VALUES_OFFSET = valuesOffset(INTERNAL_CAPACITY);
+
+    static_assert(LEAF_CAPACITY >= 3 && INTERNAL_CAPACITY >= 3, "B+ tree key too wide for PAGE_SIZE");
+    static_assert(LEAF_VALUES_OFFSET + LEAF_CAPACITY * sizeof(RecordId) <= PAGE_SIZE, "leaf layout overflows page");
+    static_assert(INTERNAL_VALUES_OFFSET + (INTERNAL_CAPACITY + 1) * sizeof(PageId) <= PAGE_SIZE,
+        "internal layout overflows page");
+};
+
+// 頁框上的節點視圖：不擁有資料，呼叫端必須持有頁面閂鎖（修改時為獨占閂鎖）
+template <typename Key>
+class BPlusTreeNodeView {
+public:
+    using Traits = BPlusTreeKeyTraits<Key>;
+    using Layout = BPlusTreeLayout<Key>;
+    using Probe = typename Traits::Probe;
+
+private:
+    char* data_;
+
+    char* keySlot(size_t i) const { return data_ + sizeof(BPlusTreeNodeHeader) + i * Layout::KEY_SIZE; }
+
+    char* valueSlot(size_t i) const {
+        return data_ + (isLeaf() ? Layout::LEAF_VALUES_OFFSET : Layout::INTERNAL_VALUES_OFFSET) + i * sizeof(uint64_t);
+    }
+
+    uint64_t valueAt(size_t i) const {
+        uint64_t value;
+        std::memcpy(&value, valueSlot(i), sizeof(value));
+        return value;
+    }
+
+    void setValue(size_t i, uint64_t value) { std::memcpy(valueSlot(i), &value, sizeof(value)); }
+
+    void setKeyCount(size_t count) {
+        uint32_t value = static_cast<uint32_t>(count);
+        std::memcpy(data_ + offsetof(BPlusTreeNodeHeader, key_count), &value, sizeof(value));
+    }
+
+    // 型別化二分搜尋：Upper 為 false 時回傳第一個 >= probe 的位置，為 true 時回傳第一個 > probe 的位置
+    template <bool Upper>
+    size_t bound(Probe probe) const {
+        size_t lo = 0, hi = keyCount();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            Probe current = keyAt(mid);
+            bool go_right = Upper ? !(probe < current) : (current < probe);
+            if (go_right) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // 將 [pos, count) 的鍵與 [value_pos, value_count) 的值各往後移一格
+    void shiftRight(size_t pos, size_t value_pos, size_t value_count) {
+        const size_t count = keyCount();
+        std::memmove(keySlot(pos + 1), keySlot(pos), (count - pos) * Layout::KEY_SIZE);
+        std::memmove(valueSlot(value_pos + 1), valueSlot(value_pos), (value_count - value_pos) * sizeof(uint64_t));
+    }
+
+public:
+    explicit BPlusTreeNodeView(char* data) : data_(data) {}
+
+    // 在頁框上初始化一個空節點
+    static BPlusTreeNodeView format(char* data, bool is_leaf) {
+        std::memset(data, 0, PAGE_SIZE);
+        BPlusTreeNodeHeader h{};
+        h.is_leaf = is_leaf ? 1 : 0;
+        h.key_type = static_cast<uint8_t>(Traits::dataType());
+        std::memcpy(data, &h, sizeof(h));
+        return BPlusTreeNodeView(data);
+    }
+
+    bool isValid() const {
+        BPlusTreeNodeHeader h;
+        std::memcpy(&h, data_, sizeof(h));
+        return h.key_type == static_cast<uint8_t>(Traits::dataType()) && h.key_count <= capacity();
+    }
+
+    bool isLeaf() const { return data_[offsetof(BPlusTreeNodeHeader, is_leaf)] != 0; }
+
+    size_t keyCount() const {
+        uint32_t count;
+        std::memcpy(&count, data_ + offsetof(BPlusTreeNodeHeader, key_count), sizeof(count));
+        return count;
+    }
+
+    size_t capacity() const { return isLeaf() ? Layout::LEAF_CAPACITY : Layout::INTERNAL_CAPACITY; }
+    bool isFull() const { return keyCount() >= capacity(); }
+    double fillRatio() const { return static_cast<double>(keyCount()) / capacity(); }
+
+    PageId nextLeaf() const {
+        PageId next;
+        std::memcpy(&next, data_ + offsetof(BPlusTreeNodeHeader, next_leaf), sizeof(next));
+        return next;
+    }
+
+    void setNextLeaf(PageId next) {
+        std::memcpy(data_ + offsetof(BPlusTreeNodeHeader, next_leaf), &next, sizeof(next));
+    }
+
+    RecordId record(size_t i) const { return valueAt(i); }
+    PageId child(size_t i) const { return valueAt(i); }
+
+    Probe keyAt(size_t i) const { return Traits::load(keySlot(i)); }
+
+    // 第 i 個鍵是否大於 probe；範圍掃描用它檢查整個葉子是否都在上界內
+    bool keyGreaterThan(size_t i, Probe probe) const { return probe < keyAt(i); }
+
+    size_t lowerBound(Probe key) const { return bound<false>(key); }
+    size_t upperBound(Probe key) const { return bound<true>(key); }
+
+    // 內部節點：等於分隔鍵的查詢走左子樹，再沿葉子鏈結往右
+    size_t findChildIndex(Probe key) const { return lowerBound(key); }
+
+    void insertRecord(size_t pos, Probe key, RecordId record_id) {
+        const size_t count = keyCount();
+        shiftRight(pos, pos, count);
+        Traits::store(keySlot(pos), key);
+        setValue(pos, record_id);
+        setKeyCount(count + 1);
+    }
+
+    // 在分隔鍵位置 pos 插入鍵，新的右子節點放在 pos + 1
+    void insertChild(size_t pos, Probe key, PageId right_child) {
+        const size_t count = keyCount();
+        shiftRight(pos, pos + 1, count + 1);
+        Traits::store(keySlot(pos), key);
+        setValue(pos + 1, right_child);
+        setKeyCount(count + 1);
+    }
+
+    void appendRecord(Probe key, RecordId record_id) {
+        const size_t count = keyCount();
+        Traits::store(keySlot(count), key);
+        setValue(count, record_id);
+        setKeyCount(count + 1);
+    }
+
+    // 內部節點：先以 setFirstChild 設定最左子節點，之後每次附加 (分隔鍵, 右子節點)
+    void setFirstChild(PageId child_page) { setValue(0, child_page); }
+
+    void appendChild(Probe separator, PageId child_page) {
+        const size_t count = keyCount();
+        Traits::store(keySlot(count), separator);
+        setValue(count + 1, child_page);
+        setKeyCount(count + 1);
+    }
+
+    // 將 mid 之後的內容搬到空的 right 節點。
+    // 葉子：right 取得 [mid, count)；內部節點：keys[mid] 上推，right 取得 keys[mid+1, count) 與對應子節點
+    void moveUpperHalf(size_t mid, BPlusTreeNodeView& right) {
+        const size_t count = keyCount();
+        const size_t first_key = isLeaf() ? mid : mid + 1;
+        const size_t moved_keys = count - first_key;
+        const size_t moved_values = isLeaf() ? moved_keys : moved_keys + 1;
+
+        std::memcpy(right.keySlot(0), keySlot(first_key), moved_keys * Layout::KEY_SIZE);
+        std::memcpy(right.valueSlot(0), valueSlot(first_key), moved_values * sizeof(uint64_t));
+        right.setKeyCount(moved_keys);
+        setKeyCount(mid);
+    }
+
+    // 與變長節點共用的插入/分裂介面；固定寬度節點的空間只取決於鍵數
+    bool canInsert(Probe) const { return !isFull(); }
+    bool canInsertSeparator() const { return !isFull(); }
+
+    typename Traits::Owned keyCopy(size_t i) const { return typename Traits::Owned(keyAt(i)); }
+
+    // 兩個相鄰葉子之間的分隔鍵；固定寬度鍵無法截短，直接使用右邊的第一個鍵
+    static Probe shortestSeparator(Probe, Probe right_first) { return right_first; }
+
+    // 分裂已滿的葉子並插入新鍵，回傳分隔鍵（新鍵不小於分隔鍵時放右邊，分隔鍵因此不會改變）
+    typename Traits::Owned splitInsertLeaf(BPlusTreeNodeView& right, Probe key, RecordId record_id) {
+        moveUpperHalf(keyCount() / 2, right);
+        typename Traits::Owned separator = right.keyCopy(0);
+        BPlusTreeNodeView& target = (key < Probe(separator)) ? *this : right;
+        target.insertRecord(target.lowerBound(key), key, record_id);
+        return separator;
+    }
+
+    // 分裂已滿的內部節點並插入 (key, right_child)，回傳上推的鍵
+    typename Traits::Owned splitInsertInternal(BPlusTreeNodeView& right, size_t child_index, Probe key,
+        PageId right_child) {
+        const size_t mid = keyCount() / 2;
+        typename Traits::Owned promoted_key = keyCopy(mid);
+        moveUpperHalf(mid, right);
+
+        // 分裂的子節點位於左半時（child_index <= mid）插入左邊，否則插入右邊
+        if (child_index <= mid) {
+            insertChild(child_index, key, right_child);
+        }
+        else {
+            right.insertChild(child_index - mid - 1, key, right_child);
+        }
+        return promoted_key;
+    }
+};
+
+// 變長鍵節點的頁內格式：
+//   [BPlusTreeNodeHeader][BPlusTreeSlottedHeader][槽位陣列 →    ...    ← 鍵堆積（共同前綴 + 各鍵後綴）]
+// 槽位 i = (值, 後綴位移, 後綴長度)；葉子的值為 RecordId，內部節點的值為鍵 i 右邊的子節點，
+// 最左子節點存在標頭。節點內所有鍵共用一段前綴，鍵堆積只存放各鍵去掉前綴後的部分。
+struct BPlusTreeSlottedHeader {
+    uint16_t prefix_offset;
+    uint16_t prefix_length;
+    uint32_t heap_offset;  // 鍵堆積目前的起點，由頁尾往前成長
+    PageId leftmost_child;
+};
+
+static_assert(sizeof(BPlusTreeSlottedHeader) == 16, "slotted node header must stay 16 bytes");
+static_assert(PAGE_SIZE <= 65536, "slotted B+ tree nodes use 16-bit key offsets");
+
+class BPlusTreeSlottedNode {
+public:
+    using Traits = BPlusTreeKeyTraits<VarString>;
+    using Probe = std::string_view;
+    using Owned = std::string;
+
+    static constexpr size_t HEADER_SIZE = sizeof(BPlusTreeNodeHeader) + sizeof(BPlusTreeSlottedHeader);
+    static constexpr size_t SLOT_SIZE = sizeof(uint64_t) + 2 * sizeof(uint16_t);
+    static constexpr size_t MAX_SLOTS = (PAGE_SIZE - HEADER_SIZE) / SLOT_SIZE;
+
+private:
+    // 分成兩段的完整鍵（節點前綴 + 後綴），避免為了比較而串接字串
+    struct KeyParts {
+        std::string_view head;
+        std::string_view tail;
+
+        size_t size() const { return head.size() + tail.size(); }
+        char operator[](size_t i) const { return i < head.size() ? head[i] : tail[i - head.size()]; }
+
+        void copyTo(char* dest, size_t from, size_t to) const {
+            for (size_t i = from; i < to; ++i) *dest++ = (*this)[i];
+        }
+
+        Owned str() const { return Owned(head) + Owned(tail); }
+    };
+
+    // 暫存副本中的舊項目再插入一個新項目後的有序序列，用來重建或分裂節點
+    struct MergedEntries {
+        const BPlusTreeSlottedNode& source;
+        size_t insert_pos;
+        KeyParts key;
+        uint64_t value;
+
+        size_t size() const { return source.keyCount() + 1; }
+
+        KeyParts keyAt(size_t j) const {
+            if (j == insert_pos) return key;
+            return source.keyParts(j < insert_pos ? j : j - 1);
+        }
+
+        uint64_t valueAt(size_t j) const {
+            if (j == insert_pos) return value;
+            return source.slotValue(j < insert_pos ? j : j - 1);
+        }
+    };
+
+    char* data_;
+
+    BPlusTreeSlottedHeader slotted() const {
+        BPlusTreeSlottedHeader h;
+        std::memcpy(&h, data_ + sizeof(BPlusTreeNodeHeader), sizeof(h));
+        return h;
+    }
+
+    void setSlotted(const BPlusTreeSlottedHeader& h) {
+        std::memcpy(data_ + sizeof(BPlusTreeNodeHeader), &h, sizeof(h));
+    }
+
+    void setKeyCount(size_t count) {
+        uint32_t value = static_cast<uint32_t>(count);
+        std::memcpy(data_ + offsetof(BPlusTreeNodeHeader, key_count), &value, sizeof(value));
+    }
+
+    char* slot(size_t i) const { return data_ + HEADER_SIZE + i * SLOT_SIZE; }
+
+    uint64_t slotValue(size_t i) const {
+        uint64_t value;
+        std::memcpy(&value, slot(i), sizeof(value));
+        return value;
+    }
+
+    std::string_view suffix(size_t i) const {
+        uint16_t location[2];
+        std::memcpy(location, slot(i) + sizeof(uint64_t), sizeof(location));
+        return std::string_view(data_ + location[0], location[1]);
+    }
+
+    void writeSlot(size_t i, uint64_t value, size_t offset, size_t length) {
+        uint16_t location[2] = { static_cast<uint16_t>(offset), static_cast<uint16_t>(length) };
+        std::memcpy(slot(i), &value, sizeof(value));
+        std::memcpy(slot(i) + sizeof(uint64_t), location, sizeof(location));
+    }
+
+    std::string_view prefix() const {
+        BPlusTreeSlottedHeader h = slotted();
+        return std::string_view(data_ + h.prefix_offset, h.prefix_length);
+    }
+
+    KeyParts keyParts(size_t i) const { return { prefix(), suffix(i) }; }
+
+    size_t freeSpace() const {
+        return slotted().heap_offset - (HEADER_SIZE + keyCount() * SLOT_SIZE);
+    }
+
+    static size_t commonPrefix(const KeyParts& a, const KeyParts& b) {
+        size_t n = std::min(a.size(), b.size());
+        size_t i = 0;
+        while (i < n && a[i] == b[i]) ++i;
+        return i;
+    }
+
+    // 以 entries[begin, end) 重建節點的前綴、槽位與鍵堆積；其他標頭欄位（鏈結、最左子節點）保持不變。
+    // entries 必須指向另一塊記憶體（通常是本頁的暫存副本）。有序序列的共同前綴即首尾兩鍵的共同前綴。
+    void rebuild(const MergedEntries& entries, size_t begin, size_t end) {
+        const size_t count = end - begin;
+        BPlusTreeSlottedHeader h = slotted();
+        size_t heap = PAGE_SIZE;
+        size_t prefix_length = 0;
+
+        if (count > 0) {
+            KeyParts first = entries.keyAt(begin);
+            prefix_length = count == 1 ? first.size() : commonPrefix(first, entries.keyAt(end - 1));
+            heap -= prefix_length;
+            first.copyTo(data_ + heap, 0, prefix_length);
+        }
+        h.prefix_offset = static_cast<uint16_t>(heap);
+        h.prefix_length = static_cast<uint16_t>(prefix_length);
+
+        for (size_t j = 0; j < count; ++j) {
+            KeyParts key = entries.keyAt(begin + j);
+            const size_t length = key.size() - prefix_length;
+            if (heap < HEADER_SIZE + count * SLOT_SIZE + length) {
+                throw std::runtime_error("B+ tree node overflow while rebuilding slotted node");
+            }
+            heap -= length;
+            key.copyTo(data_ + heap, prefix_length, key.size());
+            writeSlot(j, entries.valueAt(begin + j), heap, length);
+        }
+
+        h.heap_offset = static_cast<uint32_t>(heap);
+        setSlotted(h);
+        setKeyCount(count);
+    }
+
+    void rebuildWithInsert(size_t pos, Probe key, uint64_t value) {
+        char scratch[PAGE_SIZE];
+        std::memcpy(scratch, data_, PAGE_SIZE);
+        BPlusTreeSlottedNode source(scratch);
+        MergedEntries merged{ source, pos, KeyParts{ key, {} }, value };
+        rebuild(merged, 0, merged.size());
+    }
+
+    // 有序序列 [begin, end) 重建成一個節點後佔用的位元組數
+    static size_t rangeBytes(const MergedEntries& entries, const std::vector<size_t>& length_sum,
+        size_t begin, size_t end) {
+        const size_t count = end - begin;
+        if (count == 0) return HEADER_SIZE;
+        const size_t prefix_length = count == 1 ? 0 : commonPrefix(entries.keyAt(begin), entries.keyAt(end - 1));
+        return HEADER_SIZE + count * SLOT_SIZE + (length_sum[end] - length_sum[begin]) - (count - 1) * prefix_length;
+    }
+
+    // 依位元組選擇分裂點，使兩半大小盡量相近且都放得進一頁。
+    // 葉子：左 [0, m)、右 [m, n)；內部節點：左 [0, m)、keys[m] 上推、右 [m + 1, n)
+    static size_t chooseSplit(const MergedEntries& entries, bool is_leaf) {
+        const size_t n = entries.size();
+        std::vector<size_t> length_sum(n + 1, 0);
+        for (size_t j = 0; j < n; ++j) length_sum[j + 1] = length_sum[j] + entries.keyAt(j).size();
+
+        const size_t right_skip = is_leaf ? 0 : 1;
+        size_t best = 0;
+        size_t best_cost = std::numeric_limits<size_t>::max();
+        for (size_t m = 1; m + right_skip < n; ++m) {
+            size_t left = rangeBytes(entries, length_sum, 0, m);
+            size_t right = rangeBytes(entries, length_sum, m + right_skip, n);
+            if (left > PAGE_SIZE || right > PAGE_SIZE) continue;
+            size_t cost = std::max(left, right);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best = m;
+            }
+        }
+        if (best == 0) {
+            throw std::runtime_error("Cannot split slotted B+ tree node");
+        }
+        return best;
+    }
+
+    static Owned separatorBetween(const KeyParts& left_last, const KeyParts& right_first) {
+        size_t length = std::min(commonPrefix(left_last, right_first) + 1, right_first.size());
+        return KeyParts{ right_first.head.substr(0, length),
+            right_first.tail.substr(0, length - std::min(length, right_first.head.size())) }.str();
+    }
+
+    // 前綴比對後在後綴上二分搜尋；Upper 為 false 時回傳第一個 >= probe 的位置，為 true 時回傳第一個 > probe 的位置
+    template <bool Upper>
+    size_t bound(Probe probe) const {
+        const size_t count = keyCount();
+        const std::string_view node_prefix = prefix();
+        const int prefix_cmp = probe.substr(0, node_prefix.size()).compare(node_prefix);
+        if (prefix_cmp < 0) return 0;
+        if (prefix_cmp > 0) return count;
+
+        const std::string_view rest = probe.substr(node_prefix.size());
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            int cmp = suffix(mid).compare(rest);
+            bool go_right = Upper ? cmp <= 0 : cmp < 0;
+            if (go_right) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // 在 pos 插入一個槽位；新鍵不含目前前綴時整頁重建以縮短前綴
+    void insertSlot(size_t pos, Probe key, uint64_t value) {
+        const size_t count = keyCount();
+        const std::string_view node_prefix = prefix();
+        if (count == 0 || key.substr(0, node_prefix.size()) != node_prefix) {
+            rebuildWithInsert(pos, key, value);
+            return;
+        }
+
+        const std::string_view rest = key.substr(node_prefix.size());
+        BPlusTreeSlottedHeader h = slotted();
+        h.heap_offset -= static_cast<uint32_t>(rest.size());
+        std::memcpy(data_ + h.heap_offset, rest.data(), rest.size());
+        setSlotted(h);
+
+        std::memmove(slot(pos + 1), slot(pos), (count - pos) * SLOT_SIZE);
+        writeSlot(pos, value, h.heap_offset, rest.size());
+        setKeyCount(count + 1);
+    }
+
+public:
+    explicit BPlusTreeSlottedNode(char* data) : data_(data) {}
+
+    static BPlusTreeSlottedNode format(char* data, bool is_leaf) {
+        std::memset(data, 0, HEADER_SIZE);
+        BPlusTreeNodeHeader h{};
+        h.is_leaf = is_leaf ? 1 : 0;
+        h.key_type = static_cast<uint8_t>(Traits::dataType());
+        std::memcpy(data, &h, sizeof(h));
+
+        BPlusTreeSlottedHeader s{};
+        s.prefix_offset = static_cast<uint16_t>(PAGE_SIZE - 1);
+        s.heap_offset = static_cast<uint32_t>(PAGE_SIZE);
+        BPlusTreeSlottedNode node(data);
+        node.setSlotted(s);
+        return node;
+    }
+
+    bool isValid() const {
+        BPlusTreeNodeHeader h;
+        std::memcpy(&h, data_, sizeof(h));
+        const BPlusTreeSlottedHeader s = slotted();
+        return h.key_type == static_cast<uint8_t>(Traits::dataType()) && h.key_count <= MAX_SLOTS &&
+            s.heap_offset <= PAGE_SIZE && s.heap_offset >= HEADER_SIZE + h.key_count * SLOT_SIZE &&
+            size_t(s.prefix_offset) + s.prefix_length <= PAGE_SIZE;
+    }
+
+    bool isLeaf() const { return data_[offsetof(BPlusTreeNodeHeader, is_leaf)] != 0; }
+
+    size_t keyCount() const {
+        uint32_t count;
+        std::memcpy(&count, data_ + offsetof(BPlusTreeNodeHeader, key_count), sizeof(count));
+        return count;
+    }
+
+    // 槽位與鍵堆積佔用的比例
+    double fillRatio() const {
+        return 1.0 - static_cast<double>(freeSpace()) / (PAGE_SIZE - HEADER_SIZE);
+    }
+
+    // 精確計算插入 key 所需空間，包含前綴縮短後每個既有後綴變長的部分
+    bool canInsert(Probe key) const {
+        const size_t count = keyCount();
+        if (count == 0) return freeSpace() >= SLOT_SIZE + key.size();
+
+        const std::string_view node_prefix = prefix();
+        KeyParts probe{ key, {} };
+        const size_t shared = std::min(node_prefix.size(), commonPrefix(KeyParts{ node_prefix, {} }, probe));
+        const size_t grow = node_prefix.size() - shared;
+        return freeSpace() >= SLOT_SIZE + (key.size() - shared) + grow * (count - 1);
+    }
+
+    // 悲觀插入的安全節點判斷：能否容納任何長度的分隔鍵
+    bool canInsertSeparator() const {
+        return freeSpace() >= SLOT_SIZE + VarString::MAX_LENGTH + prefix().size() * keyCount();
+    }
+
+    PageId nextLeaf() const {
+        PageId next;
+        std::memcpy(&next, data_ + offsetof(BPlusTreeNodeHeader, next_leaf), sizeof(next));
+        return next;
+    }
+
+    void setNextLeaf(PageId next) {
+        std::memcpy(data_ + offsetof(BPlusTreeNodeHeader, next_leaf), &next, sizeof(next));
+    }
+
+    RecordId record(size_t i) const { return slotValue(i); }
+    PageId child(size_t i) const { return i == 0 ? slotted().leftmost_child : slotValue(i - 1); }
+
+    Owned keyCopy(size_t i) const { return keyParts(i).str(); }
+
+    bool keyGreaterThan(size_t i, Probe probe) const {
+        const std::string_view node_prefix = prefix();
+        const int prefix_cmp = probe.substr(0, node_prefix.size()).compare(node_prefix);
+        if (prefix_cmp != 0) return prefix_cmp < 0;
+        return suffix(i).compare(probe.substr(node_prefix.size())) > 0;
+    }
+
+    size_t lowerBound(Probe key) const { return bound<false>(key); }
+    size_t upperBound(Probe key) const { return bound<true>(key); }
+
+    // 內部節點：等於分隔鍵的查詢走左子樹，再沿葉子鏈結往右
+    size_t findChildIndex(Probe key) const { return lowerBound(key); }
+
+    void insertRecord(size_t pos, Probe key, RecordId record_id) { insertSlot(pos, key, record_id); }
+
+    // 在分隔鍵位置 pos 插入鍵，新的右子節點放在 pos + 1（即槽位 pos 的值）
+    void insertChild(size_t pos, Probe key, PageId right_child) { insertSlot(pos, key, right_child); }
+
+    void appendRecord(Probe key, RecordId record_id) { insertSlot(keyCount(), key, record_id); }
+
+    void setFirstChild(PageId child_page) {
+        BPlusTreeSlottedHeader h = slotted();
+        h.leftmost_child = child_page;
+        setSlotted(h);
+    }
+
+    void appendChild(Probe separator, PageId child_page) { insertSlot(keyCount(), separator, child_page); }
+
+    // 相鄰葉子之間的最短分隔鍵（後綴截斷）：取右邊第一個鍵中剛好大於左邊最後一個鍵的最短前綴
+    static Probe shortestSeparator(Probe left_last, Probe right_first) {
+        size_t shared = commonPrefix(KeyParts{ left_last, {} }, KeyParts{ right_first, {} });
+        return right_first.substr(0, std::min(shared + 1, right_first.size()));
+    }
+
+    // 分裂已滿的葉子並插入新鍵，回傳截斷後的分隔鍵
+    Owned splitInsertLeaf(BPlusTreeSlottedNode& right, Probe key, RecordId record_id) {
+        char scratch[PAGE_SIZE];
+        std::memcpy(scratch, data_, PAGE_SIZE);
+        BPlusTreeSlottedNode source(scratch);
+        MergedEntries merged{ source, source.lowerBound(key), KeyParts{ key, {} }, record_id };
+
+        const size_t mid = chooseSplit(merged, true);
+        Owned separator = separatorBetween(merged.keyAt(mid - 1), merged.keyAt(mid));
+        rebuild(merged, 0, mid);
+        right.rebuild(merged, mid, merged.size());
+        return separator;
+    }
+
+    // 分裂已滿的內部節點並插入 (key, right_child)，回傳上推的鍵
+    Owned splitInsertInternal(BPlusTreeSlottedNode& right, size_t child_index, Probe key, PageId right_child) {
+        char scratch[PAGE_SIZE];
+        std::memcpy(scratch, data_, PAGE_SIZE);
+        BPlusTreeSlottedNode source(scratch);
+        MergedEntries merged{ source, child_index, KeyParts{ key, {} }, right_child };
+
+        const size_t mid = chooseSplit(merged, false);
+        Owned promoted_key = merged.keyAt(mid).str();
+        right.setFirstChild(merged.valueAt(mid));
+        rebuild(merged, 0, mid);
+        right.rebuild(merged, mid + 1, merged.size());
+        return promoted_key;
+    }
+};
+
+// 各鍵型別使用的節點格式：定長鍵用型別化陣列，變長字串用前綴壓縮的槽位頁
+template <typename Key>
+struct BPlusTreeNodeFor {
+    using type = BPlusTreeNodeView<Key>;
+};
+
+template <>
+struct BPlusTreeNodeFor<VarString> {
+    using type = BPlusTreeSlottedNode;
+};
+
+// 檔案內的頁面配置器 - 高水位以下不再使用的頁面放進空閒清單，配置時優先重用頁號最小的空閒頁，
+// 釋放最頂端的頁面時直接降低高水位，讓檔案保持緊密。頁 0 保留不配置
+class PageAllocator {
+private:
+    mutable std::mutex mutex_;
+    PageId high_water_ = 1;  // 下一個從未配置過的頁號
+    std::set<PageId> free_pages_;
+
+public:
+    PageId allocate() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!free_pages_.empty()) {
+            PageId page_id = *free_pages_.begin();
+            free_pages_.erase(free_pages_.begin());
+            return page_id;
+        }
+        return high_water_++;
+    }
+
+    // 配置 count 個連續頁號並回傳第一個：優先使用空閒清單中最低的一段連續頁面，否則從高水位延伸
+    PageId allocateRun(size_t count) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        PageId run_start = 0;
+        size_t run_length = 0;
+        for (PageId page_id : free_pages_) {
+            if (run_length > 0 && page_id == run_start + run_length) {
+                run_length++;
+            }
+            else {
+                run_start = page_id;
+                run_length = 1;
+            }
+            if (run_length == count) {
+                free_pages_.erase(free_pages_.find(run_start), free_pages_.upper_bound(page_id));
+                return run_start;
+            }
+        }
+        PageId start = high_water_;
+        high_water_ += count;
+        return start;
+    }
+
+    void release(PageId page_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (page_id == 0 || page_id >= high_water_ || !free_pages_.insert(page_id).second) {
+            throw std::runtime_error("Invalid page release " + std::to_string(page_id));
+        }
+        while (!free_pages_.empty() && *free_pages_.rbegin() == high_water_ - 1) {
+            free_pages_.erase(std::prev(free_pages_.end()));
+            high_water_--;
+        }
+    }
+
+    // 整個檔案不再有使用中的頁面
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        high_water_ = 1;
+        free_pages_.clear();
+    }
+
+    PageId highWater() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return high_water_;
+    }
+
+    size_t freePages() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return free_pages_.size();
+    }
+
+    void saveState(ByteWriter& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        out.put(static_cast<uint64_t>(high_water_));
+        out.put(static_cast<uint32_t>(free_pages_.size()));
+        for (PageId page_id : free_pages_) out.put(static_cast<uint64_t>(page_id));
+    }
+
+    void restoreState(ByteReader& in) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        high_water_ = in.get<uint64_t>();
+        free_pages_.clear();
+        for (size_t i = 0, n = in.get<uint32_t>(); i < n; ++i) {
+            PageId page_id = in.get<uint64_t>();
+            if (page_id == 0 || page_id >= high_water_) {
+                throw std::runtime_error("Invalid free page " + std::to_string(page_id) + " in catalog");
+            }
+            free_pages_.insert(page_id);
+        }
+    }
+};
+
+// 欄位索引介面 - DiskBasedColumn 以 Value 呼叫；
+// 各型別的 BPlusTreeIndex<Key> 在進入時把 Value 轉成鍵一次，樹內的比較不再經過 variant
+class ColumnIndex {
+public:
+    virtual ~ColumnIndex() = default;
+    virtual void insert(const Value& key, RecordId record_id) = 0;
+    // sorted_entries 必須依鍵排序（點陣圖索引不要求）
+    virtual void bulkLoad(const std::vector<std::pair<Value, RecordId>>& sorted_entries) = 0;
+    // 批次插入的型別化路徑，不經過 Value：keys 為 count 個與鍵型別相同的原生槽位（字串索引則為字串），
+    // 對應的 RecordId 由 first_record_id 起連續；不需要事先排序
+    virtual void bulkLoadSlots(const char* keys, size_t count, RecordId first_record_id) = 0;
+    virtual void bulkLoadStrings(const std::string* keys, size_t count, RecordId first_record_id) = 0;
+    virtual std::vector<RecordId> search(const Value& key) = 0;
+    virtual std::vector<RecordId> rangeSearch(const Value& start_key, const Value& end_key) = 0;
+    // 依索引順序（B+ 樹為鍵順序，點陣圖為 RecordId 順序）略過 offset 筆後最多取 limit 筆
+    virtual std::vector<RecordId> rangeSearch(const Value& start_key, const Value& end_key,
+        size_t offset, size_t limit) = 0;
+    // 下列操作只讀索引，不取出 RecordId 清單；只計 RecordId 小於 visible 的項目（尚未對讀者可見的列不算）
+    virtual size_t countRange(const Value& start_key, const Value& end_key, RecordId visible) = 0;
+    // 最小／最大的鍵；沒有可見的項目時回傳 std::nullopt
+    virtual std::optional<Value> firstKey(RecordId visible) = 0;
+    virtual std::optional<Value> lastKey(RecordId visible) = 0;
+    virtual bool empty() = 0;
+    // 目錄保存與還原的索引狀態：根頁、樹高與頁面配置器（高水位與空閒清單）。呼叫端保證沒有並行的寫入者
+    virtual void saveState(ByteWriter& out) = 0;
+    virtual void restoreState(ByteReader& in) = 0;
+    // 清空索引以便重建；舊頁面之後重新配置時會被覆寫
+    virtual void clear() = 0;
+    // 以現有內容重建緊密的樹：葉子填滿、頁號連續，釋放舊頁面。回傳重建後使用的頁數
+    virtual size_t compact() = 0;
+    // 索引形狀：樹高、使用中的頁數、葉子數、項目數與葉子平均填滿比例（table/column 由呼叫端填入）。
+    // B+ 樹會走訪所有葉子，只在統計時呼叫
+    virtual IndexMetrics describe() = 0;
+};
+
+// 欄位的索引型別
+enum class ColumnIndexType {
+    BTREE,   // 每列一個 (鍵, RecordId) 項目的 B+ 樹，適合高基數欄位與範圍查詢
+    BITMAP   // 每個相異鍵一個 Roaring 點陣圖，適合低基數欄位；述詞可跨欄位以 AND/OR 合併，COUNT 直接取基數
+};
+
+// B+樹索引
+// 並發控制：根指標由 root_latch_ 保護，節點由所在頁框的閂鎖保護。
+// 讀取以共享閂鎖由上而下耦合（取得子節點後才釋放父節點）；
+// 插入先樂觀地以共享閂鎖走到葉子的父節點、只對葉子取獨占閂鎖，
+// 葉子會分裂時才改走悲觀路徑：獨占閂鎖耦合，遇到不會分裂的安全節點就釋放所有祖先。
+// 葉子鏈結只由左往右取得閂鎖，因此範圍掃描不會與寫入者死結。
+// 範圍讀取都經由 RangeCursor：定位一次後沿葉子鏈結前進，COUNT 與 MIN/MAX 直接在葉子上計算。
+// 每個操作在整個走訪期間共享持有 structure_latch_；compact 獨占持有，釋放的頁面不會還有走訪停留。
+// 節點直接在頁框上存取（定長鍵為 BPlusTreeNodeView，變長字串為 BPlusTreeSlottedNode），查詢路徑不配置記憶體。
+template <typename Key>
+class BPlusTreeIndex : public ColumnIndex {
+public:
+    using Traits = BPlusTreeKeyTraits<Key>;
+    using Node = typename BPlusTreeNodeFor<Key>::type;
+    using Probe = typename Traits::Probe;
+    using Owned = typename Traits::Owned;
+
+private:
+    std::string index_name_;
+    FileId index_file_id_;
+    PageId root_page_id_;
+    size_t tree_height_;  // 葉子層為 1；與 root_page_id_ 一起受 root_latch_ 保護
+    std::shared_mutex root_latch_;
+    std::shared_mutex structure_latch_;
+    PageAllocator allocator_;  // 索引檔自己的頁面配置，頁號不與其他索引交錯
+    BufferPoolManager& buffer_manager_;
+
+public:
+    BPlusTreeIndex(const std::string& name, BufferPoolManager& buffer_manager)
+        : index_name_(name), index_file_id_(buffer_manager.registerFile(name)), root_page_id_(0),
+        tree_height_(0), buffer_manager_(buffer_manager) {
+    }
+
+    // NaN 不等於任何值、也不落在任何範圍內，而且會破壞鍵的排序，因此不放進索引
+    static bool indexable(Probe key) {
+        if constexpr (std::is_floating_point_v<Key>) return !std::isnan(key);
+        else return true;
+    }
+
+    void insert(const Value& key, RecordId record_id) override {
+        const Probe probe = Traits::fromValue(key);
+        if (!indexable(probe)) return;
+        std::shared_lock<std::shared_mutex> structure_lock(structure_latch_);
+        insertKey(probe, record_id);
+    }
+
+    // 由已排序的 (key, RecordId) 序列自底向上建立整棵樹：
+    // 先由左到右填滿葉子節點，再逐層往上建立內部節點。
+    // 只適用於空索引；索引已有資料時改為依序逐筆插入。
+    void bulkLoad(const std::vector<std::pair<Value, RecordId>>& sorted_entries) override {
+        std::vector<std::pair<Probe, RecordId>> entries;
+        entries.reserve(sorted_entries.size());
+        for (const auto& [key, record_id] : sorted_entries) {
+            const Probe probe = Traits::fromValue(key);
+            if (indexable(probe)) entries.emplace_back(probe, record_id);
+        }
+        loadSorted(entries);
+    }
+
+    void bulkLoadSlots(const char* keys, size_t count, RecordId first_record_id) override {
+        if constexpr (std::is_arithmetic_v<Key>) {
+            std::vector<std::pair<Probe, RecordId>> entries;
+            entries.reserve(count);
+            for (size_t i = 0; i < count; ++i) {
+                Key key;
+                std::memcpy(&key, keys + i * sizeof(Key), sizeof(Key));
+                if (indexable(key)) entries.emplace_back(key, first_record_id + i);
+            }
+            std::sort(entries.begin(), entries.end());
+            loadSorted(entries);
+        }
+        else {
+            throw std::runtime_error("Index " + index_name_ + " does not take fixed-width keys");
+        }
+    }
+
+    void bulkLoadStrings(const std::string* keys, size_t count, RecordId first_record_id) override {
+        if constexpr (!std::is_arithmetic_v<Key>) {
+            std::vector<std::pair<Probe, RecordId>> entries(count);
+            for (size_t i = 0; i < count; ++i) {
+                entries[i] = { Traits::fromString(keys[i]), first_record_id + i };
+            }
+            std::sort(entries.begin(), entries.end());
+            loadSorted(entries);
+        }
+        else {
+            throw std::runtime_error("Index " + index_name_ + " does not take string keys");
+        }
+    }
+
+    bool empty() override {
+        std::shared_lock<std::shared_mutex> root_lock(root_latch_);
+        return root_page_id_ == 0;
+    }
+
+    void saveState(ByteWriter& out) override {
+        std::shared_lock<std::shared_mutex> structure_lock(structure_latch_);
+        std::shared_lock<std::shared_mutex> root_lock(root_latch_);
+        out.put(static_cast<uint64_t>(root_page_id_));
+        out.put(static_cast<uint32_t>(tree_height_));
+        allocator_.saveState(out);
+    }
+
+    void restoreState(ByteReader& in) override {
+        std::unique_lock<std::shared_mutex> structure_lock(structure_latch_);
+        std::unique_lock<std::shared_mutex> root_lock(root_latch_);
+        root_page_id_ = in.get<uint64_t>();
+        tree_height_ = in.get<uint32_t>();
+        allocator_.restoreState(in);
+        if ((root_page_id_ == 0) != (tree_height_ == 0) || root_page_id_ >= allocator_.highWater()) {
+            throw std::runtime_error("Invalid catalog state for index " + index_name_);
+        }
+    }
+
+    void clear() override {
+        std::unique_lock<std::shared_mutex> structure_lock(structure_latch_);
+        std::unique_lock<std::shared_mutex> root_lock(root_latch_);
+        root_page_id_ = 0;
+        tree_height_ = 0;
+        allocator_.reset();
+    }
+
+    // 先逐層讀出所有項目並記下整棵樹的頁面，全部釋放後再批次建立：
+    // 舊頁面都回到空閒清單，新樹從最低的頁號開始連續配置。
+    // 葉子已填滿、頁號遞增且檔案中沒有空洞時不重寫
+    size_t compact() override {
+        std::unique_lock<std::shared_mutex> structure_lock(structure_latch_);
+        std::unique_lock<std::shared_mutex> root_lock(root_latch_);
+        if (root_page_id_ == 0) return 0;
+
+        std::vector<std::pair<Owned, RecordId>> entries;
+        std::vector<PageId> pages;
+        std::vector<PageId> level{ root_page_id_ };
+        for (size_t depth = tree_height_; depth > 1; --depth) {
+            std::vector<PageId> children;
+            for (PageId page_id : level) {
+                PageGuard page = buffer_manager_.fetchPageRead(index_file_id_, page_id);
+                Node node = nodeAt(page);
+                for (size_t i = 0; i <= node.keyCount(); ++i) children.push_back(node.child(i));
+            }
+            pages.insert(pages.end(), level.begin(), level.end());
+            level = std::move(children);
+        }
+        for (PageId page_id : level) {
+            PageGuard page = buffer_manager_.fetchPageRead(index_file_id_, page_id);
+            Node node = nodeAt(page);
+            for (size_t i = 0; i < node.keyCount(); ++i) entries.emplace_back(node.keyCopy(i), node.record(i));
+        }
+        pages.insert(pages.end(), level.begin(), level.end());
+
+        const PageId old_high_water = allocator_.highWater();
+        if (pages.size() + 1 == old_high_water && std::is_sorted(level.begin(), level.end()) &&
+            level.size() == countNodes(entries.size(), true, [&](size_t i) { return Probe(entries[i].first); })) {
+            return pages.size();
+        }
+
+        for (PageId page_id : pages) allocator_.release(page_id);
+        root_page_id_ = 0;
+        tree_height_ = 0;
+        if (!entries.empty()) {
+            buildTree(entries.size(),
+                [&](size_t i) { return Probe(entries[i].first); },
+                [&](size_t i) { return entries[i].second; });
+        }
+
+        DATABASEAPP_LOG(LogLevel::DEBUG, "Compacted index " << index_name_ << " from " << pages.size() << " to "
+            << allocator_.highWater() - 1 - allocator_.freePages() << " pages (high-water "
+            << old_high_water << " -> " << allocator_.highWater() << ")");
+        return allocator_.highWater() - 1 - allocator_.freePages();
+    }
+
+    std::vector<RecordId> search(const Value& key) override {
+        return searchKey(Traits::fromValue(key));
+    }
+
+    std::vector<RecordId> searchKey(Probe key) {
+        return rangeSearchKey(key, key);
+    }
+
+    std::vector<RecordId> rangeSearch(const Value& start_key, const Value& end_key) override {
+        return rangeSearchKey(Traits::fromValue(start_key), Traits::fromValue(end_key));
+    }
+
+    std::vector<RecordId> rangeSearch(const Value& start_key, const Value& end_key,
+        size_t offset, size_t limit) override {
+        return rangeSearchKey(Traits::fromValue(start_key), Traits::fromValue(end_key), offset, limit);
+    }
+
+    size_t countRange(const Value& start_key, const Value& end_key, RecordId visible) override {
+        return countRangeKey(Traits::fromValue(start_key), Traits::fromValue(end_key), visible);
+    }
+
+    std::optional<Value> firstKey(RecordId visible) override {
+        for (RangeCursor cursor(*this); cursor.valid(); cursor.next()) {
+            if (cursor.record() < visible) return Value(cursor.key());
+        }
+        return std::nullopt;
+    }
+
+    // 最右邊的葉子由後往前找；整頁都不可見時（只有並行插入的尾端）才從頭掃描
+    std::optional<Value> lastKey(RecordId visible) override {
+        std::shared_lock<std::shared_mutex> structure_lock(structure_latch_);
+        PageGuard leaf = descend([](const Node& node) { return node.keyCount(); });
+        while (leaf) {
+            Node node(leaf->data);
+            if (node.nextLeaf() == 0) break;
+            leaf = nextLeaf(node.nextLeaf());
+        }
+        if (!leaf) return std::nullopt;
+
+        Node node(leaf->data);
+        for (size_t i = node.keyCount(); i > 0; --i) {
+            if (node.record(i - 1) < visible) return Value(node.keyCopy(i - 1));
+        }
+        leaf.release();
+        structure_lock.unlock();
+
+        std::optional<Value> last;
+        for (RangeCursor cursor(*this); cursor.valid(); cursor.next()) {
+            if (cursor.record() < visible) last = Value(cursor.key());
+        }
+        return last;
+    }
+
+    IndexMetrics describe() override {
+        std::shared_lock<std::shared_mutex> structure_lock(structure_latch_);
+        IndexMetrics metrics;
+        metrics.type = "btree";
+        {
+            std::shared_lock<std::shared_mutex> root_lock(root_latch_);
+            metrics.height = tree_height_;
+        }
+        metrics.pages = allocator_.highWater() - 1 - allocator_.freePages();
+        double fill = 0.0;
+        for (PageGuard leaf = descend([](const Node&) { return size_t(0); }); leaf; ) {
+            Node node(leaf->data);
+            metrics.leaves++;
+            metrics.entries += node.keyCount();
+            fill += node.fillRatio();
+            leaf = nextLeaf(node.nextLeaf());
+        }
+        if (metrics.leaves > 0) metrics.fill_factor = fill / metrics.leaves;
+        return metrics;
+    }
+
+    // 葉子鏈結上依鍵順序的游標：開始時定位一次，之後只在每個葉子的最後一個鍵檢查上界，
+    // 整個葉子都在範圍內時不再做比較；走出範圍即釋放葉子。
+    // 游標持有 structure_latch_ 與目前葉子的共享閂鎖，開啟期間不可寫入同一個索引
+    class RangeCursor {
+    private:
+        BPlusTreeIndex& index_;
+        std::shared_lock<std::shared_mutex> structure_lock_;
+        SequentialPrefetcher prefetcher_;
+        PageGuard leaf_;
+        Owned end_key_{};
+        bool bounded_ = false;
+        bool last_leaf_ = false;  // 範圍在目前的葉子結束
+        size_t pos_ = 0;
+        size_t end_ = 0;          // 目前葉子內範圍的結尾
+
+        // 由 pos_ 起計算目前葉子上範圍的結尾；葉子上沒有剩餘項目時前進到下一個葉子
+        void settle() {
+            while (leaf_) {
+                Node node(leaf_->data);
+                const size_t count = node.keyCount();
+                last_leaf_ = bounded_ && count > 0 && node.keyGreaterThan(count - 1, Probe(end_key_));
+                end_ = last_leaf_ ? node.upperBound(Probe(end_key_)) : count;
+                if (pos_ < end_) {
+                    prefetcher_.access(leaf_->page_id);
+                    return;
+                }
+                if (last_leaf_) {
+                    leaf_.release();
+                    return;
+                }
+                leaf_ = index_.nextLeaf(node.nextLeaf());
+                pos_ = 0;
+            }
+        }
+
+    public:
+        // 整個索引，由最小的鍵開始
+        explicit RangeCursor(BPlusTreeIndex& index)
+            : index_(index), structure_lock_(index.structure_latch_),
+            prefetcher_(index.buffer_manager_, index.index_file_id_) {
+            leaf_ = index_.descend([](const Node&) { return size_t(0); });
+            settle();
+        }
+
+        // start_key <= 鍵 <= end_key 的項目
+        RangeCursor(BPlusTreeIndex& index, Probe start_key, Probe end_key)
+            : index_(index), structure_lock_(index.structure_latch_),
+            prefetcher_(index.buffer_manager_, index.index_file_id_), end_key_(end_key), bounded_(true) {
+            if (!indexable(start_key) || !indexable(end_key) || end_key < start_key) return;
+            leaf_ = index_.findLeaf(start_key);
+            if (!leaf_) return;
+            pos_ = Node(leaf_->data).lowerBound(start_key);
+            settle();
+        }
+
+        RangeCursor(const RangeCursor&) = delete;
+        RangeCursor& operator=(const RangeCursor&) = delete;
+
+        bool valid() const { return static_cast<bool>(leaf_); }
+        Owned key() const { return Node(leaf_->data).keyCopy(pos_); }
+        RecordId record() const { return Node(leaf_->data).record(pos_); }
+
+        void next() {
+            if (++pos_ < end_) return;
+            advanceLeaf();
+        }
+
+        // 目前葉子上還在範圍內的項目數
+        size_t remainingInLeaf() const { return end_ - pos_; }
+
+        // 目前葉子上剩餘項目中 RecordId 小於 visible 的個數
+        size_t countVisibleInLeaf(RecordId visible) const {
+            Node node(leaf_->data);
+            size_t n = 0;
+            for (size_t i = pos_; i < end_; ++i) n += node.record(i) < visible ? 1 : 0;
+            return n;
+        }
+
+        // 略過目前葉子的其餘項目
+        void advanceLeaf() {
+            if (last_leaf_) {
+                leaf_.release();
+                return;
+            }
+            leaf_ = index_.nextLeaf(Node(leaf_->data).nextLeaf());
+            pos_ = 0;
+            settle();
+        }
+
+        // 略過 n 個項目；整個葉子一次跳過，不逐筆前進
+        void skip(size_t n) {
+            while (n > 0 && valid()) {
+                const size_t step = std::min(n, remainingInLeaf());
+                n -= step;
+                pos_ += step;
+                if (pos_ >= end_) advanceLeaf();
+            }
+        }
+    };
+
+    // 重複鍵與範圍都可能跨越多個葉子，沿著葉子鏈結繼續收集。
+    // 批次建立的葉子頁號連續，長範圍的葉子走訪會觸發循序預讀
+    std::vector<RecordId> rangeSearchKey(Probe start_key, Probe end_key,
+        size_t offset = 0, size_t limit = std::numeric_limits<size_t>::max()) {
+        std::vector<RecordId> results;
+        RangeCursor cursor(*this, start_key, end_key);
+        cursor.skip(offset);
+        for (; cursor.valid() && results.size() < limit; cursor.next()) {
+            results.push_back(cursor.record());
+        }
+        return results;
+    }
+
+    // 逐葉子累加範圍內的項目數，不建立 RecordId 清單
+    size_t countRangeKey(Probe start_key, Probe end_key, RecordId visible) {
+        size_t count = 0;
+        for (RangeCursor cursor(*this, start_key, end_key); cursor.valid(); cursor.advanceLeaf()) {
+            count += cursor.countVisibleInLeaf(visible);
+        }
+        return count;
+    }
+
+private:
+    void insertKey(Probe key, RecordId record_id) {
+        if (insertOptimistic(key, record_id)) return;
+        insertPessimistic(key, record_id);
+    }
+
+    // 空索引自底向上建立；索引已有資料時改為依序逐筆插入
+    void loadSorted(const std::vector<std::pair<Probe, RecordId>>& entries) {
+        if (entries.empty()) return;
+
+        std::shared_lock<std::shared_mutex> structure_lock(structure_latch_);
+        std::unique_lock<std::shared_mutex> root_lock(root_latch_);
+        if (root_page_id_ != 0) {
+            root_lock.unlock();
+            for (const auto& [key, record_id] : entries) {
+                insertKey(key, record_id);
+            }
+            return;
+        }
+
+        buildTree(entries.size(),
+            [&](size_t i) { return entries[i].first; },
+            [&](size_t i) { return entries[i].second; });
+    }
+
+    // 由已排序的項目自底向上建立整棵樹：先由左到右填滿葉子節點，再逐層往上建立內部節點。
+    // 每一層先取得一段連續頁號，使葉子鏈結依頁號遞增。呼叫端持有 root_latch_ 且索引為空
+    template <typename KeyAt, typename RecordAt>
+    void buildTree(size_t total, KeyAt entry_key, RecordAt entry_record) {
+        // 每一層的 (與左邊相鄰子樹的分隔鍵, 頁面) 清單；字串鍵指向呼叫端保存的字串
+        std::vector<std::pair<Probe, PageId>> level;
+
+        // 建立葉子層：先在暫存頁上試排求出葉子數，再平均分配，避免最後一個葉子過空
+        size_t remaining_leaves = countNodes(total, true, entry_key);
+        level.reserve(remaining_leaves);
+
+        PageRun leaf_run = reservePages(remaining_leaves);
+        PageId leaf_page = takePage(leaf_run);
+        size_t pos = 0;
+        while (pos < total) {
+            const size_t target = (total - pos + remaining_leaves - 1) / remaining_leaves;
+            remaining_leaves = std::max<size_t>(1, remaining_leaves - 1);
+
+            PageGuard page = buffer_manager_.fetchPageWrite(index_file_id_, leaf_page);
+            Node leaf = Node::format(page->data, true);
+            level.emplace_back(pos == 0 ? entry_key(0) : Node::shortestSeparator(entry_key(pos - 1), entry_key(pos)),
+                leaf_page);
+            const size_t end = std::min(total, pos + target);
+            while (pos < end && leaf.canInsert(entry_key(pos))) {
+                leaf.appendRecord(entry_key(pos), entry_record(pos));
+                ++pos;
+            }
+
+            PageId next_page = (pos < total) ? takePage(leaf_run) : 0;
+            leaf.setNextLeaf(next_page);
+            page->is_dirty = true;
+            leaf_page = next_page;
+        }
+        releaseUnused(leaf_run);
+
+        // 逐層建立內部節點直到只剩一個根
+        size_t height = 1;
+        while (level.size() > 1) {
+            height++;
+            auto separator = [&](size_t i) { return level[i].first; };
+            size_t remaining_nodes = countNodes(level.size(), false, separator);
+            std::vector<std::pair<Probe, PageId>> parent_level;
+            parent_level.reserve(remaining_nodes);
+            PageRun node_run = reservePages(remaining_nodes);
+
+            size_t child = 0;
+            while (child < level.size()) {
+                const size_t target = (level.size() - child + remaining_nodes - 1) / remaining_nodes;
+                remaining_nodes = std::max<size_t>(1, remaining_nodes - 1);
+
+                PageId page_id = takePage(node_run);
+                PageGuard page = buffer_manager_.fetchPageWrite(index_file_id_, page_id);
+                Node node = Node::format(page->data, false);
+                parent_level.emplace_back(level[child].first, page_id);
+                node.setFirstChild(level[child].second);
+                const size_t end = std::min(level.size(), child + target);
+                for (++child; child < end && node.canInsert(separator(child)); ++child) {
+                    node.appendChild(separator(child), level[child].second);
+                }
+                page->is_dirty = true;
+            }
+            releaseUnused(node_run);
+            level = std::move(parent_level);
+        }
+
+        root_page_id_ = level.front().second;
+        tree_height_ = height;
+    }
+
+    // 預先配置的一段連續頁號；實際節點數超過試排估計時再逐頁配置
+    struct PageRun {
+        PageId next;
+        PageId end;
+    };
+
+    PageRun reservePages(size_t count) {
+        PageId first = allocator_.allocateRun(count);
+        return { first, first + count };
+    }
+
+    PageId takePage(PageRun& run) {
+        return run.next < run.end ? run.next++ : allocator_.allocate();
+    }
+
+    void releaseUnused(PageRun& run) {
+        while (run.next < run.end) allocator_.release(run.next++);
+    }
+
+    // 讀取已持有閂鎖的頁面上的節點，格式不符時拋出例外
+    Node nodeAt(const PageGuard& page) const {
+        Node node(page->data);
+        if (!node.isValid()) {
+            throw std::runtime_error("Corrupted B+ tree node " + std::to_string(page->page_id) +
+                " in index " + index_name_);
+        }
+        return node;
+    }
+
+    // 以共享閂鎖耦合走到 key 所在的葉子，回傳持有共享閂鎖的葉子頁面；空樹回傳空守衛
+    PageGuard findLeaf(Probe key) {
+        return descend([&](const Node& node) { return node.findChildIndex(key); });
+    }
+
+    // 以共享閂鎖耦合由根往下，choose(內部節點) 決定走哪個子節點
+    template <typename Choose>
+    PageGuard descend(Choose&& choose) {
+        std::shared_lock<std::shared_mutex> root_lock(root_latch_);
+        if (root_page_id_ == 0) return PageGuard();
+
+        PageGuard guard = buffer_manager_.fetchPageRead(index_file_id_, root_page_id_);
+        root_lock.unlock();
+
+        while (true) {
+            Node node = nodeAt(guard);
+            if (node.isLeaf()) return guard;
+
+            // 先取得子節點閂鎖，再釋放父節點
+            guard = buffer_manager_.fetchPageRead(index_file_id_, node.child(choose(node)));
+        }
+    }
+
+    // 沿葉子鏈結前進：先鎖住右邊的葉子再釋放目前的葉子
+    // （呼叫端以 leaf = nextLeaf(...) 指派時，右邊的葉子已鎖住後才會釋放舊守衛）
+    PageGuard nextLeaf(PageId next_page) {
+        if (next_page == 0) return PageGuard();
+        return buffer_manager_.fetchPageRead(index_file_id_, next_page);
+    }
+
+    // 樂觀插入：以共享閂鎖走到葉子的父節點，只對葉子取獨占閂鎖。
+    // 葉子已滿（或樹只有一層）時回傳 false，由悲觀路徑處理。
+    bool insertOptimistic(Probe key, RecordId record_id) {
+        std::shared_lock<std::shared_mutex> root_lock(root_latch_);
+        if (root_page_id_ == 0 || tree_height_ < 2) return false;
+
+        const size_t height = tree_height_;
+        PageGuard guard = buffer_manager_.fetchPageRead(index_file_id_, root_page_id_);
+        root_lock.unlock();
+
+        // 在新根產生之前鎖住的子樹高度不會改變，因此可依高度判斷何時到達葉子的父節點
+        for (size_t level = height; level > 1; --level) {
+            Node node = nodeAt(guard);
+            if (node.isLeaf()) return false;
+
+            PageId child = node.child(node.findChildIndex(key));
+            if (level == 2) {
+                PageGuard leaf = buffer_manager_.fetchPageWrite(index_file_id_, child);
+                guard.release();
+
+                Node leaf_node = nodeAt(leaf);
+                if (!leaf_node.isLeaf() || !leaf_node.canInsert(key)) return false;
+
+                leaf_node.insertRecord(leaf_node.lowerBound(key), key, record_id);
+                leaf->is_dirty = true;
+                return true;
+            }
+            guard = buffer_manager_.fetchPageRead(index_file_id_, child);
+        }
+        return false;
+    }
+
+    // 悲觀插入：獨占閂鎖耦合；遇到插入後不會分裂的節點即釋放所有祖先（含根指標鎖）
+    void insertPessimistic(Probe key, RecordId record_id) {
+        struct PathEntry {
+            PageGuard page;
+            size_t child_index;
+        };
+
+        std::unique_lock<std::shared_mutex> root_lock(root_latch_);
+        if (root_page_id_ == 0) {
+            // 創建根節點
+            root_page_id_ = createNewNode(true);
+            tree_height_ = 1;
+        }
+
+        std::vector<PathEntry> path;
+        PageId page_id = root_page_id_;
+        while (true) {
+            PageGuard page = buffer_manager_.fetchPageWrite(index_file_id_, page_id);
+            Node node = nodeAt(page);
+
+            if (node.isLeaf() ? node.canInsert(key) : node.canInsertSeparator()) {
+                path.clear();
+                if (root_lock.owns_lock()) root_lock.unlock();
+            }
+
+            if (node.isLeaf()) {
+                path.push_back({ std::move(page), 0 });
+                break;
+            }
+
+            size_t child_index = node.findChildIndex(key);
+            page_id = node.child(child_index);
+            path.push_back({ std::move(page), child_index });
+        }
+
+        // 葉子節點：未滿時直接在頁框上插入
+        PathEntry& leaf = path.back();
+        Node leaf_node(leaf.page->data);
+        leaf.page->is_dirty = true;
+        if (leaf_node.canInsert(key)) {
+            leaf_node.insertRecord(leaf_node.lowerBound(key), key, record_id);
+            return;
+        }
+
+        // 分裂葉子節點，並沿著仍持有閂鎖的路徑往上插入分隔鍵
+        auto result = splitLeaf(leaf_node, key, record_id);
+        for (size_t i = path.size() - 1; i-- > 0;) {
+            PathEntry& parent = path[i];
+            Node parent_node(parent.page->data);
+            parent.page->is_dirty = true;
+
+            if (parent_node.canInsert(result.first)) {
+                parent_node.insertChild(parent.child_index, result.first, result.second);
+                return;
+            }
+
+            // 分裂內部節點
+            result = splitInternal(parent_node, parent.child_index, result.first, result.second);
+        }
+
+        // 路徑最上層也分裂了：它必定是根，且根指標鎖仍然持有。
+        // 根節點分裂，創建新根
+        PageId new_root = allocateNodePage();
+        PageGuard root_page = buffer_manager_.fetchPageWrite(index_file_id_, new_root);
+        Node root_node = Node::format(root_page->data, false);
+        root_node.setFirstChild(root_page_id_);
+        root_node.appendChild(result.first, result.second);
+        root_page->is_dirty = true;
+        root_page_id_ = new_root;
+        tree_height_++;
+    }
+
+    PageId allocateNodePage() {
+        return allocator_.allocate();
+    }
+
+    PageId createNewNode(bool is_leaf) {
+        PageId page_id = allocateNodePage();
+
+        PageGuard page = buffer_manager_.fetchPageWrite(index_file_id_, page_id);
+        Node::format(page->data, is_leaf);
+        page->is_dirty = true;
+
+        return page_id;
+    }
+
+    // 試排：以暫存頁模擬貪婪填滿，估計一層需要的節點數。
+    // key_at(i) 為第 i 個項目的鍵（內部節點的第一個子節點不需要鍵）
+    template <typename KeyAt>
+    size_t countNodes(size_t total, bool is_leaf, KeyAt key_at) const {
+        std::vector<char> scratch(PAGE_SIZE);
+        size_t nodes = 0;
+        size_t pos = 0;
+        while (pos < total) {
+            Node node = Node::format(scratch.data(), is_leaf);
+            if (is_leaf) {
+                while (pos < total && node.canInsert(key_at(pos))) node.appendRecord(key_at(pos++), 0);
+            }
+            else {
+                node.setFirstChild(0);
+                ++pos;  // 第一個子節點不需要分隔鍵
+                while (pos < total && node.canInsert(key_at(pos))) node.appendChild(key_at(pos++), 0);
+            }
+            nodes++;
+        }
+        return nodes;
+    }
+
+    // 分裂已滿且持有獨占閂鎖的葉子並插入新鍵；新節點在連結進樹之前也持有獨占閂鎖
+    std::pair<Owned, PageId> splitLeaf(Node& node, Probe key, RecordId record_id) {
+        PageId new_page_id = allocateNodePage();
+        PageGuard new_page = buffer_manager_.fetchPageWrite(index_file_id_, new_page_id);
+        Node new_node = Node::format(new_page->data, true);
+        bumpCounter(buffer_manager_.metrics().local().leaf_splits);
+        DATABASEAPP_LOG(LogLevel::TRACE, "Splitting B+ tree leaf of " << index_name_ << " into node " << new_page_id);
+
+        new_node.setNextLeaf(node.nextLeaf());
+        node.setNextLeaf(new_page_id);
+        Owned separator = node.splitInsertLeaf(new_node, key, record_id);
+        new_page->is_dirty = true;
+
+        return { std::move(separator), new_page_id };
+    }
+
+    // 分裂已滿的內部節點，並在分裂後的一半插入 (key, right_child)
+    std::pair<Owned, PageId> splitInternal(Node& node, size_t child_index, Probe key, PageId right_child) {
+        PageId new_page_id = allocateNodePage();
+        PageGuard new_page = buffer_manager_.fetchPageWrite(index_file_id_, new_page_id);
+        Node new_node = Node::format(new_page->data, false);
+        bumpCounter(buffer_manager_.metrics().local().internal_splits);
+        DATABASEAPP_LOG(LogLevel::TRACE, "Splitting B+ tree internal node of " << index_name_ << " into node "
+            << new_page_id);
+
+        Owned promoted_key = node.splitInsertInternal(new_node, child_index, key, right_child);
+        new_page->is_dirty = true;
+
+        return { std::move(promoted_key), new_page_id };
+    }
+};
+
+// 依欄位型別建立對應鍵型別的 B+樹索引
+inline std::unique_ptr<ColumnIndex> makeColumnIndex(const std::string& name, DataType type,
+    BufferPoolManager& buffer_manager) {
+    switch (type) {
+    case DataType::INT32: return std::make_unique<BPlusTreeIndex<int32_t>>(name, buffer_manager);
+    case DataType::INT64: return std::make_unique<BPlusTreeIndex<int64_t>>(name, buffer_manager);
+    case DataType::FLOAT: return std::make_unique<BPlusTreeIndex<float>>(name, buffer_manager);
+    case DataType::DOUBLE: return std::make_unique<BPlusTreeIndex<double>>(name, buffer_manager);
+    case DataType::STRING: return std::make_unique<BPlusTreeIndex<VarString>>(name, buffer_manager);
+    case DataType::BOOL: return std::make_unique<BPlusTreeIndex<bool>>(name, buffer_manager);
+    }
+    throw std::runtime_error("Unsupported index key type");
+}
+
+// Morsel 執行器 - 工作竊取的執行緒池。parallelFor 把 [0, count) 個 morsel 平均切成與參與者數相同的連續區段，
+// 參與者先從自己區段的前端取用，用完後從其他區段的後端竊取一半。呼叫端執行緒也是參與者，
+// 即使工作執行緒都在忙其他查詢，呼叫仍會完成；同時可有多個 parallelFor 進行。
+// fn(worker, morsel) 的 worker 在 [0, parallelism()) 內，同一個 parallelFor 中不會有兩個執行緒同時使用同一個 worker，
+// 可直接索引各參與者自己的部分結果
+class MorselExecutor {
+private:
+    struct alignas(64) Range {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    struct Job {
+        std::function<void(size_t, size_t)> fn;
+        std::unique_ptr<Range[]> ranges;
+        size_t count = 0;
+        std::atomic<size_t> next_worker{ 1 };  // worker 0 是呼叫端
+        std::atomic<size_t> done{ 0 };
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+        std::exception_ptr error;  // 受 done_mutex 保護
+    };
+
+    size_t parallelism_;
+    std::vector<std::thread> workers_;
+    std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<std::shared_ptr<Job>> jobs_;  // 還有 worker 名額的工作
+    bool stopping_ = false;
+
+    std::atomic<uint64_t> parallel_jobs_{ 0 };
+    std::atomic<uint64_t> morsels_{ 0 };
+    std::atomic<uint64_t> steals_{ 0 };
+
+public:
+    // threads 為參與者總數（含呼叫端）；0 表示硬體執行緒數
+    explicit MorselExecutor(size_t threads = 0)
+        : parallelism_(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())) {
+        for (size_t i = 1; i < parallelism_; ++i) {
+            workers_.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    MorselExecutor(const MorselExecutor&) = delete;
+    MorselExecutor& operator=(const MorselExecutor&) = delete;
+
+    ~MorselExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            stopping_ = true;
+        }
+        queue_cv_.notify_all();
+        for (auto& worker : workers_) worker.join();
+    }
+
+    size_t parallelism() const { return parallelism_; }
+    uint64_t parallelJobs() const { return parallel_jobs_.load(std::memory_order_relaxed); }
+    uint64_t morsels() const { return morsels_.load(std::memory_order_relaxed); }
+    uint64_t steals() const { return steals_.load(std::memory_order_relaxed); }
+
+    // 執行 fn(worker, morsel)，morsel 為 [0, count)；所有 morsel 完成後才返回，第一個例外在呼叫端重新拋出
+    template <typename Fn>
+    void parallelFor(size_t count, Fn&& fn) {
+        morsels_.fetch_add(count, std::memory_order_relaxed);
+        if (count <= 1 || parallelism_ == 1) {
+            for (size_t morsel = 0; morsel < count; ++morsel) fn(0, morsel);
+            return;
+        }
+        parallel_jobs_.fetch_add(1, std::memory_order_relaxed);
+
+        auto job = std::make_shared<Job>();
+        job->fn = [&fn](size_t worker, size_t morsel) { fn(worker, morsel); };
+        job->count = count;
+        job->ranges = std::make_unique<Range[]>(parallelism_);
+        for (size_t w = 0; w < parallelism_; ++w) {
+            job->ranges[w].begin = count * w / parallelism_;
+            job->ranges[w].end = count * (w + 1) / parallelism_;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            jobs_.push_back(job);
+        }
+        queue_cv_.notify_all();
+
+        participate(*job, 0);
+        {
+            std::unique_lock<std::mutex> lock(job->done_mutex);
+            job->done_cv.wait(lock, [&] { return job->done.load(std::memory_order_acquire) == count; });
+        }
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            auto it = std::find(jobs_.begin(), jobs_.end(), job);
+            if (it != jobs_.end()) jobs_.erase(it);
+        }
+        if (job->error) std::rethrow_exception(job->error);
+    }
+
+private:
+    void workerLoop() {
+        for (;;) {
+            std::shared_ptr<Job> job;
+            size_t worker = 0;
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex_);
+                queue_cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+                if (stopping_) return;
+                job = jobs_.front();
+                worker = job->next_worker.fetch_add(1, std::memory_order_relaxed);
+                if (worker + 1 >= parallelism_) jobs_.pop_front();  // 名額用完
+                if (worker >= parallelism_) continue;
+            }
+            participate(*job, worker);
+        }
+    }
+
+    void participate(Job& job, size_t worker) {
+        size_t morsel;
+        while (takeLocal(job, worker, morsel) || steal(job, worker, morsel)) {
+            try {
+                job.fn(worker, morsel);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(job.done_mutex);
+                if (!job.error) job.error = std::current_exception();
+            }
+            if (job.done.fetch_add(1, std::memory_order_acq_rel) + 1 == job.count) {
+                std::lock_guard<std::mutex> lock(job.done_mutex);
+                job.done_cv.notify_all();
+            }
+        }
+    }
+
+    bool takeLocal(Job& job, size_t worker, size_t& morsel) {
+        Range& range = job.ranges[worker];
+        std::lock_guard<std::mutex> lock(range.mutex);
+        if (range.begin == range.end) return false;
+        morsel = range.begin++;
+        return true;
+    }
+
+    // 從其他參與者區段的後端取走一半，第一個 morsel 立即執行，其餘放入自己的區段
+    bool steal(Job& job, size_t worker, size_t& morsel) {
+        for (size_t i = 1; i < parallelism_; ++i) {
+            Range& victim = job.ranges[(worker + i) % parallelism_];
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                const size_t remaining = victim.end - victim.begin;
+                if (remaining == 0) continue;
+                end = victim.end;
+                begin = end - (remaining + 1) / 2;
+                victim.end = begin;
+            }
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            morsel = begin;
+            Range& own = job.ranges[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = begin + 1;
+            own.end = end;
+            return true;
+        }
+        return false;
+    }
+};
+
+// 每個參與者一份的部分結果，各佔一條快取線，避免平行掃描時的偽共享
+template <typename T>
+struct alignas(64) WorkerLocal {
+    T value{};
+};
+
+// 聚合結果 - 各掃描核心的部分結果可直接合併
+struct AggregateResult {
+    size_t count = 0;
+    double sum = 0.0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+
+    void merge(const AggregateResult& other) {
+        count += other.count;
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+    }
+
+    double average() const { return count == 0 ? 0.0 : sum / count; }
+};
+
+// 比較運算子
+enum class CompareOp {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+    BETWEEN  // value <= x <= upper
+};
+
+// 單一欄位上的比較述詞
+struct ColumnPredicate {
+    std::string column;
+    CompareOp op;
+    Value value;
+    Value upper;  // 只有 BETWEEN 使用
+
+    ColumnPredicate(std::string col, CompareOp cmp, Value v, Value hi = Value{})
+        : column(std::move(col)), op(cmp), value(std::move(v)), upper(std::move(hi)) {
+    }
+};
+
+// 述詞的析取：外層各組以 OR 合併，組內的述詞以 AND 合併
+using PredicateDisjunction = std::vector<std::vector<ColumnPredicate>>;
+
+inline size_t countTrailingZeros(uint64_t word) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return index;
+#else
+    return static_cast<size_t>(__builtin_ctzll(word));
+#endif
+}
+
+// 選取向量 - 每個 RecordId 一個位元
+class SelectionVector {
+private:
+    std::vector<uint64_t> bits_;
+    size_t size_;
+
+public:
+    explicit SelectionVector(size_t size = 0) : bits_((size + 63) / 64, 0), size_(size) {}
+
+    size_t size() const { return size_; }
+    uint64_t* words() { return bits_.data(); }
+    const uint64_t* words() const { return bits_.data(); }
+
+    void set(RecordId id) { bits_[id >> 6] |= uint64_t(1) << (id & 63); }
+    bool test(RecordId id) const { return (bits_[id >> 6] >> (id & 63)) & 1; }
+
+    // 範圍 [begin, begin + count) 內是否有任何位元被設定
+    bool anyInRange(size_t begin, size_t count) const {
+        size_t end = std::min(begin + count, size_);
+        for (size_t pos = begin; pos < end;) {
+            size_t shift = pos & 63;
+            size_t n = std::min<size_t>(64 - shift, end - pos);
+            uint64_t mask = (n == 64) ? ~uint64_t(0) : (((uint64_t(1) << n) - 1) << shift);
+            if (bits_[pos >> 6] & mask) return true;
+            pos += n;
+        }
+        return false;
+    }
+
+    // 設定範圍 [begin, begin + count) 內的所有位元
+    void setRange(size_t begin, size_t count) {
+        size_t end = std::min(begin + count, size_);
+        for (size_t pos = begin; pos < end;) {
+            size_t shift = pos & 63;
+            size_t n = std::min<size_t>(64 - shift, end - pos);
+            uint64_t mask = (n == 64) ? ~uint64_t(0) : (((uint64_t(1) << n) - 1) << shift);
+            bits_[pos >> 6] |= mask;
+            pos += n;
+        }
+    }
+
+    size_t countInRange(size_t begin, size_t count) const {
+        size_t end = std::min(begin + count, size_);
+        size_t total = 0;
+        for (size_t pos = begin; pos < end;) {
+            size_t shift = pos & 63;
+            size_t n = std::min<size_t>(64 - shift, end - pos);
+            uint64_t mask = (n == 64) ? ~uint64_t(0) : (((uint64_t(1) << n) - 1) << shift);
+            total += static_cast<size_t>(std::bitset<64>(bits_[pos >> 6] & mask).count());
+            pos += n;
+        }
+        return total;
+    }
+
+    void intersect(const SelectionVector& other) {
+        size_t n = std::min(bits_.size(), other.bits_.size());
+        for (size_t i = 0; i < n; ++i) bits_[i] &= other.bits_[i];
+        for (size_t i = n; i < bits_.size(); ++i) bits_[i] = 0;
+    }
+
+    void unite(const SelectionVector& other) {
+        size_t n = std::min(bits_.size(), other.bits_.size());
+        for (size_t i = 0; i < n; ++i) bits_[i] |= other.bits_[i];
+    }
+
+    size_t count() const {
+        size_t total = 0;
+        for (uint64_t w : bits_) total += static_cast<size_t>(std::bitset<64>(w).count());
+        return total;
+    }
+
+    // 轉為遞增排序的 RecordId 清單
+    std::vector<RecordId> toRecordIds() const {
+        std::vector<RecordId> ids;
+        ids.reserve(count());
+        for (size_t w = 0; w < bits_.size(); ++w) {
+            uint64_t word = bits_[w];
+            while (word != 0) {
+                ids.push_back(w * 64 + countTrailingZeros(word));
+                word &= word - 1;
+            }
+        }
+        return ids;
+    }
+};
+
+// 型別化掃描核心 - 直接在頁面原始位元組上運算，不經過 Value/std::variant。
+// 有 AVX2/NEON 時使用向量指令，否則退回多累加器的純量迴圈（編譯器可自動向量化）。
+namespace ScanKernels {
+
+    template <typename T>
+    inline T loadValue(const char* data, size_t index) {
+        T val;
+        std::memcpy(&val, data + index * sizeof(T), sizeof(T));
+        return val;
+    }
+
+    // 純量版本：四個獨立累加器打破相依鏈
+    template <typename T, typename SumT>
+    inline void aggregateScalar(const char* data, size_t begin, size_t count, AggregateResult& out) {
+        if (begin >= count) return;
+
+        SumT sums[4] = { 0, 0, 0, 0 };
+        T lo = loadValue<T>(data, begin);
+        T hi = lo;
+        size_t i = begin;
+        for (; i + 4 <= count; i += 4) {
+            for (size_t lane = 0; lane < 4; ++lane) {
+                T v = loadValue<T>(data, i + lane);
+                sums[lane] += static_cast<SumT>(v);
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+            }
+        }
+        for (; i < count; ++i) {
+            T v = loadValue<T>(data, i);
+            sums[0] += static_cast<SumT>(v);
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+        }
+
+        out.sum += static_cast<double>((sums[0] + sums[1]) + (sums[2] + sums[3]));
+        out.min = std::min(out.min, static_cast<double>(lo));
+        out.max = std::max(out.max, static_cast<double>(hi));
+    }
+
+    inline void aggregateInt32(const char* data, size_t count, AggregateResult& out) {
+        size_t i = 0;
+#if defined(__AVX2__)
+        if (count >= 8) {
+            __m256i sum_lo = _mm256_setzero_si256();
+            __m256i sum_hi = _mm256_setzero_si256();
+            __m256i vmin = _mm256_set1_epi32(std::numeric_limits<int32_t>::max());
+            __m256i vmax = _mm256_set1_epi32(std::numeric_limits<int32_t>::min());
+            for (; i + 8 <= count; i += 8) {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i * sizeof(int32_t)));
+                sum_lo = _mm256_add_epi64(sum_lo, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+                sum_hi = _mm256_add_epi64(sum_hi, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+                vmin = _mm256_min_epi32(vmin, v);
+                vmax = _mm256_max_epi32(vmax, v);
+            }
+            alignas(32) int64_t sums[4];
+            alignas(32) int32_t mins[8];
+            alignas(32) int32_t maxs[8];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(sums), _mm256_add_epi64(sum_lo, sum_hi));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(mins), vmin);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(maxs), vmax);
+            out.sum += static_cast<double>(sums[0] + sums[1] + sums[2] + sums[3]);
+            out.min = std::min(out.min, static_cast<double>(*std::min_element(mins, mins + 8)));
+            out.max = std::max(out.max, static_cast<double>(*std::max_element(maxs, maxs + 8)));
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        if (count >= 4) {
+            int64x2_t sum_lo = vdupq_n_s64(0);
+            int64x2_t sum_hi = vdupq_n_s64(0);
+            int32x4_t vmin = vdupq_n_s32(std::numeric_limits<int32_t>::max());
+            int32x4_t vmax = vdupq_n_s32(std::numeric_limits<int32_t>::min());
+            for (; i + 4 <= count; i += 4) {
+                int32x4_t v = vld1q_s32(reinterpret_cast<const int32_t*>(data + i * sizeof(int32_t)));
+                sum_lo = vaddw_s32(sum_lo, vget_low_s32(v));
+                sum_hi = vaddw_high_s32(sum_hi, v);
+                vmin = vminq_s32(vmin, v);
+                vmax = vmaxq_s32(vmax, v);
+            }
+            out.sum += static_cast<double>(vaddvq_s64(vaddq_s64(sum_lo, sum_hi)));
+            out.min = std::min(out.min, static_cast<double>(vminvq_s32(vmin)));
+            out.max = std::max(out.max, static_cast<double>(vmaxvq_s32(vmax)));
+        }
+#endif
+        aggregateScalar<int32_t, int64_t>(data, i, count, out);
+    }
+
+    inline void aggregateInt64(const char* data, size_t count, AggregateResult& out) {
+        // AVX2 沒有 int64 -> double 的轉換指令，交給自動向量化
+        aggregateScalar<int64_t, double>(data, 0, count, out);
+    }
+
+    inline void aggregateFloat(const char* data, size_t count, AggregateResult& out) {
+        size_t i = 0;
+#if defined(__AVX2__)
+        if (count >= 8) {
+            __m256d sum_lo = _mm256_setzero_pd();
+            __m256d sum_hi = _mm256_setzero_pd();
+            __m256 vmin = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+            __m256 vmax = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+            for (; i + 8 <= count; i += 8) {
+                __m256 v = _mm256_loadu_ps(reinterpret_cast<const float*>(data + i * sizeof(float)));
+                sum_lo = _mm256_add_pd(sum_lo, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+                sum_hi = _mm256_add_pd(sum_hi, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+                vmin = _mm256_min_ps(vmin, v);
+                vmax = _mm256_max_ps(vmax, v);
+            }
+            alignas(32) double sums[4];
+            alignas(32) float mins[8];
+            alignas(32) float maxs[8];
+            _mm256_store_pd(sums, _mm256_add_pd(sum_lo, sum_hi));
+            _mm256_store_ps(mins, vmin);
+            _mm256_store_ps(maxs, vmax);
+            out.sum += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+            out.min = std::min(out.min, static_cast<double>(*std::min_element(mins, mins + 8)));
+            out.max = std::max(out.max, static_cast<double>(*std::max_element(maxs, maxs + 8)));
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        if (count >= 4) {
+            float64x2_t sum_lo = vdupq_n_f64(0.0);
+            float64x2_t sum_hi = vdupq_n_f64(0.0);
+            float32x4_t vmin = vdupq_n_f32(std::numeric_limits<float>::infinity());
+            float32x4_t vmax = vdupq_n_f32(-std::numeric_limits<float>::infinity());
+            for (; i + 4 <= count; i += 4) {
+                float32x4_t v = vld1q_f32(reinterpret_cast<const float*>(data + i * sizeof(float)));
+                sum_lo = vaddq_f64(sum_lo, vcvt_f64_f32(vget_low_f32(v)));
+                sum_hi = vaddq_f64(sum_hi, vcvt_high_f64_f32(v));
+                vmin = vminq_f32(vmin, v);
+                vmax = vmaxq_f32(vmax, v);
+            }
+            out.sum += vaddvq_f64(vaddq_f64(sum_lo, sum_hi));
+            out.min = std::min(out.min, static_cast<double>(vminvq_f32(vmin)));
+            out.max = std::max(out.max, static_cast<double>(vmaxvq_f32(vmax)));
+        }
+#endif
+        aggregateScalar<float, double>(data, i, count, out);
+    }
+
+    inline void aggregateDouble(const char* data, size_t count, AggregateResult& out) {
+        size_t i = 0;
+#if defined(__AVX2__)
+        if (count >= 8) {
+            __m256d sum0 = _mm256_setzero_pd();
+            __m256d sum1 = _mm256_setzero_pd();
+            __m256d vmin = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+            __m256d vmax = _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+            for (; i + 8 <= count; i += 8) {
+                __m256d a = _mm256_loadu_pd(reinterpret_cast<const double*>(data + i * sizeof(double)));
+                __m256d b = _mm256_loadu_pd(reinterpret_cast<const double*>(data + (i + 4) * sizeof(double)));
+                sum0 = _mm256_add_pd(sum0, a);
+                sum1 = _mm256_add_pd(sum1, b);
+                vmin = _mm256_min_pd(vmin, _mm256_min_pd(a, b));
+                vmax = _mm256_max_pd(vmax, _mm256_max_pd(a, b));
+            }
+            alignas(32) double sums[4];
+            alignas(32) double mins[4];
+            alignas(32) double maxs[4];
+            _mm256_store_pd(sums, _mm256_add_pd(sum0, sum1));
+            _mm256_store_pd(mins, vmin);
+            _mm256_store_pd(maxs, vmax);
+            out.sum += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+            out.min = std::min(out.min, *std::min_element(mins, mins + 4));
+            out.max = std::max(out.max, *std::max_element(maxs, maxs + 4));
+        }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        if (count >= 4) {
+            float64x2_t sum0 = vdupq_n_f64(0.0);
+            float64x2_t sum1 = vdupq_n_f64(0.0);
+            float64x2_t vmin = vdupq_n_f64(std::numeric_limits<double>::infinity());
+            float64x2_t vmax = vdupq_n_f64(-std::numeric_limits<double>::infinity());
+            for (; i + 4 <= count; i += 4) {
+                float64x2_t a = vld1q_f64(reinterpret_cast<const double*>(data + i * sizeof(double)));
+                float64x2_t b = vld1q_f64(reinterpret_cast<const double*>(data + (i + 2) * sizeof(double)));
+                sum0 = vaddq_f64(sum0, a);
+                sum1 = vaddq_f64(sum1, b);
+                vmin = vminq_f64(vmin, vminq_f64(a, b));
+                vmax = vmaxq_f64(vmax, vmaxq_f64(a, b));
+            }
+            out.sum += vaddvq_f64(vaddq_f64(sum0, sum1));
+            out.min = std::min(out.min, vminvq_f64(vmin));
+            out.max = std::max(out.max, vmaxvq_f64(vmax));
+        }
+#endif
+        aggregateScalar<double, double>(data, i, count, out);
+    }
+
+    // 依列型別分派一次（每頁一次，而不是每筆資料一次）
+    inline void aggregate(DataType type, const char* data, size_t count, AggregateResult& out) {
+        switch (type) {
+        case DataType::INT32: aggregateInt32(data, count, out); break;
+        case DataType::INT64: aggregateInt64(data, count, out); break;
+        case DataType::FLOAT: aggregateFloat(data, count, out); break;
+        case DataType::DOUBLE: aggregateDouble(data, count, out); break;
+        default: break;  // 非數值型別只計數
+        }
+        out.count += count;
+    }
+
+    // 述詞核心：對一頁的原始值求值，結果以位元寫入 bits（從 bit_offset 開始）。
+    // 每次組好一個 64 位元字組再寫回，內層迴圈沒有分支。
+    template <typename T, typename Pred>
+    inline void filterLoop(const char* data, size_t count, uint64_t* bits, size_t bit_offset, Pred pred) {
+        size_t i = 0;
+        while (i < count) {
+            size_t pos = bit_offset + i;
+            size_t shift = pos & 63;
+            size_t n = std::min<size_t>(64 - shift, count - i);
+            uint64_t mask = 0;
+            for (size_t j = 0; j < n; ++j) {
+                mask |= uint64_t(pred(loadValue<T>(data, i + j))) << j;
+            }
+            bits[pos >> 6] |= mask << shift;
+            i += n;
+        }
+    }
+
+    template <typename T>
+    inline void filter(const char* data, size_t count, CompareOp op, T lo, T hi,
+        uint64_t* bits, size_t bit_offset) {
+        switch (op) {
+        case CompareOp::EQ: filterLoop<T>(data, count, bits, bit_offset, [lo](T v) { return v == lo; }); break;
+        case CompareOp::NE: filterLoop<T>(data, count, bits, bit_offset, [lo](T v) { return v != lo; }); break;
+        case CompareOp::LT: filterLoop<T>(data, count, bits, bit_offset, [lo](T v) { return v < lo; }); break;
+        case CompareOp::LE: filterLoop<T>(data, count, bits, bit_offset, [lo](T v) { return v <= lo; }); break;
+        case CompareOp::GT: filterLoop<T>(data, count, bits, bit_offset, [lo](T v) { return v > lo; }); break;
+        case CompareOp::GE: filterLoop<T>(data, count, bits, bit_offset, [lo](T v) { return v >= lo; }); break;
+        case CompareOp::BETWEEN:
+            filterLoop<T>(data, count, bits, bit_offset, [lo, hi](T v) { return v >= lo && v <= hi; });
+            break;
+        }
+    }
+
+    // 單一值的述詞（點陣圖索引逐鍵求值時使用）
+    template <typename T>
+    inline bool matchValue(CompareOp op, T v, T lo, T hi) {
+        switch (op) {
+        case CompareOp::EQ: return v == lo;
+        case CompareOp::NE: return v != lo;
+        case CompareOp::LT: return v < lo;
+        case CompareOp::LE: return v <= lo;
+        case CompareOp::GT: return v > lo;
+        case CompareOp::GE: return v >= lo;
+        case CompareOp::BETWEEN: return v >= lo && v <= hi;
+        }
+        return false;
+    }
+
+    // 單一字串值的述詞
+    inline bool matchString(CompareOp op, std::string_view v, std::string_view lo, std::string_view hi) {
+        switch (op) {
+        case CompareOp::EQ: return v == lo;
+        case CompareOp::NE: return v != lo;
+        case CompareOp::LT: return v < lo;
+        case CompareOp::LE: return v <= lo;
+        case CompareOp::GT: return v > lo;
+        case CompareOp::GE: return v >= lo;
+        case CompareOp::BETWEEN: return v >= lo && v <= hi;
+        }
+        return false;
+    }
+
+    // 字典代碼的述詞：code_match[code] 為該代碼是否符合；超出表格的代碼（掃描期間新增的字串）視為不符合
+    inline void filterCodes(const char* data, size_t count, const uint8_t* code_match, size_t code_count,
+        uint64_t* bits, size_t bit_offset) {
+        filterLoop<int32_t>(data, count, bits, bit_offset, [code_match, code_count](int32_t code) {
+            return static_cast<uint32_t>(code) < code_count && code_match[code] != 0;
+        });
+    }
+}
+
+// 資料頁封存（寫滿）時依內容自動選用的編碼
+enum class PageEncoding : uint8_t {
+    PLAIN,     // 原始槽位
+    CONSTANT,  // 整頁同一個值，不佔頁面空間
+    RLE,       // 段結尾（uint16）陣列 + 每段的值
+    FOR,       // frame-of-reference：減去最小值後以最少位元數打包
+    DELTA      // 相鄰差值再做 frame-of-reference 打包，適合遞增的 id
+};
+
+// 已封存資料頁的位置與解碼參數。多個編碼後的頁面依序緊密存放在欄位資料檔中，不跨越實體頁邊界
+struct EncodedPageInfo {
+    PageId page_id = 0;      // 欄位資料檔中的實體頁
+    uint32_t offset = 0;     // 實體頁內的位元組位移
+    uint32_t size = 0;       // 編碼後的位元組數（CONSTANT 為 0）
+    PageEncoding encoding = PageEncoding::PLAIN;
+    uint8_t bit_width = 0;   // FOR/DELTA 打包寬度
+    uint16_t run_count = 0;  // RLE 段數
+    int64_t base = 0;        // CONSTANT 的值、FOR 的參考值、DELTA 的首值
+    int64_t delta_base = 0;  // DELTA 差值的參考值
+};
+
+// 資料頁編解碼 - 槽位一律視為 1/4/8 位元組的整數位元樣式，浮點數的編碼同樣無損
+namespace PageCodec {
+
+    constexpr uint8_t MAX_PACKED_WIDTH = 56;  // 打包值一次 64 位元載入即可取出
+
+    inline int64_t loadSlot(const char* data, size_t index, size_t value_size) {
+        const char* p = data + index * value_size;
+        switch (value_size) {
+        case 1: { uint8_t v; std::memcpy(&v, p, 1); return v; }
+        case 4: { int32_t v; std::memcpy(&v, p, 4); return v; }
+        default: { int64_t v; std::memcpy(&v, p, 8); return v; }
+        }
+    }
+
+    inline void storeSlot(char* data, size_t index, size_t value_size, int64_t value) {
+        char* p = data + index * value_size;
+        switch (value_size) {
+        case 1: { uint8_t v = static_cast<uint8_t>(value); std::memcpy(p, &v, 1); break; }
+        case 4: { int32_t v = static_cast<int32_t>(value); std::memcpy(p, &v, 4); break; }
+        default: std::memcpy(p, &value, 8); break;
+        }
+    }
+
+    inline uint8_t bitWidth(uint64_t range) {
+        uint8_t width = 0;
+        while (range != 0) {
+            ++width;
+            range >>= 1;
+        }
+        return width;
+    }
+
+    // 尾端多保留一個字組，解碼時可無條件做 64 位元載入
+    inline size_t packedSize(size_t count, uint8_t width) {
+        return width == 0 ? 0 : (count * width + 7) / 8 + sizeof(uint64_t);
+    }
+
+    inline void pack(char* out, size_t index, uint8_t width, uint64_t value) {
+        if (width == 0) return;
+        size_t bit = index * width;
+        uint64_t word;
+        std::memcpy(&word, out + bit / 8, sizeof(word));
+        word |= value << (bit & 7);
+        std::memcpy(out + bit / 8, &word, sizeof(word));
+    }
+
+    inline uint64_t unpack(const char* in, size_t index, uint8_t width) {
+        if (width == 0) return 0;
+        size_t bit = index * width;
+        uint64_t word;
+        std::memcpy(&word, in + bit / 8, sizeof(word));
+        return (word >> (bit & 7)) & ((uint64_t(1) << width) - 1);
+    }
+
+    // 分析一頁的值，選出編碼後最小的編碼；同大小時依 FOR、DELTA、RLE 的順序偏好，都不比原始小則維持 PLAIN
+    inline EncodedPageInfo analyze(const char* data, size_t count, size_t value_size) {
+        EncodedPageInfo info;
+        info.size = static_cast<uint32_t>(count * value_size);
+        if (count == 0) return info;
+
+        int64_t prev = loadSlot(data, 0, value_size);
+        int64_t lo = prev, hi = prev;
+        int64_t delta_lo = std::numeric_limits<int64_t>::max();
+        int64_t delta_hi = std::numeric_limits<int64_t>::min();
+        size_t runs = 1;
+        for (size_t i = 1; i < count; ++i) {
+            int64_t v = loadSlot(data, i, value_size);
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+            int64_t delta = static_cast<int64_t>(static_cast<uint64_t>(v) - static_cast<uint64_t>(prev));
+            delta_lo = std::min(delta_lo, delta);
+            delta_hi = std::max(delta_hi, delta);
+            if (v != prev) ++runs;
+            prev = v;
+        }
+
+        if (lo == hi) {
+            info.encoding = PageEncoding::CONSTANT;
+            info.size = 0;
+            info.base = lo;
+            return info;
+        }
+
+        // 依偏好順序比較，只有嚴格更小才換掉先前的選擇
+        const uint8_t for_width = bitWidth(static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo));
+        if (for_width <= MAX_PACKED_WIDTH && packedSize(count, for_width) < info.size) {
+            info.encoding = PageEncoding::FOR;
+            info.size = static_cast<uint32_t>(packedSize(count, for_width));
+            info.bit_width = for_width;
+            info.base = lo;
+        }
+
+        const uint8_t delta_width = bitWidth(static_cast<uint64_t>(delta_hi) - static_cast<uint64_t>(delta_lo));
+        if (delta_width <= MAX_PACKED_WIDTH && packedSize(count - 1, delta_width) < info.size) {
+            info.encoding = PageEncoding::DELTA;
+            info.size = static_cast<uint32_t>(packedSize(count - 1, delta_width));
+            info.bit_width = delta_width;
+            info.base = loadSlot(data, 0, value_size);
+            info.delta_base = delta_lo;
+        }
+
+        const size_t rle_size = runs * (sizeof(uint16_t) + value_size);
+        if (runs <= std::numeric_limits<uint16_t>::max() && rle_size < info.size) {
+            info.encoding = PageEncoding::RLE;
+            info.size = static_cast<uint32_t>(rle_size);
+            info.bit_width = 0;
+            info.run_count = static_cast<uint16_t>(runs);
+        }
+        return info;
+    }
+
+    // 依 analyze 的結果編碼 count 個槽位，out 至少需要 info.size 位元組
+    inline void encode(const EncodedPageInfo& info, const char* data, size_t count, size_t value_size, char* out) {
+        switch (info.encoding) {
+        case PageEncoding::PLAIN:
+            std::memcpy(out, data, count * value_size);
+            break;
+        case PageEncoding::CONSTANT:
+            break;
+        case PageEncoding::RLE: {
+            char* values = out + info.run_count * sizeof(uint16_t);
+            size_t run = 0;
+            for (size_t i = 0; i < count; ++i) {
+                int64_t v = loadSlot(data, i, value_size);
+                if (i + 1 == count || loadSlot(data, i + 1, value_size) != v) {
+                    uint16_t end = static_cast<uint16_t>(i + 1);
+                    std::memcpy(out + run * sizeof(uint16_t), &end, sizeof(end));
+                    storeSlot(values, run, value_size, v);
+                    ++run;
+                }
+            }
+            break;
+        }
+        case PageEncoding::FOR:
+            std::memset(out, 0, info.size);
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t v = static_cast<uint64_t>(loadSlot(data, i, value_size));
+                pack(out, i, info.bit_width, v - static_cast<uint64_t>(info.base));
+            }
+            break;
+        case PageEncoding::DELTA:
+            std::memset(out, 0, info.size);
+            for (size_t i = 1; i < count; ++i) {
+                uint64_t delta = static_cast<uint64_t>(loadSlot(data, i, value_size)) -
+                    static_cast<uint64_t>(loadSlot(data, i - 1, value_size));
+                pack(out, i - 1, info.bit_width, delta - static_cast<uint64_t>(info.delta_base));
+            }
+            break;
+        }
+    }
+
+    inline uint16_t runEnd(const char* in, size_t run) {
+        uint16_t end;
+        std::memcpy(&end, in + run * sizeof(uint16_t), sizeof(end));
+        return end;
+    }
+
+    // 將前 count 個值解碼回原始槽位格式，之後即可直接交給 ScanKernels
+    inline void decode(const EncodedPageInfo& info, const char* in, size_t count, size_t value_size, char* out) {
+        switch (info.encoding) {
+        case PageEncoding::PLAIN:
+            std::memcpy(out, in, count * value_size);
+            break;
+        case PageEncoding::CONSTANT:
+            for (size_t i = 0; i < count; ++i) storeSlot(out, i, value_size, info.base);
+            break;
+        case PageEncoding::RLE: {
+            const char* values = in + info.run_count * sizeof(uint16_t);
+            size_t begin = 0;
+            for (size_t run = 0; run < info.run_count && begin < count; ++run) {
+                size_t end = std::min<size_t>(runEnd(in, run), count);
+                int64_t v = loadSlot(values, run, value_size);
+                for (size_t i = begin; i < end; ++i) storeSlot(out, i, value_size, v);
+                begin = end;
+            }
+            break;
+        }
+        case PageEncoding::FOR:
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t v = static_cast<uint64_t>(info.base) + unpack(in, i, info.bit_width);
+                storeSlot(out, i, value_size, static_cast<int64_t>(v));
+            }
+            break;
+        case PageEncoding::DELTA: {
+            uint64_t v = static_cast<uint64_t>(info.base);
+            if (count > 0) storeSlot(out, 0, value_size, info.base);
+            for (size_t i = 1; i < count; ++i) {
+                v += static_cast<uint64_t>(info.delta_base) + unpack(in, i - 1, info.bit_width);
+                storeSlot(out, i, value_size, static_cast<int64_t>(v));
+            }
+            break;
+        }
+        }
+    }
+
+    // 單筆解碼，供點查詢使用；DELTA 需要累加到 index 為止
+    inline int64_t decodeValue(const EncodedPageInfo& info, const char* in, size_t index, size_t value_size) {
+        switch (info.encoding) {
+        case PageEncoding::PLAIN:
+            return loadSlot(in, index, value_size);
+        case PageEncoding::CONSTANT:
+            return info.base;
+        case PageEncoding::RLE: {
+            size_t lo = 0, hi = info.run_count;
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (runEnd(in, mid) <= index) lo = mid + 1;
+                else hi = mid;
+            }
+            return loadSlot(in + info.run_count * sizeof(uint16_t), lo, value_size);
+        }
+        case PageEncoding::FOR:
+            return static_cast<int64_t>(static_cast<uint64_t>(info.base) + unpack(in, index, info.bit_width));
+        case PageEncoding::DELTA: {
+            uint64_t v = static_cast<uint64_t>(info.base);
+            if (info.bit_width == 0) {
+                return static_cast<int64_t>(v + static_cast<uint64_t>(info.delta_base) * index);
+            }
+            for (size_t i = 0; i < index; ++i) {
+                v += static_cast<uint64_t>(info.delta_base) + unpack(in, i, info.bit_width);
+            }
+            return static_cast<int64_t>(v);
+        }
+        }
+        return 0;
+    }
+
+    // CONSTANT/RLE 頁面不必解碼：逐段回呼 fn(slot, begin, length)，slot 指向該段值的原始槽位
+    template <typename Fn>
+    inline void forEachRun(const EncodedPageInfo& info, const char* in, size_t count, size_t value_size, Fn&& fn) {
+        if (info.encoding == PageEncoding::CONSTANT) {
+            char slot[sizeof(int64_t)];
+            storeSlot(slot, 0, value_size, info.base);
+            fn(static_cast<const char*>(slot), size_t(0), count);
+            return;
+        }
+
+        const char* values = in + info.run_count * sizeof(uint16_t);
+        size_t begin = 0;
+        for (size_t run = 0; run < info.run_count && begin < count; ++run) {
+            size_t end = std::min<size_t>(runEnd(in, run), count);
+            fn(values + run * value_size, begin, end - begin);
+            begin = end;
+        }
+    }
+}
+
+// 字串欄位的存放方式
+enum class StringEncoding {
+    HEAP,        // 資料檔存放 StringRef，字串本身依序存放在字串堆積檔
+    DICTIONARY   // 資料檔存放字典代碼（int32），適合低基數欄位；述詞與索引都在代碼上運作
+};
+
+constexpr size_t MAX_STRING_LENGTH = 255;  // 超過的部分會被截斷
+
+// 字串堆積中一個字串的位置；字串不會跨頁
+struct StringRef {
+    uint32_t page;
+    uint16_t offset;
+    uint16_t length;
+};
+
+static_assert(sizeof(StringRef) == 8, "StringRef must stay 8 bytes");
+
+// 字串堆積檔 - 只附加；附加由呼叫端序列化（DiskBasedColumn 的 append_mutex_）
+class StringHeap {
+private:
+    FileId file_id_;
+    BufferPoolManager& buffer_manager_;
+    uint32_t tail_page_;
+    size_t tail_offset_;
+
+public:
+    StringHeap(const std::string& file_name, BufferPoolManager& buffer_manager)
+        : file_id_(buffer_manager.registerFile(file_name)), buffer_manager_(buffer_manager),
+        tail_page_(0), tail_offset_(0) {
+    }
+
+    StringRef append(std::string_view value) {
+        value = value.substr(0, MAX_STRING_LENGTH);
+        if (tail_offset_ + value.size() > PAGE_SIZE) {
+            tail_page_++;
+            tail_offset_ = 0;
+        }
+
+        StringRef ref{ tail_page_, static_cast<uint16_t>(tail_offset_), static_cast<uint16_t>(value.size()) };
+        if (!value.empty()) {
+            auto page = buffer_manager_.fetchPageWrite(file_id_, tail_page_);
+            std::memcpy(page->data + tail_offset_, value.data(), value.size());
+            page->is_dirty = true;
+        }
+        tail_offset_ += value.size();
+        return ref;
+    }
+
+    // 帶長度的記錄 [u16 長度+1][位元組]，供字典重新開啟時依序讀回；長度欄位為 0 表示本頁其餘部分未使用
+    void appendRecord(std::string_view value) {
+        value = value.substr(0, MAX_STRING_LENGTH);
+        const size_t bytes = sizeof(uint16_t) + value.size();
+        if (tail_offset_ + bytes > PAGE_SIZE) {
+            if (tail_offset_ + sizeof(uint16_t) <= PAGE_SIZE) {
+                auto page = buffer_manager_.fetchPageWrite(file_id_, tail_page_);
+                std::memset(page->data + tail_offset_, 0, sizeof(uint16_t));
+                page->is_dirty = true;
+            }
+            tail_page_++;
+            tail_offset_ = 0;
+        }
+
+        const uint16_t header = static_cast<uint16_t>(value.size() + 1);
+        auto page = buffer_manager_.fetchPageWrite(file_id_, tail_page_);
+        std::memcpy(page->data + tail_offset_, &header, sizeof(header));
+        std::memcpy(page->data + tail_offset_ + sizeof(header), value.data(), value.size());
+        page->is_dirty = true;
+        tail_offset_ += bytes;
+    }
+
+    // 依序把前 count 筆 appendRecord 寫入的記錄交給 fn(string_view)
+    template <typename Fn>
+    void forEachRecord(size_t count, Fn&& fn) const {
+        PageGuard page;
+        uint32_t page_id = 0;
+        size_t offset = 0;
+        for (size_t i = 0; i < count;) {
+            if (page_id > tail_page_) {
+                throw std::runtime_error("String heap ends after " + std::to_string(i) + " records");
+            }
+            if (offset + sizeof(uint16_t) > PAGE_SIZE) {
+                page_id++;
+                offset = 0;
+                continue;
+            }
+            if (!page || page->page_id != page_id) {
+                page = buffer_manager_.fetchPageRead(file_id_, page_id);
+            }
+
+            uint16_t header;
+            std::memcpy(&header, page->data + offset, sizeof(header));
+            if (header == 0) {
+                page_id++;
+                offset = 0;
+                continue;
+            }
+            const size_t length = header - 1u;
+            if (length > MAX_STRING_LENGTH || offset + sizeof(header) + length > PAGE_SIZE) {
+                throw std::runtime_error("Corrupt record in string heap page " + std::to_string(page_id));
+            }
+            fn(std::string_view(page->data + offset + sizeof(header), length));
+            offset += sizeof(header) + length;
+            ++i;
+        }
+    }
+
+    void saveState(ByteWriter& out) const {
+        out.put(tail_page_);
+        out.put(static_cast<uint32_t>(tail_offset_));
+    }
+
+    void restoreState(ByteReader& in) {
+        tail_page_ = in.get<uint32_t>();
+        tail_offset_ = in.get<uint32_t>();
+        if (tail_offset_ > PAGE_SIZE) throw std::runtime_error("Invalid string heap state in catalog");
+    }
+
+    std::string read(const StringRef& ref) const {
+        if (ref.length == 0) return std::string();
+        auto page = buffer_manager_.fetchPageRead(file_id_, ref.page);
+        return std::string(page->data + ref.offset, ref.length);
+    }
+
+    // 連續讀取時重用呼叫端持有的頁面守衛，同一頁的字串只取頁一次；
+    // 回傳的 string_view 在 cached 換頁或釋放前有效
+    std::string_view view(const StringRef& ref, PageGuard& cached) const {
+        if (ref.length == 0) return std::string_view();
+        if (!cached || cached->page_id != ref.page) {
+            cached = buffer_manager_.fetchPageRead(file_id_, ref.page);
+        }
+        return std::string_view(cached->data + ref.offset, ref.length);
+    }
+};
+
+// 字串字典 - 代碼依字串首次出現的順序分配，字串同時以帶長度的記錄寫入字典堆積檔
+class StringDictionary {
+private:
+    StringHeap heap_;
+    std::vector<std::string> values_;
+    std::unordered_map<std::string, int32_t> codes_;
+    mutable std::shared_mutex latch_;
+
+public:
+    static constexpr int32_t NO_CODE = -1;
+
+    StringDictionary(const std::string& file_name, BufferPoolManager& buffer_manager)
+        : heap_(file_name, buffer_manager) {
+    }
+
+    // 取得字串的代碼，不存在時新增
+    int32_t encode(std::string_view value) {
+        std::string key(value.substr(0, MAX_STRING_LENGTH));
+        {
+            std::shared_lock<std::shared_mutex> lock(latch_);
+            auto it = codes_.find(key);
+            if (it != codes_.end()) return it->second;
+        }
+
+        std::unique_lock<std::shared_mutex> lock(latch_);
+        auto it = codes_.find(key);
+        if (it != codes_.end()) return it->second;
+        if (values_.size() >= static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+            throw std::runtime_error("String dictionary is full");
+        }
+
+        int32_t code = static_cast<int32_t>(values_.size());
+        heap_.appendRecord(key);
+        codes_.emplace(key, code);
+        values_.push_back(std::move(key));
+        return code;
+    }
+
+    // 查詢字串的代碼；不在字典中時回傳 NO_CODE
+    int32_t find(std::string_view value) const {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        auto it = codes_.find(std::string(value.substr(0, MAX_STRING_LENGTH)));
+        return it != codes_.end() ? it->second : NO_CODE;
+    }
+
+    std::string decode(int32_t code) const {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        if (code < 0 || static_cast<size_t>(code) >= values_.size()) {
+            throw std::runtime_error("Invalid dictionary code " + std::to_string(code));
+        }
+        return values_[code];
+    }
+
+    // 在字典上求值述詞，回傳每個代碼是否符合
+    std::vector<uint8_t> matchCodes(CompareOp op, std::string_view lo, std::string_view hi) const {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        std::vector<uint8_t> match(values_.size());
+        for (size_t code = 0; code < values_.size(); ++code) {
+            match[code] = ScanKernels::matchString(op, values_[code], lo, hi) ? 1 : 0;
+        }
+        return match;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        return values_.size();
+    }
+
+    void saveState(ByteWriter& out) const {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        out.put(static_cast<uint32_t>(values_.size()));
+        heap_.saveState(out);
+    }
+
+    // 從字典堆積依序讀回前 count 個字串，代碼即為讀回的順序
+    void restoreState(ByteReader& in) {
+        std::unique_lock<std::shared_mutex> lock(latch_);
+        const size_t count = in.get<uint32_t>();
+        heap_.restoreState(in);
+        values_.clear();
+        codes_.clear();
+        values_.reserve(count);
+        heap_.forEachRecord(count, [this](std::string_view value) {
+            codes_.emplace(std::string(value), static_cast<int32_t>(values_.size()));
+            values_.emplace_back(value);
+        });
+    }
+};
+
+// 欄式記錄批次 - 每個欄位一個型別化的連續陣列，欄位依位置存取，不為每列配置雜湊表與 variant。
+// DiskBasedTable::newBatch() 建立與表格欄位順序、型別相同的空批次；insertBatch 時每個欄位整段寫入資料頁。
+// BOOL 欄位以 uint8_t（0/1）存放，避免 std::vector<bool> 的位元壓縮
+class RecordBatch {
+public:
+    // 與 Value、DataType 的順序一致
+    using ColumnValues = std::variant<std::vector<int32_t>, std::vector<int64_t>, std::vector<float>,
+        std::vector<double>, std::vector<std::string>, std::vector<uint8_t>>;
+
+    struct Column {
+        std::string name;
+        DataType type;
+        ColumnValues values;
+
+        size_t size() const {
+            return std::visit([](const auto& v) { return v.size(); }, values);
+        }
+    };
+
+private:
+    std::vector<Column> columns_;
+
+public:
+    void addColumn(const std::string& name, DataType type) {
+        columns_.push_back({ name, type, makeValues(type) });
+    }
+
+    size_t columnCount() const { return columns_.size(); }
+    const Column& column(size_t index) const { return columns_.at(index); }
+    Column& column(size_t index) { return columns_.at(index); }
+
+    size_t columnIndex(const std::string& name) const {
+        for (size_t i = 0; i < columns_.size(); ++i) {
+            if (columns_[i].name == name) return i;
+        }
+        throw std::runtime_error("Column not in batch: " + name);
+    }
+
+    // 第 index 個欄位的值陣列；T 必須與欄位型別相同
+    template <typename T>
+    std::vector<T>& values(size_t index) {
+        auto* values = std::get_if<std::vector<T>>(&columns_.at(index).values);
+        if (!values) {
+            throw std::runtime_error("Batch column " + columns_[index].name + " has a different type");
+        }
+        return *values;
+    }
+
+    template <typename T>
+    const std::vector<T>& values(size_t index) const {
+        const auto* values = std::get_if<std::vector<T>>(&columns_.at(index).values);
+        if (!values) {
+            throw std::runtime_error("Batch column " + columns_[index].name + " has a different type");
+        }
+        return *values;
+    }
+
+    // 單一儲存格；逐格轉成 Value 較慢，只適合輸出少量結果
+    Value value(size_t column, size_t row) const {
+        return std::visit([row](const auto& v) -> Value {
+            using T = typename std::decay_t<decltype(v)>::value_type;
+            if constexpr (std::is_same_v<T, uint8_t>) {
+                return v.at(row) != 0;
+            }
+            else {
+                return v.at(row);
+            }
+            }, columns_.at(column).values);
+    }
+
+    void reserve(size_t rows) {
+        for (auto& column : columns_) {
+            std::visit([rows](auto& v) { v.reserve(rows); }, column.values);
+        }
+    }
+
+    // 列數；各欄位長度不一致時拋出例外
+    size_t rowCount() const {
+        if (columns_.empty()) return 0;
+        const size_t rows = columns_.front().size();
+        for (const auto& column : columns_) {
+            if (column.size() != rows) {
+                throw std::runtime_error("Batch column " + column.name + " has " + std::to_string(column.size()) +
+                    " values, expected " + std::to_string(rows));
+            }
+        }
+        return rows;
+    }
+
+    // 在結構相同的批次後面附加 other 的所有列
+    void append(const RecordBatch& other) {
+        if (other.columns_.size() != columns_.size()) {
+            throw std::runtime_error("Cannot append a batch with a different number of columns");
+        }
+        for (size_t c = 0; c < columns_.size(); ++c) {
+            std::visit([&](auto& v) {
+                using V = std::decay_t<decltype(v)>;
+                const auto* source = std::get_if<V>(&other.columns_[c].values);
+                if (!source) throw std::runtime_error("Batch column " + columns_[c].name + " has a different type");
+                v.insert(v.end(), source->begin(), source->end());
+                }, columns_[c].values);
+        }
+    }
+
+    // 保留欄位結構，清空所有值
+    void clear() {
+        for (auto& column : columns_) {
+            std::visit([](auto& v) { v.clear(); }, column.values);
+        }
+    }
+
+    // 日誌內容：依欄位順序寫入整段值；定長值為原始位元組，字串逐筆帶長度
+    void writeValues(ByteWriter& out) const {
+        for (const auto& column : columns_) {
+            out.put(static_cast<uint8_t>(column.type));
+            std::visit([&out](const auto& v) {
+                using T = typename std::decay_t<decltype(v)>::value_type;
+                if constexpr (std::is_same_v<T, std::string>) {
+                    for (const auto& str : v) out.putString(str);
+                }
+                else {
+                    out.putBytes(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+                }
+                }, column.values);
+        }
+    }
+
+    // 在結構相同的批次後面附加 writeValues 寫出的 rows 列
+    void readValues(ByteReader& in, size_t rows) {
+        for (auto& column : columns_) {
+            if (static_cast<DataType>(in.get<uint8_t>()) != column.type) {
+                throw std::runtime_error("Batch record does not match column " + column.name);
+            }
+            std::visit([&in, rows](auto& v) {
+                using T = typename std::decay_t<decltype(v)>::value_type;
+                if constexpr (std::is_same_v<T, std::string>) {
+                    for (size_t r = 0; r < rows; ++r) v.push_back(in.getString());
+                }
+                else {
+                    std::string_view bytes = in.getBytes();
+                    if (bytes.size() != rows * sizeof(T)) throw std::runtime_error("Truncated batch record");
+                    const size_t start = v.size();
+                    v.resize(start + rows);
+                    std::memcpy(v.data() + start, bytes.data(), bytes.size());
+                }
+                }, column.values);
+        }
+    }
+
+private:
+    static ColumnValues makeValues(DataType type) {
+        switch (type) {
+        case DataType::INT32: return std::vector<int32_t>();
+        case DataType::INT64: return std::vector<int64_t>();
+        case DataType::FLOAT: return std::vector<float>();
+        case DataType::DOUBLE: return std::vector<double>();
+        case DataType::STRING: return std::vector<std::string>();
+        case DataType::BOOL: return std::vector<uint8_t>();
+        }
+        throw std::runtime_error("Unsupported column type");
+    }
+};
+
+// Roaring 壓縮點陣圖 - RecordId 依高位元（id >> 16）分到各容器，容器存放 65536 個 id 範圍內的低 16 位元：
+// 基數不超過 ARRAY_LIMIT 時為遞增排序的 uint16 陣列，否則為 1024 個 64 位元字組的點陣圖。
+// 稀疏與密集的區段都很緊湊；交集與聯集逐容器進行，每個容器維護自己的基數，計數不必走訪位元
+class RoaringBitmap {
+public:
+    static constexpr size_t ARRAY_LIMIT = 4096;
+    static constexpr size_t CONTAINER_WORDS = 1024;
+
+private:
+    struct Container {
+        std::vector<uint16_t> array;  // 陣列容器
+        std::vector<uint64_t> bits;   // 點陣圖容器；非空時代表此容器為點陣圖
+        size_t cardinality = 0;
+
+        bool isBitmap() const { return !bits.empty(); }
+
+        bool contains(uint16_t low) const {
+            if (isBitmap()) return (bits[low >> 6] >> (low & 63)) & 1;
+            return std::binary_search(array.begin(), array.end(), low);
+        }
+
+        // 回傳是否新增；依序附加時只在陣列尾端推入
+        bool add(uint16_t low) {
+            if (isBitmap()) {
+                uint64_t& word = bits[low >> 6];
+                const uint64_t mask = uint64_t(1) << (low & 63);
+                if (word & mask) return false;
+                word |= mask;
+                cardinality++;
+                return true;
+            }
+            if (array.empty() || array.back() < low) {
+                array.push_back(low);
+            }
+            else {
+                auto it = std::lower_bound(array.begin(), array.end(), low);
+                if (*it == low) return false;
+                array.insert(it, low);
+            }
+            cardinality++;
+            if (array.size() > ARRAY_LIMIT) toBitmap();
+            return true;
+        }
+
+        void toBitmap() {
+            bits.assign(CONTAINER_WORDS, 0);
+            for (uint16_t low : array) bits[low >> 6] |= uint64_t(1) << (low & 63);
+            array.clear();
+            array.shrink_to_fit();
+        }
+
+        // 基數降到 ARRAY_LIMIT 以下的點陣圖容器轉回陣列
+        void shrink() {
+            if (!isBitmap() || cardinality > ARRAY_LIMIT) return;
+            array.reserve(cardinality);
+            forEach([&](uint16_t low) { array.push_back(low); });
+            bits.clear();
+            bits.shrink_to_fit();
+        }
+
+        // 依遞增順序走訪低 16 位元
+        template <typename Fn>
+        void forEach(Fn&& fn) const {
+            if (!isBitmap()) {
+                for (uint16_t low : array) fn(low);
+                return;
+            }
+            for (size_t w = 0; w < CONTAINER_WORDS; ++w) {
+                uint64_t word = bits[w];
+                while (word != 0) {
+                    fn(static_cast<uint16_t>(w * 64 + countTrailingZeros(word)));
+                    word &= word - 1;
+                }
+            }
+        }
+
+        // 低 16 位元小於 limit 的個數
+        size_t countBelow(size_t limit) const {
+            if (!isBitmap()) {
+                return static_cast<size_t>(std::lower_bound(array.begin(), array.end(), limit) - array.begin());
+            }
+            size_t total = 0;
+            for (size_t w = 0; w < limit / 64; ++w) total += static_cast<size_t>(std::bitset<64>(bits[w]).count());
+            if (limit % 64 != 0) {
+                total += static_cast<size_t>(std::bitset<64>(bits[limit / 64] & ((uint64_t(1) << (limit % 64)) - 1)).count());
+            }
+            return total;
+        }
+    };
+
+    std::vector<uint64_t> keys_;  // 各容器的高位元，遞增
+    std::vector<Container> containers_;
+    size_t cardinality_ = 0;
+
+    static size_t popcount(const std::vector<uint64_t>& words) {
+        size_t total = 0;
+        for (uint64_t w : words) total += static_cast<size_t>(std::bitset<64>(w).count());
+        return total;
+    }
+
+    static Container intersect(const Container& a, const Container& b) {
+        Container out;
+        if (a.isBitmap() && b.isBitmap()) {
+            out.bits.resize(CONTAINER_WORDS);
+            for (size_t w = 0; w < CONTAINER_WORDS; ++w) out.bits[w] = a.bits[w] & b.bits[w];
+            out.cardinality = popcount(out.bits);
+            out.shrink();
+            return out;
+        }
+        if (a.isBitmap() || b.isBitmap()) {
+            const Container& array = a.isBitmap() ? b : a;
+            const Container& bitmap = a.isBitmap() ? a : b;
+            for (uint16_t low : array.array) {
+                if (bitmap.contains(low)) out.array.push_back(low);
+            }
+        }
+        else {
+            std::set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(),
+                std::back_inserter(out.array));
+        }
+        out.cardinality = out.array.size();
+        return out;
+    }
+
+    static void unite(Container& into, const Container& other) {
+        if (other.isBitmap()) {
+            if (!into.isBitmap()) {
+                Container merged = other;
+                for (uint16_t low : into.array) merged.add(low);
+                into = std::move(merged);
+                return;
+            }
+            for (size_t w = 0; w < CONTAINER_WORDS; ++w) into.bits[w] |= other.bits[w];
+            into.cardinality = popcount(into.bits);
+            return;
+        }
+        if (into.isBitmap()) {
+            for (uint16_t low : other.array) into.add(low);
+            return;
+        }
+        std::vector<uint16_t> merged;
+        merged.reserve(into.array.size() + other.array.size());
+        std::set_union(into.array.begin(), into.array.end(), other.array.begin(), other.array.end(),
+            std::back_inserter(merged));
+        into.array = std::move(merged);
+        into.cardinality = into.array.size();
+        if (into.array.size() > ARRAY_LIMIT) into.toBitmap();
+    }
+
+public:
+    size_t cardinality() const { return cardinality_; }
+    bool empty() const { return cardinality_ == 0; }
+
+    void add(RecordId id) {
+        const uint64_t key = static_cast<uint64_t>(id) >> 16;
+        size_t index;
+        if (!keys_.empty() && keys_.back() == key) {
+            index = keys_.size() - 1;
+        }
+        else if (keys_.empty() || keys_.back() < key) {
+            keys_.push_back(key);
+            containers_.emplace_back();
+            index = keys_.size() - 1;
+        }
+        else {
+            index = static_cast<size_t>(std::lower_bound(keys_.begin(), keys_.end(), key) - keys_.begin());
+            if (keys_[index] != key) {
+                keys_.insert(keys_.begin() + index, key);
+                containers_.insert(containers_.begin() + index, Container());
+            }
+        }
+        if (containers_[index].add(static_cast<uint16_t>(id & 0xFFFF))) cardinality_++;
+    }
+
+    bool contains(RecordId id) const {
+        const uint64_t key = static_cast<uint64_t>(id) >> 16;
+        auto it = std::lower_bound(keys_.begin(), keys_.end(), key);
+        return it != keys_.end() && *it == key && containers_[it - keys_.begin()].contains(static_cast<uint16_t>(id & 0xFFFF));
+    }
+
+    // 小於 limit 的 RecordId 個數：limit 之前的容器直接取基數，只有邊界容器需要計數
+    size_t countBelow(RecordId limit) const {
+        const uint64_t limit_key = static_cast<uint64_t>(limit) >> 16;
+        size_t total = 0;
+        for (size_t i = 0; i < keys_.size() && keys_[i] <= limit_key; ++i) {
+            total += keys_[i] < limit_key ? containers_[i].cardinality : containers_[i].countBelow(limit & 0xFFFF);
+        }
+        return total;
+    }
+
+    static RoaringBitmap intersect(const RoaringBitmap& a, const RoaringBitmap& b) {
+        RoaringBitmap out;
+        size_t i = 0, j = 0;
+        while (i < a.keys_.size() && j < b.keys_.size()) {
+            if (a.keys_[i] < b.keys_[j]) {
+                ++i;
+            }
+            else if (b.keys_[j] < a.keys_[i]) {
+                ++j;
+            }
+            else {
+                Container container = intersect(a.containers_[i], b.containers_[j]);
+                if (container.cardinality != 0) {
+                    out.cardinality_ += container.cardinality;
+                    out.keys_.push_back(a.keys_[i]);
+                    out.containers_.push_back(std::move(container));
+                }
+                ++i;
+                ++j;
+            }
+        }
+        return out;
+    }
+
+    // 就地取聯集
+    void unite(const RoaringBitmap& other) {
+        std::vector<uint64_t> keys;
+        std::vector<Container> containers;
+        keys.reserve(keys_.size() + other.keys_.size());
+        containers.reserve(keys_.size() + other.keys_.size());
+        size_t i = 0, j = 0;
+        while (i < keys_.size() || j < other.keys_.size()) {
+            if (j == other.keys_.size() || (i < keys_.size() && keys_[i] < other.keys_[j])) {
+                keys.push_back(keys_[i]);
+                containers.push_back(std::move(containers_[i++]));
+            }
+            else if (i == keys_.size() || other.keys_[j] < keys_[i]) {
+                keys.push_back(other.keys_[j]);
+                containers.push_back(other.containers_[j++]);
+            }
+            else {
+                keys.push_back(keys_[i]);
+                containers.push_back(std::move(containers_[i++]));
+                unite(containers.back(), other.containers_[j++]);
+            }
+        }
+        keys_ = std::move(keys);
+        containers_ = std::move(containers);
+        cardinality_ = 0;
+        for (const auto& container : containers_) cardinality_ += container.cardinality;
+    }
+
+    // 依遞增順序走訪所有 RecordId
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t i = 0; i < keys_.size(); ++i) {
+            const RecordId base = static_cast<RecordId>(keys_[i] << 16);
+            containers_[i].forEach([&](uint16_t low) { fn(base + low); });
+        }
+    }
+
+    std::vector<RecordId> toRecordIds() const {
+        std::vector<RecordId> ids;
+        ids.reserve(cardinality_);
+        forEach([&](RecordId id) { ids.push_back(id); });
+        return ids;
+    }
+
+    // 把位元併入選取向量；點陣圖容器整個字組複製。超出選取向量大小的 RecordId（之後才插入的列）忽略
+    void addTo(SelectionVector& selection) const {
+        const size_t size = selection.size();
+        uint64_t* words = selection.words();
+        for (size_t i = 0; i < keys_.size(); ++i) {
+            const size_t base = static_cast<size_t>(keys_[i] << 16);
+            if (base >= size) break;
+            const Container& container = containers_[i];
+            if (!container.isBitmap()) {
+                for (uint16_t low : container.array) {
+                    if (base + low >= size) break;
+                    selection.set(base + low);
+                }
+                continue;
+            }
+            const size_t first_word = base / 64;
+            for (size_t w = 0; w < CONTAINER_WORDS && (first_word + w) * 64 < size; ++w) {
+                uint64_t word = container.bits[w];
+                const size_t remaining = size - (first_word + w) * 64;
+                if (remaining < 64) word &= (uint64_t(1) << remaining) - 1;
+                words[first_word + w] |= word;
+            }
+        }
+    }
+
+    // 估計的記憶體用量（位元組）
+    size_t memoryBytes() const {
+        size_t bytes = keys_.size() * (sizeof(uint64_t) + sizeof(Container));
+        for (const auto& container : containers_) {
+            bytes += container.isBitmap() ? CONTAINER_WORDS * sizeof(uint64_t) : container.array.size() * sizeof(uint16_t);
+        }
+        return bytes;
+    }
+
+    void save(ByteWriter& out) const {
+        out.put(static_cast<uint64_t>(keys_.size()));
+        for (size_t i = 0; i < keys_.size(); ++i) {
+            const Container& container = containers_[i];
+            out.put(keys_[i]);
+            out.put(static_cast<uint8_t>(container.isBitmap() ? 1 : 0));
+            if (container.isBitmap()) {
+                out.putBytes(reinterpret_cast<const char*>(container.bits.data()), CONTAINER_WORDS * sizeof(uint64_t));
+            }
+            else {
+                out.putBytes(reinterpret_cast<const char*>(container.array.data()), container.array.size() * sizeof(uint16_t));
+            }
+        }
+    }
+
+    static RoaringBitmap load(ByteReader& in) {
+        RoaringBitmap bitmap;
+        const size_t count = in.get<uint64_t>();
+        for (size_t i = 0; i < count; ++i) {
+            const uint64_t key = in.get<uint64_t>();
+            const bool is_bitmap = in.get<uint8_t>() != 0;
+            std::string_view bytes = in.getBytes();
+            Container container;
+            if (is_bitmap) {
+                if (bytes.size() != CONTAINER_WORDS * sizeof(uint64_t)) {
+                    throw std::runtime_error("Invalid bitmap container");
+                }
+                container.bits.resize(CONTAINER_WORDS);
+                std::memcpy(container.bits.data(), bytes.data(), bytes.size());
+                container.cardinality = popcount(container.bits);
+            }
+            else {
+                container.array.resize(bytes.size() / sizeof(uint16_t));
+                std::memcpy(container.array.data(), bytes.data(), container.array.size() * sizeof(uint16_t));
+                container.cardinality = container.array.size();
+            }
+            bitmap.cardinality_ += container.cardinality;
+            bitmap.keys_.push_back(key);
+            bitmap.containers_.push_back(std::move(container));
+        }
+        return bitmap;
+    }
+};
+
+// 點陣圖索引在 ColumnIndex 之外提供的查詢：結果直接是點陣圖，跨欄位的 AND/OR 是點陣圖的交集與聯集，
+// COUNT 取基數即可，不讀取資料頁
+class BitmapColumnIndex : public ColumnIndex {
+public:
+    // 鍵等於 key 的列
+    virtual RoaringBitmap lookup(const Value& key) const = 0;
+    // accept(鍵) 為真的各鍵點陣圖的聯集；低基數欄位的鍵很少，逐鍵求值述詞
+    virtual RoaringBitmap unionWhere(const std::function<bool(const Value&)>& accept) const = 0;
+    virtual size_t keyCount() const = 0;
+    virtual size_t memoryBytes() const = 0;
+};
+
+// 點陣圖索引 - 每個相異鍵一個 Roaring 點陣圖，常駐記憶體，檢查點時整個寫入目錄檔。
+// 浮點欄位的 NaN 列另外記錄：NaN 不等於任何鍵，只有 NE 述詞會選到
+template <typename Key>
+class BitmapIndex : public BitmapColumnIndex {
+private:
+    std::map<Key, RoaringBitmap> bitmaps_;
+    RoaringBitmap nan_rows_;
+    mutable std::shared_mutex latch_;
+
+    static Key keyOf(const Value& value) {
+        const Key* key = std::get_if<Key>(&value);
+        if (!key) {
+            throw std::runtime_error("Key type does not match bitmap index key type");
+        }
+        if constexpr (std::is_same_v<Key, std::string>) return key->substr(0, MAX_STRING_LENGTH);
+        else return *key;
+    }
+
+    static bool isNaN(const Key& key) {
+        if constexpr (std::is_floating_point_v<Key>) return std::isnan(key);
+        else return false;
+    }
+
+    // 呼叫端持有獨占的 latch_
+    void add(const Key& key, RecordId record_id) {
+        if (isNaN(key)) nan_rows_.add(record_id);
+        else bitmaps_[key].add(record_id);
+    }
+
+    // 對 start_key <= 鍵 <= end_key 的每個點陣圖呼叫 fn
+    template <typename Fn>
+    void forEachInRange(const Value& start_key, const Value& end_key, Fn&& fn) const {
+        const Key lo = keyOf(start_key);
+        const Key hi = keyOf(end_key);
+        if (isNaN(lo) || isNaN(hi) || hi < lo) return;
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        for (auto it = bitmaps_.lower_bound(lo); it != bitmaps_.end() && !(hi < it->first); ++it) fn(it->second);
+    }
+
+    RoaringBitmap unionRange(const Value& start_key, const Value& end_key) const {
+        RoaringBitmap matched;
+        forEachInRange(start_key, end_key, [&](const RoaringBitmap& bitmap) { matched.unite(bitmap); });
+        return matched;
+    }
+
+public:
+    void insert(const Value& key, RecordId record_id) override {
+        const Key k = keyOf(key);
+        std::unique_lock<std::shared_mutex> lock(latch_);
+        add(k, record_id);
+    }
+
+    void bulkLoad(const std::vector<std::pair<Value, RecordId>>& sorted_entries) override {
+        std::unique_lock<std::shared_mutex> lock(latch_);
+        for (const auto& [key, record_id] : sorted_entries) add(keyOf(key), record_id);
+    }
+
+    void bulkLoadSlots(const char* keys, size_t count, RecordId first_record_id) override {
+        if constexpr (std::is_arithmetic_v<Key>) {
+            std::unique_lock<std::shared_mutex> lock(latch_);
+            for (size_t i = 0; i < count; ++i) {
+                Key key;
+                std::memcpy(&key, keys + i * sizeof(Key), sizeof(Key));
+                add(key, first_record_id + i);
+            }
+        }
+        else {
+            throw std::runtime_error("Bitmap index does not take fixed-width keys");
+        }
+    }
+
+    void bulkLoadStrings(const std::string* keys, size_t count, RecordId first_record_id) override {
+        if constexpr (std::is_same_v<Key, std::string>) {
+            std::unique_lock<std::shared_mutex> lock(latch_);
+            for (size_t i = 0; i < count; ++i) add(keys[i].substr(0, MAX_STRING_LENGTH), first_record_id + i);
+        }
+        else {
+            throw std::runtime_error("Bitmap index does not take string keys");
+        }
+    }
+
+    std::vector<RecordId> search(const Value& key) override {
+        return lookup(key).toRecordIds();
+    }
+
+    std::vector<RecordId> rangeSearch(const Value& start_key, const Value& end_key) override {
+        return unionRange(start_key, end_key).toRecordIds();
+    }
+
+    std::vector<RecordId> rangeSearch(const Value& start_key, const Value& end_key,
+        size_t offset, size_t limit) override {
+        std::vector<RecordId> ids = unionRange(start_key, end_key).toRecordIds();
+        ids.erase(ids.begin(), ids.begin() + std::min(offset, ids.size()));
+        if (ids.size() > limit) ids.resize(limit);
+        return ids;
+    }
+
+    size_t countRange(const Value& start_key, const Value& end_key, RecordId visible) override {
+        size_t count = 0;
+        forEachInRange(start_key, end_key, [&](const RoaringBitmap& bitmap) { count += bitmap.countBelow(visible); });
+        return count;
+    }
+
+    std::optional<Value> firstKey(RecordId visible) override {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        for (auto it = bitmaps_.begin(); it != bitmaps_.end(); ++it) {
+            if (it->second.countBelow(visible) > 0) return Value(it->first);
+        }
+        return std::nullopt;
+    }
+
+    std::optional<Value> lastKey(RecordId visible) override {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        for (auto it = bitmaps_.rbegin(); it != bitmaps_.rend(); ++it) {
+            if (it->second.countBelow(visible) > 0) return Value(it->first);
+        }
+        return std::nullopt;
+    }
+
+    bool empty() override {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        return bitmaps_.empty() && nan_rows_.empty();
+    }
+
+    // 點陣圖常駐記憶體，沒有頁面與樹高；項目數為各點陣圖基數的總和
+    IndexMetrics describe() override {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        IndexMetrics metrics;
+        metrics.type = "bitmap";
+        metrics.entries = nan_rows_.cardinality();
+        for (const auto& [key, bitmap] : bitmaps_) metrics.entries += bitmap.cardinality();
+        return metrics;
+    }
+
+    void saveState(ByteWriter& out) override {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        out.put(static_cast<uint64_t>(bitmaps_.size()));
+        for (const auto& [key, bitmap] : bitmaps_) {
+            if constexpr (std::is_same_v<Key, std::string>) out.putString(key);
+            else out.put(key);
+            bitmap.save(out);
+        }
+        nan_rows_.save(out);
+    }
+
+    void restoreState(ByteReader& in) override {
+        std::unique_lock<std::shared_mutex> lock(latch_);
+        bitmaps_.clear();
+        const size_t count = in.get<uint64_t>();
+        for (size_t i = 0; i < count; ++i) {
+            Key key;
+            if constexpr (std::is_same_v<Key, std::string>) key = in.getString();
+            else key = in.get<Key>();
+            bitmaps_.emplace(std::move(key), RoaringBitmap::load(in));
+        }
+        nan_rows_ = RoaringBitmap::load(in);
+    }
+
+    void clear() override {
+        std::unique_lock<std::shared_mutex> lock(latch_);
+        bitmaps_.clear();
+        nan_rows_ = RoaringBitmap();
+    }
+
+    // 點陣圖常駐記憶體，不使用索引頁
+    size_t compact() override { return 0; }
+
+    RoaringBitmap lookup(const Value& key) const override {
+        const Key k = keyOf(key);
+        if (isNaN(k)) return RoaringBitmap();
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        auto it = bitmaps_.find(k);
+        return it != bitmaps_.end() ? it->second : RoaringBitmap();
+    }
+
+    RoaringBitmap unionWhere(const std::function<bool(const Value&)>& accept) const override {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        RoaringBitmap matched;
+        for (const auto& [key, bitmap] : bitmaps_) {
+            if (accept(Value(key))) matched.unite(bitmap);
+        }
+        if constexpr (std::is_floating_point_v<Key>) {
+            if (!nan_rows_.empty() && accept(Value(std::numeric_limits<Key>::quiet_NaN()))) matched.unite(nan_rows_);
+        }
+        return matched;
+    }
+
+    size_t keyCount() const override {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        return bitmaps_.size();
+    }
+
+    size_t memoryBytes() const override {
+        std::shared_lock<std::shared_mutex> lock(latch_);
+        size_t bytes = nan_rows_.memoryBytes();
+        for (const auto& [key, bitmap] : bitmaps_) bytes += sizeof(Key) + bitmap.memoryBytes();
+        return bytes;
+    }
+};
+
+// 依欄位型別建立對應鍵型別的點陣圖索引
+inline std::unique_ptr<BitmapColumnIndex> makeBitmapIndex(DataType type) {
+    switch (type) {
+    case DataType::INT32: return std::make_unique<BitmapIndex<int32_t>>();
+    case DataType::INT64: return std::make_unique<BitmapIndex<int64_t>>();
+    case DataType::FLOAT: return std::make_unique<BitmapIndex<float>>();
+    case DataType::DOUBLE: return std::make_unique<BitmapIndex<double>>();
+    case DataType::STRING: return std::make_unique<BitmapIndex<std::string>>();
+    case DataType::BOOL: return std::make_unique<BitmapIndex<bool>>();
+    }
+    throw std::runtime_error("Unsupported index key type");
+}
+
+// 已封存資料頁的統計（zone map），常駐記憶體；min/max 以列的原生型別比較後存成槽位位元樣式。
+// bounded 為 false 時（含 NaN 的浮點頁、堆積字串頁）不能用來略過頁面
+struct ZoneMap {
+    int64_t min = 0;
+    int64_t max = 0;
+    size_t count = 0;
+    bool bounded = false;
+};
+
+// 述詞對一個資料頁的可能結果
+enum class ZoneMatch {
+    NONE,  // 整頁都不符合，不必讀取
+    SOME,  // 需要逐筆求值
+    ALL    // 整頁都符合，直接設定選取位元
+};
+
+// 支援大資料集的列存儲結構
+class DiskBasedColumn {
+private:
+    std::string name_;
+    DataType type_;
+    std::string data_file_;
+    FileId data_file_id_;
+    std::unique_ptr<ColumnIndex> index_;
+    BufferPoolManager& buffer_manager_;
+    std::atomic<size_t> total_records_;  // 已寫入完成、對讀取者可見的記錄數
+    std::mutex append_mutex_;
+    size_t records_per_page_;
+
+    // 附加中的資料頁以原始槽位存放在尾端頁檔（單一頁面）；寫滿時封存：
+    // 依內容選擇編碼後緊密附加到資料檔，並在頁目錄中記錄位置與解碼參數
+    FileId tail_file_id_;
+    std::vector<EncodedPageInfo> encoded_pages_;
+    std::vector<ZoneMap> zone_maps_;  // 與 encoded_pages_ 一一對應，同受 directory_latch_ 保護
+    mutable std::shared_mutex directory_latch_;
+    std::atomic<size_t> sealed_pages_;
+    size_t extent_size_;           // 資料檔的實體頁大小；封存頁緊密排列在 extent 中，掃描時一次讀取一整個 extent
+    PageId encoded_tail_page_;     // 僅在 append_mutex_ 下存取
+    size_t encoded_tail_offset_;
+    std::atomic<PageId> immutable_pages_;  // 資料檔中已寫滿並寫回磁碟的實體頁數，可經由記憶體映射讀取
+
+    // 字串欄位：資料檔只存放定長的 StringRef 或字典代碼
+    StringEncoding string_encoding_;
+    std::unique_ptr<StringHeap> string_heap_;
+    std::unique_ptr<StringDictionary> dictionary_;
+
+    MorselExecutor* executor_ = nullptr;  // nullptr 時掃描與聚合在呼叫端執行緒上依序執行
+
+    ColumnIndexType index_type_;
+    BitmapColumnIndex* bitmap_index_ = nullptr;  // 點陣圖索引時與 index_ 指向同一個物件
+
+public:
+    // extent_size 為資料檔的實體頁大小，緩衝池必須有這個大小的頁框類別
+    DiskBasedColumn(const std::string& name, DataType type, BufferPoolManager& buffer_manager,
+        StringEncoding string_encoding = StringEncoding::HEAP, size_t extent_size = COLUMN_EXTENT_SIZE,
+        ColumnIndexType index_type = ColumnIndexType::BTREE)
+        : name_(name), type_(type), buffer_manager_(buffer_manager), total_records_(0),
+        sealed_pages_(0), extent_size_(extent_size), encoded_tail_page_(0), encoded_tail_offset_(0),
+        immutable_pages_(0), string_encoding_(string_encoding), index_type_(index_type) {
+        
+        // name 參數是從資料庫根目錄開始的相對路徑（例如："employees/id"）
+        // 我們需要創建相對於資料庫根目錄的資料檔案路徑
+        data_file_ = name + ".data";
+        data_file_id_ = buffer_manager_.registerFile(data_file_, extent_size_);
+        tail_file_id_ = buffer_manager_.registerFile(name + ".tail");
+
+        if (type_ == DataType::STRING) {
+            if (isDictionaryEncoded()) {
+                dictionary_ = std::make_unique<StringDictionary>(name + ".dict", buffer_manager);
+            }
+            else {
+                string_heap_ = std::make_unique<StringHeap>(name + ".heap", buffer_manager);
+            }
+        }
+
+        // 計算每頁可存儲的記錄數
+        size_t record_size = getRecordSize();
+        records_per_page_ = PAGE_SIZE / record_size;
+
+        // 為此列創建索引；字典編碼的欄位以代碼建立索引
+        const DataType key_type = isDictionaryEncoded() ? DataType::INT32 : type;
+        if (index_type_ == ColumnIndexType::BITMAP) {
+            auto bitmap_index = makeBitmapIndex(key_type);
+            bitmap_index_ = bitmap_index.get();
+            index_ = std::move(bitmap_index);
+        }
+        else {
+            index_ = makeColumnIndex(name + ".idx", key_type, buffer_manager);
+        }
+    }
+
+    RecordId append(const Value& value) {
+        RecordId record_id = appendWithoutIndex(value);
+
+        // 更新索引
+        indexRecord(value, record_id);
+
+        return record_id;
+    }
+
+    // 只寫入列資料，不維護索引；批量載入時由 buildIndex 一次建立。
+    // 多個執行緒可同時附加；值寫入頁面後才更新 total_records_，讀取者不會看到未寫完的記錄
+    RecordId appendWithoutIndex(const Value& value) {
+        std::lock_guard<std::mutex> lock(append_mutex_);
+        RecordId record_id = total_records_.load(std::memory_order_relaxed);
+        PageId page_id = record_id / records_per_page_;
+        size_t offset = record_id % records_per_page_;
+
+        // 先編碼（字串會寫入堆積或字典），避免同時持有資料頁與堆積頁的閂鎖
+        char slot[sizeof(uint64_t)];
+        encodeValue(value, slot);
+        {
+            auto page = buffer_manager_.fetchPageWrite(tail_file_id_, 0);
+            const size_t record_size = getRecordSize();
+            std::memcpy(page->data + offset * record_size, slot, record_size);
+            page->is_dirty = true;
+        }
+
+        DATABASEAPP_LOG(LogLevel::TRACE, "Appended record " << record_id << " to page " << page_id
+            << " in file " << data_file_);
+
+        if (offset + 1 == records_per_page_) {
+            sealTailPage(page_id);
+        }
+
+        total_records_.store(record_id + 1, std::memory_order_release);
+        return record_id;
+    }
+
+    // 整批附加一個欄位的值（型別須與欄位相同）並回傳第一筆的 RecordId；不維護索引。
+    // 定長數值直接使用批次的陣列；字串寫入堆積或字典、BOOL 正規化，編碼後的槽位留在 scratch 給 indexBatch
+    RecordId appendBatch(const RecordBatch::Column& values, std::vector<char>& scratch) {
+        std::lock_guard<std::mutex> lock(append_mutex_);
+        const size_t count = values.size();
+        const size_t record_size = getRecordSize();
+        const char* slots = nullptr;
+        if (const auto* strings = std::get_if<std::vector<std::string>>(&values.values)) {
+            scratch.resize(count * record_size);
+            for (size_t i = 0; i < count; ++i) {
+                if (isDictionaryEncoded()) {
+                    int32_t code = dictionary_->encode((*strings)[i]);
+                    std::memcpy(scratch.data() + i * record_size, &code, sizeof(code));
+                }
+                else {
+                    StringRef ref = string_heap_->append((*strings)[i]);
+                    std::memcpy(scratch.data() + i * record_size, &ref, sizeof(ref));
+                }
+            }
+            slots = scratch.data();
+        }
+        else if (const auto* bools = std::get_if<std::vector<uint8_t>>(&values.values)) {
+            scratch.resize(count);
+            for (size_t i = 0; i < count; ++i) scratch[i] = (*bools)[i] != 0;
+            slots = scratch.data();
+        }
+        else {
+            slots = std::visit([](const auto& v) { return reinterpret_cast<const char*>(v.data()); }, values.values);
+        }
+        return appendSlots(slots, count);
+    }
+
+    // 為 appendBatch 附加的值建立索引：鍵以原生型別排序，不經過 Value
+    void indexBatch(const RecordBatch::Column& values, const std::vector<char>& scratch, RecordId first_record_id) {
+        const size_t count = values.size();
+        if (type_ == DataType::STRING && !isDictionaryEncoded()) {
+            index_->bulkLoadStrings(std::get<std::vector<std::string>>(values.values).data(), count, first_record_id);
+        }
+        else if (type_ == DataType::STRING || type_ == DataType::BOOL) {
+            index_->bulkLoadSlots(scratch.data(), count, first_record_id);
+        }
+        else {
+            index_->bulkLoadSlots(std::visit([](const auto& v) { return reinterpret_cast<const char*>(v.data()); },
+                values.values), count, first_record_id);
+        }
+    }
+
+    void indexRecord(const Value& value, RecordId record_id) {
+        if (isDictionaryEncoded()) {
+            index_->insert(dictionary_->find(stringArgument(value)), record_id);
+            return;
+        }
+        index_->insert(value, record_id);
+    }
+
+    Value get(RecordId record_id) const {
+        char slot[sizeof(int64_t)];
+        readSlot(record_id, slot);
+        return decodeSlot(slot);
+    }
+
+    // 由 (值, RecordId) 序列建立索引：排序後自底向上批量載入；點陣圖索引不需要排序。
+    // B+ 樹不收 NaN，而且 NaN 會破壞排序的嚴格弱序，排序前先移除
+    void buildIndex(std::vector<std::pair<Value, RecordId>>& entries) {
+        if (isDictionaryEncoded()) {
+            for (auto& entry : entries) {
+                entry.first = dictionary_->find(stringArgument(entry.first));
+            }
+        }
+        if (bitmap_index_) {
+            index_->bulkLoad(entries);
+            return;
+        }
+        if (type_ == DataType::FLOAT || type_ == DataType::DOUBLE) {
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [](const auto& entry) {
+                return std::visit([](const auto& v) {
+                    if constexpr (std::is_floating_point_v<std::decay_t<decltype(v)>>) return std::isnan(v);
+                    else return false;
+                    }, entry.first);
+                }), entries.end());
+        }
+        std::sort(entries.begin(), entries.end());
+        index_->bulkLoad(entries);
+    }
+
+    // 逐頁在原始位元組上求值述詞，將符合的 RecordId 寫入 selection。
+    // 若提供 candidates，完全沒有候選列的頁面直接跳過不讀取。
+    void filter(const ColumnPredicate& predicate, SelectionVector& selection,
+        const SelectionVector* candidates = nullptr) const {
+        if (type_ == DataType::STRING) {
+            filterStrings(predicate, selection, candidates);
+            return;
+        }
+
+        filterPages(std::min(size(), selection.size()), candidates, selection,
+            [&](const char* data, size_t count, uint64_t* bits, size_t bit_offset) {
+                filterPage(data, count, predicate, bits, bit_offset);
+            },
+            [&](const ZoneMap& zone) { return zoneMatch(zone, predicate); });
+    }
+
+    // 以點陣圖索引求值述詞，不讀取資料頁；語意與 filter 相同。欄位必須使用點陣圖索引
+    RoaringBitmap matchBitmap(const ColumnPredicate& predicate) const {
+        if (!bitmap_index_) {
+            throw std::runtime_error("Column " + name_ + " has no bitmap index");
+        }
+        const CompareOp op = predicate.op;
+        switch (type_) {
+        case DataType::INT32: return matchBitmapAs<int32_t>(predicate);
+        case DataType::INT64: return matchBitmapAs<int64_t>(predicate);
+        case DataType::FLOAT: return matchBitmapAs<float>(predicate);
+        case DataType::DOUBLE: return matchBitmapAs<double>(predicate);
+        case DataType::BOOL: return matchBitmapAs<bool>(predicate);
+        case DataType::STRING: break;
+        }
+
+        const std::string& lo = stringArgument(predicate.value);
+        const std::string empty;
+        const std::string& hi = op == CompareOp::BETWEEN ? stringArgument(predicate.upper) : empty;
+        if (!isDictionaryEncoded()) {
+            if (op == CompareOp::EQ) return bitmap_index_->lookup(lo);
+            return bitmap_index_->unionWhere([&](const Value& key) {
+                return ScanKernels::matchString(op, std::get<std::string>(key), lo, hi);
+            });
+        }
+        if (op == CompareOp::EQ) {
+            int32_t code = dictionary_->find(lo);
+            return code == StringDictionary::NO_CODE ? RoaringBitmap() : bitmap_index_->lookup(code);
+        }
+        auto match = dictionary_->matchCodes(op, lo, hi);
+        return bitmap_index_->unionWhere([&](const Value& key) {
+            const size_t code = static_cast<size_t>(std::get<int32_t>(key));
+            return code < match.size() && match[code] != 0;
+        });
+    }
+
+    // 依遞增排序的 RecordId 取值：同一頁面的記錄只讀取（解碼）一次
+    std::vector<Value> gather(const std::vector<RecordId>& sorted_ids) const {
+        std::vector<Value> values;
+        values.reserve(sorted_ids.size());
+
+        const size_t record_size = getRecordSize();
+        size_t i = 0;
+        while (i < sorted_ids.size()) {
+            PageId page_id = sorted_ids[i] / records_per_page_;
+            RecordId page_start = page_id * records_per_page_;
+            RecordId page_end = page_start + records_per_page_;
+            size_t count = std::min<size_t>(records_per_page_, sorted_ids.back() + 1 - page_start);
+            withPage(page_id, count, AccessType::NORMAL, [&](const char* data) {
+                for (; i < sorted_ids.size() && sorted_ids[i] < page_end; ++i) {
+                    values.push_back(decodeSlot(data + (sorted_ids[i] - page_start) * record_size));
+                }
+            });
+        }
+
+        return values;
+    }
+
+    // 依 RecordId 取值並附加到批次欄位的型別化陣列，不經過 Value；同一頁只讀取（解碼）一次。
+    // ids 未排序時（範圍查詢依鍵值排序、連接的輸出）先將位置依 RecordId 排序，
+    // 逐頁把槽位複製到依原順序排列的暫存區，再依原順序解碼附加，結果順序與 ids 相同
+    void gatherInto(const RecordId* ids, size_t count, RecordBatch::Column& out) const {
+        if (out.type != type_) {
+            throw std::runtime_error("Batch column " + out.name + " does not match column " + name_);
+        }
+        if (count == 0) return;
+
+        std::visit([&](auto& values) {
+            values.reserve(values.size() + count);
+            PageGuard heap_page;  // 連續的堆積字串通常在同一頁，重用頁面守衛
+            auto append = [&](const char* slot) { appendSlot(slot, values, heap_page); };
+            const size_t record_size = getRecordSize();
+
+            if (!std::is_sorted(ids, ids + count)) {
+                std::vector<size_t> order(count);
+                std::iota(order.begin(), order.end(), size_t{ 0 });
+                std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return ids[a] < ids[b]; });
+
+                std::vector<char> slots(count * record_size);
+                const RecordId last = ids[order.back()];
+                size_t k = 0;
+                while (k < count) {
+                    PageId page_id = ids[order[k]] / records_per_page_;
+                    RecordId page_start = page_id * records_per_page_;
+                    RecordId page_end = page_start + records_per_page_;
+                    size_t page_count = std::min<size_t>(records_per_page_, last + 1 - page_start);
+                    withPage(page_id, page_count, AccessType::NORMAL, [&](const char* data) {
+                        for (; k < count && ids[order[k]] < page_end; ++k) {
+                            std::memcpy(slots.data() + order[k] * record_size,
+                                data + (ids[order[k]] - page_start) * record_size, record_size);
+                        }
+                    });
+                }
+                for (size_t i = 0; i < count; ++i) {
+                    append(slots.data() + i * record_size);
+                }
+                return;
+            }
+
+            size_t i = 0;
+            while (i < count) {
+                PageId page_id = ids[i] / records_per_page_;
+                RecordId page_start = page_id * records_per_page_;
+                RecordId page_end = page_start + records_per_page_;
+                size_t page_count = std::min<size_t>(records_per_page_, ids[count - 1] + 1 - page_start);
+                withPage(page_id, page_count, AccessType::NORMAL, [&](const char* data) {
+                    for (; i < count && ids[i] < page_end; ++i) {
+                        append(data + (ids[i] - page_start) * record_size);
+                    }
+                });
+            }
+            }, out.values);
+    }
+
+    std::vector<RecordId> findRecords(const Value& value) {
+        if (isDictionaryEncoded()) {
+            int32_t code = dictionary_->find(stringArgument(value));
+            if (code == StringDictionary::NO_CODE) return {};
+            return index_->search(code);
+        }
+        return index_->search(value);
+    }
+
+    // 字典代碼不保序：先在字典上找出範圍內的代碼，再逐一查索引，結果依 RecordId 排序。
+    // 點陣圖索引取範圍內各鍵點陣圖的聯集，結果同樣依 RecordId 排序
+    std::vector<RecordId> findRecordsInRange(const Value& start, const Value& end) {
+        if (bitmap_index_) {
+            return matchBitmap(ColumnPredicate(name_, CompareOp::BETWEEN, start, end)).toRecordIds();
+        }
+        if (isDictionaryEncoded()) {
+            auto match = dictionary_->matchCodes(CompareOp::BETWEEN, stringArgument(start), stringArgument(end));
+            std::vector<RecordId> results;
+            for (size_t code = 0; code < match.size(); ++code) {
+                if (!match[code]) continue;
+                auto ids = index_->search(static_cast<int32_t>(code));
+                results.insert(results.end(), ids.begin(), ids.end());
+            }
+            std::sort(results.begin(), results.end());
+            return results;
+        }
+        return index_->rangeSearch(start, end);
+    }
+
+    // 範圍查詢的一頁結果：略過 offset 筆後最多取 limit 筆。B+ 樹依鍵順序沿葉子鏈結取，
+    // 取滿即停止，不收集整個範圍；字典與點陣圖欄位依 RecordId 順序
+    std::vector<RecordId> findRecordsInRange(const Value& start, const Value& end, size_t offset, size_t limit) {
+        if (bitmap_index_ || isDictionaryEncoded()) {
+            std::vector<RecordId> ids = findRecordsInRange(start, end);
+            ids.erase(ids.begin(), ids.begin() + std::min(offset, ids.size()));
+            if (ids.size() > limit) ids.resize(limit);
+            return ids;
+        }
+        return index_->rangeSearch(start, end, offset, limit);
+    }
+
+    // 由索引回答 COUNT(*) WHERE predicate，只讀索引頁（字典欄位另查常駐的字典），不讀資料頁。
+    // 只計 RecordId 小於 visible 的列；B+ 樹回答不了 NE（要另外扣掉不在索引中的 NaN 列），回傳 std::nullopt
+    std::optional<size_t> countIndexed(const ColumnPredicate& predicate, RecordId visible) {
+        if (bitmap_index_) return matchBitmap(predicate).countBelow(visible);
+
+        switch (type_) {
+        case DataType::INT32: return countIndexedAs<int32_t>(predicate, visible);
+        case DataType::INT64: return countIndexedAs<int64_t>(predicate, visible);
+        case DataType::FLOAT: return countIndexedAs<float>(predicate, visible);
+        case DataType::DOUBLE: return countIndexedAs<double>(predicate, visible);
+        case DataType::BOOL: return countIndexedAs<bool>(predicate, visible);
+        case DataType::STRING: break;
+        }
+
+        const CompareOp op = predicate.op;
+        const std::string& lo = stringArgument(predicate.value);
+        const std::string& hi = op == CompareOp::BETWEEN ? stringArgument(predicate.upper) : lo;
+        if (!isDictionaryEncoded()) return countIndexedRange(op, Value(lo), Value(hi), visible);
+
+        // 字典代碼不保序：逐一計算符合的代碼
+        auto match = dictionary_->matchCodes(op, lo, hi);
+        size_t count = 0;
+        for (size_t code = 0; code < match.size(); ++code) {
+            if (!match[code]) continue;
+            const Value key(static_cast<int32_t>(code));
+            count += index_->countRange(key, key, visible);
+        }
+        return count;
+    }
+
+    // 索引中最小／最大的值，只讀索引頁；NaN 不在索引中。字典欄位比較仍有可見列的各代碼的字串
+    std::optional<Value> indexMin(RecordId visible) { return indexBound(visible, false); }
+    std::optional<Value> indexMax(RecordId visible) { return indexBound(visible, true); }
+
+    // 聚合函式 - 針對大資料集優化
+    // 分頁處理，避免記憶體溢出；每頁直接交給型別化掃描核心。
+    // 頁面範圍切成 morsel 平行掃描，各執行緒累加自己的部分結果，最後合併
+    AggregateResult aggregate() const {
+        const size_t total = size();
+        std::vector<WorkerLocal<AggregateResult>> partials(parallelism());
+
+        forEachMorsel(total, [&](size_t worker, PageId first_page, PageId end_page) {
+            AggregateResult& result = partials[worker].value;
+            forEachPageInRange(first_page, end_page, total, nullptr,
+                [&](const char* data, size_t count, size_t) {
+                    ScanKernels::aggregate(type_, data, count, result);
+                },
+                [&](const char* slot, size_t, size_t length) {
+                    AggregateResult one;
+                    ScanKernels::aggregate(type_, slot, 1, one);
+                    result.count += length;
+                    result.sum += one.sum * static_cast<double>(length);
+                    result.min = std::min(result.min, one.min);
+                    result.max = std::max(result.max, one.max);
+                });
+        });
+
+        AggregateResult result;
+        for (const auto& partial : partials) result.merge(partial.value);
+        return result;
+    }
+
+    double sum() const {
+        return aggregate().sum;
+    }
+
+    double average() const {
+        return aggregate().average();
+    }
+
+    // 只聚合 selection 中被選取的列；沒有選取列的頁面不讀取
+    AggregateResult aggregate(const SelectionVector& selection) const {
+        const size_t record_size = getRecordSize();
+        const size_t total = std::min(size(), selection.size());
+        std::vector<WorkerLocal<AggregateResult>> partials(parallelism());
+
+        forEachMorsel(total, [&](size_t worker, PageId first_page, PageId end_page) {
+            AggregateResult& result = partials[worker].value;
+            forEachPageInRange(first_page, end_page, total, &selection,
+                [&](const char* data, size_t count, size_t start_record) {
+                    // 先把選取的槽位壓緊，再交給型別化掃描核心
+                    alignas(64) char selected[PAGE_SIZE];
+                    size_t n = 0;
+                    for (size_t i = 0; i < count; ++i) {
+                        if (selection.test(start_record + i)) {
+                            std::memcpy(selected + n * record_size, data + i * record_size, record_size);
+                            ++n;
+                        }
+                    }
+                    ScanKernels::aggregate(type_, selected, n, result);
+                },
+                [&](const char* slot, size_t start_record, size_t length) {
+                    size_t n = selection.countInRange(start_record, length);
+                    if (n == 0) return;
+                    AggregateResult one;
+                    ScanKernels::aggregate(type_, slot, 1, one);
+                    result.count += n;
+                    result.sum += one.sum * static_cast<double>(n);
+                    result.min = std::min(result.min, one.min);
+                    result.max = std::max(result.max, one.max);
+                });
+        });
+
+        AggregateResult result;
+        for (const auto& partial : partials) result.merge(partial.value);
+        return result;
+    }
+
+    double min() const {
+        return minMax().min;
+    }
+
+    double max() const {
+        return minMax().max;
+    }
+
+    size_t size() const { return total_records_.load(std::memory_order_acquire); }
+    size_t sealedPageCount() const { return sealed_pages_.load(std::memory_order_acquire); }
+
+    // 已封存頁面的編碼，供統計與除錯
+    std::vector<PageEncoding> pageEncodings() const {
+        std::shared_lock<std::shared_mutex> lock(directory_latch_);
+        std::vector<PageEncoding> encodings;
+        encodings.reserve(encoded_pages_.size());
+        for (const auto& info : encoded_pages_) encodings.push_back(info.encoding);
+        return encodings;
+    }
+
+    // 索引形狀，供統計與 metricsSnapshot
+    IndexMetrics describeIndex() { return index_->describe(); }
+
+    const std::string& getName() const { return name_; }
+    DataType getType() const { return type_; }
+    StringEncoding getStringEncoding() const { return string_encoding_; }
+    ColumnIndexType getIndexType() const { return index_type_; }
+    const BitmapColumnIndex* bitmapIndex() const { return bitmap_index_; }
+    size_t getExtentSize() const { return extent_size_; }
+    bool isDictionaryEncoded() const { return type_ == DataType::STRING && string_encoding_ == StringEncoding::DICTIONARY; }
+
+    // 掃描與聚合改由執行器平行執行；在欄位開始被查詢之前設定
+    void setExecutor(MorselExecutor* executor) { executor_ = executor; }
+
+    // 目錄內容：記錄數、資料檔的附加位置、頁目錄與 zone map、尾端頁的原始槽位、
+    // 字串堆積或字典的尾端位置與索引狀態。與附加互斥取得一致的快照
+    void saveState(ByteWriter& out) {
+        std::lock_guard<std::mutex> lock(append_mutex_);
+        const size_t total = total_records_.load(std::memory_order_relaxed);
+        out.put(static_cast<uint64_t>(total));
+        out.put(static_cast<uint64_t>(encoded_tail_page_));
+        out.put(static_cast<uint32_t>(encoded_tail_offset_));
+        {
+            auto tail = buffer_manager_.fetchPageRead(tail_file_id_, 0);
+            out.putBytes(tail->data, (total % records_per_page_) * getRecordSize());
+        }
+        {
+            std::shared_lock<std::shared_mutex> directory_lock(directory_latch_);
+            out.put(static_cast<uint64_t>(encoded_pages_.size()));
+            for (size_t i = 0; i < encoded_pages_.size(); ++i) {
+                savePageEntry(out, encoded_pages_[i], zone_maps_[i]);
+            }
+        }
+        if (string_heap_) string_heap_->saveState(out);
+        if (dictionary_) dictionary_->saveState(out);
+        index_->saveState(out);
+    }
+
+    // 在剛建構的欄位上還原 saveState 的內容；頁目錄之前的資料頁都已在檢查點寫回磁碟
+    void restoreState(ByteReader& in) {
+        std::lock_guard<std::mutex> lock(append_mutex_);
+        const size_t total = in.get<uint64_t>();
+        const PageId tail_page = in.get<uint64_t>();
+        const size_t tail_offset = in.get<uint32_t>();
+        const std::string_view tail = in.getBytes();
+        const size_t sealed = in.get<uint64_t>();
+        if (sealed != total / records_per_page_ || tail.size() != (total % records_per_page_) * getRecordSize() ||
+            tail_offset > extent_size_) {
+            throw std::runtime_error("Invalid catalog state for column " + name_);
+        }
+
+        {
+            std::unique_lock<std::shared_mutex> directory_lock(directory_latch_);
+            encoded_pages_.resize(sealed);
+            zone_maps_.resize(sealed);
+            for (size_t i = 0; i < sealed; ++i) {
+                loadPageEntry(in, encoded_pages_[i], zone_maps_[i]);
+                if (encoded_pages_[i].page_id > tail_page) {
+                    throw std::runtime_error("Invalid page directory in catalog for column " + name_);
+                }
+            }
+        }
+        if (!tail.empty()) {
+            auto page = buffer_manager_.fetchPageWrite(tail_file_id_, 0);
+            std::memcpy(page->data, tail.data(), tail.size());
+            page->is_dirty = true;
+        }
+        if (string_heap_) string_heap_->restoreState(in);
+        if (dictionary_) dictionary_->restoreState(in);
+        index_->restoreState(in);
+
+        encoded_tail_page_ = tail_page;
+        encoded_tail_offset_ = tail_offset;
+        immutable_pages_.store(tail_page, std::memory_order_release);
+        sealed_pages_.store(sealed, std::memory_order_release);
+        total_records_.store(total, std::memory_order_release);
+    }
+
+    size_t compactIndex() { return index_->compact(); }
+
+    // 捨棄索引並由欄位資料重新批量載入；非正常關閉後索引頁可能已被檢查點之後的寫回改動
+    void rebuildIndex() {
+        index_->clear();
+        const size_t total = size();
+        if (total == 0) return;
+
+        std::vector<RecordId> ids(total);
+        for (size_t i = 0; i < total; ++i) ids[i] = i;
+        auto values = gather(ids);
+
+        std::vector<std::pair<Value, RecordId>> entries;
+        entries.reserve(total);
+        for (size_t i = 0; i < total; ++i) entries.emplace_back(std::move(values[i]), i);
+        buildIndex(entries);
+    }
+
+    size_t recordsPerPage() const { return records_per_page_; }
+
+    // 依頁面順序把記錄 [begin, end) 的原始槽位交給 fn(data, count, start_record)；begin 必須落在頁面邊界。
+    // 若提供 candidates，沒有候選列的頁面不讀取
+    template <typename Fn>
+    void scanSlots(size_t begin, size_t end, const SelectionVector* candidates, Fn&& fn) const {
+        end = std::min(end, size());
+        if (begin >= end) return;
+        forEachPageInRange(static_cast<PageId>(begin / records_per_page_), static_cast<PageId>(pageCount(end)),
+            end, candidates, fn);
+    }
+
+    // 原始槽位對應的值；字典欄位的槽位是代碼
+    Value slotValue(const char* slot) const { return decodeSlot(slot); }
+
+    size_t dictionarySize() const { return dictionary_ ? dictionary_->size() : 0; }
+
+private:
+    // 資料檔中每筆記錄的槽位大小
+    size_t getRecordSize() const {
+        switch (type_) {
+        case DataType::INT32: return sizeof(int32_t);
+        case DataType::INT64: return sizeof(int64_t);
+        case DataType::FLOAT: return sizeof(float);
+        case DataType::DOUBLE: return sizeof(double);
+        case DataType::STRING: return isDictionaryEncoded() ? sizeof(int32_t) : sizeof(StringRef);
+        case DataType::BOOL: return sizeof(bool);
+        }
+        return 8;  // 預設大小
+    }
+
+    EncodedPageInfo encodedPage(PageId page_id) const {
+        std::shared_lock<std::shared_mutex> lock(directory_latch_);
+        return encoded_pages_[page_id];
+    }
+
+    static void savePageEntry(ByteWriter& out, const EncodedPageInfo& info, const ZoneMap& zone) {
+        out.put(static_cast<uint64_t>(info.page_id));
+        out.put(info.offset);
+        out.put(info.size);
+        out.put(static_cast<uint8_t>(info.encoding));
+        out.put(info.bit_width);
+        out.put(info.run_count);
+        out.put(info.base);
+        out.put(info.delta_base);
+        out.put(zone.min);
+        out.put(zone.max);
+        out.put(static_cast<uint64_t>(zone.count));
+        out.put(static_cast<uint8_t>(zone.bounded ? 1 : 0));
+    }
+
+    static void loadPageEntry(ByteReader& in, EncodedPageInfo& info, ZoneMap& zone) {
+        info.page_id = in.get<uint64_t>();
+        info.offset = in.get<uint32_t>();
+        info.size = in.get<uint32_t>();
+        info.encoding = static_cast<PageEncoding>(in.get<uint8_t>());
+        info.bit_width = in.get<uint8_t>();
+        info.run_count = in.get<uint16_t>();
+        info.base = in.get<int64_t>();
+        info.delta_base = in.get<int64_t>();
+        zone.min = in.get<int64_t>();
+        zone.max = in.get<int64_t>();
+        zone.count = in.get<uint64_t>();
+        zone.bounded = in.get<uint8_t>() != 0;
+    }
+
+    // 封存頁的編碼位元組：已寫滿並寫回磁碟的實體頁直接指向記憶體映射，其餘經由緩衝池並由 guard 持有。
+    // 掃描傳入 prefetcher，經由緩衝池讀取的實體頁會觸發循序預讀（映射的頁面由核心預讀）
+    const char* encodedBytes(const EncodedPageInfo& info, AccessType access, PageGuard& guard,
+        SequentialPrefetcher* prefetcher = nullptr) const {
+        if (info.size == 0) return nullptr;
+        if (info.page_id < immutable_pages_.load(std::memory_order_acquire)) {
+            if (const char* mapped = buffer_manager_.mapPage(data_file_id_, info.page_id, access)) {
+                return mapped + info.offset;
+            }
+        }
+        if (prefetcher) prefetcher->access(info.page_id);
+        guard = buffer_manager_.fetchPageRead(data_file_id_, info.page_id, access);
+        return guard->data + info.offset;
+    }
+
+    ZoneMap zoneMap(PageId page_id) const {
+        std::shared_lock<std::shared_mutex> lock(directory_latch_);
+        return zone_maps_[page_id];
+    }
+
+    template <typename T>
+    static T slotValue(int64_t bits) {
+        char slot[sizeof(int64_t)];
+        PageCodec::storeSlot(slot, 0, sizeof(T), bits);
+        T value;
+        std::memcpy(&value, slot, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    static ZoneMap computeZone(const char* data, size_t count) {
+        ZoneMap zone;
+        zone.count = count;
+        if (count == 0) return zone;
+
+        T lo = ScanKernels::loadValue<T>(data, 0);
+        T hi = lo;
+        for (size_t i = 0; i < count; ++i) {
+            T v = ScanKernels::loadValue<T>(data, i);
+            if constexpr (std::is_floating_point_v<T>) {
+                if (std::isnan(v)) return zone;
+            }
+            lo = std::min(lo, v);
+            hi = std::max(hi, v);
+        }
+
+        char slot[sizeof(T)];
+        std::memcpy(slot, &lo, sizeof(T));
+        zone.min = PageCodec::loadSlot(slot, 0, sizeof(T));
+        std::memcpy(slot, &hi, sizeof(T));
+        zone.max = PageCodec::loadSlot(slot, 0, sizeof(T));
+        zone.bounded = true;
+        return zone;
+    }
+
+    ZoneMap computeZone(const char* data, size_t count) const {
+        switch (type_) {
+        case DataType::INT32: return computeZone<int32_t>(data, count);
+        case DataType::INT64: return computeZone<int64_t>(data, count);
+        case DataType::FLOAT: return computeZone<float>(data, count);
+        case DataType::DOUBLE: return computeZone<double>(data, count);
+        case DataType::BOOL: return computeZone<bool>(data, count);
+        case DataType::STRING:
+            // 字典代碼可用於等值述詞；StringRef 的位元樣式沒有順序意義
+            if (isDictionaryEncoded()) return computeZone<int32_t>(data, count);
+            break;
+        }
+        ZoneMap zone;
+        zone.count = count;
+        return zone;
+    }
+
+    template <typename T>
+    static ZoneMatch zoneMatch(const ZoneMap& zone, CompareOp op, T lo, T hi) {
+        if (!zone.bounded) return ZoneMatch::SOME;
+        const T min = slotValue<T>(zone.min);
+        const T max = slotValue<T>(zone.max);
+
+        bool none = false;
+        bool all = false;
+        switch (op) {
+        case CompareOp::EQ: none = lo < min || lo > max; all = min == lo && max == lo; break;
+        case CompareOp::NE: none = min == lo && max == lo; all = lo < min || lo > max; break;
+        case CompareOp::LT: none = min >= lo; all = max < lo; break;
+        case CompareOp::LE: none = min > lo; all = max <= lo; break;
+        case CompareOp::GT: none = max <= lo; all = min > lo; break;
+        case CompareOp::GE: none = max < lo; all = min >= lo; break;
+        case CompareOp::BETWEEN: none = max < lo || min > hi; all = min >= lo && max <= hi; break;
+        }
+        return none ? ZoneMatch::NONE : (all ? ZoneMatch::ALL : ZoneMatch::SOME);
+    }
+
+    ZoneMatch zoneMatch(const ZoneMap& zone, const ColumnPredicate& predicate) const {
+        const CompareOp op = predicate.op;
+        const bool ranged = op == CompareOp::BETWEEN;
+
+        switch (type_) {
+        case DataType::INT32:
+            return zoneMatch<int32_t>(zone, op, predicateConstant<int32_t>(predicate.value),
+                ranged ? predicateConstant<int32_t>(predicate.upper) : 0);
+        case DataType::INT64:
+            return zoneMatch<int64_t>(zone, op, predicateConstant<int64_t>(predicate.value),
+                ranged ? predicateConstant<int64_t>(predicate.upper) : 0);
+        case DataType::FLOAT:
+            return zoneMatch<float>(zone, op, predicateConstant<float>(predicate.value),
+                ranged ? predicateConstant<float>(predicate.upper) : 0.0f);
+        case DataType::DOUBLE:
+            return zoneMatch<double>(zone, op, predicateConstant<double>(predicate.value),
+                ranged ? predicateConstant<double>(predicate.upper) : 0.0);
+        case DataType::BOOL:
+            return zoneMatch<bool>(zone, op, predicateConstant<bool>(predicate.value),
+                ranged ? predicateConstant<bool>(predicate.upper) : false);
+        case DataType::STRING:
+            break;
+        }
+        return ZoneMatch::SOME;
+    }
+
+    // 數值欄位的 MIN/MAX：封存頁直接取 zone map，只有尾端頁與無界頁需要讀取
+    AggregateResult minMax() const {
+        if (type_ == DataType::STRING || type_ == DataType::BOOL) {
+            return aggregate();
+        }
+
+        AggregateResult result;
+        forEachPage(size(), nullptr,
+            [&](const char* data, size_t count, size_t) {
+                ScanKernels::aggregate(type_, data, count, result);
+            },
+            nullptr,
+            [&](const ZoneMap& zone, size_t, size_t) {
+                if (!zone.bounded) return ZoneMatch::SOME;
+                char slot[sizeof(int64_t)];
+                PageCodec::storeSlot(slot, 0, getRecordSize(), zone.min);
+                AggregateResult bound;
+                ScanKernels::aggregate(type_, slot, 1, bound);
+                PageCodec::storeSlot(slot, 0, getRecordSize(), zone.max);
+                ScanKernels::aggregate(type_, slot, 1, bound);
+                result.min = std::min(result.min, bound.min);
+                result.max = std::max(result.max, bound.max);
+                return ZoneMatch::NONE;
+            });
+        return result;
+    }
+
+    // 依頁面整段複製已編碼的槽位到尾端頁，寫滿即封存；每段寫完才推進 total_records_。
+    // 呼叫端持有 append_mutex_
+    RecordId appendSlots(const char* slots, size_t count) {
+        const size_t record_size = getRecordSize();
+        const RecordId first_record_id = total_records_.load(std::memory_order_relaxed);
+        size_t done = 0;
+        while (done < count) {
+            const RecordId record_id = first_record_id + done;
+            const PageId page_id = record_id / records_per_page_;
+            const size_t offset = record_id % records_per_page_;
+            const size_t n = std::min(count - done, records_per_page_ - offset);
+            {
+                auto page = buffer_manager_.fetchPageWrite(tail_file_id_, 0);
+                std::memcpy(page->data + offset * record_size, slots + done * record_size, n * record_size);
+                page->is_dirty = true;
+            }
+            if (offset + n == records_per_page_) {
+                sealTailPage(page_id);
+            }
+            done += n;
+            total_records_.store(first_record_id + done, std::memory_order_release);
+        }
+        DATABASEAPP_LOG(LogLevel::TRACE, "Appended " << count << " records starting at " << first_record_id
+            << " to file " << data_file_);
+        return first_record_id;
+    }
+
+    // 封存寫滿的尾端頁：編碼後附加到資料檔，登記到頁目錄後才對讀取者公開。
+    // 呼叫端持有 append_mutex_；不同時持有兩個頁面閂鎖
+    void sealTailPage(PageId page_id) {
+        const size_t record_size = getRecordSize();
+        alignas(64) char raw[PAGE_SIZE];
+        {
+            auto tail = buffer_manager_.fetchPageRead(tail_file_id_, 0);
+            std::memcpy(raw, tail->data, records_per_page_ * record_size);
+        }
+
+        EncodedPageInfo info = PageCodec::analyze(raw, records_per_page_, record_size);
+        if (encoded_tail_offset_ + info.size > extent_size_) {
+            // 寫滿的 extent 不再修改：寫回磁碟後即可改由記憶體映射讀取
+            buffer_manager_.flushPage(data_file_id_, encoded_tail_page_);
+            encoded_tail_page_++;
+            encoded_tail_offset_ = 0;
+            immutable_pages_.store(encoded_tail_page_, std::memory_order_release);
+        }
+        info.page_id = encoded_tail_page_;
+        info.offset = static_cast<uint32_t>(encoded_tail_offset_);
+
+        if (info.size > 0) {
+            auto page = buffer_manager_.fetchPageWrite(data_file_id_, info.page_id);
+            PageCodec::encode(info, raw, records_per_page_, record_size, page->data + info.offset);
+            page->is_dirty = true;
+        }
+        encoded_tail_offset_ += info.size;
+
+        ZoneMap zone = computeZone(raw, records_per_page_);
+        {
+            std::unique_lock<std::shared_mutex> lock(directory_latch_);
+            encoded_pages_.push_back(info);
+            zone_maps_.push_back(zone);
+        }
+        sealed_pages_.store(page_id + 1, std::memory_order_release);
+    }
+
+    // 以原始槽位格式提供第 page_id 頁的前 count 筆給 fn(data)。
+    // 尾端頁在閂鎖下再確認一次未被封存：封存後的附加會覆寫尾端頁
+    template <typename Fn>
+    void withPage(PageId page_id, size_t count, AccessType access, Fn&& fn,
+        SequentialPrefetcher* prefetcher = nullptr) const {
+        if (page_id >= sealed_pages_.load(std::memory_order_acquire)) {
+            auto tail = buffer_manager_.fetchPageRead(tail_file_id_, 0, access);
+            if (page_id >= sealed_pages_.load(std::memory_order_acquire)) {
+                fn(static_cast<const char*>(tail->data));
+                return;
+            }
+        }
+
+        const EncodedPageInfo info = encodedPage(page_id);
+        PageGuard page;
+        const char* encoded = encodedBytes(info, access, page, prefetcher);
+        if (info.encoding == PageEncoding::PLAIN) {
+            fn(encoded);
+            return;
+        }
+
+        alignas(64) char decoded[PAGE_SIZE];
+        PageCodec::decode(info, encoded, count, getRecordSize(), decoded);
+        fn(static_cast<const char*>(decoded));
+    }
+
+    size_t pageCount(size_t total) const { return (total + records_per_page_ - 1) / records_per_page_; }
+
+    // 參與平行掃描的執行緒數，也就是各執行緒部分結果的個數
+    size_t parallelism() const { return executor_ ? executor_->parallelism() : 1; }
+
+    // 把 [0, total) 的頁面切成每 MORSEL_PAGES 頁一個 morsel 交給執行器，fn(worker, first_page, end_page)。
+    // 每頁的記錄數是 64 的倍數，不同 morsel 寫入選取向量的字組不會重疊；頁數太少時直接在呼叫端執行
+    template <typename Fn>
+    void forEachMorsel(size_t total, Fn&& fn) const {
+        const size_t pages = pageCount(total);
+        if (!executor_ || pages <= MORSEL_PAGES || records_per_page_ % 64 != 0) {
+            fn(size_t(0), PageId(0), static_cast<PageId>(pages));
+            return;
+        }
+        executor_->parallelFor((pages + MORSEL_PAGES - 1) / MORSEL_PAGES, [&](size_t worker, size_t morsel) {
+            fn(worker, static_cast<PageId>(morsel * MORSEL_PAGES),
+                static_cast<PageId>(std::min(pages, (morsel + 1) * MORSEL_PAGES)));
+        });
+    }
+
+    // 依頁面順序掃描 [0, total)；若提供 candidates，沒有候選列的頁面直接跳過不讀取。
+    // on_page(data, count, start_record) 收到原始槽位（封存頁先解碼到 L1 大小的緩衝區）；
+    // 若提供 on_run，CONSTANT/RLE 頁面不解碼，改為每段呼叫一次 on_run(slot, start_record, length)；
+    // 若提供 on_zone(zone, start_record, count)，封存頁先以 zone map 判斷，只有回傳 SOME 的頁面才讀取。
+    // 資料檔的實體頁依序讀取，交給 SequentialPrefetcher 預讀
+    template <typename PageFn, typename RunFn = std::nullptr_t, typename ZoneFn = std::nullptr_t>
+    void forEachPage(size_t total, const SelectionVector* candidates, PageFn&& on_page,
+        RunFn&& on_run = nullptr, ZoneFn&& on_zone = nullptr) const {
+        forEachPageInRange(0, pageCount(total), total, candidates, on_page, on_run, on_zone);
+    }
+
+    // 同 forEachPage，只掃描頁號 [first_page, end_page)
+    template <typename PageFn, typename RunFn = std::nullptr_t, typename ZoneFn = std::nullptr_t>
+    void forEachPageInRange(PageId first_page, PageId end_page, size_t total, const SelectionVector* candidates,
+        PageFn&& on_page, RunFn&& on_run = nullptr, ZoneFn&& on_zone = nullptr) const {
+        const size_t record_size = getRecordSize();
+        SequentialPrefetcher prefetcher(buffer_manager_, data_file_id_,
+            immutable_pages_.load(std::memory_order_acquire) + 1);
+        for (PageId page_id = first_page; page_id < end_page && page_id * records_per_page_ < total; ++page_id) {
+            size_t start_record = page_id * records_per_page_;
+            size_t count = std::min(records_per_page_, total - start_record);
+            if (candidates && !candidates->anyInRange(start_record, count)) continue;
+
+            if constexpr (!std::is_same_v<std::decay_t<ZoneFn>, std::nullptr_t>) {
+                if (page_id < sealed_pages_.load(std::memory_order_acquire) &&
+                    on_zone(zoneMap(page_id), start_record, count) != ZoneMatch::SOME) {
+                    continue;
+                }
+            }
+
+            if constexpr (!std::is_same_v<std::decay_t<RunFn>, std::nullptr_t>) {
+                if (page_id < sealed_pages_.load(std::memory_order_acquire)) {
+                    const EncodedPageInfo info = encodedPage(page_id);
+                    if (info.encoding == PageEncoding::CONSTANT || info.encoding == PageEncoding::RLE) {
+                        PageGuard page;
+                        PageCodec::forEachRun(info, encodedBytes(info, AccessType::SCAN, page, &prefetcher), count, record_size,
+                            [&](const char* slot, size_t begin, size_t length) {
+                                on_run(slot, start_record + begin, length);
+                            });
+                        continue;
+                    }
+                }
+            }
+
+            withPage(page_id, count, AccessType::SCAN, [&](const char* data) {
+                on_page(data, count, start_record);
+            }, &prefetcher);
+        }
+    }
+
+    // 以 kernel(data, count, bits, bit_offset) 逐頁求值述詞；CONSTANT/RLE 頁面每段只求值一次。
+    // zone_match(zone) 判定整頁不符合的頁面不讀取，整頁符合的頁面直接設定選取位元。
+    // parallel 時各 morsel 由不同執行緒求值，kernel 必須可以同時呼叫
+    template <typename Kernel, typename ZoneFn>
+    void filterPages(size_t total, const SelectionVector* candidates, SelectionVector& selection,
+        Kernel&& kernel, ZoneFn&& zone_match, bool parallel = true) const {
+        uint64_t* bits = selection.words();
+        auto scan = [&](PageId first_page, PageId end_page) {
+            forEachPageInRange(first_page, end_page, total, candidates,
+                [&](const char* data, size_t count, size_t start_record) {
+                    kernel(data, count, bits, start_record);
+                },
+                [&](const char* slot, size_t start_record, size_t length) {
+                    uint64_t match = 0;
+                    kernel(slot, 1, &match, 0);
+                    if (match) selection.setRange(start_record, length);
+                },
+                [&](const ZoneMap& zone, size_t start_record, size_t count) {
+                    ZoneMatch match = zone_match(zone);
+                    if (match == ZoneMatch::ALL) selection.setRange(start_record, count);
+                    return match;
+                });
+        };
+
+        if (!parallel) {
+            scan(0, static_cast<PageId>(pageCount(total)));
+            return;
+        }
+        forEachMorsel(total, [&](size_t, PageId first_page, PageId end_page) { scan(first_page, end_page); });
+    }
+
+    static const std::string& stringArgument(const Value& value) {
+        const auto* str = std::get_if<std::string>(&value);
+        if (!str) {
+            throw std::runtime_error("Value does not match STRING column type");
+        }
+        return *str;
+    }
+
+    // 字串述詞：字典模式先在字典上求值，等值述詞直接比較代碼；堆積模式逐筆讀取堆積中的字串
+    void filterStrings(const ColumnPredicate& predicate, SelectionVector& selection,
+        const SelectionVector* candidates) const {
+        const CompareOp op = predicate.op;
+        const std::string& lo = stringArgument(predicate.value);
+        const std::string empty;
+        const std::string& hi = op == CompareOp::BETWEEN ? stringArgument(predicate.upper) : empty;
+        const size_t total = std::min(size(), selection.size());
+
+        if (isDictionaryEncoded()) {
+            if (op == CompareOp::EQ) {
+                int32_t code = dictionary_->find(lo);
+                if (code == StringDictionary::NO_CODE) return;
+                filterPages(total, candidates, selection,
+                    [&](const char* data, size_t count, uint64_t* bits, size_t bit_offset) {
+                        ScanKernels::filter<int32_t>(data, count, CompareOp::EQ, code, 0, bits, bit_offset);
+                    },
+                    [&](const ZoneMap& zone) { return zoneMatch<int32_t>(zone, CompareOp::EQ, code, 0); });
+                return;
+            }
+
+            auto match = dictionary_->matchCodes(op, lo, hi);
+            filterPages(total, candidates, selection,
+                [&](const char* data, size_t count, uint64_t* bits, size_t bit_offset) {
+                    ScanKernels::filterCodes(data, count, match.data(), match.size(), bits, bit_offset);
+                },
+                [](const ZoneMap&) { return ZoneMatch::SOME; });
+            return;
+        }
+
+        PageGuard heap_page;
+        filterPages(total, candidates, selection,
+            [&](const char* data, size_t count, uint64_t* bits, size_t bit_offset) {
+                for (size_t i = 0; i < count; ++i) {
+                    StringRef ref;
+                    std::memcpy(&ref, data + i * sizeof(StringRef), sizeof(StringRef));
+                    bool match = ScanKernels::matchString(op, string_heap_->view(ref, heap_page), lo, hi);
+                    size_t pos = bit_offset + i;
+                    bits[pos >> 6] |= uint64_t(match) << (pos & 63);
+                }
+            },
+            [](const ZoneMap&) { return ZoneMatch::SOME; },
+            false);  // 堆積字串重用同一個頁面守衛，依序求值
+    }
+
+    // 將值編碼成資料檔槽位的位元組（最多 8 位元組）；字串先寫入字串堆積或字典
+    void encodeValue(const Value& value, char* slot) {
+        switch (type_) {
+        case DataType::INT32: {
+            int32_t val = std::get<int32_t>(value);
+            std::memcpy(slot, &val, sizeof(int32_t));
+            break;
+        }
+        case DataType::INT64: {
+            int64_t val = std::get<int64_t>(value);
+            std::memcpy(slot, &val, sizeof(int64_t));
+            break;
+        }
+        case DataType::FLOAT: {
+            float val = std::get<float>(value);
+            std::memcpy(slot, &val, sizeof(float));
+            break;
+        }
+        case DataType::DOUBLE: {
+            double val = std::get<double>(value);
+            std::memcpy(slot, &val, sizeof(double));
+            break;
+        }
+        case DataType::STRING: {
+            const std::string& val = stringArgument(value);
+            if (isDictionaryEncoded()) {
+                int32_t code = dictionary_->encode(val);
+                std::memcpy(slot, &code, sizeof(int32_t));
+            }
+            else {
+                StringRef ref = string_heap_->append(val);
+                std::memcpy(slot, &ref, sizeof(StringRef));
+            }
+            break;
+        }
+        case DataType::BOOL: {
+            bool val = std::get<bool>(value);
+            std::memcpy(slot, &val, sizeof(bool));
+            break;
+        }
+        }
+    }
+
+    // 將述詞常數轉為列的原生型別
+    template <typename T>
+    static T predicateConstant(const Value& value) {
+        return std::visit([](const auto& v) -> T {
+            using V = std::decay_t<decltype(v)>;
+            if constexpr (std::is_arithmetic_v<V>) {
+                return static_cast<T>(v);
+            }
+            else {
+                throw std::runtime_error("Predicate constant does not match column type");
+            }
+        }, value);
+    }
+
+    template <typename T>
+    RoaringBitmap matchBitmapAs(const ColumnPredicate& predicate) const {
+        const T lo = predicateConstant<T>(predicate.value);
+        const T hi = predicate.op == CompareOp::BETWEEN ? predicateConstant<T>(predicate.upper) : T{};
+        if (predicate.op == CompareOp::EQ) return bitmap_index_->lookup(lo);
+        return bitmap_index_->unionWhere([&](const Value& key) {
+            return ScanKernels::matchValue<T>(predicate.op, std::get<T>(key), lo, hi);
+        });
+    }
+
+    template <typename T>
+    std::optional<size_t> countIndexedAs(const ColumnPredicate& predicate, RecordId visible) {
+        const T lo = predicateConstant<T>(predicate.value);
+        const T hi = predicate.op == CompareOp::BETWEEN ? predicateConstant<T>(predicate.upper) : lo;
+        return countIndexedRange(predicate.op, Value(lo), Value(hi), visible);
+    }
+
+    // 單邊範圍以索引的第一個／最後一個鍵補上另一端；LT/GT 再扣掉等於邊界的項目
+    std::optional<size_t> countIndexedRange(CompareOp op, const Value& lo, const Value& hi, RecordId visible) {
+        switch (op) {
+        case CompareOp::EQ: return index_->countRange(lo, lo, visible);
+        case CompareOp::BETWEEN: return index_->countRange(lo, hi, visible);
+        case CompareOp::NE: return std::nullopt;
+        case CompareOp::LT:
+        case CompareOp::LE:
+        case CompareOp::GT:
+        case CompareOp::GE:
+            break;
+        }
+
+        const bool below = op == CompareOp::LT || op == CompareOp::LE;
+        std::optional<Value> edge = below ? index_->firstKey(visible) : index_->lastKey(visible);
+        if (!edge) return 0;
+        size_t count = below ? index_->countRange(*edge, lo, visible) : index_->countRange(lo, *edge, visible);
+        if (op == CompareOp::LT || op == CompareOp::GT) {
+            // 兩次計數之間可能有並行插入變得可見，不讓差值變成負數
+            count -= std::min(count, index_->countRange(lo, lo, visible));
+        }
+        return count;
+    }
+
+    std::optional<Value> indexBound(RecordId visible, bool last) {
+        if (!isDictionaryEncoded()) return last ? index_->lastKey(visible) : index_->firstKey(visible);
+
+        std::optional<std::string> bound;
+        const size_t codes = dictionary_->size();
+        for (size_t code = 0; code < codes; ++code) {
+            const Value key(static_cast<int32_t>(code));
+            if (index_->countRange(key, key, visible) == 0) continue;
+            std::string value = dictionary_->decode(static_cast<int32_t>(code));
+            if (!bound || (last ? *bound < value : value < *bound)) bound = std::move(value);
+        }
+        if (!bound) return std::nullopt;
+        return Value(std::move(*bound));
+    }
+
+    void filterPage(const char* data, size_t count, const ColumnPredicate& predicate,
+        uint64_t* bits, size_t bit_offset) const {
+        const CompareOp op = predicate.op;
+        const bool ranged = op == CompareOp::BETWEEN;
+
+        switch (type_) {
+        case DataType::INT32:
+            ScanKernels::filter<int32_t>(data, count, op, predicateConstant<int32_t>(predicate.value),
+                ranged ? predicateConstant<int32_t>(predicate.upper) : 0, bits, bit_offset);
+            break;
+        case DataType::INT64:
+            ScanKernels::filter<int64_t>(data, count, op, predicateConstant<int64_t>(predicate.value),
+                ranged ? predicateConstant<int64_t>(predicate.upper) : 0, bits, bit_offset);
+            break;
+        case DataType::FLOAT:
+            ScanKernels::filter<float>(data, count, op, predicateConstant<float>(predicate.value),
+                ranged ? predicateConstant<float>(predicate.upper) : 0.0f, bits, bit_offset);
+            break;
+        case DataType::DOUBLE:
+            ScanKernels::filter<double>(data, count, op, predicateConstant<double>(predicate.value),
+                ranged ? predicateConstant<double>(predicate.upper) : 0.0, bits, bit_offset);
+            break;
+        case DataType::BOOL:
+            ScanKernels::filter<bool>(data, count, op, predicateConstant<bool>(predicate.value),
+                ranged ? predicateConstant<bool>(predicate.upper) : false, bits, bit_offset);
+            break;
+        case DataType::STRING:
+            // 字串述詞由 filterStrings 處理
+            break;
+        }
+    }
+
+    // 將一筆記錄的原始槽位複製到 slot（至少 8 位元組）；已封存的頁面只解碼需要的那一筆
+    void readSlot(RecordId record_id, char* slot) const {
+        PageId page_id = record_id / records_per_page_;
+        size_t offset = record_id % records_per_page_;
+        const size_t record_size = getRecordSize();
+
+        if (page_id >= sealed_pages_.load(std::memory_order_acquire)) {
+            auto page = buffer_manager_.fetchPageRead(tail_file_id_, 0);
+            if (page_id >= sealed_pages_.load(std::memory_order_acquire)) {
+                std::memcpy(slot, page->data + offset * record_size, record_size);
+                return;
+            }
+        }
+
+        const EncodedPageInfo info = encodedPage(page_id);
+        PageGuard page;
+        const char* encoded = encodedBytes(info, AccessType::NORMAL, page);
+        PageCodec::storeSlot(slot, 0, record_size, PageCodec::decodeValue(info, encoded, offset, record_size));
+    }
+
+    // 將一個原始槽位附加到型別化陣列；T 與欄位型別對應（BOOL 為 uint8_t）
+    template <typename T>
+    void appendSlot(const char* data_ptr, std::vector<T>& out, PageGuard& heap_page) const {
+        if constexpr (std::is_same_v<T, std::string>) {
+            if (isDictionaryEncoded()) {
+                int32_t code;
+                std::memcpy(&code, data_ptr, sizeof(int32_t));
+                out.push_back(dictionary_->decode(code));
+            }
+            else {
+                StringRef ref;
+                std::memcpy(&ref, data_ptr, sizeof(StringRef));
+                out.emplace_back(string_heap_->view(ref, heap_page));
+            }
+        }
+        else if constexpr (std::is_same_v<T, uint8_t>) {
+            out.push_back(*data_ptr != 0 ? 1 : 0);
+        }
+        else {
+            T val;
+            std::memcpy(&val, data_ptr, sizeof(T));
+            out.push_back(val);
+        }
+    }
+
+    // 將一個原始槽位解碼為 Value
+    Value decodeSlot(const char* data_ptr) const {
+
+        switch (type_) {
+        case DataType::INT32: {
+            int32_t val;
+            std::memcpy(&val, data_ptr, sizeof(int32_t));
+            return val;
+        }
+        case DataType::INT64: {
+            int64_t val;
+            std::memcpy(&val, data_ptr, sizeof(int64_t));
+            return val;
+        }
+        case DataType::FLOAT: {
+            float val;
+            std::memcpy(&val, data_ptr, sizeof(float));
+            return val;
+        }
+        case DataType::DOUBLE: {
+            double val;
+            std::memcpy(&val, data_ptr, sizeof(double));
+            return val;
+        }
+        case DataType::STRING: {
+            if (isDictionaryEncoded()) {
+                int32_t code;
+                std::memcpy(&code, data_ptr, sizeof(int32_t));
+                return dictionary_->decode(code);
+            }
+            StringRef ref;
+            std::memcpy(&ref, data_ptr, sizeof(StringRef));
+            return string_heap_->read(ref);
+        }
+        case DataType::BOOL: {
+            bool val;
+            std::memcpy(&val, data_ptr, sizeof(bool));
+            return val;
+        }
+        }
+        return int32_t(0);
+    }
+};
+
+enum class LogRecordType : uint8_t {
+    CREATE_TABLE = 1,  // 表格名稱
+    ADD_COLUMN = 2,    // 表格、欄位名稱、型別、字串編碼、extent 大小、索引型別
+    INSERT = 3,        // 表格、第一個 RecordId、列數、依欄位順序排列的值
+    INSERT_BATCH = 4,  // 與 INSERT 相同的開頭，之後依欄位順序存放整段值（RecordBatch::writeValues）
+    DROP_TABLE = 5     // 表格名稱
+};
+
+// 提交的持久性保證
+enum class DurabilityMode {
+    SYNC,   // 提交等待日誌落盤；同時提交的交易共用一次 fsync（群組提交）
+    ASYNC,  // 記錄交給日誌寫入執行緒後立即返回，當機時可能遺失最後一組提交
+    NONE    // 不寫日誌，資料只在檢查點與關閉時寫回
+};
+
+// 預寫日誌 - 表格的附加與 DDL 以邏輯記錄循序寫入 wal.log，取代逐頁強制寫回。
+//
+// 記錄格式：[u32 長度][u32 CRC][u64 LSN][u8 型別][內容]。LSN 是記錄結尾在日誌串流中的位置，
+// 單調遞增且跨檢查點延續；CRC 涵蓋 LSN、型別與內容，讀取時遇到 CRC 不符的記錄即視為日誌結尾。
+// 檔頭記錄 base_lsn：LSN 不大於 base_lsn 的記錄已由檢查點涵蓋。
+//
+// 群組提交：append 只把記錄放進記憶體緩衝；日誌寫入執行緒每次取走整個緩衝，
+// 一次寫入、一次 fsync 後推進 durable_lsn，期間新附加的記錄累積成下一組。
+// 索引不另外記錄：索引內容由附加的值決定，重做附加時一併重建。
+//
+// 寫入者以 admitWriter() 取得共享閂鎖，檢查點以 blockWriters() 等待進行中的寫入完成，
+// 讓資料頁寫回時正好對應日誌的某個 LSN
+class WriteAheadLog {
+public:
+    using Lsn = uint64_t;
+
+private:
+    static constexpr uint64_t MAGIC = 0x4C41574244505041ull;  // "APPDBWAL"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t HEADER_BYTES = 4096;
+    static constexpr size_t RECORD_HEADER_BYTES = 16;
+
+    struct FileHeader {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t crc;  // 涵蓋 base_lsn
+        uint64_t base_lsn;
+    };
+
+    std::string path_;
+    DurabilityMode mode_;
+    NativeFile file_;
+    std::function<void()> on_log_full_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable writer_cv_;
+    std::condition_variable durable_cv_;
+    std::string buffer_;        // 尚未交給寫入執行緒的記錄
+    std::string writing_;       // 寫入執行緒正在寫的一組記錄
+    Lsn base_lsn_ = 0;
+    Lsn next_lsn_ = 0;          // 已附加記錄的結尾
+    Lsn durable_lsn_ = 0;       // 已落盤記錄的結尾
+    uint64_t file_end_ = HEADER_BYTES;
+    bool log_full_signaled_ = false;
+    bool failed_ = false;
+    bool stopping_ = false;
+    uint64_t records_ = 0;
+    uint64_t commits_ = 0;
+    uint64_t syncs_ = 0;
+    uint64_t checkpoints_ = 0;
+
+    std::shared_mutex checkpoint_latch_;
+    std::thread writer_;
+
+public:
+    // on_log_full 在日誌自上次檢查點起超過 CHECKPOINT_LOG_BYTES 時呼叫一次（在附加者的執行緒上）。
+    // 開啟時清空舊的日誌，呼叫端須先以 replay 重做並寫好檢查點；LSN 從 base_lsn 接續
+    WriteAheadLog(const std::string& path, DurabilityMode mode, std::function<void()> on_log_full = nullptr,
+        Lsn base_lsn = 0)
+        : path_(path), mode_(mode), on_log_full_(std::move(on_log_full)), base_lsn_(base_lsn),
+        next_lsn_(base_lsn), durable_lsn_(base_lsn) {
+#if defined(_WIN32)
+        file_ = CreateFileA(path_.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) {
+#else
+        file_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (file_ < 0) {
+#endif
+            throw std::runtime_error("Failed to create write-ahead log: " + path_);
+        }
+        if (!writeHeader()) {
+            closeFile();
+            throw std::runtime_error("Failed to initialize write-ahead log: " + path_);
+        }
+        writer_ = std::thread([this] { writerLoop(); });
+    }
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    ~WriteAheadLog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        writer_cv_.notify_all();
+        writer_.join();  // 寫入執行緒會先寫完緩衝中剩下的記錄
+        closeFile();
+    }
+
+    DurabilityMode mode() const { return mode_; }
+
+    std::shared_lock<std::shared_mutex> admitWriter() {
+        return std::shared_lock<std::shared_mutex>(checkpoint_latch_);
+    }
+
+    std::unique_lock<std::shared_mutex> blockWriters() {
+        return std::unique_lock<std::shared_mutex>(checkpoint_latch_);
+    }
+
+    // 附加一筆記錄並回傳其 LSN；記錄只放進記憶體緩衝，落盤需呼叫 commit
+    Lsn append(LogRecordType type, const ByteWriter& record) {
+        const std::string& body = record.body();
+        if (body.size() + 1 > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error("Log record too large");
+        }
+        const uint32_t length = static_cast<uint32_t>(body.size() + 1);
+        const char type_byte = static_cast<char>(type);
+
+        bool notify_full = false;
+        Lsn lsn;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (failed_) throw std::runtime_error("Write-ahead log is unavailable after a write failure");
+            lsn = next_lsn_ + RECORD_HEADER_BYTES + length;
+            uint32_t crc = crc32(reinterpret_cast<const char*>(&lsn), sizeof(lsn));
+            crc = crc32(&type_byte, 1, crc);
+            crc = crc32(body.data(), body.size(), crc);
+
+            char header[RECORD_HEADER_BYTES];
+            std::memcpy(header, &length, 4);
+            std::memcpy(header + 4, &crc, 4);
+            std::memcpy(header + 8, &lsn, 8);
+            buffer_.append(header, RECORD_HEADER_BYTES);
+            buffer_.push_back(type_byte);
+            buffer_.append(body);
+            next_lsn_ = lsn;
+            records_++;
+
+            if (!log_full_signaled_ && next_lsn_ - base_lsn_ >= CHECKPOINT_LOG_BYTES) {
+                log_full_signaled_ = true;
+                notify_full = static_cast<bool>(on_log_full_);
+            }
+        }
+        writer_cv_.notify_one();
+        if (notify_full) on_log_full_();
+        return lsn;
+    }
+
+    // 提交：SYNC 模式等待 lsn 之前的記錄落盤；等待期間其他交易的記錄會併入同一次 fsync
+    void commit(Lsn lsn) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        commits_++;
+        if (mode_ != DurabilityMode::SYNC) return;
+        durable_cv_.wait(lock, [this, lsn] { return durable_lsn_ >= lsn || failed_; });
+        if (durable_lsn_ < lsn) {
+            throw std::runtime_error("Write-ahead log write failed");
+        }
+    }
+
+    // 等待目前已附加的記錄全部落盤
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const Lsn target = next_lsn_;
+        durable_cv_.wait(lock, [this, target] { return durable_lsn_ >= target || failed_; });
+    }
+
+    // 檢查點資料頁落盤後呼叫，呼叫端必須持有 blockWriters()：
+    // 先把新的 base_lsn 寫入檔頭再截斷，兩步之間當機時舊記錄也會因 LSN 不大於 base_lsn 被略過
+    void truncate() {
+        flush();
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (failed_) return;
+        const uint64_t truncated = file_end_ - HEADER_BYTES;
+        base_lsn_ = next_lsn_;
+        if (!writeHeader() || !PositionalIo::truncate(file_, HEADER_BYTES) || !PositionalIo::sync(file_)) {
+            DATABASEAPP_LOG(LogLevel::ERR, "Failed to truncate write-ahead log " << path_);
+            failed_ = true;
+            return;
+        }
+        file_end_ = HEADER_BYTES;
+        log_full_signaled_ = false;
+        checkpoints_++;
+        DATABASEAPP_LOG(LogLevel::DEBUG, "Checkpoint at LSN " << base_lsn_ << ", truncated " << truncated
+            << " bytes of log");
+    }
+
+    uint64_t bytesSinceCheckpoint() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return next_lsn_ - base_lsn_;
+    }
+
+    // 已附加記錄的結尾；檢查點在 blockWriters() 下記錄到目錄中
+    Lsn endLsn() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return next_lsn_;
+    }
+
+    // 依序把 LSN 大於 after_lsn 的記錄交給 apply(type, body)，回傳最後一筆有效記錄的 LSN（至少為 after_lsn）。
+    // 遇到不完整、CRC 不符或 LSN 不連續的記錄即視為日誌結尾；檔頭無效時整個日誌視為空的
+    static Lsn replay(const std::string& path, Lsn after_lsn,
+        const std::function<void(LogRecordType, ByteReader&)>& apply) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return after_lsn;
+        std::string log((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        FileHeader header;
+        if (log.size() < HEADER_BYTES) return after_lsn;
+        std::memcpy(&header, log.data(), sizeof(header));
+        if (header.magic != MAGIC || header.version != VERSION ||
+            header.crc != crc32(reinterpret_cast<const char*>(&header.base_lsn), sizeof(header.base_lsn))) {
+            DATABASEAPP_LOG(LogLevel::ERR, "Ignoring write-ahead log with an invalid header: " << path);
+            return after_lsn;
+        }
+        if (header.base_lsn > after_lsn) {
+            throw std::runtime_error("Write-ahead log " + path + " starts after the catalog checkpoint");
+        }
+
+        Lsn lsn = header.base_lsn;
+        size_t replayed = 0;
+        for (size_t offset = HEADER_BYTES; offset + RECORD_HEADER_BYTES < log.size();) {
+            uint32_t length;
+            uint32_t crc;
+            Lsn record_lsn;
+            std::memcpy(&length, log.data() + offset, 4);
+            std::memcpy(&crc, log.data() + offset + 4, 4);
+            std::memcpy(&record_lsn, log.data() + offset + 8, 8);
+            if (length == 0 || length > log.size() - offset - RECORD_HEADER_BYTES ||
+                record_lsn != lsn + RECORD_HEADER_BYTES + length ||
+                crc != crc32(log.data() + offset + 8, 8 + length)) {
+                break;
+            }
+
+            if (record_lsn > after_lsn) {
+                const char* type = log.data() + offset + RECORD_HEADER_BYTES;
+                ByteReader body(type + 1, length - 1);
+                apply(static_cast<LogRecordType>(*type), body);
+                replayed++;
+            }
+            lsn = record_lsn;
+            offset += RECORD_HEADER_BYTES + length;
+        }
+        DATABASEAPP_LOG(LogLevel::DEBUG, "Replayed " << replayed << " log records from " << path << " up to LSN "
+            << std::max(lsn, after_lsn));
+        return std::max(lsn, after_lsn);
+    }
+
+    struct Stats {
+        uint64_t records;
+        uint64_t commits;
+        uint64_t syncs;
+        uint64_t checkpoints;
+        Lsn durable_lsn;
+    };
+
+    Stats getStats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return { records_, commits_, syncs_, checkpoints_, durable_lsn_ };
+    }
+
+private:
+    void writerLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            writer_cv_.wait(lock, [this] { return stopping_ || !buffer_.empty(); });
+            if (buffer_.empty()) break;
+
+            writing_.clear();
+            writing_.swap(buffer_);
+            const Lsn end = next_lsn_;
+            const uint64_t offset = file_end_;
+            file_end_ += writing_.size();
+            lock.unlock();
+
+            bool ok = PositionalIo::writeAt(file_, offset, writing_.data(), writing_.size())
+                && PositionalIo::sync(file_);
+
+            lock.lock();
+            syncs_++;
+            if (ok) {
+                durable_lsn_ = end;
+            }
+            else {
+                DATABASEAPP_LOG(LogLevel::ERR, "Failed to write " << writing_.size()
+                    << " bytes to write-ahead log " << path_);
+                failed_ = true;
+            }
+            durable_cv_.notify_all();
+        }
+    }
+
+    bool writeHeader() {
+        FileHeader header{ MAGIC, VERSION, 0, base_lsn_ };
+        header.crc = crc32(reinterpret_cast<const char*>(&header.base_lsn), sizeof(header.base_lsn));
+        std::vector<char> block(HEADER_BYTES, 0);
+        std::memcpy(block.data(), &header, sizeof(header));
+        return PositionalIo::writeAt(file_, 0, block.data(), block.size()) && PositionalIo::sync(file_);
+    }
+
+    void closeFile() {
+#if defined(_WIN32)
+        CloseHandle(file_);
+#else
+        ::close(file_);
+#endif
+    }
+};
+
+// 查詢結果的串流游標 - 開啟時只求出符合的 RecordId（每筆 8 位元組），
+// 投影欄位的值在 next() 時才依欄位取出，每次最多 batch_rows 列。
+// 游標使用期間表格必須存在；開啟之後插入的記錄不在結果中
+class ResultCursor {
+private:
+    std::vector<RecordId> record_ids_;
+    std::vector<const DiskBasedColumn*> columns_;
+    RecordBatch schema_;
+    size_t batch_rows_;
+    size_t position_;
+
+public:
+    static constexpr size_t DEFAULT_BATCH_ROWS = 4096;
+
+    ResultCursor(std::vector<RecordId> record_ids, std::vector<const DiskBasedColumn*> columns,
+        RecordBatch schema, size_t batch_rows = DEFAULT_BATCH_ROWS)
+        : record_ids_(std::move(record_ids)), columns_(std::move(columns)), schema_(std::move(schema)),
+        batch_rows_(std::max<size_t>(batch_rows, 1)), position_(0) {
+    }
+
+    // 空批次，欄位依投影順序
+    const RecordBatch& schema() const { return schema_; }
+    size_t size() const { return record_ids_.size(); }
+    size_t remaining() const { return record_ids_.size() - position_; }
+
+    // 以下一批結果取代 batch 的內容；batch 的欄位結構與緩衝區可重複使用。沒有剩餘結果時回傳 false
+    bool next(RecordBatch& batch) {
+        if (position_ >= record_ids_.size()) return false;
+        if (batch.columnCount() != schema_.columnCount()) {
+            batch = schema_;
+        }
+        else {
+            batch.clear();
+        }
+
+        const size_t count = std::min(batch_rows_, record_ids_.size() - position_);
+        for (size_t c = 0; c < columns_.size(); ++c) {
+            columns_[c]->gatherInto(record_ids_.data() + position_, count, batch.column(c));
+        }
+        position_ += count;
+        return true;
+    }
+
+    // 一次取出所有剩餘結果
+    RecordBatch readAll() {
+        RecordBatch result = schema_;
+        result.reserve(remaining());
+        for (size_t c = 0; c < columns_.size(); ++c) {
+            columns_[c]->gatherInto(record_ids_.data() + position_, remaining(), result.column(c));
+        }
+        position_ = record_ids_.size();
+        return result;
+    }
+};
+
+// 鍵的等值比較表示：整數符號延伸為 64 位元，浮點數取正規化後的位元樣式（-0 與 0 相同、NaN 只有一種）
+template <typename T>
+uint64_t normalizedKeyBits(T value) {
+    if constexpr (std::is_floating_point_v<T>) {
+        if (value == 0) value = 0;
+        if (std::isnan(value)) value = std::numeric_limits<T>::quiet_NaN();
+        if constexpr (sizeof(T) == sizeof(uint32_t)) {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+        else {
+            uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            return bits;
+        }
+    }
+    else {
+        return static_cast<uint64_t>(static_cast<int64_t>(value));
+    }
+}
+
+inline uint64_t mixKeyBits(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+// 分組用的開放定址雜湊表 - 線性探測，鍵與分組編號放在同一個槽位，探測只讀取連續記憶體。
+// 分組編號依鍵首次出現的順序從 0 開始指派；負載超過一半時容量加倍
+class GroupHashTable {
+public:
+    static constexpr uint32_t NO_GROUP = std::numeric_limits<uint32_t>::max();
+
+private:
+    struct Slot {
+        uint64_t key;
+        uint32_t group;
+    };
+
+    std::vector<Slot> slots_;
+    size_t mask_;
+    uint32_t size_ = 0;
+
+    static size_t hash(uint64_t key) { return static_cast<size_t>(mixKeyBits(key)); }
+
+    void grow() {
+        std::vector<Slot> old(slots_.size() * 2, Slot{ 0, NO_GROUP });
+        old.swap(slots_);
+        mask_ = slots_.size() - 1;
+        for (const Slot& slot : old) {
+            if (slot.group == NO_GROUP) continue;
+            size_t pos = hash(slot.key) & mask_;
+            while (slots_[pos].group != NO_GROUP) pos = (pos + 1) & mask_;
+            slots_[pos] = slot;
+        }
+    }
+
+public:
+    GroupHashTable() : GroupHashTable(64) {}
+
+    explicit GroupHashTable(size_t capacity) {
+        size_t slots = 16;
+        while (slots < capacity * 2) slots *= 2;
+        slots_.assign(slots, Slot{ 0, NO_GROUP });
+        mask_ = slots - 1;
+    }
+
+    // 回傳 key 的分組編號；不存在時新增並指派編號 size()
+    uint32_t findOrInsert(uint64_t key) {
+        if ((size_t(size_) + 1) * 2 > slots_.size()) grow();
+        for (size_t pos = hash(key) & mask_;; pos = (pos + 1) & mask_) {
+            Slot& slot = slots_[pos];
+            if (slot.group == NO_GROUP) {
+                slot = Slot{ key, size_ };
+                return size_++;
+            }
+            if (slot.key == key) return slot.group;
+        }
+    }
+
+    size_t size() const { return size_; }
+};
+
+// 分組聚合的結果：每個分組一筆，依鍵值遞增排序；浮點鍵的所有 NaN 合併成一個分組，排在最後
+struct GroupAggregate {
+    Value key;
+    size_t count = 0;                         // 分組內的列數
+    std::vector<AggregateResult> aggregates;  // 與聚合欄位的順序一致
+};
+
+// 雜湊分組聚合 - 依鍵欄位分組，對每個聚合欄位計算 COUNT/SUM/MIN/MAX/AVG。
+// 鍵為整數（含 BOOL 與字典代碼）且值域不超過 DIRECT_GROUP_LIMIT 時，分組編號直接是 key - min，
+// 部分結果放在陣列中；其他鍵使用開放定址雜湊表（浮點鍵以位元樣式分組，-0 與 0 視為相同）。
+// 記錄切成 morsel 平行處理：每個 morsel 先由鍵欄位解出各列的分組編號，再依序掃描各聚合欄位的同一段記錄，
+// 各執行緒累加在自己的分組表上，最後依鍵合併
+class GroupByOperator {
+public:
+    static constexpr size_t DIRECT_GROUP_LIMIT = 4096;
+
+private:
+    struct Partial {
+        GroupHashTable table;
+        std::vector<uint64_t> keys;               // 雜湊模式下每個分組的鍵
+        std::vector<size_t> counts;
+        std::vector<AggregateResult> aggregates;  // [分組 * 聚合欄位數 + 欄位]
+        std::vector<uint32_t> groups;             // 目前 morsel 每筆記錄的分組編號
+    };
+
+    const DiskBasedColumn& key_column_;
+    std::vector<const DiskBasedColumn*> aggregate_columns_;
+    MorselExecutor* executor_;
+    bool direct_ = false;
+    int64_t base_ = 0;        // 直接陣列模式的最小鍵
+    size_t group_slots_ = 0;  // 直接陣列模式的分組數
+
+public:
+    GroupByOperator(const DiskBasedColumn& key_column, std::vector<const DiskBasedColumn*> aggregate_columns,
+        MorselExecutor* executor)
+        : key_column_(key_column), aggregate_columns_(std::move(aggregate_columns)), executor_(executor) {
+        if (key_column_.getType() == DataType::STRING && !key_column_.isDictionaryEncoded()) {
+            throw std::runtime_error("GROUP BY on string column " + key_column_.getName() +
+                " requires StringEncoding::DICTIONARY");
+        }
+        for (const auto* column : aggregate_columns_) {
+            if (column->getType() == DataType::STRING) {
+                throw std::runtime_error("Cannot aggregate string column " + column->getName());
+            }
+        }
+    }
+
+    // 聚合記錄 [0, total)；selection 非 nullptr 時只聚合被選取的列
+    std::vector<GroupAggregate> execute(size_t total, const SelectionVector* selection) {
+        total = std::min(total, key_column_.size());
+        for (const auto* column : aggregate_columns_) total = std::min(total, column->size());
+        if (selection) total = std::min(total, selection->size());
+        if (total == 0) return {};
+        chooseLayout();
+
+        size_t morsel_records = key_column_.recordsPerPage();
+        for (const auto* column : aggregate_columns_) {
+            morsel_records = std::max(morsel_records, column->recordsPerPage());
+        }
+        morsel_records *= MORSEL_PAGES;  // 每頁記錄數都是 2 的冪次，morsel 邊界同時對齊所有欄位的頁面
+        const size_t morsels = (total + morsel_records - 1) / morsel_records;
+
+        std::vector<WorkerLocal<Partial>> partials(executor_ ? executor_->parallelism() : 1);
+        for (auto& partial : partials) resetPartial(partial.value);
+        auto run = [&](size_t worker, size_t morsel) {
+            const size_t begin = morsel * morsel_records;
+            processMorsel(partials[worker].value, begin, std::min(total, begin + morsel_records), selection);
+        };
+        if (executor_) {
+            executor_->parallelFor(morsels, run);
+        }
+        else {
+            for (size_t morsel = 0; morsel < morsels; ++morsel) run(0, morsel);
+        }
+
+        Partial merged;
+        resetPartial(merged);
+        for (auto& partial : partials) mergePartial(merged, partial.value);
+        return results(merged);
+    }
+
+private:
+    // 以鍵欄位的值域決定使用直接陣列或雜湊表
+    void chooseLayout() {
+        direct_ = false;
+        if (key_column_.isDictionaryEncoded()) {
+            base_ = 0;
+            group_slots_ = key_column_.dictionarySize();
+            direct_ = group_slots_ <= DIRECT_GROUP_LIMIT;
+            return;
+        }
+        switch (key_column_.getType()) {
+        case DataType::BOOL:
+            base_ = 0;
+            group_slots_ = 2;
+            direct_ = true;
+            return;
+        case DataType::INT32:
+        case DataType::INT64: {
+            // 統計值是 double；超出 2^53 的整數無法精確表示，改用雜湊表
+            const double lo = key_column_.min();
+            const double hi = key_column_.max();
+            if (!(std::fabs(lo) < 9007199254740992.0 && std::fabs(hi) < 9007199254740992.0)) return;
+            base_ = static_cast<int64_t>(lo);
+            group_slots_ = static_cast<size_t>(static_cast<int64_t>(hi) - base_ + 1);
+            direct_ = group_slots_ <= DIRECT_GROUP_LIMIT;
+            return;
+        }
+        default:
+            return;
+        }
+    }
+
+    void resetPartial(Partial& partial) const {
+        const size_t slots = direct_ ? group_slots_ : 0;
+        partial.counts.assign(slots, 0);
+        partial.aggregates.assign(slots * aggregate_columns_.size(), AggregateResult());
+    }
+
+    // 依槽位型別呼叫 fn(T{})；字典代碼為 int32_t，BOOL 為 uint8_t
+    template <typename Fn>
+    static void withSlotType(const DiskBasedColumn& column, Fn&& fn) {
+        switch (column.getType()) {
+        case DataType::INT32: fn(int32_t{}); return;
+        case DataType::INT64: fn(int64_t{}); return;
+        case DataType::FLOAT: fn(float{}); return;
+        case DataType::DOUBLE: fn(double{}); return;
+        case DataType::BOOL: fn(uint8_t{}); return;
+        case DataType::STRING: fn(int32_t{}); return;
+        }
+    }
+
+    uint32_t groupOf(Partial& partial, uint64_t key) const {
+        if (direct_) {
+            const uint64_t slot = static_cast<uint64_t>(static_cast<int64_t>(key) - base_);
+            if (slot >= group_slots_) throw std::runtime_error("GROUP BY key outside of column range");
+            return static_cast<uint32_t>(slot);
+        }
+        const uint32_t group = partial.table.findOrInsert(key);
+        if (group == partial.keys.size()) {
+            partial.keys.push_back(key);
+            partial.counts.push_back(0);
+            partial.aggregates.resize(partial.aggregates.size() + aggregate_columns_.size());
+        }
+        return group;
+    }
+
+    void processMorsel(Partial& partial, size_t begin, size_t end, const SelectionVector* selection) const {
+        partial.groups.assign(end - begin, GroupHashTable::NO_GROUP);
+
+        withSlotType(key_column_, [&](auto tag) {
+            using T = decltype(tag);
+            key_column_.scanSlots(begin, end, selection, [&](const char* data, size_t count, size_t start_record) {
+                for (size_t i = 0; i < count; ++i) {
+                    if (selection && !selection->test(start_record + i)) continue;
+                    const uint32_t group = groupOf(partial, normalizedKeyBits(ScanKernels::loadValue<T>(data, i)));
+                    partial.counts[group]++;
+                    partial.groups[start_record + i - begin] = group;
+                }
+            });
+        });
+
+        const size_t width = aggregate_columns_.size();
+        for (size_t a = 0; a < width; ++a) {
+            const DiskBasedColumn& column = *aggregate_columns_[a];
+            withSlotType(column, [&](auto tag) {
+                using T = decltype(tag);
+                column.scanSlots(begin, end, selection, [&](const char* data, size_t count, size_t start_record) {
+                    const uint32_t* groups = partial.groups.data() + (start_record - begin);
+                    for (size_t i = 0; i < count; ++i) {
+                        if (groups[i] == GroupHashTable::NO_GROUP) continue;
+                        const double value = static_cast<double>(ScanKernels::loadValue<T>(data, i));
+                        AggregateResult& result = partial.aggregates[groups[i] * width + a];
+                        result.count++;
+                        result.sum += value;
+                        result.min = std::min(result.min, value);
+                        result.max = std::max(result.max, value);
+                    }
+                });
+            });
+        }
+    }
+
+    void mergePartial(Partial& merged, const Partial& partial) const {
+        const size_t width = aggregate_columns_.size();
+        const size_t groups = direct_ ? group_slots_ : partial.keys.size();
+        for (size_t g = 0; g < groups; ++g) {
+            if (partial.counts[g] == 0) continue;
+            const uint32_t target = direct_ ? static_cast<uint32_t>(g) : groupOf(merged, partial.keys[g]);
+            merged.counts[target] += partial.counts[g];
+            for (size_t a = 0; a < width; ++a) {
+                merged.aggregates[target * width + a].merge(partial.aggregates[g * width + a]);
+            }
+        }
+    }
+
+    std::vector<GroupAggregate> results(const Partial& merged) const {
+        const size_t width = aggregate_columns_.size();
+        const size_t groups = direct_ ? group_slots_ : merged.keys.size();
+        std::vector<GroupAggregate> out;
+        for (size_t g = 0; g < groups; ++g) {
+            if (merged.counts[g] == 0) continue;
+            const uint64_t key = direct_ ? static_cast<uint64_t>(base_ + static_cast<int64_t>(g)) : merged.keys[g];
+            GroupAggregate group;
+            group.key = keyValue(key);
+            group.count = merged.counts[g];
+            group.aggregates.assign(merged.aggregates.begin() + g * width, merged.aggregates.begin() + (g + 1) * width);
+            out.push_back(std::move(group));
+        }
+        // 所有 NaN 合併成一個分組，排在最後；NaN 會破壞 operator< 的嚴格弱序，先分開比較
+        std::sort(out.begin(), out.end(), [](const GroupAggregate& a, const GroupAggregate& b) {
+            const bool a_nan = isNaNKey(a.key);
+            const bool b_nan = isNaNKey(b.key);
+            if (a_nan || b_nan) return !a_nan;
+            return a.key < b.key;
+        });
+        return out;
+    }
+
+    static bool isNaNKey(const Value& key) {
+        return std::visit([](const auto& v) {
+            if constexpr (std::is_floating_point_v<std::decay_t<decltype(v)>>) return std::isnan(v);
+            else return false;
+        }, key);
+    }
+
+    // 把分組表示寫回槽位，再由鍵欄位解碼成 Value（字典代碼解碼成字串）
+    Value keyValue(uint64_t key) const {
+        char slot[sizeof(int64_t)] = {};
+        withSlotType(key_column_, [&](auto tag) {
+            using T = decltype(tag);
+            T value;
+            if constexpr (std::is_floating_point_v<T>) {
+                std::memcpy(&value, &key, sizeof(T));  // 小端序：位元樣式在低位元組
+            }
+            else {
+                value = static_cast<T>(static_cast<int64_t>(key));
+            }
+            std::memcpy(slot, &value, sizeof(T));
+        });
+        return key_column_.slotValue(slot);
+    }
+};
+
+// 支援大資料集的表格
+class DiskBasedTable {
+private:
+    std::string name_;
+    std::string table_path_;
+    std::unordered_map<std::string, std::unique_ptr<DiskBasedColumn>> columns_;
+    std::vector<std::string> column_order_;
+    BufferPoolManager& buffer_manager_;
+    WriteAheadLog* wal_;  // nullptr 時不寫日誌
+    MorselExecutor* executor_;  // 欄位掃描與聚合的平行執行器；nullptr 時依序執行
+    std::atomic<size_t> row_count_;
+    std::mutex insert_mutex_;  // 讓同一列在各欄位取得相同的 RecordId，日誌記錄順序與 RecordId 一致
+
+public:
+    DiskBasedTable(const std::string& name, BufferPoolManager& buffer_manager, WriteAheadLog* wal = nullptr,
+        MorselExecutor* executor = nullptr)
+        : name_(name), buffer_manager_(buffer_manager), wal_(wal), executor_(executor), row_count_(0) {
+        table_path_ = name;  // 只是表格名稱，相對路徑將由列來構建
+        // 註記：目錄創建將在檔案創建時處理
+    }
+
+    // string_encoding 只對 STRING 欄位有意義；低基數的字串欄位可選用 DICTIONARY。
+    // extent_size 為欄位資料檔的實體頁大小，必須是緩衝池已配置的頁框大小
+    void addColumn(const std::string& name, DataType type,
+        StringEncoding string_encoding = StringEncoding::HEAP, size_t extent_size = COLUMN_EXTENT_SIZE) {
+        addColumn(name, type, ColumnIndexType::BTREE, string_encoding, extent_size);
+    }
+
+    // 指定索引型別；低基數欄位（例如分類代碼）可選用 BITMAP
+    void addColumn(const std::string& name, DataType type, ColumnIndexType index_type,
+        StringEncoding string_encoding = StringEncoding::HEAP, size_t extent_size = COLUMN_EXTENT_SIZE) {
+        if (columns_.find(name) != columns_.end()) {
+            throw std::runtime_error("Column already exists: " + name);
+        }
+
+        std::shared_lock<std::shared_mutex> admitted;
+        if (wal_) admitted = wal_->admitWriter();
+
+        auto column = std::make_unique<DiskBasedColumn>(
+            table_path_ + "/" + name, type, buffer_manager_, string_encoding, extent_size, index_type);
+        column->setExecutor(executor_);
+
+        {
+            std::lock_guard<std::mutex> lock(insert_mutex_);
+            // 如果表格已有資料，新列需要填入預設值
+            for (size_t i = 0, n = row_count_.load(); i < n; ++i) {
+                column->append(defaultValue(type));
+            }
+
+            columns_[name] = std::move(column);
+            column_order_.push_back(name);
+        }
+
+        if (wal_) {
+            ByteWriter record;
+            record.putString(name_);
+            record.putString(name);
+            record.put(static_cast<uint8_t>(type));
+            record.put(static_cast<uint8_t>(string_encoding));
+            record.put(static_cast<uint32_t>(extent_size));
+            record.put(static_cast<uint8_t>(index_type));
+            WriteAheadLog::Lsn lsn = wal_->append(LogRecordType::ADD_COLUMN, record);
+            admitted.unlock();
+            wal_->commit(lsn);
+        }
+    }
+
+    // 可由多個執行緒同時呼叫：列資料在表格鎖內附加，索引在鎖外以閂鎖耦合並行更新。
+    // 寫日誌時在索引更新後才等待落盤，同時插入的執行緒共用一次 fsync
+    void insertRow(const std::unordered_map<std::string, Value>& row_data) {
+        std::shared_lock<std::shared_mutex> admitted;
+        if (wal_) admitted = wal_->admitWriter();
+
+        std::vector<Value> values;
+        RecordId record_id = 0;
+        WriteAheadLog::Lsn lsn = 0;
+        {
+            std::lock_guard<std::mutex> lock(insert_mutex_);
+            // 先轉換整列，任何一個值不符合欄位型別時在附加之前拋出，表格保持不變
+            values = rowValues(row_data);
+            for (size_t c = 0; c < column_order_.size(); ++c) {
+                record_id = columns_[column_order_[c]]->appendWithoutIndex(values[c]);
+            }
+            row_count_++;
+            if (wal_) lsn = logInsert(record_id, values);
+        }
+
+        for (size_t c = 0; c < column_order_.size(); ++c) {
+            columns_[column_order_[c]]->indexRecord(values[c], record_id);
+        }
+
+        if (wal_) {
+            admitted.unlock();
+            wal_->commit(lsn);
+        }
+    }
+
+    // 批量插入 - 對大資料集優化
+    // 先附加所有列資料，再以排序後的 (key, RecordId) 序列自底向上建立各列索引，
+    // 避免每筆資料都從根走到葉子並重新序列化節點。整批寫成一筆日誌記錄，
+    // 髒頁留給檢查點與背景寫回，不再逐頁強制寫回
+    void bulkInsert(const std::vector<std::unordered_map<std::string, Value>>& rows) {
+        if (rows.empty()) return;
+
+        std::shared_lock<std::shared_mutex> admitted;
+        if (wal_) admitted = wal_->admitWriter();
+
+        std::vector<DiskBasedColumn*> columns;
+        std::vector<std::vector<std::pair<Value, RecordId>>> index_entries(column_order_.size());
+        columns.reserve(column_order_.size());
+        for (size_t c = 0; c < column_order_.size(); ++c) {
+            columns.push_back(columns_[column_order_[c]].get());
+            index_entries[c].reserve(rows.size());
+        }
+
+        WriteAheadLog::Lsn lsn = 0;
+        {
+            std::lock_guard<std::mutex> lock(insert_mutex_);
+            const RecordId first_record_id = row_count_.load(std::memory_order_relaxed);
+            // 先轉換整批，任何一列被拒絕時不附加任何資料
+            for (const auto& row : rows) {
+                std::vector<Value> values = rowValues(row);
+                for (size_t c = 0; c < columns.size(); ++c) {
+                    index_entries[c].emplace_back(std::move(values[c]), RecordId(0));
+                }
+            }
+            for (size_t c = 0; c < columns.size(); ++c) {
+                for (auto& [value, record_id] : index_entries[c]) {
+                    record_id = columns[c]->appendWithoutIndex(value);
+                }
+            }
+            row_count_ += rows.size();
+
+            if (wal_) {
+                ByteWriter record;
+                beginInsertRecord(record, first_record_id, rows.size());
+                for (size_t r = 0; r < rows.size(); ++r) {
+                    for (size_t c = 0; c < columns.size(); ++c) record.putValue(index_entries[c][r].first);
+                }
+                lsn = wal_->append(LogRecordType::INSERT, record);
+            }
+        }
+
+        for (size_t c = 0; c < columns.size(); ++c) {
+            columns[c]->buildIndex(index_entries[c]);
+        }
+
+        if (wal_) {
+            admitted.unlock();
+            wal_->commit(lsn);
+        }
+    }
+
+    // 與表格欄位順序、型別相同的空批次
+    RecordBatch newBatch() const {
+        RecordBatch batch;
+        for (const auto& col_name : column_order_) {
+            batch.addColumn(col_name, columns_.at(col_name)->getType());
+        }
+        return batch;
+    }
+
+    // 欄式批次插入：batch 的欄位必須與表格欄位的順序與型別相同（以 newBatch() 建立）。
+    // 欄位只解析一次，每個欄位的值整段附加到資料頁；索引以原生型別排序後批次建立。
+    // 整批寫成一筆欄式日誌記錄
+    void insertBatch(const RecordBatch& batch) {
+        const size_t rows = batch.rowCount();
+        if (rows == 0) return;
+
+        std::shared_lock<std::shared_mutex> admitted;
+        if (wal_) admitted = wal_->admitWriter();
+
+        std::vector<DiskBasedColumn*> columns = batchColumns(batch);
+        std::vector<std::vector<char>> scratch(columns.size());
+        RecordId first_record_id;
+        WriteAheadLog::Lsn lsn = 0;
+        {
+            std::lock_guard<std::mutex> lock(insert_mutex_);
+            first_record_id = row_count_.load(std::memory_order_relaxed);
+            for (size_t c = 0; c < columns.size(); ++c) {
+                columns[c]->appendBatch(batch.column(c), scratch[c]);
+            }
+            row_count_ += rows;
+
+            if (wal_) {
+                ByteWriter record;
+                beginInsertRecord(record, first_record_id, rows);
+                batch.writeValues(record);
+                lsn = wal_->append(LogRecordType::INSERT_BATCH, record);
+            }
+        }
+
+        for (size_t c = 0; c < columns.size(); ++c) {
+            columns[c]->indexBatch(batch.column(c), scratch[c], first_record_id);
+        }
+
+        if (wal_) {
+            admitted.unlock();
+            wal_->commit(lsn);
+        }
+    }
+
+    DiskBasedColumn* getColumn(const std::string& name) {
+        auto it = columns_.find(name);
+        return (it != columns_.end()) ? it->second.get() : nullptr;
+    }
+
+    // 索引查詢 - 利用B+樹快速定位；結果依欄位存放，欄位依 selected_columns 的順序（預設為全部欄位）
+    RecordBatch indexedSelect(
+        const std::string& index_column,
+        const Value& value,
+        const std::vector<std::string>& selected_columns = {}) {
+        return openIndexedSelect(index_column, value, selected_columns).readAll();
+    }
+
+    // 範圍查詢
+    RecordBatch rangeSelect(
+        const std::string& index_column,
+        const Value& start_value,
+        const Value& end_value,
+        const std::vector<std::string>& selected_columns = {}) {
+        return openRangeSelect(index_column, start_value, end_value, selected_columns).readAll();
+    }
+
+    // 述詞下推掃描 - 逐頁在列資料上求值所有述詞（AND），有點陣圖索引的欄位改以點陣圖求值，
+    // 得到選取向量後才依頁面順序取出需要的列
+    RecordBatch scanSelect(
+        const std::vector<ColumnPredicate>& predicates,
+        const std::vector<std::string>& selected_columns = {}) {
+        return openScanSelect(predicates, selected_columns).readAll();
+    }
+
+    // 符合任一組述詞（組內為 AND）的列
+    RecordBatch scanSelectAny(
+        const PredicateDisjunction& terms,
+        const std::vector<std::string>& selected_columns = {}) {
+        return openScanSelectAny(terms, selected_columns).readAll();
+    }
+
+    // 串流形式：回傳游標逐批取出結果，大型結果不必一次全部存在記憶體中
+    ResultCursor openIndexedSelect(const std::string& index_column, const Value& value,
+        const std::vector<std::string>& selected_columns = {},
+        size_t batch_rows = ResultCursor::DEFAULT_BATCH_ROWS) {
+        QueryTimer timer(buffer_manager_.metrics(), QueryKind::INDEX_LOOKUP, name_);
+        auto* column = getColumn(index_column);
+        return makeCursor(column ? column->findRecords(value) : std::vector<RecordId>(), selected_columns, batch_rows);
+    }
+
+    ResultCursor openRangeSelect(const std::string& index_column, const Value& start_value, const Value& end_value,
+        const std::vector<std::string>& selected_columns = {},
+        size_t batch_rows = ResultCursor::DEFAULT_BATCH_ROWS) {
+        QueryTimer timer(buffer_manager_.metrics(), QueryKind::RANGE, name_);
+        auto* column = getColumn(index_column);
+        return makeCursor(column ? column->findRecordsInRange(start_value, end_value) : std::vector<RecordId>(),
+            selected_columns, batch_rows);
+    }
+
+    // 範圍查詢的一頁：略過 offset 筆後最多取 limit 筆，B+ 樹欄位取滿即停止走訪葉子
+    ResultCursor openRangeSelect(const std::string& index_column, const Value& start_value, const Value& end_value,
+        size_t offset, size_t limit, const std::vector<std::string>& selected_columns = {},
+        size_t batch_rows = ResultCursor::DEFAULT_BATCH_ROWS) {
+        QueryTimer timer(buffer_manager_.metrics(), QueryKind::RANGE, name_);
+        auto* column = getColumn(index_column);
+        return makeCursor(column ? column->findRecordsInRange(start_value, end_value, offset, limit)
+            : std::vector<RecordId>(), selected_columns, batch_rows);
+    }
+
+    ResultCursor openScanSelect(const std::vector<ColumnPredicate>& predicates,
+        const std::vector<std::string>& selected_columns = {},
+        size_t batch_rows = ResultCursor::DEFAULT_BATCH_ROWS) {
+        QueryTimer timer(buffer_manager_.metrics(), QueryKind::SCAN, name_);
+        return makeCursor(evaluatePredicates(predicates).toRecordIds(), selected_columns, batch_rows);
+    }
+
+    ResultCursor openScanSelectAny(const PredicateDisjunction& terms,
+        const std::vector<std::string>& selected_columns = {},
+        size_t batch_rows = ResultCursor::DEFAULT_BATCH_ROWS) {
+        QueryTimer timer(buffer_manager_.metrics(), QueryKind::SCAN, name_);
+        return makeCursor(evaluatePredicates(terms).toRecordIds(), selected_columns, batch_rows);
+    }
+
+    // COUNT(*) WHERE 述詞（AND）：述詞都落在點陣圖索引的欄位上時直接取交集的基數，不讀取資料頁
+    size_t countWhere(const std::vector<ColumnPredicate>& predicates) {
+        QueryTimer timer(buffer_manager_.metrics(), QueryKind::COUNT, name_);
+        const size_t row_count = getRowCount();
+        RoaringBitmap indexed;
+        std::vector<const ColumnPredicate*> scanned;
+        const bool has_bitmaps = matchBitmaps(predicates, indexed, scanned);
+        if (has_bitmaps && scanned.empty()) return indexed.countBelow(row_count);
+        // 只有一個 B+ 樹述詞時沿葉子計數，不讀取資料頁
+        if (!has_bitmaps && scanned.size() == 1) {
+            auto count = getColumn(scanned[0]->column)->countIndexed(*scanned[0], row_count);
+            if (count) return *count;
+        }
+        return filterScanned(row_count, has_bitmaps ? &indexed : nullptr, scanned).count();
+    }
+
+    // COUNT(*) WHERE 各組述詞的 OR：完全由點陣圖回答的組只取點陣圖聯集的基數
+    size_t countWhereAny(const PredicateDisjunction& terms) {
+        QueryTimer timer(buffer_manager_.metrics(), QueryKind::COUNT, name_);
+        const size_t row_count = getRowCount();
+        RoaringBitmap indexed;
+        SelectionVector selection;
+        if (!evaluateTerms(terms, row_count, indexed, selection)) return indexed.countBelow(row_count);
+        indexed.addTo(selection);
+        return selection.count();
+    }
+
+    // MIN/MAX 直接取索引的第一個／最後一個鍵，不讀取資料頁；欄位沒有可見的非 NaN 值時回傳 std::nullopt
+    std::optional<Value> indexedMin(const std::string& column_name) {
+        auto* column = getColumn(column_name);
+        if (!column) {
+            throw std::runtime_error("Column not found: " + column_name);
+        }
+        return column->indexMin(getRowCount());
+    }
+
+    std::optional<Value> indexedMax(const std::string& column_name) {
+        auto* column = getColumn(column_name);
+        if (!column) {
+            throw std::runtime_error("Column not found: " + column_name);
+        }
+        return column->indexMax(getRowCount());
+    }
+
+    // 過濾後聚合 - 以述詞下推得到選取向量，只聚合被選取的列；
+    // zone map 排除的頁面在求值述詞與聚合時都不會讀取
+    AggregateResult aggregateWhere(const std::string& column_name, const std::vector<ColumnPredicate>& predicates) {
+        QueryTimer timer(buffer_manager_.metrics(), QueryKind::AGGREGATE, name_);
+        auto* column = getColumn(column_name);
+        if (!column) {
+            throw std::runtime_error("Column not found: " + column_name);
+        }
+        if (predicates.empty()) {
+            return column->aggregate();
+        }
+        return column->aggregate(evaluatePredicates(predicates));
+    }
+
+    // 分組聚合：依 key_column 分組，計算 aggregate_columns 各欄位的 COUNT/SUM/MIN/MAX/AVG；
+    // predicates 非空時只聚合符合的列。結果依鍵值排序，各分組在多個執行緒上平行累加
+    std::vector<GroupAggregate> groupBy(const std::string& key_column,
+        const std::vector<std::string>& aggregate_columns, const std::vector<ColumnPredicate>& predicates = {}) {
+        QueryTimer timer(buffer_manager_.metrics(), QueryKind::GROUP_BY, name_);
+        auto* key = getColumn(key_column);
+        if (!key) {
+            throw std::runtime_error("Column not found: " + key_column);
+        }
+        std::vector<const DiskBasedColumn*> columns;
+        for (const auto& name : aggregate_columns) {
+            auto* column = getColumn(name);
+            if (!column) {
+                throw std::runtime_error("Column not found: " + name);
+            }
+            columns.push_back(column);
+        }
+
+        const size_t total = getRowCount();
+        GroupByOperator group_by(*key, std::move(columns), executor_);
+        if (predicates.empty()) {
+            return group_by.execute(total, nullptr);
+        }
+        SelectionVector selection = evaluatePredicates(predicates);
+        return group_by.execute(total, &selection);
+    }
+
+    const std::string& getName() const { return name_; }
+    size_t getRowCount() const { return row_count_.load(std::memory_order_acquire); }
+    const std::vector<std::string>& getColumnNames() const { return column_order_; }
+
+    // 重新開啟時先還原目錄並重做日誌，之後才開始寫日誌
+    void setLog(WriteAheadLog* wal) { wal_ = wal; }
+
+    // 目錄內容：列數與各欄位的結構及狀態；與插入互斥，取得一致的快照
+    void saveState(ByteWriter& out) {
+        std::lock_guard<std::mutex> lock(insert_mutex_);
+        out.put(static_cast<uint64_t>(row_count_.load(std::memory_order_relaxed)));
+        out.put(static_cast<uint16_t>(column_order_.size()));
+        for (const auto& col_name : column_order_) {
+            DiskBasedColumn& column = *columns_.at(col_name);
+            out.putString(col_name);
+            out.put(static_cast<uint8_t>(column.getType()));
+            out.put(static_cast<uint8_t>(column.getStringEncoding()));
+            out.put(static_cast<uint32_t>(column.getExtentSize()));
+            out.put(static_cast<uint8_t>(column.getIndexType()));
+            column.saveState(out);
+        }
+    }
+
+    // 在沒有欄位的新表格上還原 saveState 的內容
+    void restoreState(ByteReader& in) {
+        std::lock_guard<std::mutex> lock(insert_mutex_);
+        const size_t row_count = in.get<uint64_t>();
+        const size_t column_count = in.get<uint16_t>();
+        for (size_t c = 0; c < column_count; ++c) {
+            std::string col_name = in.getString();
+            const auto type = static_cast<DataType>(in.get<uint8_t>());
+            const auto string_encoding = static_cast<StringEncoding>(in.get<uint8_t>());
+            const size_t extent_size = in.get<uint32_t>();
+            const auto index_type = static_cast<ColumnIndexType>(in.get<uint8_t>());
+            auto column = std::make_unique<DiskBasedColumn>(
+                table_path_ + "/" + col_name, type, buffer_manager_, string_encoding, extent_size, index_type);
+            column->setExecutor(executor_);
+            column->restoreState(in);
+            if (column->size() != row_count) {
+                throw std::runtime_error("Catalog row count mismatch in " + name_ + "." + col_name);
+            }
+            columns_[col_name] = std::move(column);
+            column_order_.push_back(std::move(col_name));
+        }
+        row_count_.store(row_count, std::memory_order_release);
+    }
+
+    // 重做一筆 INSERT 記錄（表格名稱已由呼叫端讀取）；只附加列資料，索引由 rebuildIndexes 重建
+    void redoInsert(ByteReader& record) {
+        const RecordId first_record_id = record.get<uint64_t>();
+        const size_t row_count = record.get<uint64_t>();
+        const size_t column_count = record.get<uint16_t>();
+
+        std::lock_guard<std::mutex> lock(insert_mutex_);
+        if (first_record_id != row_count_.load(std::memory_order_relaxed) || column_count != column_order_.size()) {
+            throw std::runtime_error("Log record does not match table " + name_ + " at row " +
+                std::to_string(first_record_id));
+        }
+        for (size_t r = 0; r < row_count; ++r) {
+            for (const auto& col_name : column_order_) {
+                columns_[col_name]->appendWithoutIndex(record.getValue());
+            }
+        }
+        row_count_ += row_count;
+    }
+
+    // 重做一筆 INSERT_BATCH 記錄（表格名稱已由呼叫端讀取）；索引由 rebuildIndexes 重建
+    void redoInsertBatch(ByteReader& record) {
+        const RecordId first_record_id = record.get<uint64_t>();
+        const size_t row_count = record.get<uint64_t>();
+        const size_t column_count = record.get<uint16_t>();
+
+        RecordBatch batch = newBatch();
+        if (column_count != batch.columnCount()) {
+            throw std::runtime_error("Log record does not match table " + name_);
+        }
+        batch.readValues(record, row_count);
+
+        std::vector<char> scratch;
+        std::lock_guard<std::mutex> lock(insert_mutex_);
+        if (first_record_id != row_count_.load(std::memory_order_relaxed)) {
+            throw std::runtime_error("Log record does not match table " + name_ + " at row " +
+                std::to_string(first_record_id));
+        }
+        for (size_t c = 0; c < column_count; ++c) {
+            columns_[column_order_[c]]->appendBatch(batch.column(c), scratch);
+        }
+        row_count_ += row_count;
+    }
+
+    void rebuildIndexes() {
+        for (const auto& col_name : column_order_) {
+            columns_[col_name]->rebuildIndex();
+        }
+    }
+
+    // 以現有內容重建各欄位索引，回傳重建後共使用的索引頁數
+    size_t compactIndexes() {
+        size_t pages = 0;
+        for (const auto& col_name : column_order_) {
+            pages += columns_[col_name]->compactIndex();
+        }
+        return pages;
+    }
+
+private:
+    // 依位置解析批次的欄位，結構與表格不符時拋出例外
+    std::vector<DiskBasedColumn*> batchColumns(const RecordBatch& batch) {
+        if (batch.columnCount() != column_order_.size()) {
+            throw std::runtime_error("Batch has " + std::to_string(batch.columnCount()) + " columns, table " +
+                name_ + " has " + std::to_string(column_order_.size()));
+        }
+        std::vector<DiskBasedColumn*> columns;
+        columns.reserve(column_order_.size());
+        for (size_t c = 0; c < column_order_.size(); ++c) {
+            DiskBasedColumn* column = columns_[column_order_[c]].get();
+            const auto& batch_column = batch.column(c);
+            if (batch_column.name != column_order_[c] || batch_column.type != column->getType()) {
+                throw std::runtime_error("Batch column " + batch_column.name + " does not match " + name_ + "." +
+                    column_order_[c]);
+            }
+            columns.push_back(column);
+        }
+        return columns;
+    }
+
+    void beginInsertRecord(ByteWriter& record, RecordId first_record_id, size_t row_count) const {
+        record.putString(name_);
+        record.put(static_cast<uint64_t>(first_record_id));
+        record.put(static_cast<uint64_t>(row_count));
+        record.put(static_cast<uint16_t>(column_order_.size()));
+    }
+
+    // 呼叫端持有 insert_mutex_
+    WriteAheadLog::Lsn logInsert(RecordId record_id, const std::vector<Value>& values) {
+        ByteWriter record;
+        beginInsertRecord(record, record_id, 1);
+        for (const auto& value : values) record.putValue(value);
+        return wal_->append(LogRecordType::INSERT, record);
+    }
+
+    // 所有述詞的 AND；取得列數快照，掃描期間新插入的列不在這次查詢範圍內
+    // 投影欄位不存在時略過，與舊的逐列結果相同
+    ResultCursor makeCursor(std::vector<RecordId> record_ids, const std::vector<std::string>& selected_columns,
+        size_t batch_rows) {
+        const std::vector<std::string>& names = selected_columns.empty() ? column_order_ : selected_columns;
+        std::vector<const DiskBasedColumn*> columns;
+        RecordBatch schema;
+        for (const auto& name : names) {
+            auto* column = getColumn(name);
+            if (!column) continue;
+            columns.push_back(column);
+            schema.addColumn(name, column->getType());
+        }
+        return ResultCursor(std::move(record_ids), std::move(columns), std::move(schema), batch_rows);
+    }
+
+    // 有點陣圖索引的欄位先以點陣圖求值並取交集，結果作為其餘述詞掃描時的候選列
+    SelectionVector evaluatePredicates(const std::vector<ColumnPredicate>& predicates) {
+        const size_t row_count = row_count_.load(std::memory_order_acquire);
+        RoaringBitmap indexed;
+        std::vector<const ColumnPredicate*> scanned;
+        const bool has_bitmaps = matchBitmaps(predicates, indexed, scanned);
+        return filterScanned(row_count, has_bitmaps ? &indexed : nullptr, scanned);
+    }
+
+    SelectionVector evaluatePredicates(const PredicateDisjunction& terms) {
+        const size_t row_count = row_count_.load(std::memory_order_acquire);
+        RoaringBitmap indexed;
+        SelectionVector selection(row_count);
+        evaluateTerms(terms, row_count, indexed, selection);
+        indexed.addTo(selection);
+        return selection;
+    }
+
+    // 有點陣圖索引的述詞求值後取交集存入 matched，其餘述詞放進 scanned；沒有任何點陣圖述詞時回傳 false
+    bool matchBitmaps(const std::vector<ColumnPredicate>& predicates, RoaringBitmap& matched,
+        std::vector<const ColumnPredicate*>& scanned) {
+        bool any = false;
+        for (const auto& predicate : predicates) {
+            auto* column = getColumn(predicate.column);
+            if (!column) {
+                throw std::runtime_error("Column not found: " + predicate.column);
+            }
+            if (!column->bitmapIndex()) {
+                scanned.push_back(&predicate);
+                continue;
+            }
+            RoaringBitmap bits = column->matchBitmap(predicate);
+            matched = any ? RoaringBitmap::intersect(matched, bits) : std::move(bits);
+            any = true;
+        }
+        return any;
+    }
+
+    // 依序掃描求值 scanned 的述詞（AND）；indexed 非空時為點陣圖述詞的結果，作為第一組候選列
+    SelectionVector filterScanned(size_t row_count, const RoaringBitmap* indexed,
+        const std::vector<const ColumnPredicate*>& scanned) {
+        SelectionVector selection(row_count);
+        if (indexed) {
+            indexed->addTo(selection);
+        }
+        else if (scanned.empty()) {
+            selection.setRange(0, row_count);
+        }
+        for (size_t i = 0; i < scanned.size(); ++i) {
+            auto* column = getColumn(scanned[i]->column);
+            if (i == 0 && !indexed) {
+                column->filter(*scanned[i], selection);
+            }
+            else {
+                SelectionVector matches(row_count);
+                column->filter(*scanned[i], matches, &selection);
+                selection.intersect(matches);
+            }
+        }
+        return selection;
+    }
+
+    // 析取的求值：完全由點陣圖回答的組併入 indexed；需要掃描的組的聯集寫入 selection，有這種組時回傳 true
+    bool evaluateTerms(const PredicateDisjunction& terms, size_t row_count, RoaringBitmap& indexed,
+        SelectionVector& selection) {
+        bool scanned_any = false;
+        for (const auto& term : terms) {
+            RoaringBitmap term_bits;
+            std::vector<const ColumnPredicate*> scanned;
+            const bool has_bitmaps = matchBitmaps(term, term_bits, scanned);
+            if (has_bitmaps && scanned.empty()) {
+                indexed.unite(term_bits);
+                continue;
+            }
+            SelectionVector matches = filterScanned(row_count, has_bitmaps ? &term_bits : nullptr, scanned);
+            if (scanned_any) {
+                selection.unite(matches);
+            }
+            else {
+                selection = std::move(matches);
+                scanned_any = true;
+            }
+        }
+        return scanned_any;
+    }
+
+    // 依欄位順序取出一列的值並轉為欄位型別，缺少的欄位填入預設值。呼叫端持有 insert_mutex_
+    std::vector<Value> rowValues(const std::unordered_map<std::string, Value>& row) const {
+        std::vector<Value> values;
+        values.reserve(column_order_.size());
+        for (const auto& col_name : column_order_) {
+            const DataType type = columns_.at(col_name)->getType();
+            auto it = row.find(col_name);
+            values.push_back(it != row.end() ? toColumnType(it->second, type, col_name) : defaultValue(type));
+        }
+        return values;
+    }
+
+    // 數值型別之間可以互轉，但整數欄位只接受範圍內的整數值；字串與 BOOL 欄位只接受相同型別
+    static Value toColumnType(const Value& value, DataType type, const std::string& column) {
+        switch (type) {
+        case DataType::INT32: return numericAs<int32_t>(value, column);
+        case DataType::INT64: return numericAs<int64_t>(value, column);
+        case DataType::FLOAT: return numericAs<float>(value, column);
+        case DataType::DOUBLE: return numericAs<double>(value, column);
+        case DataType::STRING:
+            if (std::holds_alternative<std::string>(value)) return value;
+            break;
+        case DataType::BOOL:
+            if (std::holds_alternative<bool>(value)) return value;
+            break;
+        }
+        throw std::runtime_error("Value does not match the type of column " + column);
+    }
+
+    template <typename T>
+    static T numericAs(const Value& value, const std::string& column) {
+        return std::visit([&](const auto& v) -> T {
+            using V = std::decay_t<decltype(v)>;
+            if constexpr (std::is_arithmetic_v<V> && !std::is_same_v<V, bool>) {
+                if constexpr (std::is_integral_v<T> && std::is_floating_point_v<V>) {
+                    // 下界 -2^k 可精確表示，上界為其相反數（不含）；NaN 不通過比較
+                    const V low = static_cast<V>(std::numeric_limits<T>::min());
+                    if (v >= low && v < -low && std::trunc(v) == v) return static_cast<T>(v);
+                }
+                else if constexpr (std::is_integral_v<T>) {
+                    const T converted = static_cast<T>(v);
+                    if (static_cast<V>(converted) == v && (converted < 0) == (v < 0)) return converted;
+                }
+                else if (!(std::is_same_v<T, float> && std::isfinite(v) &&
+                    std::abs(static_cast<double>(v)) > std::numeric_limits<float>::max())) {
+                    return static_cast<T>(v);
+                }
+            }
+            throw std::runtime_error("Value out of range or not numeric for column " + column);
+        }, value);
+    }
+
+    static Value defaultValue(DataType type) {
+        switch (type) {
+        case DataType::INT32: return int32_t(0);
+        case DataType::INT64: return int64_t(0);
+        case DataType::FLOAT: return 0.0f;
+        case DataType::DOUBLE: return 0.0;
+        case DataType::STRING: return std::string("");
+        case DataType::BOOL: return false;
+        }
+        return int32_t(0);
+    }
+};
+
+// 連接演算法
+enum class JoinAlgorithm {
+    AUTO,               // 依兩側列數與建立側的記憶體估計選擇
+    HASH,               // 以列數較少的一側建立雜湊表，另一側分批探測
+    PARTITIONED_HASH,   // 兩側依雜湊值分割寫入暫存檔，再逐一分割建立與探測；建立側超過記憶體預算時使用
+    INDEX_NESTED_LOOP   // 列數較少的一側逐列查詢另一側鍵欄位的索引
+};
+
+inline const char* joinAlgorithmName(JoinAlgorithm algorithm) {
+    switch (algorithm) {
+    case JoinAlgorithm::AUTO: return "auto";
+    case JoinAlgorithm::HASH: return "hash";
+    case JoinAlgorithm::PARTITIONED_HASH: return "partitioned hash";
+    case JoinAlgorithm::INDEX_NESTED_LOOP: return "index nested loop";
+    }
+    return "unknown";
+}
+
+// 等值內連接：left_table.left_key = right_table.right_key。
+// 輸出欄位依序為 left_columns 與 right_columns，名稱為「表格.欄位」
+struct JoinSpec {
+    std::string left_table;
+    std::string left_key;
+    std::string right_table;
+    std::string right_key;
+    std::vector<std::string> left_columns;
+    std::vector<std::string> right_columns;
+    JoinAlgorithm algorithm = JoinAlgorithm::AUTO;
+};
+
+// 向量化的等值連接運算子 - 兩側的鍵每次讀取 KEY_BATCH_ROWS 筆，符合的 (左 RecordId, 右 RecordId)
+// 累積到 OUTPUT_BATCH_ROWS 組後才依欄位取出輸出值，以一個 RecordBatch 交給呼叫端。
+// 整數鍵（INT32/INT64/BOOL）之間、浮點鍵（FLOAT/DOUBLE，以 double 比較）之間、字串鍵之間可以連接；
+// NaN 不與任何值相等。輸出列的順序不固定
+class HashJoinOperator {
+public:
+    using BatchFn = std::function<void(const RecordBatch&)>;
+
+    static constexpr size_t KEY_BATCH_ROWS = 16384;
+    static constexpr size_t OUTPUT_BATCH_ROWS = ResultCursor::DEFAULT_BATCH_ROWS;
+    static constexpr size_t INDEX_JOIN_RATIO = 64;  // 較小一側的列數乘以此值不超過另一側時改用索引
+    static constexpr size_t MAX_PARTITIONS = 64;    // 每側同時開啟的暫存檔數上限
+
+private:
+    enum class KeyClass { INTEGER, FLOATING, STRING };
+
+    struct Side {
+        const DiskBasedTable* table;
+        DiskBasedColumn* key;
+        std::vector<const DiskBasedColumn*> outputs;
+        size_t rows;
+    };
+
+    // 一批鍵的雜湊值；數值鍵的雜湊是正規化位元樣式的雙射，雜湊相等即鍵相等，字串另外比較內容
+    struct KeyBatch {
+        std::vector<uint64_t> hashes;
+        std::vector<uint8_t> valid;  // NaN 的列為 0
+        std::vector<std::string> strings;
+    };
+
+    // 建立側的雜湊表：桶陣列指向鏈上第一個項目，next 串起同一桶的項目，重複鍵依序在同一條鏈上
+    class JoinTable {
+    public:
+        static constexpr uint32_t END = std::numeric_limits<uint32_t>::max();
+
+    private:
+        std::vector<uint32_t> buckets_;
+        std::vector<uint32_t> next_;
+        std::vector<uint64_t> hashes_;
+        std::vector<std::string> strings_;
+        std::vector<RecordId> records_;
+        size_t mask_ = 0;
+
+    public:
+        void add(uint64_t hash, std::string* key, RecordId record_id) {
+            if (records_.size() >= END) throw std::runtime_error("Join build side is too large");
+            hashes_.push_back(hash);
+            if (key) strings_.push_back(std::move(*key));
+            records_.push_back(record_id);
+        }
+
+        void finalize() {
+            size_t buckets = 16;
+            while (buckets < records_.size() * 2) buckets *= 2;
+            buckets_.assign(buckets, END);
+            mask_ = buckets - 1;
+            next_.resize(records_.size());
+            // 倒序插入讓鏈上的項目依加入順序排列
+            for (size_t i = records_.size(); i-- > 0;) {
+                uint32_t& head = buckets_[hashes_[i] & mask_];
+                next_[i] = head;
+                head = static_cast<uint32_t>(i);
+            }
+        }
+
+        // 對每個鍵相同的項目呼叫 fn(record_id)
+        template <typename Fn>
+        void forEachMatch(uint64_t hash, const std::string* key, Fn&& fn) const {
+            for (uint32_t e = buckets_[hash & mask_]; e != END; e = next_[e]) {
+                if (hashes_[e] != hash) continue;
+                if (key && strings_[e] != *key) continue;
+                fn(records_[e]);
+            }
         }
+    };
+
+    // 分割暫存檔：每個項目為 [u64 雜湊][u64 RecordId]，字串鍵另附 [u16 長度][內容]；解構時刪除
+    class SpillFiles {
+    private:
+        std::vector<std::string> paths_;
+        std::vector<std::ofstream> files_;
+        std::vector<std::string> buffers_;
+
+    public:
+        static constexpr size_t BUFFER_BYTES = 64 * 1024;
+
+        SpillFiles(const std::string& prefix, size_t partitions) {
+            std::filesystem::create_directories(std::filesystem::path(prefix).parent_path());
+            for (size_t p = 0; p < partitions; ++p) {
+                paths_.push_back(prefix + "_" + std::to_string(p) + ".tmp");
+                files_.emplace_back(paths_.back(), std::ios::binary | std::ios::trunc);
+                if (!files_.back()) throw std::runtime_error("Cannot create join spill file " + paths_.back());
+            }
+            buffers_.resize(partitions);
         }
-    }
 
-    Value readValueFromPage(const Page& page, size_t offset) const {
-        size_t record_size = getRecordSize(type_);
-        const char* data_ptr = page.data.data() + offset * record_size;
+        ~SpillFiles() {
+            files_.clear();
+            std::error_code ec;
+            for (const auto& path : paths_) std::filesystem::remove(path, ec);
+        }
 
-        switch (type_) {
-        case DataType::INT32: {
-            int32_t val;
-            std::memcpy(&val, data_ptr, sizeof(int32_t));
-            return val;
+        void add(size_t partition, uint64_t hash, RecordId record_id, const std::string* key) {
+            std::string& buffer = buffers_[partition];
+            buffer.append(reinterpret_cast<const char*>(&hash), sizeof(hash));
+            const uint64_t record = record_id;
+            buffer.append(reinterpret_cast<const char*>(&record), sizeof(record));
+            if (key) {
+                const uint16_t length = static_cast<uint16_t>(std::min(key->size(), MAX_STRING_LENGTH));
+                buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+                buffer.append(key->data(), length);
+            }
+            if (buffer.size() >= BUFFER_BYTES) flush(partition);
         }
-        case DataType::INT64: {
-            int64_t val;
-            std::memcpy(&val, data_ptr, sizeof(int64_t));
-            return val;
+
+        // 寫完所有項目後呼叫一次
+        void finish() {
+            for (size_t p = 0; p < files_.size(); ++p) {
+                flush(p);
+                files_[p].close();
+                if (!files_[p]) throw std::runtime_error("Failed to write join spill file " + paths_[p]);
+            }
         }
-        case DataType::FLOAT: {
-            float val;
-            std::memcpy(&val, data_ptr, sizeof(float));
-            return val;
+
+        // 依寫入順序對分割中每個項目呼叫 fn(hash, record_id, key)；數值鍵的 key 為 nullptr
+        template <typename Fn>
+        void read(size_t partition, bool string_keys, Fn&& fn) const {
+            std::ifstream in(paths_[partition], std::ios::binary);
+            std::string key;
+            uint64_t hash, record;
+            while (in.read(reinterpret_cast<char*>(&hash), sizeof(hash))) {
+                in.read(reinterpret_cast<char*>(&record), sizeof(record));
+                if (string_keys) {
+                    uint16_t length = 0;
+                    in.read(reinterpret_cast<char*>(&length), sizeof(length));
+                    key.resize(length);
+                    in.read(key.data(), length);
+                }
+                if (!in) throw std::runtime_error("Truncated join spill file " + paths_[partition]);
+                fn(hash, static_cast<RecordId>(record), string_keys ? &key : nullptr);
+            }
         }
-        case DataType::DOUBLE: {
-            double val;
-            std::memcpy(&val, data_ptr, sizeof(double));
-            return val;
+
+    private:
+        void flush(size_t partition) {
+            std::string& buffer = buffers_[partition];
+            files_[partition].write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
         }
-        case DataType::STRING: {
-            std::string val(data_ptr, 256);
-            // 移除尾部的null字符
-            val = val.c_str();
-            return val;
+    };
+
+    Side left_;
+    Side right_;
+    KeyClass key_class_;
+    RecordBatch schema_;
+    std::string spill_prefix_;
+    size_t memory_budget_;
+    const BatchFn* on_batch_ = nullptr;
+    std::vector<RecordId> out_left_;
+    std::vector<RecordId> out_right_;
+
+public:
+    // spill_prefix 為分割暫存檔的路徑前綴；memory_budget 為建立側雜湊表的記憶體預算（位元組）
+    HashJoinOperator(const JoinSpec& spec, DiskBasedTable& left, DiskBasedTable& right,
+        std::string spill_prefix, size_t memory_budget)
+        : left_(makeSide(left, spec.left_key, spec.left_columns)),
+        right_(makeSide(right, spec.right_key, spec.right_columns)),
+        spill_prefix_(std::move(spill_prefix)), memory_budget_(memory_budget) {
+        key_class_ = keyClass(left_.key->getType());
+        if (keyClass(right_.key->getType()) != key_class_) {
+            throw std::runtime_error("Cannot join " + spec.left_key + " with " + spec.right_key +
+                ": key types are not comparable");
         }
-        case DataType::BOOL: {
-            bool val;
-            std::memcpy(&val, data_ptr, sizeof(bool));
-            return val;
+        for (size_t c = 0; c < spec.left_columns.size(); ++c) {
+            schema_.addColumn(left.getName() + "." + spec.left_columns[c], left_.outputs[c]->getType());
         }
+        for (size_t c = 0; c < spec.right_columns.size(); ++c) {
+            schema_.addColumn(right.getName() + "." + spec.right_columns[c], right_.outputs[c]->getType());
         }
-        return int32_t(0);
     }
 
-    double getNumericValue(const Value& value) const {
-        switch (type_) {
-        case DataType::INT32: return static_cast<double>(std::get<int32_t>(value));
-        case DataType::INT64: return static_cast<double>(std::get<int64_t>(value));
-        case DataType::FLOAT: return static_cast<double>(std::get<float>(value));
-        case DataType::DOUBLE: return std::get<double>(value);
-        default: return 0.0;
+    const RecordBatch& schema() const { return schema_; }
+
+    // AUTO 時依列數與記憶體估計選擇演算法
+    JoinAlgorithm choose(JoinAlgorithm requested) const {
+        if (requested != JoinAlgorithm::AUTO) return requested;
+        const Side& small = left_.rows <= right_.rows ? left_ : right_;
+        const Side& large = left_.rows <= right_.rows ? right_ : left_;
+        if (small.rows * INDEX_JOIN_RATIO <= large.rows) return JoinAlgorithm::INDEX_NESTED_LOOP;
+        if (buildBytes(small.rows) > memory_budget_) return JoinAlgorithm::PARTITIONED_HASH;
+        return JoinAlgorithm::HASH;
+    }
+
+    // 執行連接，結果逐批交給 on_batch；回傳實際使用的演算法
+    JoinAlgorithm execute(JoinAlgorithm requested, const BatchFn& on_batch) {
+        const JoinAlgorithm algorithm = choose(requested);
+        on_batch_ = &on_batch;
+        const bool build_left = left_.rows <= right_.rows;
+        switch (algorithm) {
+        case JoinAlgorithm::INDEX_NESTED_LOOP:
+            indexJoin(build_left);
+            break;
+        case JoinAlgorithm::PARTITIONED_HASH:
+            partitionedJoin(build_left);
+            break;
+        default:
+            hashJoin(build_left);
+            break;
         }
+        flush();
+        on_batch_ = nullptr;
+        return algorithm;
     }
-};
 
-// 支援大資料集的表格
-class DiskBasedTable {
 private:
-    std::string name_;
-    std::string table_path_;
-    std::unordered_map<std::string, std::unique_ptr<DiskBasedColumn>> columns_;
-    std::vector<std::string> column_order_;
-    BufferPoolManager& buffer_manager_;
-    size_t row_count_;
-
-public:
-    DiskBasedTable(const std::string& name, BufferPoolManager& buffer_manager)
-        : name_(name), buffer_manager_(buffer_manager), row_count_(0) {
-        table_path_ = name;  // 只是表格名稱，相對路徑將由列來構建
-        // 註記：目錄創建將在檔案創建時處理
+    static Side makeSide(DiskBasedTable& table, const std::string& key, const std::vector<std::string>& columns) {
+        Side side{ &table, table.getColumn(key), {}, table.getRowCount() };
+        if (!side.key) throw std::runtime_error("Column not found: " + table.getName() + "." + key);
+        for (const auto& name : columns) {
+            const DiskBasedColumn* column = table.getColumn(name);
+            if (!column) throw std::runtime_error("Column not found: " + table.getName() + "." + name);
+            side.outputs.push_back(column);
+        }
+        side.rows = std::min(side.rows, side.key->size());
+        return side;
     }
 
-    void addColumn(const std::string& name, DataType type) {
-        if (columns_.find(name) != columns_.end()) {
-            throw std::runtime_error("Column already exists: " + name);
+    static KeyClass keyClass(DataType type) {
+        switch (type) {
+        case DataType::FLOAT:
+        case DataType::DOUBLE:
+            return KeyClass::FLOATING;
+        case DataType::STRING:
+            return KeyClass::STRING;
+        default:
+            return KeyClass::INTEGER;
         }
+    }
 
-        auto column = std::make_unique<DiskBasedColumn>(
-            table_path_ + "/" + name, type, buffer_manager_);
+    // 建立側雜湊表每列的記憶體估計：桶與鏈、雜湊值、RecordId，字串鍵另加字串本身
+    size_t buildBytes(size_t rows) const {
+        const size_t per_row = 2 * sizeof(uint32_t) + sizeof(uint64_t) + sizeof(RecordId) +
+            (key_class_ == KeyClass::STRING ? sizeof(std::string) + 16 : 0);
+        return rows * per_row;
+    }
 
-        // 如果表格已有資料，新列需要填入預設值
-        for (size_t i = 0; i < row_count_; ++i) {
-            Value default_value;
-            switch (type) {
-            case DataType::INT32: default_value = int32_t(0); break;
-            case DataType::INT64: default_value = int64_t(0); break;
-            case DataType::FLOAT: default_value = 0.0f; break;
-            case DataType::DOUBLE: default_value = 0.0; break;
-            case DataType::STRING: default_value = std::string(""); break;
-            case DataType::BOOL: default_value = false; break;
+    // 讀取 side 的記錄 [begin, begin + count) 的鍵
+    void readKeys(const Side& side, RecordId begin, size_t count, KeyBatch& keys) const {
+        std::vector<RecordId> ids(count);
+        for (size_t i = 0; i < count; ++i) ids[i] = begin + i;
+        RecordBatch values;
+        values.addColumn(side.key->getName(), side.key->getType());
+        side.key->gatherInto(ids.data(), count, values.column(0));
+
+        keys.hashes.resize(count);
+        keys.valid.assign(count, 1);
+        keys.strings.clear();
+        std::visit([&](auto& column) {
+            using T = typename std::decay_t<decltype(column)>::value_type;
+            for (size_t i = 0; i < count; ++i) {
+                if constexpr (std::is_same_v<T, std::string>) {
+                    keys.hashes[i] = std::hash<std::string>()(column[i]);
+                }
+                else if constexpr (std::is_floating_point_v<T>) {
+                    const double value = static_cast<double>(column[i]);
+                    keys.valid[i] = !std::isnan(value);
+                    keys.hashes[i] = mixKeyBits(normalizedKeyBits(value));
+                }
+                else {
+                    keys.hashes[i] = mixKeyBits(normalizedKeyBits(static_cast<int64_t>(column[i])));
+                }
             }
-            column->append(default_value);
-        }
+            if constexpr (std::is_same_v<T, std::string>) keys.strings = std::move(column);
+            }, values.column(0).values);
+    }
 
-        columns_[name] = std::move(column);
-        column_order_.push_back(name);
+    void emit(bool probe_is_left, RecordId probe, RecordId build) {
+        out_left_.push_back(probe_is_left ? probe : build);
+        out_right_.push_back(probe_is_left ? build : probe);
+        if (out_left_.size() >= OUTPUT_BATCH_ROWS) flush();
     }
 
-    void insertRow(const std::unordered_map<std::string, Value>& row_data) {
-        for (const auto& col_name : column_order_) {
-            auto it = row_data.find(col_name);
-            if (it != row_data.end()) {
-                columns_[col_name]->append(it->second);
-            }
-            else {
-                // 插入預設值
-                Value default_value;
-                switch (columns_[col_name]->getType()) {
-                case DataType::INT32: default_value = int32_t(0); break;
-                case DataType::INT64: default_value = int64_t(0); break;
-                case DataType::FLOAT: default_value = 0.0f; break;
-                case DataType::DOUBLE: default_value = 0.0; break;
-                case DataType::STRING: default_value = std::string(""); break;
-                case DataType::BOOL: default_value = false; break;
-                }
-                columns_[col_name]->append(default_value);
-            }
+    // 依欄位取出累積的列並交給呼叫端
+    void flush() {
+        if (out_left_.empty()) return;
+        RecordBatch batch = schema_;
+        const size_t count = out_left_.size();
+        for (size_t c = 0; c < left_.outputs.size(); ++c) {
+            left_.outputs[c]->gatherInto(out_left_.data(), count, batch.column(c));
         }
-        row_count_++;
+        for (size_t c = 0; c < right_.outputs.size(); ++c) {
+            right_.outputs[c]->gatherInto(out_right_.data(), count, batch.column(left_.outputs.size() + c));
+        }
+        out_left_.clear();
+        out_right_.clear();
+        (*on_batch_)(batch);
     }
 
-    // 批量插入 - 對大資料集優化
-    void bulkInsert(const std::vector<std::unordered_map<std::string, Value>>& rows) {
-        for (const auto& row : rows) {
-            insertRow(row);
-
-            // 每1000行刷新一次緩衝池
-            if (row_count_ % 1000 == 0) {
-                buffer_manager_.flushAllPages();
+    void hashJoin(bool build_left) {
+        const Side& build = build_left ? left_ : right_;
+        const Side& probe = build_left ? right_ : left_;
+        const bool strings = key_class_ == KeyClass::STRING;
+
+        JoinTable table;
+        KeyBatch keys;
+        for (RecordId begin = 0; begin < build.rows; begin += KEY_BATCH_ROWS) {
+            const size_t count = std::min<size_t>(KEY_BATCH_ROWS, build.rows - begin);
+            readKeys(build, begin, count, keys);
+            for (size_t i = 0; i < count; ++i) {
+                if (keys.valid[i]) table.add(keys.hashes[i], strings ? &keys.strings[i] : nullptr, begin + i);
+            }
+        }
+        table.finalize();
+
+        for (RecordId begin = 0; begin < probe.rows; begin += KEY_BATCH_ROWS) {
+            const size_t count = std::min<size_t>(KEY_BATCH_ROWS, probe.rows - begin);
+            readKeys(probe, begin, count, keys);
+            for (size_t i = 0; i < count; ++i) {
+                if (!keys.valid[i]) continue;
+                table.forEachMatch(keys.hashes[i], strings ? &keys.strings[i] : nullptr,
+                    [&](RecordId match) { emit(!build_left, begin + i, match); });
             }
         }
     }
 
-    DiskBasedColumn* getColumn(const std::string& name) {
-        auto it = columns_.find(name);
-        return (it != columns_.end()) ? it->second.get() : nullptr;
+    // 雜湊值的高位元決定分割，低位元留給分割內雜湊表的桶
+    void partitionedJoin(bool build_left) {
+        const Side& build = build_left ? left_ : right_;
+        const Side& probe = build_left ? right_ : left_;
+        const bool strings = key_class_ == KeyClass::STRING;
+
+        size_t partitions = 2;
+        while (partitions < MAX_PARTITIONS && buildBytes(build.rows) / partitions > memory_budget_) partitions *= 2;
+        size_t shift = 64;
+        for (size_t p = partitions; p > 1; p /= 2) --shift;
+
+        auto spill = [&](const Side& side, SpillFiles& files) {
+            KeyBatch keys;
+            for (RecordId begin = 0; begin < side.rows; begin += KEY_BATCH_ROWS) {
+                const size_t count = std::min<size_t>(KEY_BATCH_ROWS, side.rows - begin);
+                readKeys(side, begin, count, keys);
+                for (size_t i = 0; i < count; ++i) {
+                    if (!keys.valid[i]) continue;
+                    files.add(static_cast<size_t>(keys.hashes[i] >> shift), keys.hashes[i], begin + i,
+                        strings ? &keys.strings[i] : nullptr);
+                }
+            }
+            files.finish();
+        };
+        SpillFiles build_files(spill_prefix_ + "_build", partitions);
+        SpillFiles probe_files(spill_prefix_ + "_probe", partitions);
+        spill(build, build_files);
+        spill(probe, probe_files);
+
+        for (size_t p = 0; p < partitions; ++p) {
+            JoinTable table;
+            build_files.read(p, strings, [&](uint64_t hash, RecordId record_id, std::string* key) {
+                table.add(hash, key, record_id);
+            });
+            table.finalize();
+            probe_files.read(p, strings, [&](uint64_t hash, RecordId record_id, std::string* key) {
+                table.forEachMatch(hash, key, [&](RecordId match) { emit(!build_left, record_id, match); });
+            });
+        }
     }
 
-    // 索引查詢 - 利用B+樹快速定位
-    std::vector<std::unordered_map<std::string, Value>> indexedSelect(
-        const std::string& index_column,
-        const Value& value,
-        const std::vector<std::string>& selected_columns = {}) {
-
-        std::vector<std::unordered_map<std::string, Value>> result;
-
-        auto* column = getColumn(index_column);
-        if (!column) return result;
-
-        // 使用索引快速找到匹配的記錄
-        auto record_ids = column->findRecords(value);
-
-        // 決定要選擇的列
-        std::vector<std::string> cols = selected_columns.empty() ? column_order_ : selected_columns;
-
-        // 構建結果
-        for (RecordId record_id : record_ids) {
-            std::unordered_map<std::string, Value> row;
-            for (const auto& col_name : cols) {
-                auto* col = getColumn(col_name);
-                if (col) {
-                    row[col_name] = col->get(record_id);
+    // 外側（列數較少）的每個鍵轉成內側鍵欄位的型別後查詢索引；無法精確表示的鍵沒有相符的列
+    void indexJoin(bool outer_left) {
+        const Side& outer = outer_left ? left_ : right_;
+        const Side& inner = outer_left ? right_ : left_;
+        const DataType inner_type = inner.key->getType();
+
+        std::vector<RecordId> ids;
+        for (RecordId begin = 0; begin < outer.rows; begin += KEY_BATCH_ROWS) {
+            const size_t count = std::min<size_t>(KEY_BATCH_ROWS, outer.rows - begin);
+            ids.resize(count);
+            for (size_t i = 0; i < count; ++i) ids[i] = begin + i;
+            RecordBatch keys;
+            keys.addColumn(outer.key->getName(), outer.key->getType());
+            outer.key->gatherInto(ids.data(), count, keys.column(0));
+
+            for (size_t i = 0; i < count; ++i) {
+                Value probe;
+                if (!convertKey(keys.value(0, i), inner_type, probe)) continue;
+                for (RecordId match : inner.key->findRecords(probe)) {
+                    if (match < inner.rows) emit(outer_left, begin + i, match);
                 }
             }
-            result.push_back(row);
         }
+    }
 
-        return result;
+    static bool convertKey(const Value& value, DataType target, Value& out) {
+        if (const auto* str = std::get_if<std::string>(&value)) {
+            out = *str;
+            return true;
+        }
+        if (target == DataType::FLOAT || target == DataType::DOUBLE) {
+            const double d = std::visit([](const auto& v) -> double {
+                if constexpr (std::is_arithmetic_v<std::decay_t<decltype(v)>>) return static_cast<double>(v);
+                else return 0.0;
+                }, value);
+            if (std::isnan(d)) return false;
+            if (target == DataType::DOUBLE) {
+                out = d;
+                return true;
+            }
+            const float f = static_cast<float>(d);
+            out = f;
+            return static_cast<double>(f) == d;
+        }
+        const int64_t n = std::visit([](const auto& v) -> int64_t {
+            if constexpr (std::is_arithmetic_v<std::decay_t<decltype(v)>>) return static_cast<int64_t>(v);
+            else return 0;
+            }, value);
+        switch (target) {
+        case DataType::INT32:
+            out = static_cast<int32_t>(n);
+            return n >= std::numeric_limits<int32_t>::min() && n <= std::numeric_limits<int32_t>::max();
+        case DataType::INT64:
+            out = n;
+            return true;
+        case DataType::BOOL:
+            out = n != 0;
+            return n == 0 || n == 1;
+        default:
+            return false;
+        }
     }
+};
 
-    // 範圍查詢
-    std::vector<std::unordered_map<std::string, Value>> rangeSelect(
-        const std::string& index_column,
-        const Value& start_value,
-        const Value& end_value,
-        const std::vector<std::string>& selected_columns = {}) {
+// 目錄檔（catalog.bin）- 檢查點時寫入表格結構、列數、各欄位的頁目錄與 zone map、尾端頁、
+// 字串堆積與字典的尾端位置、索引根頁與頁面配置的高水位，重新開啟時不必重新載入資料。
+// 先寫入暫存檔並落盤，再改名取代舊檔，當機時留下的總是完整的舊版或新版
+class Catalog {
+private:
+    static constexpr uint64_t MAGIC = 0x474C544344505041ull;  // "APPDCTLG"
+    static constexpr uint32_t VERSION = 3;  // 2：索引狀態包含頁面配置器的空閒清單；3：欄位記錄索引型別
 
-        std::vector<std::unordered_map<std::string, Value>> result;
+    struct FileHeader {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t crc;  // 涵蓋內容
+        uint64_t body_size;
+    };
 
-        auto* column = getColumn(index_column);
-        if (!column) return result;
+public:
+    // 失敗時拋出例外，舊的目錄檔保持不變
+    static void write(const std::string& path, const ByteWriter& body) {
+        const std::string& data = body.body();
+        FileHeader header{ MAGIC, VERSION, crc32(data.data(), data.size()), data.size() };
+        const std::string temp_path = path + ".tmp";
+
+#if defined(_WIN32)
+        NativeFile file = CreateFileA(temp_path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+            CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        const bool opened = file != INVALID_HANDLE_VALUE;
+#else
+        NativeFile file = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        const bool opened = file >= 0;
+#endif
+        if (!opened) {
+            throw std::runtime_error("Failed to create catalog: " + temp_path);
+        }
+        bool ok = PositionalIo::writeAt(file, 0, reinterpret_cast<const char*>(&header), sizeof(header))
+            && PositionalIo::writeAt(file, sizeof(header), data.data(), data.size())
+            && PositionalIo::sync(file);
+#if defined(_WIN32)
+        CloseHandle(file);
+#else
+        ::close(file);
+#endif
+        if (!ok) {
+            throw std::runtime_error("Failed to write catalog: " + temp_path);
+        }
 
-        // 使用索引進行範圍查詢
-        auto record_ids = column->findRecordsInRange(start_value, end_value);
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        if (error) {
+            throw std::runtime_error("Failed to install catalog " + path + ": " + error.message());
+        }
+#if !defined(_WIN32)
+        // 改名本身也要落盤，否則當機後目錄項目可能仍指向舊檔
+        const std::string dir = std::filesystem::path(path).parent_path().string();
+        int dir_fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+        if (dir_fd >= 0) {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+#endif
+    }
 
-        std::vector<std::string> cols = selected_columns.empty() ? column_order_ : selected_columns;
+    // 目錄檔不存在時回傳 false；內容損壞時拋出例外
+    static bool read(const std::string& path, std::string& body) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
 
-        for (RecordId record_id : record_ids) {
-            std::unordered_map<std::string, Value> row;
-            for (const auto& col_name : cols) {
-                auto* col = getColumn(col_name);
-                if (col) {
-                    row[col_name] = col->get(record_id);
-                }
-            }
-            result.push_back(row);
+        FileHeader header;
+        if (data.size() < sizeof(header)) {
+            throw std::runtime_error("Truncated catalog: " + path);
         }
-
-        return result;
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (header.magic == MAGIC && header.version != VERSION) {
+            throw std::runtime_error("Unsupported catalog version " + std::to_string(header.version) + ": " + path);
+        }
+        if (header.magic != MAGIC || header.body_size != data.size() - sizeof(header) ||
+            header.crc != crc32(data.data() + sizeof(header), header.body_size)) {
+            throw std::runtime_error("Corrupt catalog: " + path);
+        }
+        body = data.substr(sizeof(header));
+        return true;
     }
-
-    const std::string& getName() const { return name_; }
-    size_t getRowCount() const { return row_count_; }
-    const std::vector<std::string>& getColumnNames() const { return column_order_; }
 };
 
 // 支援大資料集的資料庫
@@ -1175,28 +9246,63 @@ private:
     std::string db_path_;
     std::unique_ptr<DiskManager> disk_manager_;
     std::unique_ptr<BufferPoolManager> buffer_manager_;
+    std::unique_ptr<WriteAheadLog> wal_;  // DurabilityMode::NONE 時為 nullptr
+    std::unique_ptr<MorselExecutor> executor_;  // 所有表格共用的查詢執行緒池，在表格之後解構
     std::unordered_map<std::string, std::unique_ptr<DiskBasedTable>> tables_;
+    std::mutex tables_mutex_;  // 新增與刪除表格時持有，讓背景檢查點可以走訪 tables_
+
+    // 背景檢查點：每 CHECKPOINT_INTERVAL 或日誌超過 CHECKPOINT_LOG_BYTES 時把髒頁寫回並截斷日誌
+    std::mutex checkpoint_mutex_;
+    std::condition_variable checkpoint_cv_;
+    bool checkpoint_requested_ = false;
+    bool stopping_ = false;
+    std::atomic<uint64_t> checkpoints_{ 0 };
+    std::thread checkpointer_;
 
 public:
-    LargeScaleDatabase(const std::string& name, const std::string& db_path)
+    // memory_mapped_reads 啟用後，已封存且寫回磁碟的欄位資料頁改由記憶體映射讀取。
+    // durability 決定插入是否寫預寫日誌、提交時是否等待日誌落盤。
+    // db_path 已有資料庫時由目錄檔還原表格，並重做上次檢查點之後的日誌。
+    // query_threads 為平行掃描與聚合的執行緒數（含呼叫端），0 表示硬體執行緒數。
+    // buffer_pool_pages 為緩衝池的 PAGE_SIZE 頁框數；欄位 extent 頁框另外配置 EXTENT_POOL_SIZE 個
+    LargeScaleDatabase(const std::string& name, const std::string& db_path,
+        ReplacementPolicyType policy = ReplacementPolicyType::LRU, bool memory_mapped_reads = false,
+        DurabilityMode durability = DurabilityMode::SYNC, size_t query_threads = 0,
+        size_t buffer_pool_pages = BUFFER_POOL_SIZE)
         : name_(name), db_path_(db_path) {
-        disk_manager_ = std::make_unique<DiskManager>(db_path);
-        buffer_manager_ = std::make_unique<BufferPoolManager>(*disk_manager_);
+        disk_manager_ = std::make_unique<DiskManager>(db_path, memory_mapped_reads);
+        buffer_manager_ = std::make_unique<BufferPoolManager>(*disk_manager_, buffer_pool_pages, policy);
+        executor_ = std::make_unique<MorselExecutor>(query_threads);
+        open(durability);
+        checkpointer_ = std::thread([this] { checkpointLoop(); });
     }
 
     ~LargeScaleDatabase() {
-        // 確保所有資料都寫入磁碟
-        std::cout << "DEBUG: Database destructor - flushing all pages\n";
-        buffer_manager_->flushAllPages();
-        std::cout << "DEBUG: All pages flushed\n";
+        {
+            std::lock_guard<std::mutex> lock(checkpoint_mutex_);
+            stopping_ = true;
+        }
+        checkpoint_cv_.notify_all();
+        checkpointer_.join();
+
+        // 確保所有資料都寫入磁碟；之後不再修改任何頁面，目錄標記為正常關閉
+        writeCheckpoint(true);
+        DATABASEAPP_LOG(LogLevel::DEBUG, "Closed database " << db_path_ << " after flushing all pages");
     }
 
+    // 建立與刪除表格都在 admitWriter 之內修改目錄並寫日誌，檢查點不會只看到其中之一
     void createTable(const std::string& table_name) {
-        if (tables_.find(table_name) != tables_.end()) {
-            throw std::runtime_error("Table already exists: " + table_name);
+        std::shared_lock<std::shared_mutex> admitted;
+        if (wal_) admitted = wal_->admitWriter();
+        {
+            std::lock_guard<std::mutex> lock(tables_mutex_);
+            if (tables_.find(table_name) != tables_.end()) {
+                throw std::runtime_error("Table already exists: " + table_name);
+            }
+            tables_[table_name] = std::make_unique<DiskBasedTable>(
+                table_name, *buffer_manager_, wal_.get(), executor_.get());
         }
-        tables_[table_name] = std::make_unique<DiskBasedTable>(
-            table_name, *buffer_manager_);
+        logTableChange(LogRecordType::CREATE_TABLE, table_name, admitted);
     }
 
     DiskBasedTable* getTable(const std::string& table_name) {
@@ -1204,15 +9310,93 @@ public:
         return (it != tables_.end()) ? it->second.get() : nullptr;
     }
 
+    // 欄位檔案仍登記在 DiskManager 中；以相同名稱重新建立表格時沿用這些檔案，由頁面 0 開始覆寫
     void dropTable(const std::string& table_name) {
-        tables_.erase(table_name);
-        // 實際實作中還需要刪除磁碟檔案
+        std::shared_lock<std::shared_mutex> admitted;
+        if (wal_) admitted = wal_->admitWriter();
+        {
+            std::lock_guard<std::mutex> lock(tables_mutex_);
+            if (tables_.erase(table_name) == 0) return;
+        }
+        logTableChange(LogRecordType::DROP_TABLE, table_name, admitted);
     }
 
-    // 壓縮和優化
+    // 壓縮和優化：重建索引使葉子填滿、頁號連續，再寫入檢查點讓目錄記錄新的根頁與空閒清單
     void optimize() {
-        buffer_manager_->flushAllPages();
-        // 可以實作表格壓縮、索引重建等優化操作
+        {
+            std::lock_guard<std::mutex> lock(tables_mutex_);
+            for (auto& [table_name, table] : tables_) table->compactIndexes();
+        }
+        checkpoint();
+    }
+
+    // 等值內連接，結果逐批交給 on_batch，不必一次全部存在記憶體中；回傳實際使用的演算法。
+    // 建立側的記憶體預算為緩衝池的大小，超過時分割寫入資料庫目錄下的暫存檔
+    JoinAlgorithm join(const JoinSpec& spec, const HashJoinOperator::BatchFn& on_batch) {
+        DiskBasedTable* left = getTable(spec.left_table);
+        DiskBasedTable* right = getTable(spec.right_table);
+        if (!left) throw std::runtime_error("Table not found: " + spec.left_table);
+        if (!right) throw std::runtime_error("Table not found: " + spec.right_table);
+
+        QueryTimer timer(disk_manager_->metrics(), QueryKind::JOIN, spec.left_table);
+        static std::atomic<uint64_t> next_join{ 0 };
+        HashJoinOperator join_operator(spec, *left, *right,
+            spillPath() + "/join_" + std::to_string(next_join.fetch_add(1)),
+            buffer_manager_->getPoolSize() * PAGE_SIZE);
+        return join_operator.execute(spec.algorithm, on_batch);
+    }
+
+    RecordBatch join(const JoinSpec& spec) {
+        RecordBatch result;
+        bool first = true;
+        join(spec, [&](const RecordBatch& batch) {
+            if (first) {
+                result = batch;
+                first = false;
+            }
+            else {
+                result.append(batch);
+            }
+        });
+        if (first) {
+            // 沒有相符的列：回傳只有欄位結構的空批次
+            DiskBasedTable* left = getTable(spec.left_table);
+            DiskBasedTable* right = getTable(spec.right_table);
+            result = HashJoinOperator(spec, *left, *right, std::string(), 0).schema();
+        }
+        return result;
+    }
+
+    // 檢查點：等待進行中的寫入完成並暫停新的寫入，寫回所有髒頁並落盤，
+    // 寫入目錄後截斷日誌。讀取不受影響
+    void checkpoint() {
+        writeCheckpoint(false);
+    }
+
+    // 執行期計量的快照：各檔案的緩衝池與 I/O 計數、I/O 延遲、B+ 樹分裂、各索引的形狀與各類查詢的耗時。
+    // 索引形狀需要走訪所有葉子，不適合在熱路徑上呼叫
+    MetricsSnapshot metricsSnapshot() {
+        MetricsSnapshot snapshot = disk_manager_->metrics().collect();
+        for (auto& file : snapshot.files) file.name = disk_manager_->getFileName(file.file_id);
+
+        std::lock_guard<std::mutex> lock(tables_mutex_);
+        for (const auto& [table_name, table] : tables_) {
+            for (const auto& col_name : table->getColumnNames()) {
+                IndexMetrics index = table->getColumn(col_name)->describeIndex();
+                index.table = table_name;
+                index.column = col_name;
+                snapshot.indexes.push_back(std::move(index));
+            }
+        }
+        std::sort(snapshot.indexes.begin(), snapshot.indexes.end(), [](const IndexMetrics& a, const IndexMetrics& b) {
+            return std::tie(a.table, a.column) < std::tie(b.table, b.column);
+        });
+        return snapshot;
+    }
+
+    // 耗時超過 threshold 的查詢以 WARN 記錄；0 表示不記錄
+    void setSlowQueryThreshold(std::chrono::nanoseconds threshold) {
+        disk_manager_->metrics().setSlowQueryThreshold(threshold);
     }
 
     // 統計資訊
@@ -1220,9 +9404,244 @@ public:
         std::cout << "Database Statistics:\n";
         std::cout << "Database Name: " << name_ << "\n";
         std::cout << "Table Count: " << tables_.size() << "\n";
+        std::cout << "Buffer Pool: " << buffer_manager_->getResidentPages() << "/"
+                  << buffer_manager_->getPoolSize() << " pages resident ("
+                  << buffer_manager_->getPolicyName() << ")\n";
+        for (const auto& frame_class : buffer_manager_->getFrameClassStats()) {
+            std::cout << "  " << frame_class.page_size / 1024 << "KB frames: " << frame_class.resident
+                      << "/" << frame_class.frames << "\n";
+        }
+        std::cout << "Parallel execution: " << executor_->parallelism() << " threads, "
+                  << executor_->parallelJobs() << " parallel scans, " << executor_->morsels() << " morsels, "
+                  << executor_->steals() << " steals\n";
+        std::cout << "Async I/O: " << disk_manager_->ioBackend() << ", "
+                  << buffer_manager_->getPrefetchedPages() << " pages prefetched\n";
+        std::cout << "Page writes: " << buffer_manager_->getBackgroundWrites() << " by background writer, "
+                  << buffer_manager_->getForegroundWrites() << " by foreground evictions\n";
+        if (disk_manager_->memoryMappedReads()) {
+            std::cout << "Memory-mapped: " << disk_manager_->getMappedBytes() / 1024 << " KB\n";
+        }
+        if (wal_) {
+            auto stats = wal_->getStats();
+            std::cout << "WAL: " << stats.records << " records, " << stats.commits << " commits in "
+                      << stats.syncs << " log syncs, " << checkpoints_.load() << " checkpoints\n";
+        }
 
         for (const auto& [table_name, table] : tables_) {
             std::cout << "  Table " << table_name << ": " << table->getRowCount() << " rows\n";
+            for (const auto& col_name : table->getColumnNames()) {
+                const BitmapColumnIndex* bitmap = table->getColumn(col_name)->bitmapIndex();
+                if (!bitmap) continue;
+                std::cout << "    Bitmap index " << col_name << ": " << bitmap->keyCount() << " keys, "
+                          << bitmap->memoryBytes() / 1024 << " KB\n";
+            }
+        }
+
+        const MetricsSnapshot metrics = metricsSnapshot();
+        std::cout << "I/O latency: read p50 " << metrics.read_latency.percentileMicros(0.50) << " us, p99 "
+                  << metrics.read_latency.percentileMicros(0.99) << " us (" << metrics.read_latency.count
+                  << " reads); write p50 " << metrics.write_latency.percentileMicros(0.50) << " us, p99 "
+                  << metrics.write_latency.percentileMicros(0.99) << " us (" << metrics.write_latency.count
+                  << " writes)\n";
+        std::cout << "B+ tree splits: " << metrics.leaf_splits << " leaf, " << metrics.internal_splits
+                  << " internal\n";
+        for (const auto& index : metrics.indexes) {
+            if (index.type != "btree" || index.entries == 0) continue;
+            std::cout << "    Index " << index.table << "." << index.column << ": height " << index.height
+                      << ", " << index.pages << " pages, " << index.leaves << " leaves, "
+                      << static_cast<int>(index.fill_factor * 100) << "% leaf fill\n";
+        }
+        std::cout << "Buffer pool by file (hits/misses/evictions/dirty writes):\n";
+        for (const auto& file : metrics.files) {
+            if (file.hits + file.misses + file.evictions + file.dirty_writes == 0) continue;
+            std::cout << "    " << file.name << ": " << file.hits << "/" << file.misses << "/" << file.evictions
+                      << "/" << file.dirty_writes << " (" << static_cast<int>(file.hitRatio() * 100) << "% hits)\n";
+        }
+        for (size_t k = 0; k < QUERY_KIND_COUNT; ++k) {
+            const HistogramSnapshot& query = metrics.queries[k];
+            if (query.count == 0) continue;
+            std::cout << "Query " << queryKindName(static_cast<QueryKind>(k)) << ": " << query.count
+                      << " calls, mean " << query.meanMicros() << " us, p99 " << query.percentileMicros(0.99)
+                      << " us, max " << query.maxMicros() << " us\n";
+        }
+    }
+
+private:
+    std::string catalogPath() const { return db_path_ + "/catalog.bin"; }
+    std::string spillPath() const { return db_path_ + "/join_spill"; }
+
+    // 還原目錄 -> 重做日誌 -> 必要時重建索引 -> 寫入檢查點 -> 開始新的日誌。
+    // 目錄在上次正常關閉時寫入且沒有需要重做的記錄時，索引頁可直接沿用
+    void open(DurabilityMode durability) {
+        const auto start = std::chrono::steady_clock::now();
+        const std::string wal_path = db_path_ + "/wal.log";
+        std::filesystem::remove_all(spillPath());  // 上次中斷的連接留下的暫存檔
+
+        std::string body;
+        const bool restored = Catalog::read(catalogPath(), body);
+        WriteAheadLog::Lsn checkpoint_lsn = 0;
+        bool clean = true;
+        if (restored) {
+            ByteReader catalog(body.data(), body.size());
+            checkpoint_lsn = catalog.get<uint64_t>();
+            clean = catalog.get<uint8_t>() != 0;
+            const size_t table_count = catalog.get<uint32_t>();
+            for (size_t t = 0; t < table_count; ++t) {
+                std::string table_name = catalog.getString();
+                auto table = std::make_unique<DiskBasedTable>(table_name, *buffer_manager_, nullptr, executor_.get());
+                table->restoreState(catalog);
+                tables_[table_name] = std::move(table);
+            }
+            if (!catalog.atEnd()) {
+                throw std::runtime_error("Unexpected trailing data in catalog " + catalogPath());
+            }
+        }
+
+        size_t replayed = 0;
+        const WriteAheadLog::Lsn end_lsn = WriteAheadLog::replay(wal_path, checkpoint_lsn,
+            [this, &replayed](LogRecordType type, ByteReader& record) {
+                redo(type, record);
+                replayed++;
+            });
+
+        if (!clean || replayed > 0) {
+            for (auto& [table_name, table] : tables_) table->rebuildIndexes();
+        }
+        if (restored || replayed > 0) {
+            // 先把還原後的狀態寫成檢查點，才能清空舊日誌；目錄標記為未正常關閉，直到下次關閉
+            buffer_manager_->flushAllPages();
+            if (!disk_manager_->syncAll()) {
+                throw std::runtime_error("Failed to sync recovered database " + db_path_);
+            }
+            Catalog::write(catalogPath(), captureCatalog(end_lsn, false));
+        }
+
+        if (durability != DurabilityMode::NONE) {
+            wal_ = std::make_unique<WriteAheadLog>(wal_path, durability, [this] {
+                requestCheckpoint();
+            }, end_lsn);
+            for (auto& [table_name, table] : tables_) table->setLog(wal_.get());
+        }
+        else {
+            std::filesystem::remove(wal_path);
+        }
+
+        if (restored || replayed > 0) {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+            DATABASEAPP_LOG(LogLevel::INFO, "Reopened database " << db_path_ << " with " << tables_.size() << " tables"
+                << (clean ? "" : " after an unclean shutdown") << ", replayed " << replayed
+                << " log records in " << elapsed.count() << " ms");
+        }
+    }
+
+    void logTableChange(LogRecordType type, const std::string& table_name,
+        std::shared_lock<std::shared_mutex>& admitted) {
+        if (!wal_) return;
+        ByteWriter record;
+        record.putString(table_name);
+        const WriteAheadLog::Lsn lsn = wal_->append(type, record);
+        admitted.unlock();
+        wal_->commit(lsn);
+    }
+
+    void redo(LogRecordType type, ByteReader& record) {
+        std::string table_name = record.getString();
+        if (type == LogRecordType::CREATE_TABLE) {
+            createTable(table_name);
+            return;
+        }
+        if (type == LogRecordType::DROP_TABLE) {
+            dropTable(table_name);
+            return;
+        }
+
+        DiskBasedTable* table = getTable(table_name);
+        if (!table) throw std::runtime_error("Log record refers to unknown table " + table_name);
+        if (type == LogRecordType::ADD_COLUMN) {
+            std::string column_name = record.getString();
+            const auto column_type = static_cast<DataType>(record.get<uint8_t>());
+            const auto string_encoding = static_cast<StringEncoding>(record.get<uint8_t>());
+            const size_t extent_size = record.get<uint32_t>();
+            const auto index_type = static_cast<ColumnIndexType>(record.get<uint8_t>());
+            table->addColumn(column_name, column_type, index_type, string_encoding, extent_size);
+        }
+        else if (type == LogRecordType::INSERT) {
+            table->redoInsert(record);
+        }
+        else if (type == LogRecordType::INSERT_BATCH) {
+            table->redoInsertBatch(record);
+        }
+        else {
+            throw std::runtime_error("Unknown log record type " + std::to_string(static_cast<int>(type)));
+        }
+    }
+
+    // 目錄內容：檢查點 LSN、是否正常關閉與各表格的狀態
+    ByteWriter captureCatalog(WriteAheadLog::Lsn checkpoint_lsn, bool clean) {
+        std::lock_guard<std::mutex> lock(tables_mutex_);
+        ByteWriter catalog;
+        catalog.put(static_cast<uint64_t>(checkpoint_lsn));
+        catalog.put(static_cast<uint8_t>(clean ? 1 : 0));
+        catalog.put(static_cast<uint32_t>(tables_.size()));
+        for (auto& [table_name, table] : tables_) {
+            catalog.putString(table_name);
+            table->saveState(catalog);
+        }
+        return catalog;
+    }
+
+    // 沒有日誌時寫入不會暫停：先取得目錄快照再寫回，快照涵蓋的頁面都在這次寫回之中
+    void writeCheckpoint(bool clean) {
+        std::unique_lock<std::shared_mutex> quiesced;
+        if (wal_) {
+            quiesced = wal_->blockWriters();
+            wal_->flush();
+        }
+
+        ByteWriter catalog = captureCatalog(wal_ ? wal_->endLsn() : 0, clean);
+        buffer_manager_->flushAllPages();
+        if (!disk_manager_->syncAll()) {
+            DATABASEAPP_LOG(LogLevel::ERR, "Checkpoint could not sync data files, keeping the log");
+            return;
+        }
+        try {
+            Catalog::write(catalogPath(), catalog);
+        }
+        catch (const std::exception& e) {
+            DATABASEAPP_LOG(LogLevel::ERR, "Checkpoint could not write the catalog, keeping the log: " << e.what());
+            return;
+        }
+        if (wal_) wal_->truncate();
+        checkpoints_++;
+    }
+
+    void requestCheckpoint() {
+        {
+            std::lock_guard<std::mutex> lock(checkpoint_mutex_);
+            checkpoint_requested_ = true;
+        }
+        checkpoint_cv_.notify_one();
+    }
+
+    void checkpointLoop() {
+        std::unique_lock<std::mutex> lock(checkpoint_mutex_);
+        while (!stopping_) {
+            checkpoint_cv_.wait_for(lock, CHECKPOINT_INTERVAL, [this] {
+                return stopping_ || checkpoint_requested_;
+            });
+            if (stopping_) break;
+            checkpoint_requested_ = false;
+            lock.unlock();
+            if (!wal_ || wal_->bytesSinceCheckpoint() > 0) {
+                try {
+                    checkpoint();
+                }
+                catch (const std::exception& e) {
+                    DATABASEAPP_LOG(LogLevel::ERR, "Background checkpoint failed: " << e.what());
+                }
+            }
+            lock.lock();
         }
     }
 };
@@ -1234,40 +9653,42 @@ void printValue(const Value& value) {
         }, value);
 }
 
-void printQueryResult(const std::vector<std::unordered_map<std::string, Value>>& result) {
-    if (result.empty()) {
+void printQueryResult(const RecordBatch& result) {
+    const size_t rows = result.rowCount();
+    if (rows == 0) {
         std::cout << "Query result is empty\n";
         return;
     }
 
     // 印出標題
-    for (const auto& pair : result[0]) {
-        std::cout << pair.first << "\t";
+    for (size_t c = 0; c < result.columnCount(); ++c) {
+        std::cout << result.column(c).name << "\t";
     }
     std::cout << "\n";
 
     // 印出分隔線
-    for (const auto& pair : result[0]) {
+    for (size_t c = 0; c < result.columnCount(); ++c) {
         std::cout << "--------\t";
     }
     std::cout << "\n";
 
     // 印出資料（限制輸出行數以避免過多輸出）
-    size_t max_rows = std::min(size_t(10), result.size());
+    size_t max_rows = std::min(size_t(10), rows);
     for (size_t i = 0; i < max_rows; ++i) {
-        for (const auto& pair : result[i]) {
-            printValue(pair.second);
+        for (size_t c = 0; c < result.columnCount(); ++c) {
+            printValue(result.value(c, i));
             std::cout << "\t";
         }
         std::cout << "\n";
     }
 
-    if (result.size() > max_rows) {
-        std::cout << "... (" << (result.size() - max_rows) << " more rows)\n";
+    if (rows > max_rows) {
+        std::cout << "... (" << (rows - max_rows) << " more rows)\n";
     }
 }
 
-// 示範程式
+// 示範程式；效能量測改用 DatabaseBenchmark。DatabaseBenchmark.cpp 引入本檔時定義 DATABASEAPP_NO_MAIN
+#ifndef DATABASEAPP_NO_MAIN
 int main() {
     try {
         std::cout << "=== Large-Scale Columnar Database Demo ===\n";
@@ -1276,6 +9697,8 @@ int main() {
         // 測試檔案系統是否工作正常
         std::cout << "0. Testing file system...\n";
         std::string test_file = "./large_scale_db/test.txt";
+        // 示範從空的資料庫開始；重新開啟既有資料庫在第 12 步示範
+        std::filesystem::remove_all("./large_scale_db");
         std::filesystem::create_directories("./large_scale_db");
         
         std::ofstream test_stream(test_file);
@@ -1293,7 +9716,8 @@ int main() {
         std::cout << "\n";
 
         // 建立支援大資料集的資料庫
-        LargeScaleDatabase db("LargeScaleDB", "./large_scale_db");
+        auto db_holder = std::make_unique<LargeScaleDatabase>("LargeScaleDB", "./large_scale_db");
+        LargeScaleDatabase& db = *db_holder;
         
         // B+ 樹序列化基本測試
         std::cout << "0.1. Basic B+ Tree serialization test:\n";
@@ -1332,7 +9756,7 @@ int main() {
         emp_table->addColumn("id", DataType::INT32);
         emp_table->addColumn("name", DataType::STRING);
         emp_table->addColumn("salary", DataType::DOUBLE);
-        emp_table->addColumn("department_id", DataType::INT32);
+        emp_table->addColumn("department_id", DataType::INT32, ColumnIndexType::BITMAP);
 
         std::cout << "1. Inserting test data...\n";
         emp_table->insertRow({ {"id", 1}, {"name", std::string("John Smith")}, {"salary", 50000.0}, {"department_id", 1} });
@@ -1351,89 +9775,209 @@ int main() {
         printQueryResult(salary_range);
         std::cout << "\n";
 
+        // 連接：employees.department_id = departments.id
+        std::cout << "3.1. Joining employees with departments:\n";
+        db.createTable("departments");
+        auto* dept_table = db.getTable("departments");
+        dept_table->addColumn("id", DataType::INT32);
+        dept_table->addColumn("name", DataType::STRING);
+        dept_table->insertRow({ {"id", 1}, {"name", std::string("Engineering")} });
+        dept_table->insertRow({ {"id", 2}, {"name", std::string("Sales")} });
+
+        auto dept_join = db.join(JoinSpec{ "employees", "department_id", "departments", "id",
+            { "name", "salary" }, { "name" } });
+        printQueryResult(dept_join);
+        std::cout << "\n";
+
         // 大資料量測試
         std::cout << "4. Large dataset test - inserting 100,000 records...\n";
-        auto start_time = std::chrono::high_resolution_clock::now();
-
         db.createTable("large_dataset");
         auto* large_table = db.getTable("large_dataset");
         large_table->addColumn("id", DataType::INT32);
         large_table->addColumn("value", DataType::DOUBLE);
-        large_table->addColumn("category", DataType::INT32);
-
-        // 批量插入
-        std::vector<std::unordered_map<std::string, Value>> batch_data;
+        // 低基數的分類欄位使用點陣圖索引
+        large_table->addColumn("category", DataType::INT32, ColumnIndexType::BITMAP);
+        large_table->addColumn("region", DataType::INT32, ColumnIndexType::BITMAP);
+
+        // 欄式批次插入 - 每個欄位一個型別化陣列，整段寫入資料頁，索引走自底向上的批量建立路徑
+        RecordBatch batch = large_table->newBatch();
+        batch.reserve(100000);
+        auto& batch_ids = batch.values<int32_t>(batch.columnIndex("id"));
+        auto& batch_values = batch.values<double>(batch.columnIndex("value"));
+        auto& batch_categories = batch.values<int32_t>(batch.columnIndex("category"));
+        auto& batch_regions = batch.values<int32_t>(batch.columnIndex("region"));
         for (int i = 0; i < 100000; ++i) {
-            batch_data.push_back({
-                {"id", i},
-                {"value", double(i * 1.5)},
-                {"category", i % 10}
-                });
-
-            // 每1000筆批量插入一次
-            if (batch_data.size() == 1000) {
-                large_table->bulkInsert(batch_data);
-                batch_data.clear();
-            }
-        }
-        if (!batch_data.empty()) {
-            large_table->bulkInsert(batch_data);
+            batch_ids.push_back(i);
+            batch_values.push_back(double(i * 1.5));
+            batch_categories.push_back(i % 10);
+            batch_regions.push_back(i % 7);
         }
+        large_table->insertBatch(batch);
 
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-
-        std::cout << "Insert completed, time taken: " << duration.count() << " milliseconds\n";
+        std::cout << "Insert completed\n";
         std::cout << "Record count: " << large_table->getRowCount() << "\n\n";
 
         // 大資料量索引查詢
         std::cout << "5. Large dataset index query test...\n";
-        start_time = std::chrono::high_resolution_clock::now();
-
         auto category_results = large_table->indexedSelect("category", 5, { "id", "value" });
 
-        end_time = std::chrono::high_resolution_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-
-        std::cout << "Index query completed, time taken: " << duration.count() << " milliseconds\n";
-        std::cout << "Found " << category_results.size() << " records\n";
+        std::cout << "Index query completed\n";
+        std::cout << "Found " << category_results.rowCount() << " records\n";
         std::cout << "First few results:\n";
         printQueryResult(category_results);
         std::cout << "\n";
 
         // 範圍查詢測試
         std::cout << "6. Range query test...\n";
-        start_time = std::chrono::high_resolution_clock::now();
+        // 以游標逐批取出結果，每批最多 ResultCursor::DEFAULT_BATCH_ROWS 列
+        auto range_cursor = large_table->openRangeSelect("value", 10000.0, 20000.0);
+        RecordBatch range_batch;
+        size_t range_rows = 0;
+        size_t range_batches = 0;
+        while (range_cursor.next(range_batch)) {
+            range_rows += range_batch.rowCount();
+            range_batches++;
+        }
 
-        auto range_results = large_table->rangeSelect("value", 10000.0, 20000.0);
+        std::cout << "Range query completed\n";
+        std::cout << "Found " << range_rows << " records in " << range_batches << " batches\n\n";
 
-        end_time = std::chrono::high_resolution_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+        // 述詞下推掃描測試
+        std::cout << "6.1. Predicate scan test (value BETWEEN 10000 AND 20000 AND category = 5)...\n";
+        auto scan_results = large_table->scanSelect({
+            ColumnPredicate("value", CompareOp::BETWEEN, 10000.0, 20000.0),
+            ColumnPredicate("category", CompareOp::EQ, 5)
+            }, { "id", "value" });
 
-        std::cout << "Range query completed, time taken: " << duration.count() << " milliseconds\n";
-        std::cout << "Found " << range_results.size() << " records\n\n";
+        std::cout << "Predicate scan completed\n";
+        std::cout << "Found " << scan_results.rowCount() << " records\n\n";
 
         // 聚合查詢測試
         std::cout << "7. Large dataset aggregate query test...\n";
-        start_time = std::chrono::high_resolution_clock::now();
-
         auto* value_column = large_table->getColumn("value");
         double total_sum = value_column->sum();
         double avg_value = value_column->average();
 
-        end_time = std::chrono::high_resolution_clock::now();
-        duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-
-        std::cout << "Aggregate query completed, time taken: " << duration.count() << " milliseconds\n";
+        std::cout << "Aggregate query completed\n";
         std::cout << "Sum: " << total_sum << "\n";
         std::cout << "Average: " << avg_value << "\n\n";
 
+        // 過濾聚合：id 依插入順序遞增，zone map 讓範圍外的頁面不必讀取
+        std::cout << "7.1. Filtered aggregate test (SUM(value) WHERE id BETWEEN 20000 AND 29999)...\n";
+        auto filtered = large_table->aggregateWhere("value", {
+            ColumnPredicate("id", CompareOp::BETWEEN, 20000, 29999)
+            });
+
+        std::cout << "Filtered aggregate completed\n";
+        std::cout << "Count: " << filtered.count << ", Sum: " << filtered.sum << "\n\n";
+
+        // 分組聚合：category 只有 10 個值，分組表是直接陣列
+        std::cout << "7.2. Group by test (SUM/AVG(value) GROUP BY category)...\n";
+        auto groups = large_table->groupBy("category", { "value" });
+
+        std::cout << "Group by completed\n";
+        std::cout << "category\tcount\tsum\tavg\n";
+        for (const auto& group : groups) {
+            printValue(group.key);
+            std::cout << "\t" << group.count << "\t" << group.aggregates[0].sum << "\t"
+                      << group.aggregates[0].average() << "\n";
+        }
+
+        // 浮點鍵：所有 NaN 合併成一個分組並排在最後，其餘分組依鍵值遞增
+        db.createTable("readings");
+        auto* readings = db.getTable("readings");
+        readings->addColumn("k", DataType::DOUBLE);
+        readings->addColumn("v", DataType::INT32);
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        int reading = 0;
+        for (double k : { 5.0, nan, 3.0, 4.0, nan, 3.0 }) {
+            readings->insertRow({ {"k", k}, {"v", ++reading} });
+        }
+        auto reading_groups = readings->groupBy("k", { "v" });
+        std::cout << "GROUP BY DOUBLE key with NaN:";
+        for (const auto& group : reading_groups) {
+            std::cout << " ";
+            printValue(group.key);
+            std::cout << "(" << group.count << ")";
+        }
+        const bool nan_last = !reading_groups.empty() && std::isnan(std::get<double>(reading_groups.back().key));
+        const bool ordered = std::is_sorted(reading_groups.begin(), reading_groups.end() - (nan_last ? 1 : 0),
+            [](const GroupAggregate& a, const GroupAggregate& b) { return a.key < b.key; });
+        std::cout << "\n" << (reading_groups.size() == 4 && nan_last && ordered ? "NaN grouping and ordering verified"
+            : "ERROR: unexpected NaN grouping or ordering") << "\n\n";
+
+        // 事實表與維度表的連接：維度表只有 10 列，AUTO 選擇查詢 category 的索引；另以雜湊連接比較
+        std::cout << "7.3. Join test (large_dataset.category = categories.id)...\n";
+        db.createTable("categories");
+        auto* category_table = db.getTable("categories");
+        category_table->addColumn("id", DataType::INT32);
+        category_table->addColumn("label", DataType::STRING, StringEncoding::DICTIONARY);
+        for (int c = 0; c < 10; ++c) {
+            category_table->insertRow({ {"id", c}, {"label", std::string("category_") + std::to_string(c)} });
+        }
+
+        for (JoinAlgorithm algorithm : { JoinAlgorithm::AUTO, JoinAlgorithm::HASH }) {
+            size_t joined_rows = 0;
+            int64_t id_sum = 0;
+            JoinAlgorithm used = db.join(JoinSpec{ "large_dataset", "category", "categories", "id",
+                { "id" }, { "label" }, algorithm }, [&](const RecordBatch& joined) {
+                    joined_rows += joined.rowCount();
+                    for (int32_t id : joined.values<int32_t>(0)) id_sum += id;
+                });
+
+            std::cout << "Join (" << joinAlgorithmName(used) << ") completed, " << joined_rows
+                      << " rows, SUM(id) = " << id_sum << "\n";
+        }
+        std::cout << "\n";
+
+        // 點陣圖索引：category 與 region 的述詞以點陣圖的交集與聯集求值，COUNT 直接取基數；
+        // value 沒有點陣圖，只在 category 點陣圖選出的候選列上掃描
+        std::cout << "7.4. Bitmap index test (COUNT over category/region bitmaps)...\n";
+        size_t both = large_table->countWhere({
+            ColumnPredicate("category", CompareOp::EQ, 3),
+            ColumnPredicate("region", CompareOp::EQ, 2)
+            });
+        size_t either = large_table->countWhereAny({
+            { ColumnPredicate("category", CompareOp::EQ, 3) },
+            { ColumnPredicate("region", CompareOp::EQ, 2) }
+            });
+        size_t mixed = large_table->countWhere({
+            ColumnPredicate("category", CompareOp::LE, 1),
+            ColumnPredicate("value", CompareOp::LT, 15000.0)
+            });
+
+        std::cout << "Bitmap counts completed\n";
+        std::cout << "category = 3 AND region = 2: " << both << "\n";
+        std::cout << "category = 3 OR region = 2: " << either << "\n";
+        std::cout << "category <= 1 AND value < 15000: " << mixed << "\n\n";
+
+        // 僅用索引的查詢：COUNT 沿葉子鏈結計數、MIN/MAX 取第一個／最後一個鍵，分頁範圍查詢取滿即停止
+        std::cout << "7.5. Index-only test (COUNT/MIN/MAX on value, range page with LIMIT)...\n";
+        size_t value_count = large_table->countWhere({
+            ColumnPredicate("value", CompareOp::BETWEEN, 10000.0, 20000.0)
+            });
+        auto value_min = large_table->indexedMin("value");
+        auto value_max = large_table->indexedMax("value");
+        auto page_cursor = large_table->openRangeSelect("value", 10000.0, 20000.0, 100, 10, { "id", "value" });
+        RecordBatch page_batch;
+        page_cursor.next(page_batch);
+
+        std::cout << "Index-only queries completed\n";
+        std::cout << "COUNT(*) WHERE value BETWEEN 10000 AND 20000: " << value_count << "\n";
+        std::cout << "MIN(value): ";
+        if (value_min) printValue(*value_min);
+        std::cout << ", MAX(value): ";
+        if (value_max) printValue(*value_max);
+        std::cout << "\nRange page (OFFSET 100 LIMIT 10):\n";
+        printQueryResult(page_batch);
+        std::cout << "\n";
+
         // 印出資料庫統計
         db.printStatistics();
 
         // 在顯示功能前強制將所有資料刷新到磁碟
         std::cout << "\n8. Flushing all data to disk...\n";
-        db.optimize();  // 這會呼叫 flushAllPages
+        db.optimize();  // 這會執行檢查點
         std::cout << "Data flush completed.\n";
         
         // 額外確保所有資料都寫入
@@ -1488,12 +10032,42 @@ int main() {
             std::cout << "Found " << salary_records.size() << " records with salary=50000 (testing B+ tree with double type)\n";
         }
 
+        // 重新開啟：正常關閉時寫入目錄，開啟時直接還原表格與索引，不重新載入資料
+        std::cout << "\n12. Reopen test:\n";
+        // 型別不符的列在附加任何欄位之前就被拒絕，各欄位與列數保持一致，資料庫仍可重新開啟
+        try {
+            emp_table->insertRow({ {"id", 4}, {"name", std::string("Bad Row")}, {"salary", std::string("n/a")} });
+        }
+        catch (const std::exception& e) {
+            std::cout << "Rejected row: " << e.what() << "\n";
+        }
+        std::cout << "Employee rows after rejected insert: " << emp_table->getRowCount() << "\n";
+        db_holder.reset();
+        db_holder = std::make_unique<LargeScaleDatabase>("LargeScaleDB", "./large_scale_db");
+
+        auto* reopened_table = db_holder->getTable("large_dataset");
+        std::cout << "Reopen completed\n";
+        std::cout << "Record count after reopen: " << (reopened_table ? reopened_table->getRowCount() : 0) << "\n";
+        if (reopened_table) {
+            auto reopened_results = reopened_table->indexedSelect("category", 5, { "id" });
+            std::cout << "Index query after reopen found " << reopened_results.rowCount() << " records\n";
+        }
+        auto* reopened_employees = db_holder->getTable("employees");
+        if (reopened_employees) {
+            auto employee = reopened_employees->indexedSelect("id", 3, { "name" });
+            std::cout << "Employees after reopen: " << reopened_employees->getRowCount() << " rows, id=3 is ";
+            if (employee.rowCount() == 1) printValue(employee.value(0, 0));
+            std::cout << "\n";
+        }
+
         std::cout << "\n=== Large-Scale Columnar Database Features ===\n";
         std::cout << "✓ Disk Storage Support - Handle datasets larger than memory\n";
         std::cout << "✓ B+ Tree Indexing - Fast queries and range searches\n";
-        std::cout << "✓ Buffer Pool Management - LRU replacement strategy, efficient memory management\n";
-        std::cout << "✓ Paging Mechanism - 4KB pages, optimized disk I/O\n";
+        std::cout << "✓ Bitmap Indexing - Roaring bitmaps for low-cardinality columns, AND/OR and COUNT from cardinalities\n";
+        std::cout << "✓ Buffer Pool Management - Pin counts, LRU/CLOCK/2Q replacement, scan-resistant fetches\n";
+        std::cout << "✓ Paging Mechanism - Per-file page size: 4KB index and logical column pages, 64KB column data extents\n";
         std::cout << "✓ Columnar Storage Architecture - Optimized for analytical queries\n";
+        std::cout << "✓ Page Compression - Constant/RLE/FOR/delta encodings chosen per sealed page\n";
         std::cout << "✓ Batch Operations - Efficient handling of large datasets\n";
         std::cout << "✓ Data-Oriented Design - Cache-friendly memory layout\n";
 
@@ -1507,6 +10081,7 @@ int main() {
 
     return 0;
 }
+#endif
 
 // Run program: Ctrl + F5 or Debug > Start Without Debugging menu
 // Debug program: F5 or Debug > Start Debugging menu
@@ -0,0 +1,523 @@
+// DatabaseBenchmark.cpp : 可重現的效能量測工作負載，輸出機器可讀的 JSON 或 CSV。
+//
+// 引擎與 DatabaseApp 共用同一份原始碼；定義 DATABASEAPP_NO_MAIN 後引入 DatabaseApp.cpp，不編譯示範用的 main()。
+// 工作負載：
+//   ingest        以 insertBatch 分批載入 --rows 列，每批為一次操作
+//   point_lookup  以 id 索引查詢一列並取出 value
+//   range_scan    以游標讀取 id 連續 --range-rows 列的 value
+//   aggregate     value 欄位的整欄 COUNT/SUM/MIN/MAX（morsel 平行掃描）
+//   mixed         --write-ratio 比例的 insertRow，其餘為點查詢
+// 除 ingest 以外的工作負載都在載入後的資料上執行；沒有選擇 ingest 時載入不計時。
+// 每個操作記錄延遲，輸出吞吐量與 p50/p99/p999（微秒）。
+
+#define DATABASEAPP_NO_MAIN
+#include "DatabaseApp.cpp"
+
+#include <random>
+#include <sstream>
+#include <iomanip>
+
+namespace {
+
+enum class KeyDistribution {
+    UNIFORM,
+    ZIPF
+};
+
+struct BenchmarkOptions {
+    size_t rows = 1000000;
+    KeyDistribution distribution = KeyDistribution::UNIFORM;
+    double zipf_theta = 0.99;
+    size_t threads = 1;                        // 用戶端執行緒數，也是查詢執行緒池的大小
+    size_t buffer_pool_pages = BUFFER_POOL_SIZE;
+    size_t operations = 100000;                // point_lookup / mixed 的總操作數
+    size_t range_operations = 1000;
+    size_t range_rows = 1000;
+    size_t aggregate_runs = 20;
+    size_t batch_rows = 10000;                 // ingest 每批列數
+    double write_ratio = 0.1;
+    uint64_t seed = 42;
+    DurabilityMode durability = DurabilityMode::NONE;
+    std::vector<std::string> workloads = { "ingest", "point_lookup", "range_scan", "aggregate", "mixed" };
+    std::string format = "json";
+    std::string output;                        // 空字串表示標準輸出
+    std::string db_path = "./benchmark_db";
+};
+
+struct BenchmarkResult {
+    std::string workload;
+    size_t operations = 0;
+    size_t rows = 0;          // 操作讀取或寫入的列數
+    double seconds = 0;
+    double p50_us = 0;
+    double p99_us = 0;
+    double p999_us = 0;
+
+    double opsPerSecond() const { return seconds > 0 ? operations / seconds : 0; }
+    double rowsPerSecond() const { return seconds > 0 ? rows / seconds : 0; }
+};
+
+using Clock = std::chrono::steady_clock;
+
+// 每個執行緒各自記錄延遲，結束後合併，量測期間不共享任何寫入位置
+class LatencyRecorder {
+private:
+    std::vector<std::vector<uint64_t>> samples_;  // 每個執行緒的延遲（奈秒）
+
+public:
+    explicit LatencyRecorder(size_t threads) : samples_(threads) {}
+
+    std::vector<uint64_t>& thread(size_t index) { return samples_[index]; }
+
+    // 以最近排名法取百分位數
+    void summarize(BenchmarkResult& result) {
+        std::vector<uint64_t> all;
+        for (auto& samples : samples_) all.insert(all.end(), samples.begin(), samples.end());
+        if (all.empty()) return;
+        std::sort(all.begin(), all.end());
+        auto percentile = [&](double p) {
+            size_t rank = static_cast<size_t>(std::ceil(p * all.size()));
+            return all[std::min(all.size(), std::max<size_t>(rank, 1)) - 1] / 1000.0;
+        };
+        result.p50_us = percentile(0.50);
+        result.p99_us = percentile(0.99);
+        result.p999_us = percentile(0.999);
+    }
+};
+
+// 在 [0, n) 上產生鍵。ZIPF 依 YCSB 的 zipfian 產生器取排名，再以雜湊打散，
+// 熱門的鍵不會集中在相鄰的葉子與資料頁上
+class KeyGenerator {
+private:
+    uint64_t n_;
+    KeyDistribution distribution_;
+    double theta_ = 0;
+    double alpha_ = 0;
+    double zetan_ = 0;
+    double eta_ = 0;
+
+    static double zeta(uint64_t n, double theta) {
+        double sum = 0;
+        for (uint64_t i = 1; i <= n; ++i) sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        return sum;
+    }
+
+    static uint64_t scramble(uint64_t x) {
+        x += 0x9E3779B97F4A7C15ull;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+
+public:
+    KeyGenerator(uint64_t n, KeyDistribution distribution, double theta)
+        : n_(std::max<uint64_t>(n, 1)), distribution_(distribution) {
+        if (distribution_ != KeyDistribution::ZIPF) return;
+        theta_ = theta;
+        alpha_ = 1.0 / (1.0 - theta_);
+        zetan_ = zeta(n_, theta_);
+        const double zeta2 = zeta(2, theta_);
+        eta_ = (1.0 - std::pow(2.0 / n_, 1.0 - theta_)) / (1.0 - zeta2 / zetan_);
+    }
+
+    uint64_t next(std::mt19937_64& rng) const {
+        if (distribution_ == KeyDistribution::UNIFORM) {
+            return std::uniform_int_distribution<uint64_t>(0, n_ - 1)(rng);
+        }
+        const double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+        const double uz = u * zetan_;
+        uint64_t rank;
+        if (uz < 1.0) rank = 0;
+        else if (uz < 1.0 + std::pow(0.5, theta_)) rank = 1;
+        else rank = std::min<uint64_t>(n_ - 1, static_cast<uint64_t>(n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_)));
+        return scramble(rank) % n_;
+    }
+};
+
+class Benchmark {
+private:
+    const BenchmarkOptions& options_;
+    KeyGenerator keys_;
+    std::unique_ptr<LargeScaleDatabase> db_;
+    DiskBasedTable* table_ = nullptr;
+    std::atomic<int64_t> next_id_{ 0 };
+
+    static void fillBatch(RecordBatch& batch, int64_t first_id, size_t rows) {
+        auto& ids = batch.values<int64_t>(0);
+        auto& values = batch.values<double>(1);
+        auto& categories = batch.values<int32_t>(2);
+        ids.clear();
+        values.clear();
+        categories.clear();
+        for (size_t i = 0; i < rows; ++i) {
+            const int64_t id = first_id + static_cast<int64_t>(i);
+            ids.push_back(id);
+            values.push_back(static_cast<double>(id % 100000) * 1.5);
+            categories.push_back(static_cast<int32_t>(id % 10));
+        }
+    }
+
+    // 每個執行緒執行 fn(thread_index, rng, latencies)，回傳所有執行緒完成的總秒數
+    template <typename Fn>
+    double runThreads(LatencyRecorder& recorder, Fn&& fn) {
+        const auto start = Clock::now();
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < options_.threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::mt19937_64 rng(options_.seed + t);
+                fn(t, rng, recorder.thread(t));
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // 把 total 個操作平均分給各執行緒
+    size_t share(size_t total, size_t thread) const {
+        return total / options_.threads + (thread < total % options_.threads ? 1 : 0);
+    }
+
+public:
+    explicit Benchmark(const BenchmarkOptions& options)
+        : options_(options), keys_(options.rows, options.distribution, options.zipf_theta) {
+        std::filesystem::remove_all(options_.db_path);
+        db_ = std::make_unique<LargeScaleDatabase>("Benchmark", options_.db_path, ReplacementPolicyType::LRU,
+            false, options_.durability, options_.threads, options_.buffer_pool_pages);
+        db_->createTable("bench");
+        table_ = db_->getTable("bench");
+        table_->addColumn("id", DataType::INT64);
+        table_->addColumn("value", DataType::DOUBLE);
+        table_->addColumn("category", DataType::INT32, ColumnIndexType::BITMAP);
+    }
+
+    ~Benchmark() {
+        db_.reset();
+        std::filesystem::remove_all(options_.db_path);
+    }
+
+    // 載入資料在單一執行緒上進行：insertBatch 在表格鎖內附加，多個載入執行緒只會互相等待
+    BenchmarkResult ingest() {
+        BenchmarkResult result{ "ingest" };
+        LatencyRecorder recorder(1);
+        RecordBatch batch = table_->newBatch();
+        const auto start = Clock::now();
+        for (size_t loaded = 0; loaded < options_.rows; loaded += options_.batch_rows) {
+            const size_t rows = std::min(options_.batch_rows, options_.rows - loaded);
+            fillBatch(batch, static_cast<int64_t>(loaded), rows);
+            const auto op_start = Clock::now();
+            table_->insertBatch(batch);
+            recorder.thread(0).push_back(elapsedNanos(op_start));
+            result.operations++;
+            result.rows += rows;
+        }
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        recorder.summarize(result);
+        next_id_ = static_cast<int64_t>(options_.rows);
+        return result;
+    }
+
+    BenchmarkResult pointLookup() {
+        BenchmarkResult result{ "point_lookup" };
+        LatencyRecorder recorder(options_.threads);
+        std::atomic<size_t> rows{ 0 };
+        result.seconds = runThreads(recorder, [&](size_t t, std::mt19937_64& rng, std::vector<uint64_t>& latencies) {
+            const size_t count = share(options_.operations, t);
+            latencies.reserve(count);
+            size_t found = 0;
+            for (size_t i = 0; i < count; ++i) {
+                const int64_t key = static_cast<int64_t>(keys_.next(rng));
+                const auto op_start = Clock::now();
+                found += table_->indexedSelect("id", key, { "value" }).rowCount();
+                latencies.push_back(elapsedNanos(op_start));
+            }
+            rows += found;
+        });
+        result.operations = options_.operations;
+        result.rows = rows;
+        recorder.summarize(result);
+        return result;
+    }
+
+    BenchmarkResult rangeScan() {
+        BenchmarkResult result{ "range_scan" };
+        LatencyRecorder recorder(options_.threads);
+        std::atomic<size_t> rows{ 0 };
+        result.seconds = runThreads(recorder, [&](size_t t, std::mt19937_64& rng, std::vector<uint64_t>& latencies) {
+            const size_t count = share(options_.range_operations, t);
+            latencies.reserve(count);
+            size_t read = 0;
+            RecordBatch batch;
+            for (size_t i = 0; i < count; ++i) {
+                const int64_t start = static_cast<int64_t>(keys_.next(rng));
+                const int64_t end = start + static_cast<int64_t>(options_.range_rows) - 1;
+                const auto op_start = Clock::now();
+                auto cursor = table_->openRangeSelect("id", start, end, { "value" });
+                while (cursor.next(batch)) read += batch.rowCount();
+                latencies.push_back(elapsedNanos(op_start));
+            }
+            rows += read;
+        });
+        result.operations = options_.range_operations;
+        result.rows = rows;
+        recorder.summarize(result);
+        return result;
+    }
+
+    // 整欄聚合本身已在查詢執行緒池上平行執行，由單一用戶端執行緒依序發出
+    BenchmarkResult aggregate() {
+        BenchmarkResult result{ "aggregate" };
+        LatencyRecorder recorder(1);
+        auto* column = table_->getColumn("value");
+        volatile double sink = 0;
+        const auto start = Clock::now();
+        for (size_t i = 0; i < options_.aggregate_runs; ++i) {
+            const auto op_start = Clock::now();
+            AggregateResult aggregate = column->aggregate();
+            recorder.thread(0).push_back(elapsedNanos(op_start));
+            sink = sink + aggregate.sum;
+            result.rows += aggregate.count;
+        }
+        result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        result.operations = options_.aggregate_runs;
+        recorder.summarize(result);
+        return result;
+    }
+
+    // 讀取只查詢載入時的鍵；寫入附加新的 id，與讀取並行更新同一組索引
+    BenchmarkResult mixed() {
+        BenchmarkResult result{ "mixed" };
+        LatencyRecorder recorder(options_.threads);
+        std::atomic<size_t> rows{ 0 };
+        result.seconds = runThreads(recorder, [&](size_t t, std::mt19937_64& rng, std::vector<uint64_t>& latencies) {
+            const size_t count = share(options_.operations, t);
+            latencies.reserve(count);
+            std::bernoulli_distribution write(options_.write_ratio);
+            size_t touched = 0;
+            for (size_t i = 0; i < count; ++i) {
+                const bool is_write = write(rng);
+                const int64_t key = static_cast<int64_t>(keys_.next(rng));
+                const auto op_start = Clock::now();
+                if (is_write) {
+                    const int64_t id = next_id_.fetch_add(1);
+                    table_->insertRow({ {"id", id}, {"value", static_cast<double>(id % 100000) * 1.5},
+                        {"category", static_cast<int32_t>(id % 10)} });
+                    touched++;
+                }
+                else {
+                    touched += table_->indexedSelect("id", key, { "value" }).rowCount();
+                }
+                latencies.push_back(elapsedNanos(op_start));
+            }
+            rows += touched;
+        });
+        result.operations = options_.operations;
+        result.rows = rows;
+        recorder.summarize(result);
+        return result;
+    }
+
+    std::vector<BenchmarkResult> run() {
+        auto selected = [&](const std::string& name) {
+            return std::find(options_.workloads.begin(), options_.workloads.end(), name) != options_.workloads.end();
+        };
+
+        std::vector<BenchmarkResult> results;
+        BenchmarkResult loaded = ingest();
+        if (selected("ingest")) results.push_back(loaded);
+        // 載入後先寫回檢查點，讀取工作負載不與載入留下的髒頁寫回重疊
+        db_->optimize();
+        if (selected("point_lookup")) results.push_back(pointLookup());
+        if (selected("range_scan")) results.push_back(rangeScan());
+        if (selected("aggregate")) results.push_back(aggregate());
+        if (selected("mixed")) results.push_back(mixed());
+        return results;
+    }
+
+    // 引擎自己的計量（各檔案的命中率、I/O 延遲、索引形狀與各類查詢耗時），附在 JSON 結果中
+    std::string engineMetrics() { return db_->metricsSnapshot().toJson(); }
+};
+
+const char* distributionName(KeyDistribution distribution) {
+    return distribution == KeyDistribution::ZIPF ? "zipf" : "uniform";
+}
+
+const char* durabilityName(DurabilityMode durability) {
+    switch (durability) {
+    case DurabilityMode::SYNC: return "sync";
+    case DurabilityMode::ASYNC: return "async";
+    case DurabilityMode::NONE: return "none";
+    }
+    return "none";
+}
+
+void writeJson(std::ostream& out, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results,
+    const std::string& engine_metrics) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"config\": {"
+        << "\"rows\": " << options.rows
+        << ", \"distribution\": \"" << distributionName(options.distribution) << "\""
+        << ", \"zipf_theta\": " << options.zipf_theta
+        << ", \"threads\": " << options.threads
+        << ", \"buffer_pool_pages\": " << options.buffer_pool_pages
+        << ", \"durability\": \"" << durabilityName(options.durability) << "\""
+        << ", \"seed\": " << options.seed << "},\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\"workload\": \"" << r.workload << "\""
+            << ", \"operations\": " << r.operations
+            << ", \"rows\": " << r.rows
+            << ", \"seconds\": " << r.seconds
+            << ", \"ops_per_sec\": " << r.opsPerSecond()
+            << ", \"rows_per_sec\": " << r.rowsPerSecond()
+            << ", \"p50_us\": " << r.p50_us
+            << ", \"p99_us\": " << r.p99_us
+            << ", \"p999_us\": " << r.p999_us << "}";
+    }
+    out << "\n  ],\n  \"engine\": " << engine_metrics << "\n}\n";
+}
+
+// 每列帶上設定欄位，多次執行的結果可直接串接比較
+void writeCsv(std::ostream& out, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results) {
+    out << std::fixed << std::setprecision(3);
+    out << "workload,rows,distribution,threads,buffer_pool_pages,durability,operations,rows_touched,seconds,"
+        << "ops_per_sec,rows_per_sec,p50_us,p99_us,p999_us\n";
+    for (const BenchmarkResult& r : results) {
+        out << r.workload << "," << options.rows << "," << distributionName(options.distribution) << ","
+            << options.threads << "," << options.buffer_pool_pages << "," << durabilityName(options.durability) << ","
+            << r.operations << "," << r.rows << "," << r.seconds << "," << r.opsPerSecond() << ","
+            << r.rowsPerSecond() << "," << r.p50_us << "," << r.p99_us << "," << r.p999_us << "\n";
+    }
+}
+
+void printUsage() {
+    std::cerr <<
+        "Usage: DatabaseBenchmark [--name=value ...]\n"
+        "  --rows=N                 rows loaded before the read workloads (default 1000000)\n"
+        "  --distribution=uniform|zipf\n"
+        "  --zipf-theta=X           skew of the zipf distribution (default 0.99)\n"
+        "  --threads=N              client threads and query thread pool size (default 1)\n"
+        "  --buffer-pool=N          buffer pool size in 4KB frames (default " << BUFFER_POOL_SIZE << ")\n"
+        "  --operations=N           point_lookup and mixed operations (default 100000)\n"
+        "  --range-operations=N     range_scan operations (default 1000)\n"
+        "  --range-rows=N           rows per range scan (default 1000)\n"
+        "  --aggregate-runs=N       full-column aggregates (default 20)\n"
+        "  --batch-rows=N           rows per ingest batch (default 10000)\n"
+        "  --write-ratio=X          fraction of inserts in mixed (default 0.1)\n"
+        "  --durability=none|async|sync\n"
+        "  --workloads=a,b,...      ingest,point_lookup,range_scan,aggregate,mixed\n"
+        "  --seed=N\n"
+        "  --format=json|csv\n"
+        "  --output=PATH            write results to PATH instead of stdout\n"
+        "  --db-path=PATH           scratch database directory (default ./benchmark_db)\n";
+}
+
+size_t parseCount(const std::string& name, const std::string& value) {
+    size_t pos = 0;
+    unsigned long long parsed = std::stoull(value, &pos);
+    if (pos != value.size()) throw std::invalid_argument("Invalid value for --" + name + ": " + value);
+    return static_cast<size_t>(parsed);
+}
+
+BenchmarkOptions parseOptions(int argc, char** argv) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            throw std::invalid_argument("Expected --name=value, got: " + arg);
+        }
+        const std::string name = arg.substr(2, eq - 2);
+        const std::string value = arg.substr(eq + 1);
+
+        if (name == "rows") options.rows = parseCount(name, value);
+        else if (name == "zipf-theta") options.zipf_theta = std::stod(value);
+        else if (name == "threads") options.threads = std::max<size_t>(1, parseCount(name, value));
+        else if (name == "buffer-pool") options.buffer_pool_pages = parseCount(name, value);
+        else if (name == "operations") options.operations = parseCount(name, value);
+        else if (name == "range-operations") options.range_operations = parseCount(name, value);
+        else if (name == "range-rows") options.range_rows = std::max<size_t>(1, parseCount(name, value));
+        else if (name == "aggregate-runs") options.aggregate_runs = parseCount(name, value);
+        else if (name == "batch-rows") options.batch_rows = std::max<size_t>(1, parseCount(name, value));
+        else if (name == "write-ratio") options.write_ratio = std::stod(value);
+        else if (name == "seed") options.seed = parseCount(name, value);
+        else if (name == "output") options.output = value;
+        else if (name == "db-path") options.db_path = value;
+        else if (name == "distribution") {
+            if (value == "uniform") options.distribution = KeyDistribution::UNIFORM;
+            else if (value == "zipf") options.distribution = KeyDistribution::ZIPF;
+            else throw std::invalid_argument("Unknown distribution: " + value);
+        }
+        else if (name == "durability") {
+            if (value == "none") options.durability = DurabilityMode::NONE;
+            else if (value == "async") options.durability = DurabilityMode::ASYNC;
+            else if (value == "sync") options.durability = DurabilityMode::SYNC;
+            else throw std::invalid_argument("Unknown durability mode: " + value);
+        }
+        else if (name == "format") {
+            if (value != "json" && value != "csv") throw std::invalid_argument("Unknown format: " + value);
+            options.format = value;
+        }
+        else if (name == "workloads") {
+            options.workloads.clear();
+            std::stringstream list(value);
+            std::string workload;
+            while (std::getline(list, workload, ',')) {
+                static const std::set<std::string> known = { "ingest", "point_lookup", "range_scan", "aggregate", "mixed" };
+                if (!known.count(workload)) throw std::invalid_argument("Unknown workload: " + workload);
+                options.workloads.push_back(workload);
+            }
+        }
+        else {
+            throw std::invalid_argument("Unknown option: --" + name);
+        }
+    }
+    if (options.rows == 0) throw std::invalid_argument("--rows must be positive");
+    if (options.zipf_theta <= 0 || options.zipf_theta >= 1) throw std::invalid_argument("--zipf-theta must be in (0, 1)");
+    if (options.write_ratio < 0 || options.write_ratio > 1) throw std::invalid_argument("--write-ratio must be in [0, 1]");
+    return options;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc == 2 && std::string(argv[1]) == "--help") {
+        printUsage();
+        return 0;
+    }
+
+    BenchmarkOptions options;
+    try {
+        options = parseOptions(argc, argv);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        printUsage();
+        return 2;
+    }
+
+    std::vector<BenchmarkResult> results;
+    std::string engine_metrics;
+    try {
+        Benchmark benchmark(options);
+        results = benchmark.run();
+        engine_metrics = benchmark.engineMetrics();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::ofstream file;
+    if (!options.output.empty()) {
+        file.open(options.output);
+        if (!file) {
+            std::cerr << "Error: cannot write " << options.output << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = options.output.empty() ? std::cout : file;
+    if (options.format == "csv") writeCsv(out, options, results);
+    else writeJson(out, options, results, engine_metrics);
+    return 0;
+}